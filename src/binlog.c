@@ -0,0 +1,390 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./binlog.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "./destination.h"
+#include "./log.h"
+
+/* A mapped binary log file */
+struct binlog_file
+{
+	int fd;
+	uint8_t* map;
+};
+
+static struct
+{
+	char* path;
+	char* old_path;           /* Where the previous file is kept, path.1 */
+	char* next_path;          /* Where the next file is prepared, path.next */
+	size_t size;
+	struct binlog_file file;
+	struct binlog_header* header;
+	struct binlog_record* records;
+	uint64_t capacity;
+	uint64_t count;
+
+	/* The rotation thread prepares the next file while this one fills up,
+	 * and retires the full one, so logging never waits for the filesystem */
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int running;
+	int stop;
+	int prepare;              /* The next file is wanted */
+	int failed;               /* The next file could not be prepared */
+	struct binlog_file spare; /* The next file, map is NULL until it is ready */
+	struct binlog_file retired; /* The full file, map is NULL if there is none */
+} s_binlog = { NULL, NULL, NULL, 0, { -1, NULL } };
+
+static char* make_path(const char* suffix)
+{
+	size_t len = strlen(s_binlog.path);
+	char* path = malloc(len + strlen(suffix) + 1);
+	if (path)
+	{
+		memcpy(path,s_binlog.path,len);
+		strcpy(path + len,suffix);
+	}
+	return path;
+}
+
+static void close_file(struct binlog_file* f)
+{
+	if (f->map)
+	{
+		munmap(f->map,s_binlog.size);
+		f->map = NULL;
+	}
+
+	if (f->fd != -1)
+	{
+		close(f->fd);
+		f->fd = -1;
+	}
+}
+
+/* Create, allocate and map the file at path, with its header written */
+static int create_file(const char* path, struct binlog_file* f)
+{
+	struct binlog_header* header;
+	int err;
+
+	f->map = NULL;
+	f->fd = open(path,O_RDWR | O_CREAT | O_TRUNC,0644);
+	if (f->fd == -1)
+	{
+		LOG_ERROR(("Failed to create binary log %s: %s\n",path,strerror(errno)));
+		return 0;
+	}
+
+	/* Allocate all the blocks now, so writing never has to wait for the filesystem */
+	err = posix_fallocate(f->fd,0,s_binlog.size);
+	if (err)
+	{
+		LOG_ERROR(("Failed to allocate binary log %s: %s\n",path,strerror(err)));
+		close_file(f);
+		return 0;
+	}
+
+	f->map = mmap(NULL,s_binlog.size,PROT_READ | PROT_WRITE,MAP_SHARED,f->fd,0);
+	if (f->map == MAP_FAILED)
+	{
+		LOG_ERROR(("Failed to map binary log %s: %s\n",path,strerror(errno)));
+		f->map = NULL;
+		close_file(f);
+		return 0;
+	}
+
+	header = (struct binlog_header*)f->map;
+	memcpy(header->magic,BINLOG_MAGIC,sizeof(header->magic));
+	header->version = BINLOG_VERSION;
+	header->record_size = sizeof(struct binlog_record);
+	header->capacity = s_binlog.capacity;
+	header->count = 0;
+
+	return 1;
+}
+
+/* Log to f from now on */
+static void use_file(const struct binlog_file* f)
+{
+	s_binlog.file = *f;
+	s_binlog.header = (struct binlog_header*)f->map;
+	s_binlog.records = (struct binlog_record*)(f->map + sizeof(struct binlog_header));
+	s_binlog.count = 0;
+}
+
+/* Close the full file and keep it as path.1, the file now in use moves from path.next to path */
+static void retire_file(struct binlog_file* f)
+{
+	close_file(f);
+
+	if (rename(s_binlog.path,s_binlog.old_path) != 0 && errno != ENOENT)
+		LOG_WARN(("Failed to rotate binary log %s: %s\n",s_binlog.path,strerror(errno)));
+
+	if (rename(s_binlog.next_path,s_binlog.path) != 0)
+		LOG_WARN(("Failed to rename binary log %s: %s\n",s_binlog.next_path,strerror(errno)));
+}
+
+static void* rotation_thread(void* arg)
+{
+	pthread_mutex_lock(&s_binlog.lock);
+	for (;;)
+	{
+		if (s_binlog.retired.map)
+		{
+			struct binlog_file f = s_binlog.retired;
+			s_binlog.retired.map = NULL;
+			s_binlog.retired.fd = -1;
+
+			pthread_mutex_unlock(&s_binlog.lock);
+			retire_file(&f);
+			pthread_mutex_lock(&s_binlog.lock);
+		}
+		else if (s_binlog.stop)
+			break;
+		else if (s_binlog.prepare)
+		{
+			struct binlog_file f;
+			int created;
+
+			pthread_mutex_unlock(&s_binlog.lock);
+			created = create_file(s_binlog.next_path,&f);
+			pthread_mutex_lock(&s_binlog.lock);
+
+			s_binlog.prepare = 0;
+			if (created)
+				s_binlog.spare = f;
+			else
+				s_binlog.failed = 1;
+			pthread_cond_broadcast(&s_binlog.cond);
+		}
+		else
+			pthread_cond_wait(&s_binlog.cond,&s_binlog.lock);
+	}
+	pthread_mutex_unlock(&s_binlog.lock);
+	return NULL;
+}
+
+/* Ask the rotation thread for the next file */
+static void prepare_file(void)
+{
+	pthread_mutex_lock(&s_binlog.lock);
+	if (!s_binlog.spare.map && !s_binlog.failed)
+	{
+		s_binlog.prepare = 1;
+		pthread_cond_broadcast(&s_binlog.cond);
+	}
+	pthread_mutex_unlock(&s_binlog.lock);
+}
+
+/* Swap to the next file, and hand the full one to the rotation thread. Only
+ * waits if the file filled up before the next one was ready */
+static int next_file(void)
+{
+	int ready;
+
+	prepare_file();
+
+	pthread_mutex_lock(&s_binlog.lock);
+	while (!s_binlog.spare.map && !s_binlog.failed)
+		pthread_cond_wait(&s_binlog.cond,&s_binlog.lock);
+
+	ready = (s_binlog.spare.map != NULL);
+	if (ready)
+	{
+		s_binlog.retired = s_binlog.file;
+		use_file(&s_binlog.spare);
+		s_binlog.spare.map = NULL;
+		s_binlog.spare.fd = -1;
+		pthread_cond_broadcast(&s_binlog.cond);
+	}
+	pthread_mutex_unlock(&s_binlog.lock);
+
+	return ready;
+}
+
+int binlog_open(const char* path, size_t size)
+{
+	static int registered = 0;
+	struct binlog_file f;
+	int err;
+
+	if (size < sizeof(struct binlog_header) + sizeof(struct binlog_record))
+	{
+		LOG_ERROR(("Binary log size %lu is too small\n",(unsigned long)size));
+		return -1;
+	}
+
+	binlog_close();
+
+	s_binlog.path = malloc(strlen(path) + 1);
+	if (!s_binlog.path)
+	{
+		LOG_ERROR(("Failed to allocate binary log path\n"));
+		return -1;
+	}
+	strcpy(s_binlog.path,path);
+	s_binlog.old_path = make_path(".1");
+	s_binlog.next_path = make_path(".next");
+	if (!s_binlog.old_path || !s_binlog.next_path)
+	{
+		LOG_ERROR(("Failed to allocate binary log path\n"));
+		binlog_close();
+		return -1;
+	}
+	s_binlog.size = size;
+	s_binlog.capacity = (size - sizeof(struct binlog_header)) / sizeof(struct binlog_record);
+
+	/* Keep the previous file */
+	if (rename(s_binlog.path,s_binlog.old_path) != 0 && errno != ENOENT)
+		LOG_WARN(("Failed to rotate binary log %s: %s\n",s_binlog.path,strerror(errno)));
+
+	if (!create_file(s_binlog.path,&f))
+	{
+		binlog_close();
+		return -1;
+	}
+	use_file(&f);
+
+	s_binlog.stop = 0;
+	s_binlog.prepare = 0;
+	s_binlog.failed = 0;
+	s_binlog.spare.fd = -1;
+	s_binlog.spare.map = NULL;
+	s_binlog.retired.fd = -1;
+	s_binlog.retired.map = NULL;
+	pthread_mutex_init(&s_binlog.lock,NULL);
+	pthread_cond_init(&s_binlog.cond,NULL);
+
+	err = pthread_create(&s_binlog.thread,NULL,&rotation_thread,NULL);
+	if (err)
+	{
+		LOG_ERROR(("Failed to start binary log rotation thread: %s\n",strerror(err)));
+		pthread_mutex_destroy(&s_binlog.lock);
+		pthread_cond_destroy(&s_binlog.cond);
+		binlog_close();
+		return -1;
+	}
+	s_binlog.running = 1;
+
+	if (!registered)
+	{
+		atexit(&binlog_close);
+		registered = 1;
+	}
+
+	return 0;
+}
+
+void binlog_close(void)
+{
+	if (s_binlog.running)
+	{
+		/* The rotation thread finishes retiring the full file first */
+		pthread_mutex_lock(&s_binlog.lock);
+		s_binlog.stop = 1;
+		pthread_cond_broadcast(&s_binlog.cond);
+		pthread_mutex_unlock(&s_binlog.lock);
+		pthread_join(s_binlog.thread,NULL);
+		s_binlog.running = 0;
+
+		pthread_mutex_destroy(&s_binlog.lock);
+		pthread_cond_destroy(&s_binlog.cond);
+
+		/* A next file that was never used */
+		if (s_binlog.spare.map)
+		{
+			close_file(&s_binlog.spare);
+			unlink(s_binlog.next_path);
+		}
+	}
+
+	/* The header always has the count of records written */
+	close_file(&s_binlog.file);
+	s_binlog.header = NULL;
+	s_binlog.records = NULL;
+
+	free(s_binlog.path);
+	s_binlog.path = NULL;
+	free(s_binlog.old_path);
+	s_binlog.old_path = NULL;
+	free(s_binlog.next_path);
+	s_binlog.next_path = NULL;
+}
+
+int binlog_enabled(void)
+{
+	return s_binlog.file.map != NULL;
+}
+
+void binlog_event(enum binlog_event event, unsigned int message, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* metrics, unsigned int fields, uint32_t cost)
+{
+	struct binlog_record* r;
+	struct timespec now;
+
+	if (!s_binlog.file.map)
+		return;
+
+	if (s_binlog.count == s_binlog.capacity && !next_file())
+	{
+		LOG_ERROR(("Binary logging stopped\n"));
+		binlog_close();
+		return;
+	}
+
+	/* The file was zeroed when it was allocated, so only set what is needed */
+	r = &s_binlog.records[s_binlog.count];
+	r->event = event;
+	r->message = message;
+	r->cost = cost;
+
+	if (mac)
+		memcpy(r->mac,mac,sizeof(r->mac));
+
+	if (link && link->len <= sizeof(r->link_id))
+	{
+		r->link_id_len = link->len;
+		memcpy(r->link_id,link->id,link->len);
+	}
+
+	if (metrics)
+	{
+		r->present = metrics->present & fields;
+		r->mdrr = metrics->mdrr;
+		r->mdrt = metrics->mdrt;
+		r->cdrr = metrics->cdrr;
+		r->cdrt = metrics->cdrt;
+		r->latency = metrics->latency;
+		r->latency_min = metrics->latency_min;
+		r->latency_max = metrics->latency_max;
+		r->resources = metrics->resources;
+		r->rlqr = metrics->rlqr;
+		r->rlqt = metrics->rlqt;
+		r->mtu = metrics->mtu;
+	}
+
+	/* The timestamp goes last, it marks the record as written */
+	clock_gettime(CLOCK_REALTIME,&now);
+	r->timestamp = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+
+	s_binlog.header->count = ++s_binlog.count;
+
+	/* Have the next file ready long before this one is full */
+	if (s_binlog.count == s_binlog.capacity / 2)
+		prepare_file();
+}
@@ -0,0 +1,81 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Binary event log: fixed-size records written straight into a memory-mapped,
+ * preallocated file, which is rotated when full. The next file is prepared by
+ * a background thread while the current one fills up. Decode with dlep_logdump
+ */
+
+#ifndef DLEP_BINLOG_H_
+#define DLEP_BINLOG_H_
+
+#include "./util.h"
+
+#define BINLOG_MAGIC   "DLEPBLOG"
+#define BINLOG_VERSION 3
+
+enum binlog_event {
+	BINLOG_RX = 1,            /* Message received, with its MAC Address and metrics if any */
+	BINLOG_TX,                /* Message sent */
+	BINLOG_PUBLISH_UP,        /* Destination published up, with all its metrics */
+	BINLOG_PUBLISH_DOWN,      /* Destination published down */
+	BINLOG_PUBLISH_FIELDS,    /* Changed metrics of a destination published */
+	BINLOG_PUBLISH_COST       /* Link cost of a destination published */
+};
+
+/* The file starts with this header, records are in host byte order */
+struct binlog_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t capacity;        /* Number of records the file can hold */
+	uint64_t count;           /* Number of records written */
+	uint8_t reserved[32];
+};
+
+struct binlog_record
+{
+	uint64_t timestamp;       /* Nanoseconds since the epoch, 0 marks an unused record */
+	uint16_t event;           /* enum binlog_event */
+	uint16_t message;         /* enum dlep_message, if relevant */
+	uint16_t present;         /* Which metrics are valid, bitmask of enum destination_field */
+	uint8_t mac[6];
+	uint8_t resources;
+	uint8_t rlqr;
+	uint8_t rlqt;
+	uint8_t link_id_len;      /* Since version 3, 0 if the destination has no Link Identifier */
+	uint16_t mtu;
+	uint16_t reserved2;
+	uint32_t cost;
+	uint64_t mdrr;
+	uint64_t mdrt;
+	uint64_t cdrr;
+	uint64_t cdrt;
+	uint64_t latency;
+	uint64_t latency_min;     /* Since version 2 */
+	uint64_t latency_max;
+	uint8_t link_id[16];      /* Since version 3 */
+};
+
+struct destination_metrics;
+struct link_id;
+
+/* Start logging to path, a file of size bytes. The previous file is kept as
+ * path.1, and the next one is prepared as path.next */
+int binlog_open(const char* path, size_t size);
+
+/* Stop logging, registered with atexit() */
+void binlog_close(void);
+
+/* Non-zero if a binary log is open */
+int binlog_enabled(void);
+
+/* Record an event, mac, link and metrics may be NULL, and only the metrics in fields are recorded */
+void binlog_event(enum binlog_event event, unsigned int message, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* metrics, unsigned int fields, uint32_t cost);
+
+#endif /* DLEP_BINLOG_H_ */
@@ -0,0 +1,375 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./capture.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "./log.h"
+
+/* pcapng block types */
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+/* pcapng option codes */
+#define PCAPNG_OPT_ENDOFOPT     0
+#define PCAPNG_OPT_COMMENT      1
+#define PCAPNG_OPT_SHB_USERAPPL 4
+#define PCAPNG_OPT_IF_NAME      2
+#define PCAPNG_OPT_IF_DESCR     3
+#define PCAPNG_OPT_IF_TSRESOL   9
+#define PCAPNG_OPT_EPB_FLAGS    2
+
+/* There is no link type for bare DLEP, so use the first user link type */
+#define LINKTYPE_USER0 147
+
+#define USER_APPLICATION "dlep_router 0.1.2"
+
+#define PAD4(n) (((n) + 3) & ~(size_t)3)
+#define OPTION_LEN(n) (4 + PAD4(n))
+
+struct capture_interface
+{
+	char* name;
+	char* description;
+	long idb;                 /* Interface id in the current file, -1 if not written yet */
+};
+
+static struct
+{
+	char* path;
+	size_t size;
+	int fd;
+	uint8_t* map;
+	size_t used;
+
+	struct capture_interface* interfaces;
+	size_t interface_count;
+	long idb_count;           /* Interfaces written to the current file */
+} s_capture = { NULL, 0, -1, NULL, 0, NULL, 0, 0 };
+
+static uint8_t* put_uint16(uint8_t* p, uint16_t v)
+{
+	memcpy(p,&v,sizeof(v));
+	return p + sizeof(v);
+}
+
+static uint8_t* put_uint32(uint8_t* p, uint32_t v)
+{
+	memcpy(p,&v,sizeof(v));
+	return p + sizeof(v);
+}
+
+static uint8_t* put_option(uint8_t* p, uint16_t code, const void* value, size_t len)
+{
+	p = put_uint16(p,code);
+	p = put_uint16(p,len);
+	memcpy(p,value,len);
+	memset(p + len,0,PAD4(len) - len);
+	return p + PAD4(len);
+}
+
+static uint8_t* reserve(size_t len)
+{
+	uint8_t* p = s_capture.map + s_capture.used;
+	s_capture.used += len;
+	return p;
+}
+
+static void write_shb(void)
+{
+	size_t len = 24 + OPTION_LEN(sizeof(USER_APPLICATION) - 1) + 4 + 4;
+	uint8_t* p = reserve(len);
+
+	p = put_uint32(p,PCAPNG_SHB);
+	p = put_uint32(p,len);
+	p = put_uint32(p,PCAPNG_BYTE_ORDER_MAGIC);
+	p = put_uint16(p,1);
+	p = put_uint16(p,0);
+
+	/* Section length not known */
+	p = put_uint32(p,0xFFFFFFFF);
+	p = put_uint32(p,0xFFFFFFFF);
+
+	p = put_option(p,PCAPNG_OPT_SHB_USERAPPL,USER_APPLICATION,sizeof(USER_APPLICATION) - 1);
+	p = put_option(p,PCAPNG_OPT_ENDOFOPT,NULL,0);
+	put_uint32(p,len);
+}
+
+static size_t idb_len(const struct capture_interface* i)
+{
+	return 16 + OPTION_LEN(strlen(i->name)) + OPTION_LEN(strlen(i->description)) + OPTION_LEN(1) + 4 + 4;
+}
+
+static void write_idb(struct capture_interface* i)
+{
+	size_t len = idb_len(i);
+	uint8_t* p = reserve(len);
+	uint8_t tsresol = 9;
+
+	p = put_uint32(p,PCAPNG_IDB);
+	p = put_uint32(p,len);
+	p = put_uint16(p,LINKTYPE_USER0);
+	p = put_uint16(p,0);
+	p = put_uint32(p,0);
+
+	p = put_option(p,PCAPNG_OPT_IF_NAME,i->name,strlen(i->name));
+	p = put_option(p,PCAPNG_OPT_IF_DESCR,i->description,strlen(i->description));
+
+	/* Nanosecond timestamps */
+	p = put_option(p,PCAPNG_OPT_IF_TSRESOL,&tsresol,1);
+	p = put_option(p,PCAPNG_OPT_ENDOFOPT,NULL,0);
+	put_uint32(p,len);
+
+	i->idb = s_capture.idb_count++;
+}
+
+static void close_file(void)
+{
+	if (s_capture.map)
+	{
+		munmap(s_capture.map,s_capture.size);
+		s_capture.map = NULL;
+	}
+
+	if (s_capture.fd != -1)
+	{
+		/* Drop the unused preallocated space, readers would choke on it */
+		if (ftruncate(s_capture.fd,s_capture.used) != 0)
+			LOG_WARN(("Failed to truncate capture file %s: %s\n",s_capture.path,strerror(errno)));
+
+		close(s_capture.fd);
+		s_capture.fd = -1;
+	}
+}
+
+static int create_file(void)
+{
+	size_t len = strlen(s_capture.path);
+	char* old_path;
+	size_t i;
+	int err;
+
+	/* Keep the previous file */
+	old_path = malloc(len + 3);
+	if (!old_path)
+	{
+		LOG_ERROR(("Failed to allocate capture file path\n"));
+		return 0;
+	}
+	memcpy(old_path,s_capture.path,len);
+	strcpy(old_path + len,".1");
+
+	if (rename(s_capture.path,old_path) != 0 && errno != ENOENT)
+		LOG_WARN(("Failed to rotate capture file %s: %s\n",s_capture.path,strerror(errno)));
+	free(old_path);
+
+	s_capture.fd = open(s_capture.path,O_RDWR | O_CREAT | O_TRUNC,0644);
+	if (s_capture.fd == -1)
+	{
+		LOG_ERROR(("Failed to create capture file %s: %s\n",s_capture.path,strerror(errno)));
+		return 0;
+	}
+
+	/* Allocate all the blocks now, so writing never has to wait for the filesystem */
+	err = posix_fallocate(s_capture.fd,0,s_capture.size);
+	if (err)
+	{
+		LOG_ERROR(("Failed to allocate capture file %s: %s\n",s_capture.path,strerror(err)));
+		close_file();
+		return 0;
+	}
+
+	s_capture.map = mmap(NULL,s_capture.size,PROT_READ | PROT_WRITE,MAP_SHARED,s_capture.fd,0);
+	if (s_capture.map == MAP_FAILED)
+	{
+		LOG_ERROR(("Failed to map capture file %s: %s\n",s_capture.path,strerror(errno)));
+		s_capture.map = NULL;
+		close_file();
+		return 0;
+	}
+
+	s_capture.used = 0;
+	write_shb();
+
+	/* Interface ids are per file, so interfaces are written again as they are used */
+	s_capture.idb_count = 0;
+	for (i = 0; i < s_capture.interface_count; ++i)
+		s_capture.interfaces[i].idb = -1;
+
+	return 1;
+}
+
+int capture_open(const char* path, size_t size)
+{
+	static int registered = 0;
+
+	/* Leave room for at least a full sized message */
+	if (size < 2 * 65536)
+	{
+		LOG_ERROR(("Capture file size %lu is too small\n",(unsigned long)size));
+		return -1;
+	}
+
+	capture_close();
+
+	s_capture.path = malloc(strlen(path) + 1);
+	if (!s_capture.path)
+	{
+		LOG_ERROR(("Failed to allocate capture file path\n"));
+		return -1;
+	}
+	strcpy(s_capture.path,path);
+	s_capture.size = size;
+
+	if (!create_file())
+	{
+		capture_close();
+		return -1;
+	}
+
+	if (!registered)
+	{
+		atexit(&capture_close);
+		registered = 1;
+	}
+
+	return 0;
+}
+
+void capture_close(void)
+{
+	size_t i;
+
+	close_file();
+
+	free(s_capture.path);
+	s_capture.path = NULL;
+
+	for (i = 0; i < s_capture.interface_count; ++i)
+	{
+		free(s_capture.interfaces[i].name);
+		free(s_capture.interfaces[i].description);
+	}
+	free(s_capture.interfaces);
+	s_capture.interfaces = NULL;
+	s_capture.interface_count = 0;
+}
+
+int capture_interface(const char* name, const char* description)
+{
+	struct capture_interface* interfaces;
+	struct capture_interface* i;
+	size_t n;
+
+	if (!s_capture.map)
+		return -1;
+
+	/* Only one of each, or reconnecting would add interfaces for ever */
+	for (n = 0; n < s_capture.interface_count; ++n)
+	{
+		if (!strcmp(s_capture.interfaces[n].name,name))
+			return (int)n;
+	}
+
+	interfaces = realloc(s_capture.interfaces,(s_capture.interface_count + 1) * sizeof(struct capture_interface));
+	if (!interfaces)
+	{
+		LOG_ERROR(("Failed to allocate capture interface\n"));
+		return -1;
+	}
+	s_capture.interfaces = interfaces;
+
+	i = &s_capture.interfaces[s_capture.interface_count];
+	i->name = malloc(strlen(name) + 1);
+	i->description = malloc(strlen(description) + 1);
+	if (!i->name || !i->description)
+	{
+		LOG_ERROR(("Failed to allocate capture interface\n"));
+		free(i->name);
+		free(i->description);
+		return -1;
+	}
+	strcpy(i->name,name);
+	strcpy(i->description,description);
+
+	/* The Interface Description Block is written with the first packet */
+	i->idb = -1;
+
+	return s_capture.interface_count++;
+}
+
+void capture_packet(int interface, const char* comment, enum capture_direction direction, const uint8_t* data, size_t len)
+{
+	struct capture_interface* i;
+	struct timespec now;
+	uint64_t ts;
+	uint32_t flags = direction;
+	size_t comment_len;
+	size_t block_len;
+	uint8_t* p;
+
+	if (interface < 0 || !s_capture.map)
+		return;
+
+	comment_len = (comment ? strlen(comment) : 0);
+	block_len = 28 + PAD4(len) + OPTION_LEN(sizeof(flags)) + (comment_len ? OPTION_LEN(comment_len) : 0) + 4 + 4;
+
+	i = &s_capture.interfaces[interface];
+
+	if (s_capture.used + block_len + (i->idb == -1 ? idb_len(i) : 0) > s_capture.size)
+	{
+		/* Start a new file */
+		close_file();
+		if (!create_file())
+		{
+			LOG_ERROR(("Capture stopped\n"));
+			capture_close();
+			return;
+		}
+
+		if (s_capture.used + block_len + idb_len(i) > s_capture.size)
+			return;
+	}
+
+	if (i->idb == -1)
+		write_idb(i);
+
+	clock_gettime(CLOCK_REALTIME,&now);
+	ts = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+
+	/* Enhanced Packet Block */
+	p = reserve(block_len);
+	p = put_uint32(p,PCAPNG_EPB);
+	p = put_uint32(p,block_len);
+	p = put_uint32(p,i->idb);
+	p = put_uint32(p,ts >> 32);
+	p = put_uint32(p,ts & 0xFFFFFFFF);
+	p = put_uint32(p,len);
+	p = put_uint32(p,len);
+
+	memcpy(p,data,len);
+	memset(p + len,0,PAD4(len) - len);
+	p += PAD4(len);
+
+	/* Inbound or outbound */
+	p = put_option(p,PCAPNG_OPT_EPB_FLAGS,&flags,sizeof(flags));
+
+	/* Every session shares an interface, so say which one this is */
+	if (comment_len)
+		p = put_option(p,PCAPNG_OPT_COMMENT,comment,comment_len);
+	p = put_option(p,PCAPNG_OPT_ENDOFOPT,NULL,0);
+	put_uint32(p,block_len);
+}
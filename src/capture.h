@@ -0,0 +1,36 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Capture of every DLEP message and signal to a pcapng file, appended
+ * directly into a memory-mapped, preallocated file
+ */
+
+#ifndef DLEP_CAPTURE_H_
+#define DLEP_CAPTURE_H_
+
+#include "./util.h"
+
+enum capture_direction {
+	CAPTURE_INBOUND = 1,
+	CAPTURE_OUTBOUND = 2
+};
+
+/* Start capturing to path, a file of size bytes. When it fills up it is kept as path.1 */
+int capture_open(const char* path, size_t size);
+
+/* Stop capturing, registered with atexit() */
+void capture_close(void);
+
+/* Add a capture interface, or find the one already added with the same name,
+ * returns -1 if capture is disabled */
+int capture_interface(const char* name, const char* description);
+
+/* Capture a message or signal on interface, with an optional comment naming
+ * the session it belongs to, does nothing if interface is -1 */
+void capture_packet(int interface, const char* comment, enum capture_direction direction, const uint8_t* data, size_t len);
+
+#endif /* DLEP_CAPTURE_H_ */
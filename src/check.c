@@ -9,14 +9,19 @@ Copyright (c) 2017 Airbus DS Limited
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <inttypes.h>
 
 #include "./dlep_iana.h"
+#include "./check.h"
+#include "./extension.h"
+#include "./log.h"
+#include "./stats.h"
 
 static enum dlep_status_code check_length(uint16_t item_len, unsigned int expected_len, const char* name)
 {
 	if (item_len != expected_len)
 	{
-		printf("Incorrect length in %s data item: %u, expected %u\n",name,item_len,expected_len);
+		LOG_WARN(("Incorrect length in %s data item: %u, expected %u\n",name,item_len,expected_len));
 		return DLEP_SC_INVALID_DATA;
 	}
 	return DLEP_SC_SUCCESS;
@@ -29,13 +34,13 @@ static enum dlep_status_code check_peer_type(const uint8_t* data_item, uint16_t
 	/* First field is flags */
 	if (item_len < 1)
 	{
-		printf("Incorrect length in Peer Type data item: %u, expected > 1\n",item_len);
+		LOG_WARN(("Incorrect length in Peer Type data item: %u, expected > 1\n",item_len));
 		return DLEP_SC_INVALID_DATA;
 	}
 
 	if (data_item[0] & 0xFE)
 	{
-		printf("Reserved flag bits in use in Peer Type data item: %#x\n",(unsigned int)data_item[0]);
+		LOG_WARN(("Reserved flag bits in use in Peer Type data item: %#x\n",(unsigned int)data_item[0]));
 		return DLEP_SC_INVALID_DATA;
 	}
 
@@ -44,7 +49,7 @@ static enum dlep_status_code check_peer_type(const uint8_t* data_item, uint16_t
 		/* Check for NUL (We allow a trailing NUL) */
 		if (data_item[i] == 0)
 		{
-			printf("Warning: Suspicious NUL character in peer type string\n");
+			LOG_WARN(("Warning: Suspicious NUL character in peer type string\n"));
 		}
 
 		/* TODO: One should check for valid UTF8 characters here */
@@ -62,7 +67,7 @@ static enum dlep_status_code check_heartbeat_interval(const uint8_t* data_item,
 		uint32_t hb = read_uint32(data_item);
 		if (hb == 0)
 		{
-			printf("0 heartbeat interval in Heartbeat Interval data item\n");
+			LOG_WARN(("0 heartbeat interval in Heartbeat Interval data item\n"));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 	}
@@ -74,12 +79,12 @@ static enum dlep_status_code check_ipv4_connection_point(const uint8_t* data_ite
 {
 	if (item_len != 5 && item_len != 7)
 	{
-		printf("Incorrect length in IPv4 Connection Point data item: %u, expected 5 or 7\n",item_len);
+		LOG_WARN(("Incorrect length in IPv4 Connection Point data item: %u, expected 5 or 7\n",item_len));
 		return DLEP_SC_INVALID_DATA;
 	}
 	else if (data_item[0] & 0xFE)
 	{
-		printf("Reserved flag bits in use in IPv4 Connection Point data item: %#x\n",(unsigned int)data_item[0]);
+		LOG_WARN(("Reserved flag bits in use in IPv4 Connection Point data item: %#x\n",(unsigned int)data_item[0]));
 		return DLEP_SC_INVALID_DATA;
 	}
 	return DLEP_SC_SUCCESS;
@@ -89,12 +94,12 @@ static enum dlep_status_code check_ipv6_connection_point(const uint8_t* data_ite
 {
 	if (item_len != 17 && item_len != 19)
 	{
-		printf("Incorrect length in IPv6 Connection Point data item: %u, expected 17 or 19\n",item_len);
+		LOG_WARN(("Incorrect length in IPv6 Connection Point data item: %u, expected 17 or 19\n",item_len));
 		return DLEP_SC_INVALID_DATA;
 	}
 	else if (data_item[0] & 0xFE)
 	{
-		printf("Reserved flag bits in use in IPv6 Connection Point data item: %#x\n",(unsigned int)data_item[0]);
+		LOG_WARN(("Reserved flag bits in use in IPv6 Connection Point data item: %#x\n",(unsigned int)data_item[0]));
 		return DLEP_SC_INVALID_DATA;
 	}
 	return DLEP_SC_SUCCESS;
@@ -107,12 +112,12 @@ static enum dlep_status_code check_ipv4_address(const uint8_t* data_item, uint16
 	{
 		if (data_item[0] & 0xFE)
 		{
-			printf("Reserved flag bits in use in IPv4 Address Point data item: %#x\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Reserved flag bits in use in IPv4 Address Point data item: %#x\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 		else if (add_only && data_item[0] == 0)
 		{
-			printf("Add flag incorrectly clear (i.e. Remove) in use in IPv4 Address Point data item: %#x\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Add flag incorrectly clear (i.e. Remove) in use in IPv4 Address Point data item: %#x\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 	}
@@ -126,12 +131,12 @@ static enum dlep_status_code check_ipv6_address(const uint8_t* data_item, uint16
 	{
 		if (data_item[0] & 0xFE)
 		{
-			printf("Reserved flag bits in use in IPv6 Address Point data item: %#x\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Reserved flag bits in use in IPv6 Address Point data item: %#x\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 		else if (add_only && data_item[0] == 0)
 		{
-			printf("Add flag incorrectly clear (i.e. Remove) in use in IPv6 Address Point data item: %#x\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Add flag incorrectly clear (i.e. Remove) in use in IPv6 Address Point data item: %#x\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 	}
@@ -145,17 +150,17 @@ static enum dlep_status_code check_ipv4_attached_subnet(const uint8_t* data_item
 	{
 		if (data_item[0] & 0xFE)
 		{
-			printf("Reserved flag bits in use in IPv4 Attached Subnet data item: %#x\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Reserved flag bits in use in IPv4 Attached Subnet data item: %#x\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 		else if (add_only && data_item[0] == 0)
 		{
-			printf("Add flag incorrectly clear (i.e. Remove) in use in IPv4 Attached Subnet data item: %#x\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Add flag incorrectly clear (i.e. Remove) in use in IPv4 Attached Subnet data item: %#x\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 		else if (data_item[5] > 32)
 		{
-			printf("Incorrect prefix in IPv4 Address data item: %u, expected 0-32\n",(unsigned int)data_item[5]);
+			LOG_WARN(("Incorrect prefix in IPv4 Address data item: %u, expected 0-32\n",(unsigned int)data_item[5]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 	}
@@ -169,17 +174,17 @@ static enum dlep_status_code check_ipv6_attached_subnet(const uint8_t* data_item
 	{
 		if (data_item[0] & 0xFE)
 		{
-			printf("Reserved flag bits in use in IPv6 Attached Subnet data item: %#x\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Reserved flag bits in use in IPv6 Attached Subnet data item: %#x\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 		else if (add_only && data_item[0] == 0)
 		{
-			printf("Add flag incorrectly clear (i.e. Remove) in use in IPv6 Attached Subnet data item: %#x\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Add flag incorrectly clear (i.e. Remove) in use in IPv6 Attached Subnet data item: %#x\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 		else if (data_item[17] > 128)
 		{
-			printf("Incorrect prefix in IPv4 Address data item: %u, expected 0-128\n",(unsigned int)data_item[17]);
+			LOG_WARN(("Incorrect prefix in IPv4 Address data item: %u, expected 0-128\n",(unsigned int)data_item[17]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 	}
@@ -213,7 +218,7 @@ static enum dlep_status_code check_latency(const uint8_t* data_item, uint16_t it
 	{
 		if (read_uint64(data_item) == 0)
 		{
-			printf("Wow! Zero latency device detected!\n");
+			LOG_INFO(("Wow! Zero latency device detected!\n"));
 		}
 	}
 	return sc;
@@ -226,7 +231,7 @@ static enum dlep_status_code check_resources(const uint8_t* data_item, uint16_t
 	{
 		if (data_item[0] > 100)
 		{
-			printf("Incorrect value in Resources data item: %u, expected 0 to 100%%\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Incorrect value in Resources data item: %u, expected 0 to 100%%\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 	}
@@ -240,7 +245,7 @@ static enum dlep_status_code check_rlqr(const uint8_t* data_item, uint16_t item_
 	{
 		if (data_item[0] > 100)
 		{
-			printf("Incorrect value in Relative Link Quality (Receive) data item: %u, expected 1 to 100\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Incorrect value in Relative Link Quality (Receive) data item: %u, expected 1 to 100\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 	}
@@ -254,7 +259,7 @@ static enum dlep_status_code check_rlqt(const uint8_t* data_item, uint16_t item_
 	{
 		if (data_item[0] > 100)
 		{
-			printf("Incorrect value in Relative Link Quality (Transmit) data item: %u, expected 1 to 100\n",(unsigned int)data_item[0]);
+			LOG_WARN(("Incorrect value in Relative Link Quality (Transmit) data item: %u, expected 1 to 100\n",(unsigned int)data_item[0]));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 	}
@@ -266,16 +271,67 @@ static enum dlep_status_code check_mtu(const uint8_t* data_item, uint16_t item_l
 	return check_length(item_len,2,"Maximum Transmission Unit (MTU)");
 }
 
+enum dlep_status_code check_latency_range(const uint8_t* data_item, uint16_t item_len)
+{
+	enum dlep_status_code sc = check_length(item_len,16,"Latency Range");
+	if (sc == DLEP_SC_SUCCESS)
+	{
+		/* Maximum Latency, then Minimum Latency */
+		uint64_t max = read_uint64(data_item);
+		uint64_t min = read_uint64(data_item + 8);
+		if (min > max)
+		{
+			LOG_WARN(("Minimum Latency %"PRIu64" above Maximum Latency %"PRIu64" in Latency Range data item\n",min,max));
+			sc = DLEP_SC_INVALID_DATA;
+		}
+	}
+	return sc;
+}
+
+enum dlep_status_code check_link_id_length(const uint8_t* data_item, uint16_t item_len)
+{
+	enum dlep_status_code sc = check_length(item_len,2,"Link Identifier Length");
+	if (sc == DLEP_SC_SUCCESS && read_uint16(data_item) == 0)
+	{
+		LOG_WARN(("Zero Link Identifier Length data item\n"));
+		sc = DLEP_SC_INVALID_DATA;
+	}
+	return sc;
+}
+
+enum dlep_status_code check_link_id(const uint8_t* data_item, uint16_t item_len)
+{
+	/* The negotiated length is checked by the session */
+	if (item_len == 0 || item_len > MAX_LINK_ID_LENGTH)
+	{
+		LOG_WARN(("Incorrect length in Link Identifier data item: %u, expected 1 to %u\n",item_len,MAX_LINK_ID_LENGTH));
+		return DLEP_SC_INVALID_DATA;
+	}
+	return DLEP_SC_SUCCESS;
+}
+
+enum dlep_status_code check_credit_window_init(const uint8_t* data_item, uint16_t item_len)
+{
+	/* Traffic class, then the window in octets */
+	return check_length(item_len,9,"Credit Window Initialization");
+}
+
+enum dlep_status_code check_credit_grant(const uint8_t* data_item, uint16_t item_len)
+{
+	/* Traffic class, then the credit in octets */
+	return check_length(item_len,9,"Credit Grant");
+}
+
 static enum dlep_status_code check_extensions_supported(const uint8_t* data_item, uint16_t item_len)
 {
 	enum dlep_status_code sc = DLEP_SC_SUCCESS;
 	if (item_len == 0)
 	{
-		printf("Warning: Empty DLEP Extensions Supported data item.\n");
+		LOG_WARN(("Warning: Empty DLEP Extensions Supported data item.\n"));
 	}
 	else if (item_len % 2 == 1)
 	{
-		printf("Odd (not even) length field in Extensions Supported data item: %u\n",item_len);
+		LOG_WARN(("Odd (not even) length field in Extensions Supported data item: %u\n",item_len));
 		sc = DLEP_SC_INVALID_DATA;
 	}
 	else
@@ -286,7 +342,7 @@ static enum dlep_status_code check_extensions_supported(const uint8_t* data_item
 			uint16_t ext_id = read_uint16(data_item + i);
 			if (ext_id == 0 || ext_id == 65535)
 			{
-				printf("Modem reports DLEP extension %u which is reserved\n",ext_id);
+				LOG_WARN(("Modem reports DLEP extension %u which is reserved\n",ext_id));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 		}
@@ -294,23 +350,98 @@ static enum dlep_status_code check_extensions_supported(const uint8_t* data_item
 	return sc;
 }
 
+enum dlep_status_code check_queue_parameters(const uint8_t* data_item, uint16_t item_len)
+{
+	const uint8_t* p = data_item + 4;
+	const uint8_t* end = data_item + item_len;
+	unsigned int queues = 0;
+
+	/* Octet 0 is the number of queues, the scale and reserved bits follow */
+	if (item_len < 4)
+	{
+		LOG_WARN(("Incorrect length in Queue Parameters data item: %u, expected at least 4\n",item_len));
+		return DLEP_SC_INVALID_DATA;
+	}
+
+	/* Then a Queue Parameter sub-data item per queue */
+	while (p < end)
+	{
+		uint16_t sub_len = (end - p >= 4 ? read_uint16(p + 2) : 0);
+		if (end - p < 4 || sub_len > end - p - 4)
+		{
+			LOG_WARN(("Truncated sub-data item in Queue Parameters data item\n"));
+			return DLEP_SC_INVALID_DATA;
+		}
+
+		if (read_uint16(p) != DLEP_QUEUE_PARAM_SUB_ITEM)
+		{
+			LOG_WARN(("Unexpected sub-data item %u in Queue Parameters data item\n",read_uint16(p)));
+			return DLEP_SC_INVALID_DATA;
+		}
+
+		/* Queue Index, 24 bit Queue Size, Num DSCPs then the DS Fields */
+		if (sub_len < 5 || sub_len != 5 + p[8])
+		{
+			LOG_WARN(("Incorrect length in Queue Parameter sub-data item: %u\n",sub_len));
+			return DLEP_SC_INVALID_DATA;
+		}
+
+		if (p[4] >= data_item[0])
+		{
+			LOG_WARN(("Queue Parameter sub-data item for queue %u of %u\n",p[4],data_item[0]));
+			return DLEP_SC_INVALID_DATA;
+		}
+
+		++queues;
+		p += 4 + sub_len;
+	}
+
+	if (queues != data_item[0])
+	{
+		LOG_WARN(("Queue Parameters data item has %u Queue Parameter sub-data items for %u queues\n",queues,data_item[0]));
+		return DLEP_SC_INVALID_DATA;
+	}
+	return DLEP_SC_SUCCESS;
+}
+
+static enum dlep_status_code check_queue_indexes(uint16_t item_len, const char* name)
+{
+	/* A list of Queue Indexes */
+	if (item_len == 0)
+	{
+		LOG_WARN(("Empty %s data item\n",name));
+		return DLEP_SC_INVALID_DATA;
+	}
+	return DLEP_SC_SUCCESS;
+}
+
+enum dlep_status_code check_pause(const uint8_t* data_item, uint16_t item_len)
+{
+	return check_queue_indexes(item_len,"Pause");
+}
+
+enum dlep_status_code check_restart(const uint8_t* data_item, uint16_t item_len)
+{
+	return check_queue_indexes(item_len,"Restart");
+}
+
 static enum dlep_status_code check_status(const uint8_t* data_item, uint16_t item_len)
 {
 	size_t i;
 
 	if (item_len < 1)
 	{
-		printf("Incorrect length in Status data item: %u, expected > 1\n",item_len);
+		LOG_WARN(("Incorrect length in Status data item: %u, expected > 1\n",item_len));
 		return DLEP_SC_INVALID_DATA;
 	}
 
 	if (data_item[0] > DLEP_SC_INCONSISTENT && data_item[0] <= 111)
 	{
-		printf("Warning: Unassigned Continue Status Code %u in Status data item.\n",(unsigned int)data_item[0]);
+		LOG_WARN(("Warning: Unassigned Continue Status Code %u in Status data item.\n",(unsigned int)data_item[0]));
 	}
 	else if (data_item[0] > DLEP_SC_TIMEDOUT && data_item[0] <= 239)
 	{
-		printf("Warning: Unassigned Terminate Status Code %u in Status data item.\n",(unsigned int)data_item[0]);
+		LOG_WARN(("Warning: Unassigned Terminate Status Code %u in Status data item.\n",(unsigned int)data_item[0]));
 	}
 
 	for (i=1; i < (item_len - 1); ++i)
@@ -318,7 +449,7 @@ static enum dlep_status_code check_status(const uint8_t* data_item, uint16_t ite
 		/* Check for NUL (We allow a trailing NUL) */
 		if (data_item[i] == 0)
 		{
-			printf("Warning: Suspicious NUL character in status text\n");
+			LOG_WARN(("Warning: Suspicious NUL character in status text\n"));
 		}
 
 		/* TODO: One should check for valid UTF8 characters here */
@@ -338,7 +469,7 @@ static enum dlep_status_code check_message(const uint8_t* msg, size_t len, unsig
 	enum dlep_status_code sc = DLEP_SC_SUCCESS;
 	if (len < 4)
 	{
-		printf("Packet too short for %s message: %lu bytes\n",name,(unsigned long)len);
+		LOG_WARN(("Packet too short for %s message: %lu bytes\n",name,(unsigned long)len));
 		sc = DLEP_SC_INVALID_DATA;
 	}
 	else
@@ -346,7 +477,7 @@ static enum dlep_status_code check_message(const uint8_t* msg, size_t len, unsig
 		enum dlep_message msg_id = read_uint16(msg);
 		if (msg_id != id)
 		{
-			printf("%s message expected, but message %u received\n",name,msg_id);
+			LOG_WARN(("%s message expected, but message %u received\n",name,msg_id));
 			sc = DLEP_SC_UNEXPECTED_MESSAGE;
 		}
 		else
@@ -354,7 +485,7 @@ static enum dlep_status_code check_message(const uint8_t* msg, size_t len, unsig
 			uint16_t reported_len = read_uint16(msg+2);
 			if (reported_len != len - 4)
 			{
-				printf("%s message length %u + header length does not match received packet length %lu\n",name,reported_len,(unsigned long)len);
+				LOG_WARN(("%s message length %u + header length does not match received packet length %lu\n",name,reported_len,(unsigned long)len));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 		}
@@ -448,6 +579,11 @@ static void printf_unexpected_data_item(const char* name, enum dlep_data_item it
 		break;
 
 	default:
+		/* The extensions name their own data items */
+		data_item_text = extension_item_name(item_id);
+		if (data_item_text)
+			break;
+
 		if (item_id <= 65407)
 			data_item_text = "Unassigned / Specification Required";
 		else if (item_id <= 65534)
@@ -458,9 +594,9 @@ static void printf_unexpected_data_item(const char* name, enum dlep_data_item it
 	}
 
 	if (data_item_text)
-		printf("Unexpected %s data item in %s message\n",data_item_text,name);
+		LOG_WARN(("Unexpected %s data item in %s message\n",data_item_text,name));
 	else
-		printf("Unexpected data item %u in %s message\n",item_id,name);
+		LOG_WARN(("Unexpected data item %u in %s message\n",item_id,name));
 }
 
 enum dlep_status_code check_peer_offer_signal(const uint8_t* msg, size_t len)
@@ -469,12 +605,12 @@ enum dlep_status_code check_peer_offer_signal(const uint8_t* msg, size_t len)
 	enum dlep_status_code sc = DLEP_SC_SUCCESS;
 	if (len < 8)
 	{
-		printf("Packet too short for Peer Offer signal: %u bytes\n",(unsigned int)len);
+		LOG_WARN(("Packet too short for Peer Offer signal: %u bytes\n",(unsigned int)len));
 		sc = DLEP_SC_INVALID_DATA;
 	}
 	else if (memcmp(msg,"DLEP",4) != 0)
 	{
-		printf("DLEP signal expected, but something else received, check for 'DLEP' in packet header\n");
+		LOG_WARN(("DLEP signal expected, but something else received, check for 'DLEP' in packet header\n"));
 		sc = DLEP_SC_INVALID_DATA;
 	}
 	else
@@ -482,7 +618,7 @@ enum dlep_status_code check_peer_offer_signal(const uint8_t* msg, size_t len)
 		uint16_t id = read_uint16(msg+4);
 		if (id != DLEP_PEER_OFFER)
 		{
-			printf("Peer Offer signal expected, but signal %u received\n",id);
+			LOG_WARN(("Peer Offer signal expected, but signal %u received\n",id));
 			sc = DLEP_SC_INVALID_DATA;
 		}
 		else
@@ -490,7 +626,7 @@ enum dlep_status_code check_peer_offer_signal(const uint8_t* msg, size_t len)
 			uint16_t reported_len = read_uint16(msg+6);
 			if (reported_len + 8 != len)
 			{
-				printf("Peer Offer signal length %u + header length does not match received packet length %u\n",reported_len,(unsigned int)len);
+				LOG_WARN(("Peer Offer signal length %u + header length does not match received packet length %u\n",reported_len,(unsigned int)len));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 		}
@@ -519,7 +655,7 @@ enum dlep_status_code check_peer_offer_signal(const uint8_t* msg, size_t len)
 			case DLEP_PEER_TYPE_DATA_ITEM:
 				if (seen_peer_type)
 				{
-					printf("Multiple Peer Type data items in Peer Offer signal\n");
+					LOG_WARN(("Multiple Peer Type data items in Peer Offer signal\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -545,6 +681,9 @@ enum dlep_status_code check_peer_offer_signal(const uint8_t* msg, size_t len)
 				break;
 			}
 
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
+
 			/* Increment data_item to point to the next data item */
 			data_item += item_len;
 		}
@@ -553,12 +692,12 @@ enum dlep_status_code check_peer_offer_signal(const uint8_t* msg, size_t len)
 		{
 			if (data_item != msg + len)
 			{
-	     		printf("Signal length does not equal sum of data item lengths in Peer Offer signal\n");
+	     		LOG_WARN(("Signal length does not equal sum of data item lengths in Peer Offer signal\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 			else if (!seen_ip_conn_pt)
 			{
-				printf("Missing IPv4 or IPv6 connection point data item in Peer Offer signal\n");
+				LOG_WARN(("Missing IPv4 or IPv6 connection point data item in Peer Offer signal\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 		}
@@ -586,6 +725,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 		int seen_status = 0;
 		int seen_peer_type = 0;
 		int seen_exts_supported = 0;
+		unsigned long seen_extension_items = 0;
 
 		/* Check for mandatory data items */
 		const uint8_t* data_item = msg + 4;
@@ -606,7 +746,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_STATUS_DATA_ITEM:
 				if (seen_status)
 				{
-					printf("Multiple Status data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Status data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -619,7 +759,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_PEER_TYPE_DATA_ITEM:
 				if (seen_peer_type)
 				{
-					printf("Multiple Peer Type data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Peer Type data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -632,7 +772,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_HEARTBEAT_INTERVAL_DATA_ITEM:
 				if (seen_heartbeat)
 				{
-					printf("Multiple Heartbeat Interval data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Heartbeat Interval data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -645,7 +785,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_MDRR_DATA_ITEM:
 				if (seen_mdrr)
 				{
-					printf("Multiple Maximum Data Rate (Receive) data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Maximum Data Rate (Receive) data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -658,7 +798,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_MDRT_DATA_ITEM:
 				if (seen_mdrt)
 				{
-					printf("Multiple Maximum Data Rate (Transmit) data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Maximum Data Rate (Transmit) data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -671,7 +811,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_CDRR_DATA_ITEM:
 				if (seen_cdrr)
 				{
-					printf("Multiple Current Data Rate (Receive) data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Current Data Rate (Receive) data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -684,7 +824,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_CDRT_DATA_ITEM:
 				if (seen_cdrt)
 				{
-					printf("Multiple Current Data Rate (Transmit) data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Current Data Rate (Transmit) data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -697,7 +837,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_LATENCY_DATA_ITEM:
 				if (seen_latency)
 				{
-					printf("Multiple Latency data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Latency data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -710,7 +850,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_RESOURCES_DATA_ITEM:
 				if (seen_resources)
 				{
-					printf("Multiple Resources data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Resources data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -723,7 +863,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_RLQR_DATA_ITEM:
 				if (seen_rlqr)
 				{
-					printf("Multiple Relative Link Quality (Receive) data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Relative Link Quality (Receive) data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -736,7 +876,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_RLQT_DATA_ITEM:
 				if (seen_rlqt)
 				{
-					printf("Multiple Relative Link Quality (Transmit) data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Relative Link Quality (Transmit) data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -749,7 +889,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_MTU_DATA_ITEM:
 				if (seen_mtu)
 				{
-					printf("Multiple Maximum Transmission Unit (MTU) data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Maximum Transmission Unit (MTU) data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -762,7 +902,7 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 			case DLEP_EXTS_SUPP_DATA_ITEM:
 				if (seen_exts_supported)
 				{
-					printf("Multiple Extensions Supported data items in Session Initialization Response message\n");
+					LOG_WARN(("Multiple Extensions Supported data items in Session Initialization Response message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -789,11 +929,18 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 				break;
 
 			default:
-				printf_unexpected_data_item("Session Initialization Response",item_id);
-				/* We do not report an error here as we may be negotiating an extension */
+				/* The data items of the extensions are checked by their validators */
+				if (!extension_check_item(DLEP_SESSION_INIT_RESP,item_id,data_item,item_len,&seen_extension_items,&sc))
+				{
+					printf_unexpected_data_item("Session Initialization Response",item_id);
+					/* We do not report an error here as we may be negotiating an extension */
+				}
 				break;
 			}
 
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
+
 			/* Increment data_item to point to the next data item */
 			data_item += item_len;
 		}
@@ -802,42 +949,42 @@ enum dlep_status_code check_session_init_resp_message(const uint8_t* msg, size_t
 		{
 			if (!seen_status)
 			{
-				printf("Missing mandatory Status data item in Session Initialization Response message\n");
+				LOG_WARN(("Missing mandatory Status data item in Session Initialization Response message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 			else if (!seen_peer_type)
 			{
-				printf("Missing mandatory Peer Type data item in Session Initialization Response message\n");
+				LOG_WARN(("Missing mandatory Peer Type data item in Session Initialization Response message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 			else if (!seen_heartbeat)
 			{
-				printf("Missing mandatory Heartbeat Interval data item in Session Initialization Response message\n");
+				LOG_WARN(("Missing mandatory Heartbeat Interval data item in Session Initialization Response message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 			else if (!seen_mdrr)
 			{
-				printf("Missing mandatory Maximum Data Rate (Receive) data item in Session Initialization Response message\n");
+				LOG_WARN(("Missing mandatory Maximum Data Rate (Receive) data item in Session Initialization Response message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 			else if (!seen_mdrt)
 			{
-				printf("Missing mandatory Maximum Data Rate (Transmit) data item in Session Initialization Response message\n");
+				LOG_WARN(("Missing mandatory Maximum Data Rate (Transmit) data item in Session Initialization Response message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 			else if (!seen_cdrr)
 			{
-				printf("Missing mandatory Current Data Rate (Receive) data item in Session Initialization Response message\n");
+				LOG_WARN(("Missing mandatory Current Data Rate (Receive) data item in Session Initialization Response message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 			else if (!seen_cdrt)
 			{
-				printf("Missing mandatory Current Data Rate (Transmit) data item in Session Initialization Response message\n");
+				LOG_WARN(("Missing mandatory Current Data Rate (Transmit) data item in Session Initialization Response message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 			else if (!seen_latency)
 			{
-				printf("Missing mandatory Latency data item in Session Initialization Response message\n");
+				LOG_WARN(("Missing mandatory Latency data item in Session Initialization Response message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 		}
@@ -871,6 +1018,9 @@ enum dlep_status_code check_heartbeat_message(const uint8_t* msg, size_t len)
 				break;
 			}
 
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
+
 			/* Increment data_item to point to the next data item */
 			data_item += item_len;
 		}
@@ -903,7 +1053,7 @@ enum dlep_status_code check_session_term_message(const uint8_t* msg, size_t len)
 			case DLEP_STATUS_DATA_ITEM:
 				if (seen_status)
 				{
-					printf("Multiple Status data items in Session Termination message\n");
+					LOG_WARN(("Multiple Status data items in Session Termination message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -919,6 +1069,9 @@ enum dlep_status_code check_session_term_message(const uint8_t* msg, size_t len)
 				break;
 			}
 
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
+
 			/* Increment data_item to point to the next data item */
 			data_item += item_len;
 		}
@@ -927,7 +1080,7 @@ enum dlep_status_code check_session_term_message(const uint8_t* msg, size_t len)
 		{
 			if (!seen_status)
 			{
-				printf("Missing mandatory Status data item in Session Termination message\n");
+				LOG_WARN(("Missing mandatory Status data item in Session Termination message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 		}
@@ -949,6 +1102,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 		int seen_rlqr = 0;
 		int seen_rlqt = 0;
 		int seen_mtu = 0;
+		unsigned long seen_extension_items = 0;
 
 		/* Check for mandatory data items */
 		const uint8_t* data_item = msg + 4;
@@ -984,7 +1138,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 			case DLEP_MDRR_DATA_ITEM:
 				if (seen_mdrr)
 				{
-					printf("Multiple Maximum Data Rate (Receive) data items in Session Update message\n");
+					LOG_WARN(("Multiple Maximum Data Rate (Receive) data items in Session Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -997,7 +1151,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 			case DLEP_MDRT_DATA_ITEM:
 				if (seen_mdrt)
 				{
-					printf("Multiple Maximum Data Rate (Transmit) data items in Session Update message\n");
+					LOG_WARN(("Multiple Maximum Data Rate (Transmit) data items in Session Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1010,7 +1164,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 			case DLEP_CDRR_DATA_ITEM:
 				if (seen_cdrr)
 				{
-					printf("Multiple Current Data Rate (Receive) data items in Session Update message\n");
+					LOG_WARN(("Multiple Current Data Rate (Receive) data items in Session Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1023,7 +1177,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 			case DLEP_CDRT_DATA_ITEM:
 				if (seen_cdrt)
 				{
-					printf("Multiple Current Data Rate (Transmit) data items in Session Update message\n");
+					LOG_WARN(("Multiple Current Data Rate (Transmit) data items in Session Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1036,7 +1190,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 			case DLEP_LATENCY_DATA_ITEM:
 				if (seen_latency)
 				{
-					printf("Multiple Latency data items in Session Update message\n");
+					LOG_WARN(("Multiple Latency data items in Session Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1049,7 +1203,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 			case DLEP_RESOURCES_DATA_ITEM:
 				if (seen_resources)
 				{
-					printf("Multiple Resources data items in Session Update message\n");
+					LOG_WARN(("Multiple Resources data items in Session Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1062,7 +1216,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 			case DLEP_RLQR_DATA_ITEM:
 				if (seen_rlqr)
 				{
-					printf("Multiple Relative Link Quality (Receive) data items in Session Update message\n");
+					LOG_WARN(("Multiple Relative Link Quality (Receive) data items in Session Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1075,7 +1229,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 			case DLEP_RLQT_DATA_ITEM:
 				if (seen_rlqt)
 				{
-					printf("Multiple Relative Link Quality (Transmit) data items in Session Update message\n");
+					LOG_WARN(("Multiple Relative Link Quality (Transmit) data items in Session Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1088,7 +1242,7 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 			case DLEP_MTU_DATA_ITEM:
 				if (seen_mtu)
 				{
-					printf("Multiple Maximum Transmission Unit (MTU) data items in Session Update message\n");
+					LOG_WARN(("Multiple Maximum Transmission Unit (MTU) data items in Session Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1099,11 +1253,18 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 				break;
 
 			default:
-				printf_unexpected_data_item("Session Update",item_id);
-				sc = DLEP_SC_INVALID_DATA;
+				/* The data items of the extensions are checked by their validators */
+				if (!extension_check_item(DLEP_SESSION_UPDATE,item_id,data_item,item_len,&seen_extension_items,&sc))
+				{
+					printf_unexpected_data_item("Session Update",item_id);
+					sc = DLEP_SC_INVALID_DATA;
+				}
 				break;
 			}
 
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
+
 			/* Increment data_item to point to the next data item */
 			data_item += item_len;
 		}
@@ -1128,6 +1289,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 		int seen_rlqt = 0;
 		int seen_mtu = 0;
 		int seen_address = 0;
+		unsigned long seen_extension_items = 0;
 
 		/* Check for mandatory data items */
 		const uint8_t* data_item = msg + 4;
@@ -1147,7 +1309,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_MAC_ADDRESS_DATA_ITEM:
 				if (seen_mac)
 				{
-					printf("Multiple MAC Address data items in Destination Up message\n");
+					LOG_WARN(("Multiple MAC Address data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1180,7 +1342,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_MDRR_DATA_ITEM:
 				if (seen_mdrr)
 				{
-					printf("Multiple Maximum Data Rate (Receive) data items in Destination Up message\n");
+					LOG_WARN(("Multiple Maximum Data Rate (Receive) data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1193,7 +1355,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_MDRT_DATA_ITEM:
 				if (seen_mdrt)
 				{
-					printf("Multiple Maximum Data Rate (Transmit) data items in Destination Up message\n");
+					LOG_WARN(("Multiple Maximum Data Rate (Transmit) data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1206,7 +1368,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_CDRR_DATA_ITEM:
 				if (seen_cdrr)
 				{
-					printf("Multiple Current Data Rate (Receive) data items in Destination Up message\n");
+					LOG_WARN(("Multiple Current Data Rate (Receive) data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1219,7 +1381,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_CDRT_DATA_ITEM:
 				if (seen_cdrt)
 				{
-					printf("Multiple Current Data Rate (Transmit) data items in Destination Up message\n");
+					LOG_WARN(("Multiple Current Data Rate (Transmit) data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1232,7 +1394,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_LATENCY_DATA_ITEM:
 				if (seen_latency)
 				{
-					printf("Multiple Latency data items in Destination Up message\n");
+					LOG_WARN(("Multiple Latency data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1245,7 +1407,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_RESOURCES_DATA_ITEM:
 				if (seen_resources)
 				{
-					printf("Multiple Resources data items in Destination Up message\n");
+					LOG_WARN(("Multiple Resources data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1258,7 +1420,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_RLQR_DATA_ITEM:
 				if (seen_rlqr)
 				{
-					printf("Multiple Relative Link Quality (Receive) data items in Destination Up message\n");
+					LOG_WARN(("Multiple Relative Link Quality (Receive) data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1271,7 +1433,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_RLQT_DATA_ITEM:
 				if (seen_rlqt)
 				{
-					printf("Multiple Relative Link Quality (Transmit) data items in Destination Up message\n");
+					LOG_WARN(("Multiple Relative Link Quality (Transmit) data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1284,7 +1446,7 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 			case DLEP_MTU_DATA_ITEM:
 				if (seen_mtu)
 				{
-					printf("Multiple Maximum Transmission Unit (MTU) data items in Destination Up message\n");
+					LOG_WARN(("Multiple Maximum Transmission Unit (MTU) data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1295,11 +1457,18 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 				break;
 
 			default:
-				printf_unexpected_data_item("Destination Up",item_id);
-				sc = DLEP_SC_INVALID_DATA;
+				/* The data items of the extensions are checked by their validators */
+				if (!extension_check_item(DLEP_DEST_UP,item_id,data_item,item_len,&seen_extension_items,&sc))
+				{
+					printf_unexpected_data_item("Destination Up",item_id);
+					sc = DLEP_SC_INVALID_DATA;
+				}
 				break;
 			}
 
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
+
 			/* Increment data_item to point to the next data item */
 			data_item += item_len;
 		}
@@ -1308,12 +1477,12 @@ enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t le
 		{
 			if (!seen_mac)
 			{
-				printf("Missing mandatory MAC Address data item in Destination Up message\n");
+				LOG_WARN(("Missing mandatory MAC Address data item in Destination Up message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 			else if (!seen_address)
 			{
-				printf("Warning: Destination Up message SHOULD contain at least one IP address data item\n");
+				LOG_WARN(("Warning: Destination Up message SHOULD contain at least one IP address data item\n"));
 			}
 		}
 	}
@@ -1335,6 +1504,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 		int seen_rlqr = 0;
 		int seen_rlqt = 0;
 		int seen_mtu = 0;
+		unsigned long seen_extension_items = 0;
 
 		/* Check for mandatory data items */
 		const uint8_t* data_item = msg + 4;
@@ -1354,7 +1524,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_MAC_ADDRESS_DATA_ITEM:
 				if (seen_mac)
 				{
-					printf("Multiple MAC Address data items in Destination Update message\n");
+					LOG_WARN(("Multiple MAC Address data items in Destination Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1383,7 +1553,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_MDRR_DATA_ITEM:
 				if (seen_mdrr)
 				{
-					printf("Multiple Maximum Data Rate (Receive) data items in Destination Update message\n");
+					LOG_WARN(("Multiple Maximum Data Rate (Receive) data items in Destination Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1396,7 +1566,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_MDRT_DATA_ITEM:
 				if (seen_mdrt)
 				{
-					printf("Multiple Maximum Data Rate (Transmit) data items in Destination Update message\n");
+					LOG_WARN(("Multiple Maximum Data Rate (Transmit) data items in Destination Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1409,7 +1579,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_CDRR_DATA_ITEM:
 				if (seen_cdrr)
 				{
-					printf("Multiple Current Data Rate (Receive) data items in Destination Update message\n");
+					LOG_WARN(("Multiple Current Data Rate (Receive) data items in Destination Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1422,7 +1592,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_CDRT_DATA_ITEM:
 				if (seen_cdrt)
 				{
-					printf("Multiple Current Data Rate (Transmit) data items in Destination Update message\n");
+					LOG_WARN(("Multiple Current Data Rate (Transmit) data items in Destination Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1435,7 +1605,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_LATENCY_DATA_ITEM:
 				if (seen_latency)
 				{
-					printf("Multiple Latency data items in Destination Update message\n");
+					LOG_WARN(("Multiple Latency data items in Destination Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1448,7 +1618,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_RESOURCES_DATA_ITEM:
 				if (seen_resources)
 				{
-					printf("Multiple Resources data items in Destination Update message\n");
+					LOG_WARN(("Multiple Resources data items in Destination Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1461,7 +1631,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_RLQR_DATA_ITEM:
 				if (seen_rlqr)
 				{
-					printf("Multiple Relative Link Quality (Receive) data items in Destination Update message\n");
+					LOG_WARN(("Multiple Relative Link Quality (Receive) data items in Destination Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1474,7 +1644,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_RLQT_DATA_ITEM:
 				if (seen_rlqt)
 				{
-					printf("Multiple Relative Link Quality (Transmit) data items in Destination Update message\n");
+					LOG_WARN(("Multiple Relative Link Quality (Transmit) data items in Destination Update message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1487,7 +1657,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 			case DLEP_MTU_DATA_ITEM:
 				if (seen_mtu)
 				{
-					printf("Multiple Maximum Transmission Unit (MTU) data items in Destination Up message\n");
+					LOG_WARN(("Multiple Maximum Transmission Unit (MTU) data items in Destination Up message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1498,11 +1668,18 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 				break;
 
 			default:
-				printf_unexpected_data_item("Destination Update",item_id);
-				sc = DLEP_SC_INVALID_DATA;
+				/* The data items of the extensions are checked by their validators */
+				if (!extension_check_item(DLEP_DEST_UPDATE,item_id,data_item,item_len,&seen_extension_items,&sc))
+				{
+					printf_unexpected_data_item("Destination Update",item_id);
+					sc = DLEP_SC_INVALID_DATA;
+				}
 				break;
 			}
 
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
+
 			/* Increment data_item to point to the next data item */
 			data_item += item_len;
 		}
@@ -1511,7 +1688,7 @@ enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_
 		{
 			if (!seen_mac)
 			{
-				printf("Missing mandatory MAC Address data item in Destination Update message\n");
+				LOG_WARN(("Missing mandatory MAC Address data item in Destination Update message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 		}
@@ -1525,6 +1702,7 @@ enum dlep_status_code check_destination_down_message(const uint8_t* msg, size_t
 	if (sc == DLEP_SC_SUCCESS)
 	{
 		int seen_mac = 0;
+		unsigned long seen_extension_items = 0;
 
 		/* Check for mandatory data items */
 		const uint8_t* data_item = msg + 4;
@@ -1544,7 +1722,7 @@ enum dlep_status_code check_destination_down_message(const uint8_t* msg, size_t
 			case DLEP_MAC_ADDRESS_DATA_ITEM:
 				if (seen_mac)
 				{
-					printf("Multiple MAC Address data items in Destination Down message\n");
+					LOG_WARN(("Multiple MAC Address data items in Destination Down message\n"));
 					sc = DLEP_SC_INVALID_DATA;
 				}
 				else
@@ -1555,10 +1733,301 @@ enum dlep_status_code check_destination_down_message(const uint8_t* msg, size_t
 				break;
 
 			default:
-				printf_unexpected_data_item("Destination Down",item_id);
+				/* The data items of the extensions are checked by their validators */
+				if (!extension_check_item(DLEP_DEST_DOWN,item_id,data_item,item_len,&seen_extension_items,&sc))
+				{
+					printf_unexpected_data_item("Destination Down",item_id);
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				break;
+			}
+
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
+
+			/* Increment data_item to point to the next data item */
+			data_item += item_len;
+		}
+
+		if (sc == DLEP_SC_SUCCESS)
+		{
+			if (!seen_mac)
+			{
+				LOG_WARN(("Missing mandatory MAC Address data item in Destination Down message\n"));
 				sc = DLEP_SC_INVALID_DATA;
+			}
+		}
+	}
+	return sc;
+}
+
+enum dlep_status_code check_link_char_resp_message(const uint8_t* msg, size_t len)
+{
+	enum dlep_status_code sc = check_message(msg,len,DLEP_LINK_CHAR_RESP,"Link Characteristics Response");
+	if (sc == DLEP_SC_SUCCESS)
+	{
+		int seen_mac = 0;
+		int seen_status = 0;
+		int seen_mdrr = 0;
+		int seen_mdrt = 0;
+		int seen_cdrr = 0;
+		int seen_cdrt = 0;
+		int seen_latency = 0;
+		int seen_resources = 0;
+		int seen_rlqr = 0;
+		int seen_rlqt = 0;
+		int seen_mtu = 0;
+		unsigned long seen_extension_items = 0;
+
+		/* Check for mandatory data items */
+		const uint8_t* data_item = msg + 4;
+		while (data_item < msg + len && sc == DLEP_SC_SUCCESS)
+		{
+			/* Octets 0 and 1 are the data item type */
+			enum dlep_data_item item_id = read_uint16(data_item);
+
+			/* Octets 2 and 3 are the data item length */
+			uint16_t item_len = read_uint16(data_item + 2);
+
+			/* Increment data_item to point to the data */
+			data_item += 4;
+
+			switch (item_id)
+			{
+			case DLEP_MAC_ADDRESS_DATA_ITEM:
+				if (seen_mac)
+				{
+					LOG_WARN(("Multiple MAC Address data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_mac_address(data_item,item_len);
+					seen_mac = 1;
+				}
 				break;
+
+			case DLEP_STATUS_DATA_ITEM:
+				if (seen_status)
+				{
+					LOG_WARN(("Multiple Status data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_status(data_item,item_len);
+					seen_status = 1;
+				}
+				break;
+
+			case DLEP_MDRR_DATA_ITEM:
+				if (seen_mdrr)
+				{
+					LOG_WARN(("Multiple Maximum Data Rate (Receive) data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_mdrr(data_item,item_len);
+					seen_mdrr = 1;
+				}
+				break;
+
+			case DLEP_MDRT_DATA_ITEM:
+				if (seen_mdrt)
+				{
+					LOG_WARN(("Multiple Maximum Data Rate (Transmit) data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_mdrt(data_item,item_len);
+					seen_mdrt = 1;
+				}
+				break;
+
+			case DLEP_CDRR_DATA_ITEM:
+				if (seen_cdrr)
+				{
+					LOG_WARN(("Multiple Current Data Rate (Receive) data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_cdrr(data_item,item_len);
+					seen_cdrr = 1;
+				}
+				break;
+
+			case DLEP_CDRT_DATA_ITEM:
+				if (seen_cdrt)
+				{
+					LOG_WARN(("Multiple Current Data Rate (Transmit) data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_cdrt(data_item,item_len);
+					seen_cdrt = 1;
+				}
+				break;
+
+			case DLEP_LATENCY_DATA_ITEM:
+				if (seen_latency)
+				{
+					LOG_WARN(("Multiple Latency data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_latency(data_item,item_len);
+					seen_latency = 1;
+				}
+				break;
+
+			case DLEP_RESOURCES_DATA_ITEM:
+				if (seen_resources)
+				{
+					LOG_WARN(("Multiple Resources data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_resources(data_item,item_len);
+					seen_resources = 1;
+				}
+				break;
+
+			case DLEP_RLQR_DATA_ITEM:
+				if (seen_rlqr)
+				{
+					LOG_WARN(("Multiple Relative Link Quality (Receive) data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_rlqr(data_item,item_len);
+					seen_rlqr = 1;
+				}
+				break;
+
+			case DLEP_RLQT_DATA_ITEM:
+				if (seen_rlqt)
+				{
+					LOG_WARN(("Multiple Relative Link Quality (Transmit) data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_rlqt(data_item,item_len);
+					seen_rlqt = 1;
+				}
+				break;
+
+			case DLEP_MTU_DATA_ITEM:
+				if (seen_mtu)
+				{
+					LOG_WARN(("Multiple Maximum Transmission Unit (MTU) data items in Link Characteristics Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_mtu(data_item,item_len);
+					seen_mtu = 1;
+				}
+				break;
+
+			default:
+				/* The data items of the extensions are checked by their validators */
+				if (!extension_check_item(DLEP_LINK_CHAR_RESP,item_id,data_item,item_len,&seen_extension_items,&sc))
+				{
+					printf_unexpected_data_item("Link Characteristics Response",item_id);
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				break;
+			}
+
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
+
+			/* Increment data_item to point to the next data item */
+			data_item += item_len;
+		}
+
+		if (sc == DLEP_SC_SUCCESS)
+		{
+			if (!seen_mac)
+			{
+				LOG_WARN(("Missing mandatory MAC Address data item in Link Characteristics Response message\n"));
+				sc = DLEP_SC_INVALID_DATA;
 			}
+		}
+	}
+	return sc;
+}
+
+enum dlep_status_code check_credit_control_resp_message(const uint8_t* msg, size_t len)
+{
+	enum dlep_status_code sc = check_message(msg,len,DLEP_CREDIT_CONTROL_RESP,"Credit Control Response");
+	if (sc == DLEP_SC_SUCCESS)
+	{
+		int seen_mac = 0;
+		int seen_status = 0;
+		unsigned long seen_extension_items = 0;
+
+		/* Check for mandatory data items */
+		const uint8_t* data_item = msg + 4;
+		while (data_item < msg + len && sc == DLEP_SC_SUCCESS)
+		{
+			/* Octets 0 and 1 are the data item type */
+			enum dlep_data_item item_id = read_uint16(data_item);
+
+			/* Octets 2 and 3 are the data item length */
+			uint16_t item_len = read_uint16(data_item + 2);
+
+			/* Increment data_item to point to the data */
+			data_item += 4;
+
+			switch (item_id)
+			{
+			case DLEP_MAC_ADDRESS_DATA_ITEM:
+				if (seen_mac)
+				{
+					LOG_WARN(("Multiple MAC Address data items in Credit Control Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_mac_address(data_item,item_len);
+					seen_mac = 1;
+				}
+				break;
+
+			case DLEP_STATUS_DATA_ITEM:
+				if (seen_status)
+				{
+					LOG_WARN(("Multiple Status data items in Credit Control Response message\n"));
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				else
+				{
+					sc = check_status(data_item,item_len);
+					seen_status = 1;
+				}
+				break;
+
+			default:
+				/* The data items of the extensions are checked by their validators */
+				if (!extension_check_item(DLEP_CREDIT_CONTROL_RESP,item_id,data_item,item_len,&seen_extension_items,&sc))
+				{
+					printf_unexpected_data_item("Credit Control Response",item_id);
+					sc = DLEP_SC_INVALID_DATA;
+				}
+				break;
+			}
+
+			if (sc != DLEP_SC_SUCCESS)
+				STATS_INC(stats.invalid_items[STATS_ITEM_INDEX(item_id)]);
 
 			/* Increment data_item to point to the next data item */
 			data_item += item_len;
@@ -1568,7 +2037,7 @@ enum dlep_status_code check_destination_down_message(const uint8_t* msg, size_t
 		{
 			if (!seen_mac)
 			{
-				printf("Missing mandatory MAC Address data item in Destination Down message\n");
+				LOG_WARN(("Missing mandatory MAC Address data item in Credit Control Response message\n"));
 				sc = DLEP_SC_INVALID_DATA;
 			}
 		}
@@ -17,5 +17,18 @@ enum dlep_status_code check_session_update_message(const uint8_t* msg, size_t le
 enum dlep_status_code check_destination_up_message(const uint8_t* msg, size_t len);
 enum dlep_status_code check_destination_update_message(const uint8_t* msg, size_t len);
 enum dlep_status_code check_destination_down_message(const uint8_t* msg, size_t len);
+enum dlep_status_code check_link_char_resp_message(const uint8_t* msg, size_t len);
+enum dlep_status_code check_credit_control_resp_message(const uint8_t* msg, size_t len);
+
+/* The validators of the data items the extensions add, registered with them
+ * and called by the message validators above */
+enum dlep_status_code check_queue_parameters(const uint8_t* data_item, uint16_t item_len);
+enum dlep_status_code check_pause(const uint8_t* data_item, uint16_t item_len);
+enum dlep_status_code check_restart(const uint8_t* data_item, uint16_t item_len);
+enum dlep_status_code check_link_id_length(const uint8_t* data_item, uint16_t item_len);
+enum dlep_status_code check_link_id(const uint8_t* data_item, uint16_t item_len);
+enum dlep_status_code check_latency_range(const uint8_t* data_item, uint16_t item_len);
+enum dlep_status_code check_credit_window_init(const uint8_t* data_item, uint16_t item_len);
+enum dlep_status_code check_credit_grant(const uint8_t* data_item, uint16_t item_len);
 
 #endif /* DLEP_TLV_CHECK_H_ */
@@ -0,0 +1,303 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./control.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "./dlep_iana.h"
+#include "./linkchar.h"
+#include "./log.h"
+
+/* How long a client has to send its request, in milliseconds */
+#define REQUEST_TIMEOUT 1000
+
+/* How long a Link Characteristics Request waits for the modem unless the
+ * client says otherwise, in milliseconds */
+#define DEFAULT_LINKCHAR_TIMEOUT 1000
+
+/* The longest request line */
+#define REQUEST_MAX 256
+
+static struct
+{
+	char* path;
+	int s;
+	struct linkchar_table* link_chars;
+	pthread_t thread;
+} s_control = { NULL, -1, NULL };
+
+static void reply(int s, const char* text, size_t len)
+{
+	/* The reply is small, and the session thread must never wait on a client */
+	if (send(s,text,len,MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)len)
+		LOG_DEBUG(("Failed to reply on control socket: %s\n",strerror(errno)));
+}
+
+static size_t append(char* text, size_t len, size_t size, const char* name, uint64_t value)
+{
+	int n = snprintf(text + len,size - len," %s %"PRIu64,name,value);
+	return (n > 0 && (size_t)n < size - len ? len + n : len);
+}
+
+/* Called on the session thread, the connection is in context */
+static void linkchar_done(void* context, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc, const struct destination_metrics* metrics)
+{
+	int s = (int)(intptr_t)context;
+	char text[REQUEST_MAX * 2];
+	size_t len;
+
+	if (sc == DLEP_SC_TIMEDOUT)
+		len = snprintf(text,sizeof(text),"error no response from the modem");
+	else if (!metrics)
+		len = snprintf(text,sizeof(text),"error session ended");
+	else if (sc != DLEP_SC_SUCCESS)
+		len = snprintf(text,sizeof(text),"error status %u",(unsigned int)sc);
+	else
+	{
+		len = snprintf(text,sizeof(text),"ok");
+		if (metrics->present & DEST_FIELD_MDRR)
+			len = append(text,len,sizeof(text) - 1,"mdrr",metrics->mdrr);
+		if (metrics->present & DEST_FIELD_MDRT)
+			len = append(text,len,sizeof(text) - 1,"mdrt",metrics->mdrt);
+		if (metrics->present & DEST_FIELD_CDRR)
+			len = append(text,len,sizeof(text) - 1,"cdrr",metrics->cdrr);
+		if (metrics->present & DEST_FIELD_CDRT)
+			len = append(text,len,sizeof(text) - 1,"cdrt",metrics->cdrt);
+		if (metrics->present & DEST_FIELD_LATENCY)
+			len = append(text,len,sizeof(text) - 1,"latency",metrics->latency);
+		if (metrics->present & DEST_FIELD_RESOURCES)
+			len = append(text,len,sizeof(text) - 1,"resources",metrics->resources);
+		if (metrics->present & DEST_FIELD_RLQR)
+			len = append(text,len,sizeof(text) - 1,"rlqr",metrics->rlqr);
+		if (metrics->present & DEST_FIELD_RLQT)
+			len = append(text,len,sizeof(text) - 1,"rlqt",metrics->rlqt);
+		if (metrics->present & DEST_FIELD_MTU)
+			len = append(text,len,sizeof(text) - 1,"mtu",metrics->mtu);
+	}
+	text[len++] = '\n';
+
+	reply(s,text,len);
+	close(s);
+}
+
+static int parse_mac(const char* str, uint8_t* mac)
+{
+	unsigned int octets[6];
+	char extra;
+	int i;
+
+	if (sscanf(str,"%2x:%2x:%2x:%2x:%2x:%2x%c",&octets[0],&octets[1],&octets[2],&octets[3],&octets[4],&octets[5],&extra) != 6)
+		return 0;
+
+	for (i = 0; i < 6; ++i)
+		mac[i] = (uint8_t)octets[i];
+	return 1;
+}
+
+/* A Link Identifier is given as its octets in hex */
+static int parse_link(const char* str, struct link_id* link)
+{
+	size_t len = strlen(str);
+	size_t i;
+
+	if (len == 0 || len % 2 || len / 2 > MAX_LINK_ID_LENGTH || strspn(str,"0123456789abcdefABCDEF") != len)
+		return 0;
+
+	for (i = 0; i < len / 2; ++i)
+	{
+		unsigned int octet;
+		sscanf(str + i * 2,"%2x",&octet);
+		link->id[i] = (uint8_t)octet;
+	}
+	link->len = (uint8_t)(len / 2);
+	return 1;
+}
+
+/* Returns 1 if s has been handed to a request, which will reply and close it */
+static int serve_linkchar(int s, char** saveptr)
+{
+	static const char bad_request[] = "error usage: linkchar <MAC> [link <hex>] [cdrr <bps>] [cdrt <bps>] [latency <us>] [timeout <ms>]\n";
+	static const char not_queued[] = "error no session, a link not of the negotiated length, or a request for the destination is already outstanding\n";
+	struct destination_metrics wanted = {0};
+	struct link_id link = {0};
+	unsigned long timeout = DEFAULT_LINKCHAR_TIMEOUT;
+	uint8_t mac[6];
+	char* name;
+	char* value;
+
+	name = strtok_r(NULL," \t\r\n",saveptr);
+	if (!name || !parse_mac(name,mac))
+	{
+		reply(s,bad_request,sizeof(bad_request) - 1);
+		return 0;
+	}
+
+	while ((name = strtok_r(NULL," \t\r\n",saveptr)) != NULL)
+	{
+		value = strtok_r(NULL," \t\r\n",saveptr);
+		if (!value)
+		{
+			reply(s,bad_request,sizeof(bad_request) - 1);
+			return 0;
+		}
+
+		if (!strcmp(name,"link"))
+		{
+			if (!parse_link(value,&link))
+			{
+				reply(s,bad_request,sizeof(bad_request) - 1);
+				return 0;
+			}
+		}
+		else if (!strcmp(name,"cdrr"))
+		{
+			wanted.cdrr = strtoull(value,NULL,10);
+			wanted.present |= DEST_FIELD_CDRR;
+		}
+		else if (!strcmp(name,"cdrt"))
+		{
+			wanted.cdrt = strtoull(value,NULL,10);
+			wanted.present |= DEST_FIELD_CDRT;
+		}
+		else if (!strcmp(name,"latency"))
+		{
+			wanted.latency = strtoull(value,NULL,10);
+			wanted.present |= DEST_FIELD_LATENCY;
+		}
+		else if (!strcmp(name,"timeout"))
+			timeout = strtoul(value,NULL,10);
+		else
+		{
+			reply(s,bad_request,sizeof(bad_request) - 1);
+			return 0;
+		}
+	}
+
+	/* Once queued, the request may complete on the session thread before this returns */
+	if (!linkchar_request(s_control.link_chars,mac,link.len ? &link : NULL,&wanted,timeout,&linkchar_done,(void*)(intptr_t)s))
+	{
+		reply(s,not_queued,sizeof(not_queued) - 1);
+		return 0;
+	}
+	return 1;
+}
+
+/* Returns 1 if s has been handed on, and must not be closed */
+static int serve(int s)
+{
+	static const char unknown[] = "error unknown request\n";
+	char request[REQUEST_MAX];
+	ssize_t received = 0;
+	struct pollfd pfd;
+	char* saveptr = NULL;
+	char* command;
+
+	pfd.fd = s;
+	pfd.events = POLLIN;
+	if (poll(&pfd,1,REQUEST_TIMEOUT) == 1)
+		received = recv(s,request,sizeof(request) - 1,0);
+	if (received <= 0)
+		return 0;
+	request[received] = '\0';
+
+	command = strtok_r(request," \t\r\n",&saveptr);
+	if (command && !strcmp(command,"linkchar"))
+		return serve_linkchar(s,&saveptr);
+
+	reply(s,unknown,sizeof(unknown) - 1);
+	return 0;
+}
+
+static void* control_thread(void* arg)
+{
+	for (;;)
+	{
+		int s = accept(s_control.s,NULL,NULL);
+		if (s == -1)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			LOG_ERROR(("Failed to accept control connection: %s\n",strerror(errno)));
+			return NULL;
+		}
+
+		if (!serve(s))
+			close(s);
+	}
+}
+
+static void control_stop(void)
+{
+	if (s_control.path)
+	{
+		unlink(s_control.path);
+		free(s_control.path);
+		s_control.path = NULL;
+	}
+}
+
+int control_start(const char* path, struct linkchar_table* link_chars)
+{
+	struct sockaddr_un address = {0};
+	int err;
+
+	if (strlen(path) >= sizeof(address.sun_path))
+	{
+		LOG_ERROR(("Control socket path %s is too long\n",path));
+		return -1;
+	}
+
+	s_control.path = malloc(strlen(path) + 1);
+	if (!s_control.path)
+	{
+		LOG_ERROR(("Failed to allocate control socket path\n"));
+		return -1;
+	}
+	strcpy(s_control.path,path);
+	s_control.link_chars = link_chars;
+
+	s_control.s = socket(AF_UNIX,SOCK_STREAM,0);
+	if (s_control.s == -1)
+	{
+		LOG_ERROR(("Failed to create control socket: %s\n",strerror(errno)));
+		return -1;
+	}
+
+	/* Replace the socket of a previous run */
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path,path);
+	unlink(path);
+
+	if (bind(s_control.s,(struct sockaddr*)&address,sizeof(address)) != 0 || listen(s_control.s,8) != 0)
+	{
+		LOG_ERROR(("Failed to listen on control socket %s: %s\n",path,strerror(errno)));
+		close(s_control.s);
+		return -1;
+	}
+
+	atexit(&control_stop);
+
+	err = pthread_create(&s_control.thread,NULL,&control_thread,NULL);
+	if (err)
+	{
+		LOG_ERROR(("Failed to start control thread: %s\n",strerror(err)));
+		return -1;
+	}
+	pthread_detach(s_control.thread);
+
+	return 0;
+}
@@ -0,0 +1,35 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * The control socket, a Unix socket through which other processes on the
+ * router, such as QoS admission control, drive the session. Each connection
+ * carries a single request line and gets a single line back:
+ *
+ *   linkchar <MAC> [link <hex>] [cdrr <bps>] [cdrt <bps>] [latency <us>] [timeout <ms>]
+ *
+ * sends a Link Characteristics Request for destination MAC, or for one of its
+ * links if the Link Identifier extension is in use, asking for the CDRR, CDRT
+ * and Latency given, and answers with the metrics of the modem's response once
+ * it arrives:
+ *
+ *   ok cdrr <bps> cdrt <bps> latency <us> ...
+ *
+ * or with 'error <reason>' if the request failed or timed out.
+ */
+
+#ifndef DLEP_CONTROL_H_
+#define DLEP_CONTROL_H_
+
+#include "./util.h"
+
+struct linkchar_table;
+
+/* Serve the control socket at path from a background thread, sending the
+ * Link Characteristics Requests through link_chars */
+int control_start(const char* path, struct linkchar_table* link_chars);
+
+#endif /* DLEP_CONTROL_H_ */
@@ -0,0 +1,205 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./cost.h"
+
+#include <string.h>
+
+#include "./destination.h"
+
+/* The largest cost we will publish, used for unusable links */
+#define COST_MAX 0xFFFFFFFEUL
+
+/* The reference packet size for the ETT cost, in bits */
+#define ETT_PACKET_BITS 12000.0
+
+static double etx(const struct destination_metrics* metrics)
+{
+	/* Treat the Relative Link Quality as a delivery ratio, RLQR is optional */
+	double df, dr = 1.0;
+
+	if (!(metrics->present & DEST_FIELD_RLQT) || metrics->rlqt == 0)
+		return -1.0;
+	df = metrics->rlqt / 100.0;
+
+	if (metrics->present & DEST_FIELD_RLQR)
+	{
+		if (metrics->rlqr == 0)
+			return -1.0;
+		dr = metrics->rlqr / 100.0;
+	}
+
+	return 1.0 / (df * dr);
+}
+
+static double cost_etx(const struct destination_metrics* metrics)
+{
+	double v = etx(metrics);
+	if (v < 0.0)
+		return (double)COST_MAX;
+
+	/* Fixed point, 256 is a perfect link */
+	return v * 256.0;
+}
+
+static double cost_ett(const struct destination_metrics* metrics)
+{
+	/* Expected Transmission Time of a reference packet in microseconds,
+	 * plus the link latency */
+	uint64_t rate = 0;
+	double v = etx(metrics);
+	if (v < 0.0)
+		return (double)COST_MAX;
+
+	if (metrics->present & DEST_FIELD_CDRT)
+		rate = metrics->cdrt;
+	if (!rate && (metrics->present & DEST_FIELD_MDRT))
+		rate = metrics->mdrt;
+	if (!rate)
+		return (double)COST_MAX;
+
+	v = v * ETT_PACKET_BITS * 1000000.0 / (double)rate;
+
+	if (metrics->present & DEST_FIELD_LATENCY)
+		v += (double)metrics->latency;
+
+	return v;
+}
+
+static double cost_latency(const struct destination_metrics* metrics)
+{
+	if (!(metrics->present & DEST_FIELD_LATENCY))
+		return (double)COST_MAX;
+
+	return (double)metrics->latency;
+}
+
+static double cost_jitter(const struct destination_metrics* metrics)
+{
+	/* The latency, penalised by the spread of the Latency Range, so links
+	 * with the same average but more jitter cost more */
+	double v;
+
+	if (metrics->present & DEST_FIELD_LATENCY)
+		v = (double)metrics->latency;
+	else if (metrics->present & DEST_FIELD_LATENCY_RANGE)
+		v = ((double)metrics->latency_min + (double)metrics->latency_max) / 2.0;
+	else
+		return (double)COST_MAX;
+
+	if (metrics->present & DEST_FIELD_LATENCY_RANGE)
+		v += (double)(metrics->latency_max - metrics->latency_min);
+
+	return v;
+}
+
+static const struct cost_function_entry
+{
+	const char* name;
+	cost_function fn;
+} cost_functions[] =
+{
+	{ "ett", &cost_ett },
+	{ "etx", &cost_etx },
+	{ "latency", &cost_latency },
+	{ "jitter", &cost_jitter },
+	{ NULL, NULL }
+};
+
+void cost_params_init(struct cost_params* params)
+{
+	params->name = cost_functions[0].name;
+	params->fn = cost_functions[0].fn;
+	params->alpha = 0.25;
+	params->hysteresis = 10;
+	params->hold_down = 1000;
+}
+
+int cost_params_select(struct cost_params* params, const char* name)
+{
+	const struct cost_function_entry* e = cost_functions;
+	for (; e->name; ++e)
+	{
+		if (strcmp(e->name,name) == 0)
+		{
+			params->name = e->name;
+			params->fn = e->fn;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+const char* cost_function_names(void)
+{
+	return "ett|etx|latency|jitter";
+}
+
+void cost_state_init(struct cost_state* state)
+{
+	memset(state,0,sizeof(*state));
+}
+
+int cost_update(const struct cost_params* params, struct cost_state* state, const struct destination_metrics* metrics, const struct timespec* now, uint32_t* cost)
+{
+	double raw = params->fn(metrics);
+	uint32_t candidate;
+
+	if (raw > (double)COST_MAX)
+		raw = (double)COST_MAX;
+
+	/* Exponentially weighted moving average, seeded by the first sample */
+	if (!state->published && !state->samples)
+		state->smoothed = raw;
+	else
+		state->smoothed += params->alpha * (raw - state->smoothed);
+
+	++state->samples;
+
+	candidate = (uint32_t)(state->smoothed + 0.5);
+	if (candidate == 0)
+		candidate = 1;
+
+	if (state->published)
+	{
+		/* Hysteresis: ignore changes smaller than the threshold */
+		uint32_t delta = (candidate > state->published ? candidate - state->published : state->published - candidate);
+		if ((double)delta * 100.0 < (double)params->hysteresis * (double)state->published)
+		{
+			state->held = 0;
+			return 0;
+		}
+
+		/* Hold-down: do not publish too often, but remember the change for cost_release() */
+		if (interval_ms(&state->published_time,now) < params->hold_down)
+		{
+			state->held = candidate;
+			return 0;
+		}
+	}
+
+	state->published = candidate;
+	state->published_time = *now;
+	state->samples = 0;
+	state->held = 0;
+
+	*cost = candidate;
+	return 1;
+}
+
+int cost_release(const struct cost_params* params, struct cost_state* state, const struct timespec* now, uint32_t* cost)
+{
+	if (!state->held || interval_ms(&state->published_time,now) < params->hold_down)
+		return 0;
+
+	state->published = state->held;
+	state->published_time = *now;
+	state->samples = 0;
+	state->held = 0;
+
+	*cost = state->published;
+	return 1;
+}
@@ -0,0 +1,62 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * The link-cost engine derives a single routing metric from the per-destination
+ * data items reported by the modem, smooths it and decides when a change is
+ * significant enough to be published to the routing protocol.
+ */
+
+#ifndef DLEP_COST_H_
+#define DLEP_COST_H_
+
+#include "./util.h"
+
+struct destination_metrics;
+
+/* A cost function maps the current metrics of a destination to a raw cost,
+ * lower is better */
+typedef double (*cost_function)(const struct destination_metrics* metrics);
+
+struct cost_params
+{
+	const char* name;         /* Name of the cost function */
+	cost_function fn;         /* The cost function itself */
+	double alpha;             /* EWMA weight given to each new sample, 0 < alpha <= 1 */
+	unsigned int hysteresis;  /* Minimum change in percent before a new cost is published */
+	unsigned int hold_down;   /* Minimum time in milliseconds between publications */
+};
+
+struct cost_state
+{
+	double smoothed;          /* The EWMA smoothed cost */
+	uint32_t published;       /* The last published cost, 0 if never published */
+	struct timespec published_time;
+	unsigned long samples;    /* Samples since the last publication */
+	uint32_t held;            /* A significant change waiting out the hold-down, 0 if none */
+};
+
+/* Fill in the default parameters */
+void cost_params_init(struct cost_params* params);
+
+/* Select a cost function by name, returns 0 if the name is not recognised */
+int cost_params_select(struct cost_params* params, const char* name);
+
+/* List the names of the available cost functions, separated by '|' */
+const char* cost_function_names(void);
+
+/* Reset the state of a new destination */
+void cost_state_init(struct cost_state* state);
+
+/* Feed a new sample into the engine, returns 1 and sets *cost if the
+ * new cost should be published */
+int cost_update(const struct cost_params* params, struct cost_state* state, const struct destination_metrics* metrics, const struct timespec* now, uint32_t* cost);
+
+/* Release a change that cost_update() held down, returns 1 and sets *cost
+ * if the hold-down has ended and it should be published now */
+int cost_release(const struct cost_params* params, struct cost_state* state, const struct timespec* now, uint32_t* cost);
+
+#endif /* DLEP_COST_H_ */
@@ -0,0 +1,290 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./credit.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "./log.h"
+
+static struct
+{
+	char* name;
+	struct credit_shm* map;
+	size_t count;             /* Entries in use */
+	size_t deleted;           /* Entries deleted, one slot is always left empty */
+	uint32_t starved;         /* The starved counter at the last credit_poll() */
+} s_credit = { NULL, NULL, 0, 0, 0 };
+
+static uint32_t hash_octets(uint32_t h, const uint8_t* p, size_t len)
+{
+	/* FNV-1a */
+	size_t i;
+	for (i = 0; i < len; ++i)
+	{
+		h ^= p[i];
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+static void changed(void)
+{
+	__atomic_fetch_add(&s_credit.map->generation,1,__ATOMIC_RELEASE);
+}
+
+/* Returns NULL if the destination has no entry and create is 0, or the table is full */
+static struct credit_shm_entry* find_entry(const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len, int create)
+{
+	size_t mask = CREDIT_SHM_SLOTS - 1;
+	size_t i;
+	struct credit_shm_entry* e;
+	struct credit_shm_entry* reuse = NULL;
+
+	if (link_id_len > MAX_LINK_ID_LENGTH)
+		link_id_len = MAX_LINK_ID_LENGTH;
+
+	/* Linear probing, the table is never full */
+	i = hash_octets(hash_octets(2166136261UL,mac,6),link_id,link_id_len) & mask;
+	for (; s_credit.map->entries[i].in_use != CREDIT_ENTRY_EMPTY; i = (i + 1) & mask)
+	{
+		e = &s_credit.map->entries[i];
+		if (e->in_use == CREDIT_ENTRY_DELETED)
+		{
+			if (!reuse)
+				reuse = e;
+		}
+		else if (memcmp(e->mac,mac,6) == 0 && e->link_id_len == link_id_len && memcmp(e->link_id,link_id,link_id_len) == 0)
+			return e;
+	}
+
+	if (!create)
+		return NULL;
+
+	/* Prefer a deleted entry, which shortens no probe sequence */
+	if (reuse)
+		--s_credit.deleted;
+	else if (s_credit.count + s_credit.deleted == CREDIT_SHM_SLOTS - 1)
+	{
+		LOG_WARN(("Credit shared memory is full, not publishing credits of %02X:%02X:%02X:%02X:%02X:%02X\n",mac[0],mac[1],mac[2],mac[3],mac[4],mac[5]));
+		return NULL;
+	}
+	else
+		reuse = &s_credit.map->entries[i];
+
+	/* Revoked and freshly reset entries have no credits */
+	e = reuse;
+	memcpy(e->mac,mac,6);
+	e->link_id_len = link_id_len;
+	memcpy(e->link_id,link_id,link_id_len);
+	__atomic_store_n(&e->in_use,CREDIT_ENTRY_IN_USE,__ATOMIC_RELEASE);
+	++s_credit.count;
+	return e;
+}
+
+static void delete_entry(struct credit_shm_entry* e)
+{
+	size_t mask = CREDIT_SHM_SLOTS - 1;
+	size_t i = e - s_credit.map->entries;
+
+	/* Readers may be probing past it, so it stays in the way for now */
+	__atomic_store_n(&e->in_use,CREDIT_ENTRY_DELETED,__ATOMIC_RELEASE);
+	--s_credit.count;
+	++s_credit.deleted;
+
+	/* A deleted entry just before an empty one ends every probe sequence
+	 * through it anyway, so it can be emptied, and so can any before it */
+	while (s_credit.map->entries[(i + 1) & mask].in_use == CREDIT_ENTRY_EMPTY &&
+			s_credit.map->entries[i].in_use == CREDIT_ENTRY_DELETED)
+	{
+		__atomic_store_n(&s_credit.map->entries[i].in_use,CREDIT_ENTRY_EMPTY,__ATOMIC_RELEASE);
+		--s_credit.deleted;
+		i = (i - 1) & mask;
+	}
+}
+
+int credit_open(const char* name)
+{
+	static int registered = 0;
+	int fd;
+
+	credit_close();
+
+	s_credit.name = malloc(strlen(name) + 1);
+	if (!s_credit.name)
+	{
+		LOG_ERROR(("Failed to allocate credit shared memory name\n"));
+		return -1;
+	}
+	strcpy(s_credit.name,name);
+
+	fd = shm_open(name,O_RDWR | O_CREAT | O_TRUNC,0644);
+	if (fd == -1)
+	{
+		LOG_ERROR(("Failed to create credit shared memory %s: %s\n",name,strerror(errno)));
+		credit_close();
+		return -1;
+	}
+
+	if (ftruncate(fd,sizeof(struct credit_shm)) != 0)
+	{
+		LOG_ERROR(("Failed to size credit shared memory %s: %s\n",name,strerror(errno)));
+		close(fd);
+		credit_close();
+		return -1;
+	}
+
+	/* The forwarding plane writes to it too */
+	s_credit.map = mmap(NULL,sizeof(struct credit_shm),PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if (s_credit.map == MAP_FAILED)
+	{
+		LOG_ERROR(("Failed to map credit shared memory %s: %s\n",name,strerror(errno)));
+		s_credit.map = NULL;
+		credit_close();
+		return -1;
+	}
+
+	/* Freshly truncated, so already zero */
+	s_credit.map->version = CREDIT_SHM_VERSION;
+	s_credit.map->slots = CREDIT_SHM_SLOTS;
+	s_credit.map->classes = CREDIT_CLASSES;
+	__atomic_store_n(&s_credit.map->magic,CREDIT_SHM_MAGIC,__ATOMIC_RELEASE);
+	s_credit.count = 0;
+	s_credit.deleted = 0;
+	s_credit.starved = 0;
+
+	if (!registered)
+	{
+		atexit(&credit_close);
+		registered = 1;
+	}
+
+	return 0;
+}
+
+void credit_close(void)
+{
+	if (s_credit.map)
+	{
+		munmap(s_credit.map,sizeof(struct credit_shm));
+		s_credit.map = NULL;
+	}
+
+	if (s_credit.name)
+	{
+		shm_unlink(s_credit.name);
+		free(s_credit.name);
+		s_credit.name = NULL;
+	}
+}
+
+int credit_enabled(void)
+{
+	return s_credit.map != NULL;
+}
+
+void credit_reset(void)
+{
+	size_t i;
+
+	if (!s_credit.map)
+		return;
+
+	/* Stop flow control before taking the credits away, so nothing is held for ever */
+	for (i = 0; i < CREDIT_CLASSES; ++i)
+		__atomic_store_n(&s_credit.map->window[i],0,__ATOMIC_RELEASE);
+
+	if (s_credit.count || s_credit.deleted)
+	{
+		/* Cut every probe sequence before wiping the entries */
+		for (i = 0; i < CREDIT_SHM_SLOTS; ++i)
+			__atomic_store_n(&s_credit.map->entries[i].in_use,CREDIT_ENTRY_EMPTY,__ATOMIC_RELEASE);
+
+		memset(s_credit.map->entries,0,sizeof(s_credit.map->entries));
+		s_credit.count = 0;
+		s_credit.deleted = 0;
+	}
+
+	changed();
+}
+
+void credit_window(unsigned int cls, uint64_t window)
+{
+	if (!s_credit.map || cls >= CREDIT_CLASSES)
+		return;
+
+	__atomic_store_n(&s_credit.map->window[cls],window,__ATOMIC_RELEASE);
+	changed();
+}
+
+int64_t credit_grant(const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len, unsigned int cls, uint64_t credits)
+{
+	int64_t balance;
+	struct credit_shm_entry* e;
+
+	if (!s_credit.map || cls >= CREDIT_CLASSES)
+		return 0;
+
+	e = find_entry(mac,link_id,link_id_len,1);
+	if (!e)
+		return 0;
+
+	balance = __atomic_add_fetch(&e->credits[cls],(int64_t)credits,__ATOMIC_RELEASE);
+	changed();
+	return balance;
+}
+
+void credit_revoke(const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len)
+{
+	unsigned int i;
+	struct credit_shm_entry* e;
+
+	if (!s_credit.map)
+		return;
+
+	e = find_entry(mac,link_id,link_id_len,0);
+	if (!e)
+		return;
+
+	for (i = 0; i < CREDIT_CLASSES; ++i)
+		__atomic_store_n(&e->credits[i],0,__ATOMIC_RELEASE);
+	__atomic_store_n(&e->starved,0,__ATOMIC_RELAXED);
+	delete_entry(e);
+	changed();
+}
+
+void credit_poll(credit_starved_callback callback, void* context)
+{
+	uint32_t starved;
+	size_t i;
+
+	if (!s_credit.map)
+		return;
+
+	/* The common case is a single load */
+	starved = __atomic_load_n(&s_credit.map->starved,__ATOMIC_ACQUIRE);
+	if (starved == s_credit.starved)
+		return;
+	s_credit.starved = starved;
+
+	for (i = 0; i < CREDIT_SHM_SLOTS; ++i)
+	{
+		struct credit_shm_entry* e = &s_credit.map->entries[i];
+		if (e->in_use == CREDIT_ENTRY_IN_USE && __atomic_load_n(&e->starved,__ATOMIC_RELAXED))
+		{
+			uint32_t classes = __atomic_exchange_n(&e->starved,0,__ATOMIC_ACQ_REL);
+			if (classes)
+				(*callback)(context,e->mac,e->link_id,e->link_id_len,classes);
+		}
+	}
+}
@@ -0,0 +1,109 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Credit windows, DLEP_EXT_CREDIT_WINDOW, published in a POSIX shared memory
+ * region for the forwarding plane to pace its egress queues against. The
+ * modem grants octets of credit per destination and traffic class, the
+ * router adds each grant to the destination's counter and the forwarding
+ * plane takes the length of every frame it sends from it, so the queues in
+ * the modem never grow beyond the window it advertised.
+ *
+ * Destinations are found as in pause.h: linear probing from the FNV-1a hash
+ * of the MAC address followed by the Link Identifier, stopping at the first
+ * entry that is CREDIT_ENTRY_EMPTY. Only CREDIT_ENTRY_IN_USE entries match,
+ * the entries of destinations that have gone down are CREDIT_ENTRY_DELETED
+ * until the slot is reused. A class is only flow controlled while window[]
+ * is non-zero. Before sending n octets of class c the forwarding plane does
+ *
+ *   if (__atomic_sub_fetch(&e->credits[c],n,__ATOMIC_ACQ_REL) < 0)
+ *   {
+ *       __atomic_add_fetch(&e->credits[c],n,__ATOMIC_RELAXED);
+ *       __atomic_fetch_or(&e->starved,1U << c,__ATOMIC_RELAXED);
+ *       __atomic_fetch_add(&shm->starved,1,__ATOMIC_RELEASE);
+ *       ...hold the frame until credits[c] grows
+ *   }
+ *
+ * and the router sends the modem a Credit Request for every starved class.
+ */
+
+#ifndef DLEP_CREDIT_H_
+#define DLEP_CREDIT_H_
+
+#include "./util.h"
+#include "./dlep_iana.h"
+
+#define CREDIT_SHM_MAGIC   0x444C4343  /* "DLCC" */
+#define CREDIT_SHM_VERSION 2
+#define CREDIT_SHM_SLOTS   4096        /* A power of 2 */
+
+/* The traffic classes we track, a class is a queue index as in RFC 8651 */
+#define CREDIT_CLASSES 8
+
+/* Values of in_use */
+enum credit_entry_state
+{
+	CREDIT_ENTRY_EMPTY = 0,
+	CREDIT_ENTRY_IN_USE = 1,
+	CREDIT_ENTRY_DELETED = 2
+};
+
+struct credit_shm_entry
+{
+	uint8_t mac[6];
+	uint8_t in_use;           /* enum credit_entry_state */
+	uint8_t link_id_len;
+	uint32_t starved;         /* Bitmap of the classes waiting for credit, set by the forwarding plane */
+	uint32_t reserved;
+	int64_t credits[CREDIT_CLASSES]; /* Octets that may still be sent */
+	uint8_t link_id[MAX_LINK_ID_LENGTH];
+};
+
+struct credit_shm
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t generation;
+	uint32_t classes;
+	uint32_t starved;         /* Incremented by the forwarding plane after setting a starved bit */
+
+	/* From the modem's Credit Window Initialization, 0 if the class is not flow controlled */
+	uint64_t window[CREDIT_CLASSES];
+
+	struct credit_shm_entry entries[CREDIT_SHM_SLOTS];
+};
+
+/* Called by credit_poll() for each destination with starved classes */
+typedef void (*credit_starved_callback)(void* context, const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len, uint32_t classes);
+
+/* Publish to the shared memory object name, e.g. "/dlep_credit" */
+int credit_open(const char* name);
+
+/* Stop publishing and unlink the object, registered with atexit() */
+void credit_close(void);
+
+/* Returns 1 if credits are being published */
+int credit_enabled(void);
+
+/* Forget every destination and window, at the end of a session */
+void credit_reset(void);
+
+/* Publish the window of traffic class cls, 0 stops flow controlling it */
+void credit_window(unsigned int cls, uint64_t window);
+
+/* Add credits octets to class cls of destination mac on link link_id, returns
+ * the new balance */
+int64_t credit_grant(const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len, unsigned int cls, uint64_t credits);
+
+/* Take away every credit of destination mac and free its entry, when it goes down */
+void credit_revoke(const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len);
+
+/* Call callback for every destination the forwarding plane has marked as
+ * starved since the last call, clearing the marks */
+void credit_poll(credit_starved_callback callback, void* context);
+
+#endif /* DLEP_CREDIT_H_ */
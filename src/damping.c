@@ -0,0 +1,78 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./damping.h"
+
+#include <math.h>
+
+void damping_params_init(struct damping_params* params)
+{
+	params->penalty = 1000;
+	params->suppress = 2000;
+	params->reuse = 750;
+	params->half_life = 15;
+	params->max_suppress = 60;
+}
+
+void damping_state_init(struct damping_state* state, const struct timespec* now)
+{
+	state->penalty = 0.0;
+	state->updated = *now;
+	state->suppressed = 0;
+}
+
+double damping_decay(const struct damping_params* params, struct damping_state* state, const struct timespec* now)
+{
+	if (state->penalty > 0.0 && params->half_life)
+	{
+		unsigned long elapsed = interval_ms(&state->updated,now);
+
+		state->penalty *= pow(0.5,(double)elapsed / (params->half_life * 1000.0));
+		if (state->penalty < 1.0)
+			state->penalty = 0.0;
+	}
+
+	state->updated = *now;
+	return state->penalty;
+}
+
+int damping_flap(const struct damping_params* params, struct damping_state* state, const struct timespec* now)
+{
+	double ceiling;
+
+	if (!params->half_life)
+		return 0;
+
+	damping_decay(params,state,now);
+
+	state->penalty += params->penalty;
+
+	/* Never let the penalty climb so high that it takes longer than
+	 * max_suppress seconds to decay back to the reuse threshold */
+	ceiling = params->reuse * pow(2.0,(double)params->max_suppress / params->half_life);
+	if (state->penalty > ceiling)
+		state->penalty = ceiling;
+
+	if (state->penalty >= params->suppress)
+		state->suppressed = 1;
+
+	return state->suppressed;
+}
+
+int damping_reuse(const struct damping_params* params, struct damping_state* state, const struct timespec* now)
+{
+	if (state->suppressed && damping_decay(params,state,now) < params->reuse)
+	{
+		state->suppressed = 0;
+		return 1;
+	}
+	return 0;
+}
+
+int damping_forgotten(const struct damping_params* params, struct damping_state* state, const struct timespec* now)
+{
+	return (!state->suppressed && damping_decay(params,state,now) < params->reuse / 2);
+}
@@ -0,0 +1,51 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Route flap damping, in the style of RFC 2439, applied to destinations
+ * that repeatedly go up and down
+ */
+
+#ifndef DLEP_DAMPING_H_
+#define DLEP_DAMPING_H_
+
+#include "./util.h"
+
+struct damping_params
+{
+	unsigned int penalty;     /* Penalty added for every Destination Down */
+	unsigned int suppress;    /* Penalty above which a destination is suppressed */
+	unsigned int reuse;       /* Penalty below which a suppressed destination is reused */
+	unsigned int half_life;   /* Time in seconds for the penalty to halve, 0 disables damping */
+	unsigned int max_suppress;/* Maximum time in seconds a destination can be suppressed */
+};
+
+struct damping_state
+{
+	double penalty;
+	struct timespec updated;  /* When the penalty was last decayed */
+	int suppressed;
+};
+
+/* Fill in the default parameters */
+void damping_params_init(struct damping_params* params);
+
+/* Reset the state of a new destination */
+void damping_state_init(struct damping_state* state, const struct timespec* now);
+
+/* Decay the penalty up to now, returns the current penalty */
+double damping_decay(const struct damping_params* params, struct damping_state* state, const struct timespec* now);
+
+/* Record a flap, returns 1 if the destination is now suppressed */
+int damping_flap(const struct damping_params* params, struct damping_state* state, const struct timespec* now);
+
+/* Check a suppressed destination, returns 1 if it can now be reused */
+int damping_reuse(const struct damping_params* params, struct damping_state* state, const struct timespec* now);
+
+/* Returns 1 if the flap history has decayed away completely */
+int damping_forgotten(const struct damping_params* params, struct damping_state* state, const struct timespec* now);
+
+#endif /* DLEP_DAMPING_H_ */
@@ -0,0 +1,922 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./destination.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "./dlep_iana.h"
+#include "./log.h"
+#include "./binlog.h"
+
+/* The initial number of slots in the table, must be a power of 2 */
+#define DESTINATION_TABLE_MIN 64
+
+/* How often destination_table_tick() does its maintenance, in milliseconds */
+#define TICK_INTERVAL 1000
+
+static const struct link_id s_no_link = { 0 };
+
+static size_t hash_key(const uint8_t* mac, const struct link_id* link)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261UL;
+	unsigned int i;
+	for (i = 0; i < 6; ++i)
+	{
+		h ^= mac[i];
+		h *= 16777619UL;
+	}
+	for (i = 0; i < link->len; ++i)
+	{
+		h ^= link->id[i];
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+static struct destination* lookup(struct destination_table* table, const uint8_t* mac, const struct link_id* link)
+{
+	size_t mask = table->capacity - 1;
+	size_t i = hash_key(mac,link) & mask;
+
+	/* Linear probing, the table is never full */
+	while (table->entries[i].in_use)
+	{
+		if (memcmp(table->entries[i].mac,mac,6) == 0 &&
+				table->entries[i].link.len == link->len &&
+				memcmp(table->entries[i].link.id,link->id,link->len) == 0)
+		{
+			break;
+		}
+
+		i = (i + 1) & mask;
+	}
+	return &table->entries[i];
+}
+
+static void print_destination(const struct destination* d)
+{
+	unsigned int i;
+
+	LOG_INFO(("%02X:%02X:%02X:%02X:%02X:%02X",d->mac[0],d->mac[1],d->mac[2],d->mac[3],d->mac[4],d->mac[5]));
+	if (d->link.len)
+	{
+		LOG_INFO((" link "));
+		for (i = 0; i < d->link.len; ++i)
+			LOG_INFO(("%02X",d->link.id[i]));
+	}
+}
+
+static int grow(struct destination_table* table)
+{
+	size_t i;
+	size_t old_capacity = table->capacity;
+	struct destination* old_entries = table->entries;
+	size_t new_capacity = (old_capacity ? old_capacity * 2 : DESTINATION_TABLE_MIN);
+
+	struct destination* new_entries = calloc(new_capacity,sizeof(struct destination));
+	if (!new_entries)
+	{
+		LOG_ERROR(("Failed to allocate destination table\n"));
+		return 0;
+	}
+
+	table->entries = new_entries;
+	table->capacity = new_capacity;
+
+	/* Rehash the existing entries */
+	for (i = 0; i < old_capacity; ++i)
+	{
+		if (old_entries[i].in_use)
+			*lookup(table,old_entries[i].mac,&old_entries[i].link) = old_entries[i];
+	}
+
+	free(old_entries);
+	return 1;
+}
+
+static void remove_entry(struct destination_table* table, struct destination* d)
+{
+	/* Backward shift deletion, so we never need tombstones */
+	size_t mask = table->capacity - 1;
+	size_t i = d - table->entries;
+	size_t j = i;
+
+	for (;;)
+	{
+		size_t k;
+
+		table->entries[i].in_use = 0;
+
+		for (;;)
+		{
+			j = (j + 1) & mask;
+			if (!table->entries[j].in_use)
+			{
+				--table->count;
+				return;
+			}
+
+			/* Can the entry at j move to the hole at i? */
+			k = hash_key(table->entries[j].mac,&table->entries[j].link) & mask;
+			if (i <= j ? (i >= k || k > j) : (i >= k && k > j))
+				break;
+		}
+
+		table->entries[i] = table->entries[j];
+		i = j;
+	}
+}
+
+static void print_cost(const struct destination_table* table, const struct destination* d, uint32_t cost)
+{
+	LOG_INFO(("  Publishing %s cost %u for destination ",table->cost_params.name,cost));
+	print_destination(d);
+	LOG_INFO(("\n"));
+	binlog_event(BINLOG_PUBLISH_COST,0,d->mac,&d->link,NULL,0,cost);
+}
+
+static void publish_cost(struct destination_table* table, struct destination* d, const struct timespec* now)
+{
+	uint32_t cost;
+	if (cost_update(&table->cost_params,&d->cost,&d->metrics,now,&cost))
+		print_cost(table,d,cost);
+	else if (d->cost.held)
+	{
+		/* Held down, destination_table_tick() publishes it once the hold-down ends */
+		table->ticking = 1;
+	}
+}
+
+static void print_fields(const struct destination* d, unsigned int fields)
+{
+	if (fields & DEST_FIELD_MDRR)
+		LOG_INFO((" MDRR: %"PRIu64"bps",d->metrics.mdrr));
+	if (fields & DEST_FIELD_MDRT)
+		LOG_INFO((" MDRT: %"PRIu64"bps",d->metrics.mdrt));
+	if (fields & DEST_FIELD_CDRR)
+		LOG_INFO((" CDRR: %"PRIu64"bps",d->metrics.cdrr));
+	if (fields & DEST_FIELD_CDRT)
+		LOG_INFO((" CDRT: %"PRIu64"bps",d->metrics.cdrt));
+	if (fields & DEST_FIELD_LATENCY)
+		LOG_INFO((" Latency: %"PRIu64"\x03\xBCs",d->metrics.latency));
+	if (fields & DEST_FIELD_RESOURCES)
+		LOG_INFO((" Resources: %u%%",d->metrics.resources));
+	if (fields & DEST_FIELD_RLQR)
+		LOG_INFO((" RLQR: %u",d->metrics.rlqr));
+	if (fields & DEST_FIELD_RLQT)
+		LOG_INFO((" RLQT: %u",d->metrics.rlqt));
+	if (fields & DEST_FIELD_MTU)
+		LOG_INFO((" MTU: %u",d->metrics.mtu));
+	if (fields & DEST_FIELD_LATENCY_RANGE)
+		LOG_INFO((" Latency Range: %"PRIu64"-%"PRIu64"\x03\xBCs",d->metrics.latency_min,d->metrics.latency_max));
+}
+
+static void publish_fields(const struct destination* d, unsigned int fields)
+{
+	LOG_INFO(("  Publishing destination "));
+	print_destination(d);
+	print_fields(d,fields);
+	LOG_INFO(("\n"));
+
+	binlog_event(BINLOG_PUBLISH_FIELDS,0,d->mac,&d->link,&d->metrics,fields,0);
+}
+
+static void mark_clean(struct destination_table* table, struct destination* d, const struct timespec* now)
+{
+	if (d->dirty)
+	{
+		d->dirty = 0;
+		--table->dirty_count;
+	}
+	d->flushed = *now;
+}
+
+static void mark_dirty(struct destination_table* table, struct destination* d, unsigned int fields)
+{
+	if (fields && !d->dirty)
+		++table->dirty_count;
+	d->dirty |= fields;
+}
+
+static void publish_up(struct destination_table* table, struct destination* d, const struct timespec* now)
+{
+	LOG_INFO(("  Publishing destination "));
+	print_destination(d);
+	LOG_INFO((" up\n"));
+	binlog_event(BINLOG_PUBLISH_UP,0,d->mac,&d->link,NULL,0,0);
+	d->published = 1;
+
+	/* Publish the complete state */
+	publish_fields(d,d->metrics.present);
+	mark_clean(table,d,now);
+
+	cost_state_init(&d->cost);
+	publish_cost(table,d,now);
+}
+
+static void publish_down(struct destination_table* table, struct destination* d)
+{
+	LOG_INFO(("  Publishing destination "));
+	print_destination(d);
+	LOG_INFO((" down\n"));
+	binlog_event(BINLOG_PUBLISH_DOWN,0,d->mac,&d->link,NULL,0,0);
+	d->published = 0;
+
+	/* Pending changes are of no interest any more */
+	if (d->dirty)
+	{
+		d->dirty = 0;
+		--table->dirty_count;
+	}
+}
+
+static void set_paused(struct destination* d, const uint8_t* queues, size_t count, int pause)
+{
+	size_t i;
+	unsigned int w;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (queues[i] == DLEP_ALL_QUEUES)
+		{
+			for (w = 0; w < PAUSE_QUEUE_WORDS; ++w)
+				d->paused[w] = (pause ? 0xFFFFFFFFUL : 0);
+		}
+		else if (pause)
+			d->paused[queues[i] / 32] |= (uint32_t)1 << (queues[i] % 32);
+		else
+			d->paused[queues[i] / 32] &= ~((uint32_t)1 << (queues[i] % 32));
+	}
+
+	d->any_paused = 0;
+	for (w = 0; w < PAUSE_QUEUE_WORDS; ++w)
+	{
+		if (d->paused[w])
+			d->any_paused = 1;
+	}
+
+	pause_publish(d->mac,d->link.id,d->link.len,d->paused);
+}
+
+static void unpause(struct destination* d)
+{
+	/* The modem's pauses do not outlive the destination, or the session */
+	if (d->any_paused)
+	{
+		memset(d->paused,0,sizeof(d->paused));
+		d->any_paused = 0;
+		pause_publish(d->mac,d->link.id,d->link.len,d->paused);
+	}
+}
+
+static void revoke_credits(struct destination* d)
+{
+	unsigned int i;
+
+	/* Credit is only good for the life of the destination */
+	d->credit_requested = 0;
+	for (i = 0; i < CREDIT_CLASSES; ++i)
+	{
+		if (d->credit_granted[i])
+		{
+			memset(d->credit_granted,0,sizeof(d->credit_granted));
+			credit_revoke(d->mac,d->link.id,d->link.len);
+			break;
+		}
+	}
+}
+
+void destination_table_init(struct destination_table* table)
+{
+	memset(table,0,sizeof(*table));
+	cost_params_init(&table->cost_params);
+	damping_params_init(&table->damping_params);
+	table->publish_rate = 10;
+}
+
+void destination_table_free(struct destination_table* table)
+{
+	free(table->entries);
+	table->entries = NULL;
+	table->capacity = 0;
+	table->count = 0;
+}
+
+struct destination* destination_find(struct destination_table* table, const uint8_t* mac, const struct link_id* link)
+{
+	struct destination* d;
+
+	if (!table->count)
+		return NULL;
+
+	d = lookup(table,mac,link ? link : &s_no_link);
+	return (d->in_use && d->up ? d : NULL);
+}
+
+int destination_decode_metric(struct destination_metrics* metrics, unsigned int item_id, const uint8_t* data_item)
+{
+	switch (item_id)
+	{
+	case DLEP_MDRR_DATA_ITEM:
+		metrics->mdrr = read_uint64(data_item);
+		metrics->present |= DEST_FIELD_MDRR;
+		break;
+
+	case DLEP_MDRT_DATA_ITEM:
+		metrics->mdrt = read_uint64(data_item);
+		metrics->present |= DEST_FIELD_MDRT;
+		break;
+
+	case DLEP_CDRR_DATA_ITEM:
+		metrics->cdrr = read_uint64(data_item);
+		metrics->present |= DEST_FIELD_CDRR;
+		break;
+
+	case DLEP_CDRT_DATA_ITEM:
+		metrics->cdrt = read_uint64(data_item);
+		metrics->present |= DEST_FIELD_CDRT;
+		break;
+
+	case DLEP_LATENCY_DATA_ITEM:
+		metrics->latency = read_uint64(data_item);
+		metrics->present |= DEST_FIELD_LATENCY;
+		break;
+
+	case DLEP_RESOURCES_DATA_ITEM:
+		metrics->resources = data_item[0];
+		metrics->present |= DEST_FIELD_RESOURCES;
+		break;
+
+	case DLEP_RLQR_DATA_ITEM:
+		metrics->rlqr = data_item[0];
+		metrics->present |= DEST_FIELD_RLQR;
+		break;
+
+	case DLEP_RLQT_DATA_ITEM:
+		metrics->rlqt = data_item[0];
+		metrics->present |= DEST_FIELD_RLQT;
+		break;
+
+	case DLEP_MTU_DATA_ITEM:
+		metrics->mtu = read_uint16(data_item);
+		metrics->present |= DEST_FIELD_MTU;
+		break;
+
+	case DLEP_LATENCY_RANGE_DATA_ITEM:
+		/* The maximum comes first */
+		metrics->latency_max = read_uint64(data_item);
+		metrics->latency_min = read_uint64(data_item + 8);
+		metrics->present |= DEST_FIELD_LATENCY_RANGE;
+		break;
+
+	default:
+		return 0;
+	}
+	return 1;
+}
+
+unsigned int destination_merge_metrics(struct destination_metrics* metrics, const struct destination_metrics* update)
+{
+	unsigned int changed = update->present & ~metrics->present;
+
+	if ((update->present & DEST_FIELD_MDRR) && metrics->mdrr != update->mdrr)
+	{
+		metrics->mdrr = update->mdrr;
+		changed |= DEST_FIELD_MDRR;
+	}
+	if ((update->present & DEST_FIELD_MDRT) && metrics->mdrt != update->mdrt)
+	{
+		metrics->mdrt = update->mdrt;
+		changed |= DEST_FIELD_MDRT;
+	}
+	if ((update->present & DEST_FIELD_CDRR) && metrics->cdrr != update->cdrr)
+	{
+		metrics->cdrr = update->cdrr;
+		changed |= DEST_FIELD_CDRR;
+	}
+	if ((update->present & DEST_FIELD_CDRT) && metrics->cdrt != update->cdrt)
+	{
+		metrics->cdrt = update->cdrt;
+		changed |= DEST_FIELD_CDRT;
+	}
+	if ((update->present & DEST_FIELD_LATENCY) && metrics->latency != update->latency)
+	{
+		metrics->latency = update->latency;
+		changed |= DEST_FIELD_LATENCY;
+	}
+	if ((update->present & DEST_FIELD_RESOURCES) && metrics->resources != update->resources)
+	{
+		metrics->resources = update->resources;
+		changed |= DEST_FIELD_RESOURCES;
+	}
+	if ((update->present & DEST_FIELD_RLQR) && metrics->rlqr != update->rlqr)
+	{
+		metrics->rlqr = update->rlqr;
+		changed |= DEST_FIELD_RLQR;
+	}
+	if ((update->present & DEST_FIELD_RLQT) && metrics->rlqt != update->rlqt)
+	{
+		metrics->rlqt = update->rlqt;
+		changed |= DEST_FIELD_RLQT;
+	}
+	if ((update->present & DEST_FIELD_MTU) && metrics->mtu != update->mtu)
+	{
+		metrics->mtu = update->mtu;
+		changed |= DEST_FIELD_MTU;
+	}
+	if ((update->present & DEST_FIELD_LATENCY_RANGE) && (metrics->latency_min != update->latency_min || metrics->latency_max != update->latency_max))
+	{
+		metrics->latency_min = update->latency_min;
+		metrics->latency_max = update->latency_max;
+		changed |= DEST_FIELD_LATENCY_RANGE;
+	}
+
+	metrics->present |= update->present;
+	return changed;
+}
+
+struct destination* destination_up(struct destination_table* table, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* metrics)
+{
+	struct timespec now;
+	struct destination* d;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+
+	/* Keep the load factor below 50% */
+	if ((table->count + 1) * 2 > table->capacity && !grow(table))
+		return NULL;
+
+	if (!link)
+		link = &s_no_link;
+
+	d = lookup(table,mac,link);
+	if (!d->in_use)
+	{
+		memset(d,0,sizeof(*d));
+		memcpy(d->mac,mac,6);
+		d->link = *link;
+		d->in_use = 1;
+		damping_state_init(&d->damping,&now);
+		++table->count;
+	}
+	else if (d->stale)
+	{
+		struct destination_metrics fresh = table->defaults;
+		unsigned int changed;
+
+		/* Re-announced after a session restart, so nothing needs to be
+		 * withdrawn, just publish whatever has changed */
+		d->stale = 0;
+		destination_merge_metrics(&fresh,metrics);
+		changed = destination_merge_metrics(&d->metrics,&fresh);
+
+		if (d->published)
+		{
+			publish_cost(table,d,&now);
+			mark_dirty(table,d,changed);
+		}
+		return d;
+	}
+	else if (d->up)
+	{
+		LOG_WARN(("  Destination Up for already known destination, replacing\n"));
+		revoke_credits(d);
+	}
+
+	d->up = 1;
+
+	/* Metrics not reported for the destination take the session defaults */
+	d->metrics = table->defaults;
+	destination_merge_metrics(&d->metrics,metrics);
+
+	/* Everything is published in one go once the initial burst has settled */
+	if (table->syncing)
+		return d;
+
+	if (d->damping.suppressed && !damping_reuse(&table->damping_params,&d->damping,&now))
+	{
+		LOG_INFO(("  Destination is flapping, suppressed (penalty %.0f)\n",d->damping.penalty));
+		return d;
+	}
+
+	if (!d->published)
+		publish_up(table,d,&now);
+	else
+	{
+		cost_state_init(&d->cost);
+		publish_cost(table,d,&now);
+
+		/* Republish the complete state */
+		mark_dirty(table,d,d->metrics.present);
+	}
+
+	return d;
+}
+
+struct destination* destination_update(struct destination_table* table, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* metrics)
+{
+	struct timespec now;
+	unsigned int changed;
+	struct destination* d = destination_find(table,mac,link);
+	if (!d)
+		return NULL;
+
+	changed = destination_merge_metrics(&d->metrics,metrics);
+
+	/* Suppressed destinations are not published, so neither are their costs */
+	if (metrics->present && d->published)
+	{
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		publish_cost(table,d,&now);
+
+		/* The changed fields are flushed later, at a bounded rate */
+		mark_dirty(table,d,changed);
+		if (!table->publish_rate)
+			destination_table_flush(table,&now);
+	}
+
+	return d;
+}
+
+int destination_pause(struct destination_table* table, const uint8_t* mac, const struct link_id* link, const uint8_t* queues, size_t count, int pause)
+{
+	size_t i;
+	struct destination* d;
+
+	if (mac)
+	{
+		d = destination_find(table,mac,link);
+		if (!d)
+			return 0;
+
+		set_paused(d,queues,count,pause);
+		return 1;
+	}
+
+	for (i = 0; i < table->capacity; ++i)
+	{
+		d = &table->entries[i];
+		if (d->in_use && d->up)
+			set_paused(d,queues,count,pause);
+	}
+	return 1;
+}
+
+void destination_credit_window(struct destination_table* table, unsigned int cls, uint64_t window)
+{
+	if (cls >= CREDIT_CLASSES)
+	{
+		LOG_WARN(("  Credit window for traffic class %u, we only track %u, ignoring\n",cls,CREDIT_CLASSES));
+		return;
+	}
+
+	table->credit_window[cls] = window;
+	credit_window(cls,window);
+}
+
+int destination_credit_grant(struct destination_table* table, const uint8_t* mac, const struct link_id* link, unsigned int cls, uint64_t credits)
+{
+	int64_t balance;
+	struct destination* d = destination_find(table,mac,link);
+	if (!d)
+		return 0;
+
+	if (cls >= CREDIT_CLASSES)
+	{
+		LOG_WARN(("  Credit grant for traffic class %u, we only track %u, ignoring\n",cls,CREDIT_CLASSES));
+		return 1;
+	}
+
+	d->credit_granted[cls] += credits;
+	d->credit_requested &= ~((uint32_t)1 << cls);
+
+	balance = credit_grant(d->mac,d->link.id,d->link.len,cls,credits);
+	if (table->credit_window[cls] && balance > 0 && (uint64_t)balance > table->credit_window[cls])
+		LOG_WARN(("  Credit of traffic class %u is %"PRId64", beyond the window of %"PRIu64"\n",cls,balance,table->credit_window[cls]));
+
+	return 1;
+}
+
+uint32_t destination_credit_request(struct destination_table* table, const uint8_t* mac, const struct link_id* link, uint32_t classes)
+{
+	struct timespec now;
+	unsigned int i;
+	struct destination* d = destination_find(table,mac,link);
+	if (!d)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+
+	/* Forget requests the modem has not answered */
+	if (d->credit_requested && interval_ms(&d->credit_request_time,&now) >= CREDIT_REQUEST_TIMEOUT)
+		d->credit_requested = 0;
+
+	for (i = 0; i < CREDIT_CLASSES; ++i)
+	{
+		if (!table->credit_window[i])
+			classes &= ~((uint32_t)1 << i);
+	}
+	classes &= ~d->credit_requested;
+
+	if (classes)
+	{
+		d->credit_requested |= classes;
+		d->credit_request_time = now;
+	}
+	return classes;
+}
+
+int destination_down(struct destination_table* table, const uint8_t* mac, const struct link_id* link)
+{
+	struct timespec now;
+	struct destination* d = destination_find(table,mac,link);
+	if (!d)
+		return 0;
+
+	d->up = 0;
+	d->stale = 0;
+	unpause(d);
+	revoke_credits(d);
+
+	/* Withdrawals are always published immediately */
+	if (d->published)
+		publish_down(table,d);
+
+	/* Its flap history is now waiting on destination_table_tick() */
+	table->ticking = 1;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	if (damping_flap(&table->damping_params,&d->damping,&now))
+		LOG_INFO(("  Destination is flapping, suppressing (penalty %.0f)\n",d->damping.penalty));
+	else if (!d->damping.penalty)
+	{
+		/* No flap history worth keeping */
+		remove_entry(table,d);
+	}
+
+	return 1;
+}
+
+void destination_clear(struct destination_table* table)
+{
+	size_t i;
+	for (i = 0; i < table->capacity; ++i)
+	{
+		if (table->entries[i].in_use)
+		{
+			unpause(&table->entries[i]);
+			revoke_credits(&table->entries[i]);
+		}
+
+		if (table->entries[i].in_use && table->entries[i].published)
+			publish_down(table,&table->entries[i]);
+	}
+
+	if (table->entries)
+		memset(table->entries,0,table->capacity * sizeof(struct destination));
+
+	table->count = 0;
+	table->dirty_count = 0;
+	table->syncing = 0;
+	table->retaining = 0;
+	memset(&table->defaults,0,sizeof(table->defaults));
+	memset(table->credit_window,0,sizeof(table->credit_window));
+}
+
+int destination_table_retain(struct destination_table* table, const struct timespec* now)
+{
+	size_t i;
+	size_t count = 0;
+
+	if (!table->grace_period)
+		return 0;
+
+	/* Including any announced by a reconnection that failed before it settled */
+	for (i = 0; i < table->capacity; ++i)
+	{
+		struct destination* d = &table->entries[i];
+		if (d->in_use && d->up)
+		{
+			d->stale = 1;
+			unpause(d);
+			revoke_credits(d);
+			++count;
+		}
+	}
+
+	/* A failed reconnection does not extend the grace period */
+	if (!table->retaining && count)
+	{
+		LOG_INFO(("Retaining %lu destinations for %u seconds in case the modem returns\n",(unsigned long)count,table->grace_period));
+
+		table->retaining = 1;
+		table->retained_time = *now;
+	}
+
+	table->ticking = 1;
+	table->syncing = 0;
+
+	/* The next session will report the defaults again */
+	memset(&table->defaults,0,sizeof(table->defaults));
+	memset(table->credit_window,0,sizeof(table->credit_window));
+
+	destination_table_expire(table,now);
+	return 1;
+}
+
+void destination_table_expire(struct destination_table* table, const struct timespec* now)
+{
+	if (table->retaining && interval_ms(&table->retained_time,now) >= table->grace_period * 1000UL)
+	{
+		LOG_INFO(("Session restart grace period expired\n"));
+		destination_table_sweep(table);
+	}
+}
+
+void destination_table_sweep(struct destination_table* table)
+{
+	size_t i = 0;
+	size_t count = 0;
+
+	table->retaining = 0;
+
+	while (i < table->capacity)
+	{
+		struct destination* d = &table->entries[i];
+		if (d->in_use && d->stale)
+		{
+			if (d->published)
+				publish_down(table,d);
+
+			/* Removal may shift another entry into this slot, so check it again */
+			remove_entry(table,d);
+			++count;
+			continue;
+		}
+		++i;
+	}
+
+	if (count)
+		LOG_INFO(("Withdrew %lu destinations not re-announced by the modem\n",(unsigned long)count));
+}
+
+void destination_table_sync_begin(struct destination_table* table)
+{
+	struct timespec now;
+
+	table->syncing = 1;
+
+	/* If we have been away too long, forget the previous session */
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	destination_table_expire(table,&now);
+}
+
+void destination_table_sync_end(struct destination_table* table, const struct timespec* now)
+{
+	size_t i;
+	size_t count = 0;
+
+	table->syncing = 0;
+
+	/* The modem has re-announced everything it knows about */
+	if (table->retaining)
+		destination_table_sweep(table);
+
+	for (i = 0; i < table->capacity; ++i)
+	{
+		struct destination* d = &table->entries[i];
+		if (d->in_use && d->up && !d->published && !d->damping.suppressed)
+			++count;
+	}
+
+	LOG_INFO(("Publishing snapshot of %lu destinations\n",(unsigned long)count));
+
+	for (i = 0; i < table->capacity; ++i)
+	{
+		struct destination* d = &table->entries[i];
+		if (d->in_use && d->up && !d->published && !d->damping.suppressed)
+		{
+			uint32_t cost = 0;
+
+			d->published = 1;
+			mark_clean(table,d,now);
+
+			cost_state_init(&d->cost);
+			cost_update(&table->cost_params,&d->cost,&d->metrics,now,&cost);
+
+			LOG_INFO(("  "));
+			print_destination(d);
+			LOG_INFO((" %s cost %u",table->cost_params.name,cost));
+			print_fields(d,d->metrics.present);
+			LOG_INFO(("\n"));
+
+			binlog_event(BINLOG_PUBLISH_UP,0,d->mac,&d->link,NULL,0,0);
+			binlog_event(BINLOG_PUBLISH_FIELDS,0,d->mac,&d->link,&d->metrics,d->metrics.present,0);
+			binlog_event(BINLOG_PUBLISH_COST,0,d->mac,&d->link,NULL,0,cost);
+		}
+	}
+}
+
+unsigned long destination_table_flush(struct destination_table* table, const struct timespec* now)
+{
+	size_t i;
+	unsigned long period = (table->publish_rate ? 1000 / table->publish_rate : 0);
+	unsigned long next = 0;
+
+	if (!table->dirty_count)
+		return 0;
+
+	/* Don't bother scanning the table more often than a destination can be flushed */
+	if (period && interval_ms(&table->last_flush,now) < period)
+		return period - interval_ms(&table->last_flush,now);
+
+	table->last_flush = *now;
+
+	for (i = 0; i < table->capacity && table->dirty_count; ++i)
+	{
+		struct destination* d = &table->entries[i];
+		if (d->in_use && d->dirty)
+		{
+			unsigned long since = interval_ms(&d->flushed,now);
+			if (since >= period)
+			{
+				publish_fields(d,d->dirty);
+				mark_clean(table,d,now);
+			}
+			else if (!next || period - since < next)
+				next = period - since;
+		}
+	}
+
+	return (table->dirty_count ? (next ? next : period) : 0);
+}
+
+unsigned long destination_table_tick(struct destination_table* table, const struct timespec* now)
+{
+	size_t i = 0;
+
+	/* Once a second is plenty */
+	unsigned long since = interval_ms(&table->last_tick,now);
+	if (since < TICK_INTERVAL)
+		return (table->ticking ? TICK_INTERVAL - since : 0);
+
+	table->last_tick = *now;
+
+	/* Only keep ticking while something is retained, suppressed or remembered */
+	table->ticking = table->retaining;
+
+	/* Without bulk sync there is no way to tell when the modem has finished
+	 * re-announcing, so wait for the whole grace period */
+	if (!table->syncing)
+		destination_table_expire(table,now);
+
+	while (i < table->capacity)
+	{
+		struct destination* d = &table->entries[i];
+		if (d->in_use)
+		{
+			if (!d->up)
+			{
+				/* A destination suppressed as it went down must be released
+				 * while it is down too, or it would never be forgotten */
+				damping_reuse(&table->damping_params,&d->damping,now);
+				if (damping_forgotten(&table->damping_params,&d->damping,now))
+				{
+					/* Removal may shift another entry into this slot, so check it again */
+					remove_entry(table,d);
+					continue;
+				}
+				table->ticking = 1;
+			}
+			else if (d->damping.suppressed && damping_reuse(&table->damping_params,&d->damping,now))
+			{
+				LOG_INFO(("Destination "));
+				print_destination(d);
+				LOG_INFO((" has stopped flapping\n"));
+				publish_up(table,d,now);
+			}
+			else if (d->damping.suppressed)
+				table->ticking = 1;
+			else if (d->published && d->cost.held)
+			{
+				/* A significant cost change that arrived during the hold-down */
+				uint32_t cost;
+				if (cost_release(&table->cost_params,&d->cost,now,&cost))
+					print_cost(table,d,cost);
+				else
+					table->ticking = 1;
+			}
+		}
+		++i;
+	}
+
+	return (table->ticking ? TICK_INTERVAL : 0);
+}
@@ -0,0 +1,192 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * The destination table holds the current state of every destination
+ * reported by the modem, keyed by MAC address and, where the modem exposes
+ * several links to the same neighbour, Link Identifier
+ */
+
+#ifndef DLEP_DESTINATION_H_
+#define DLEP_DESTINATION_H_
+
+#include "./util.h"
+#include "./dlep_iana.h"
+#include "./cost.h"
+#include "./damping.h"
+#include "./pause.h"
+#include "./credit.h"
+
+/* Bits identifying the individual metric fields */
+enum destination_field {
+	DEST_FIELD_MDRR       = 0x0001,
+	DEST_FIELD_MDRT       = 0x0002,
+	DEST_FIELD_CDRR       = 0x0004,
+	DEST_FIELD_CDRT       = 0x0008,
+	DEST_FIELD_LATENCY    = 0x0010,
+	DEST_FIELD_RESOURCES  = 0x0020,
+	DEST_FIELD_RLQR       = 0x0040,
+	DEST_FIELD_RLQT       = 0x0080,
+	DEST_FIELD_MTU        = 0x0100,
+	DEST_FIELD_LATENCY_RANGE = 0x0200
+};
+
+/* One of several links to the same neighbour, RFC 8703 */
+struct link_id
+{
+	uint8_t len;              /* 0 if the destination has no Link Identifier */
+	uint8_t id[MAX_LINK_ID_LENGTH];
+};
+
+/* The metrics of a destination, or the session defaults */
+struct destination_metrics
+{
+	unsigned int present;     /* Bitmask of enum destination_field */
+	uint64_t mdrr;            /* bps */
+	uint64_t mdrt;            /* bps */
+	uint64_t cdrr;            /* bps */
+	uint64_t cdrt;            /* bps */
+	uint64_t latency;         /* microseconds */
+	uint8_t resources;        /* percent */
+	uint8_t rlqr;             /* 0 to 100 */
+	uint8_t rlqt;             /* 0 to 100 */
+	uint16_t mtu;             /* octets */
+	uint64_t latency_min;     /* microseconds, the Latency Range of RFC 8757 */
+	uint64_t latency_max;     /* microseconds */
+};
+
+/* The IP addresses and attached subnets a destination announces are not kept,
+ * nothing in the router routes on them, they are only logged as they arrive */
+struct destination
+{
+	uint8_t mac[6];
+	struct link_id link;
+	int in_use;
+
+	int up;                   /* The modem reports the destination as up */
+	int published;            /* The destination has been published downstream */
+	int stale;                /* Retained from a previous session, not yet re-announced */
+
+	struct destination_metrics metrics;
+	unsigned int dirty;       /* Fields changed since the last flush, bitmask of enum destination_field */
+	struct timespec flushed;  /* When the fields were last flushed */
+	struct cost_state cost;
+
+	/* Queues paused by the modem, RFC 8651 */
+	uint32_t paused[PAUSE_QUEUE_WORDS];
+	int any_paused;
+
+	/* Credit windows granted by the modem, per traffic class */
+	uint64_t credit_granted[CREDIT_CLASSES];   /* Octets, this session */
+	uint32_t credit_requested;                 /* Bitmap of classes with a Credit Request outstanding */
+	struct timespec credit_request_time;
+
+	/* Kept after the destination goes down, until the flap history decays */
+	struct damping_state damping;
+};
+
+struct destination_table
+{
+	struct destination* entries;
+	size_t capacity;          /* Always a power of 2 */
+	size_t count;
+
+	/* The session default metrics, from the Session Initialization Response
+	 * and Session Update messages */
+	struct destination_metrics defaults;
+
+	struct cost_params cost_params;
+	struct damping_params damping_params;
+
+	/* From the modem's Credit Window Initialization, 0 if the class is not flow controlled */
+	uint64_t credit_window[CREDIT_CLASSES];
+
+	unsigned int publish_rate;/* Maximum flushes per second per destination, 0 is unlimited */
+	int syncing;              /* Destinations are not published until the initial burst has settled */
+
+	unsigned int grace_period;/* Seconds to retain destinations after a session ends, 0 disables */
+	int retaining;            /* Destinations from a previous session are being retained */
+	struct timespec retained_time;
+	size_t dirty_count;       /* Number of destinations with unflushed changes */
+
+	struct timespec last_tick;
+	int ticking;              /* Something is waiting on destination_table_tick() */
+	struct timespec last_flush;
+};
+
+/* Initialise an empty table */
+void destination_table_init(struct destination_table* table);
+
+/* Free the table entries */
+void destination_table_free(struct destination_table* table);
+
+/* Find a destination that is up, returns NULL if not known. Here and below,
+ * link is the destination's Link Identifier, or NULL if it has none */
+struct destination* destination_find(struct destination_table* table, const uint8_t* mac, const struct link_id* link);
+
+/* Decode a single metric data item into metrics, returns 0 if the item is not a metric */
+int destination_decode_metric(struct destination_metrics* metrics, unsigned int item_id, const uint8_t* data_item);
+
+/* Merge the fields present in update into metrics, returns the fields that changed */
+unsigned int destination_merge_metrics(struct destination_metrics* metrics, const struct destination_metrics* update);
+
+/* Handle a Destination Up, returns NULL on allocation failure */
+struct destination* destination_up(struct destination_table* table, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* metrics);
+
+/* Handle a Destination Update, returns NULL if the destination is not known */
+struct destination* destination_update(struct destination_table* table, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* metrics);
+
+/* Pause or restart the queues listed by a Pause or Restart data item for
+ * destination mac, or every destination if mac is NULL. Returns 0 if the
+ * destination is not known */
+int destination_pause(struct destination_table* table, const uint8_t* mac, const struct link_id* link, const uint8_t* queues, size_t count, int pause);
+
+/* Set the credit window of traffic class cls, for every destination */
+void destination_credit_window(struct destination_table* table, unsigned int cls, uint64_t window);
+
+/* Add credits octets to the window of class cls of a destination, returns 0
+ * if the destination is not known */
+int destination_credit_grant(struct destination_table* table, const uint8_t* mac, const struct link_id* link, unsigned int cls, uint64_t credits);
+
+/* The forwarding plane has run out of credit for classes, a bitmap, of a
+ * destination. Returns the classes that need a Credit Request: those that are
+ * flow controlled and have had no request outstanding for CREDIT_REQUEST_TIMEOUT */
+uint32_t destination_credit_request(struct destination_table* table, const uint8_t* mac, const struct link_id* link, uint32_t classes);
+
+/* Handle a Destination Down, returns 0 if the destination is not known */
+int destination_down(struct destination_table* table, const uint8_t* mac, const struct link_id* link);
+
+/* Remove every destination, at the end of a session */
+void destination_clear(struct destination_table* table);
+
+/* Retain the destinations at the end of a session, in case the modem comes back
+ * within the grace period, which starts at the first session to end since the
+ * modem last settled. Returns 0 if graceful restart is disabled */
+int destination_table_retain(struct destination_table* table, const struct timespec* now);
+
+/* Withdraw the retained destinations if the grace period has expired, this
+ * must also be called while there is no session */
+void destination_table_expire(struct destination_table* table, const struct timespec* now);
+
+/* Withdraw any retained destinations that have not been re-announced */
+void destination_table_sweep(struct destination_table* table);
+
+/* Hold back publication during the initial burst of Destination Up messages */
+void destination_table_sync_begin(struct destination_table* table);
+
+/* Publish a single snapshot of the destinations learnt during the initial burst */
+void destination_table_sync_end(struct destination_table* table, const struct timespec* now);
+
+/* Flush the changed fields of destinations that are due, returns the number
+ * of milliseconds until the next flush is due, or 0 if nothing is pending */
+unsigned long destination_table_flush(struct destination_table* table, const struct timespec* now);
+
+/* Perform periodic maintenance, reusing suppressed destinations, publishing
+ * cost changes held down and forgetting old flap history, returns the number
+ * of milliseconds until it is next due, or 0 if nothing is waiting on it */
+unsigned long destination_table_tick(struct destination_table* table, const struct timespec* now);
+
+#endif /* DLEP_DESTINATION_H_ */
@@ -17,58 +17,32 @@ Copyright (c) 2017 Airbus DS Limited
 
 #include "./dlep_iana.h"
 #include "./check.h"
+#include "./encode.h"
+#include "./log.h"
+#include "./capture.h"
+#include "./stats.h"
+#include "./probes.h"
+
+/* The pcapng capture interface of the current discovery, -1 if not capturing */
+static int s_capture_if = -1;
 
 static int send_peer_discovery_signal(int s, const struct sockaddr* address, socklen_t address_len)
 {
 	char str_address[FORMATADDRESS_LEN] = {0};
-	uint8_t msg[100];
-	uint8_t* p;
-	uint16_t msg_len = 0;
-	size_t peer_type_len = 0;
-	uint8_t flags = 0x00;
-
-	/* All DLEP signals start with the 4 characters 'DLEP' */
-	msg[0] = 'D';
-	msg[1] = 'L';
-	msg[2] = 'E';
-	msg[3] = 'P';
-
-	/* Octets 4 and 5 are the signal number */
-	p = write_uint16(DLEP_PEER_DISCOVERY,msg+4);
-
-	/* Octets 6 and 7 are the signal length, initialize to 0 */
-	p = write_uint16(0,p);
-
-	/* Write out Peer Type, with safety check! */
-	peer_type_len = strlen(PEER_TYPE);
-	if (peer_type_len > sizeof(msg) - 13)
-		peer_type_len = sizeof(msg) - 13;
-
-	p = write_uint16(DLEP_PEER_TYPE_DATA_ITEM,p);
-	p = write_uint16(1 + peer_type_len,p); /* includes length of the flag + description fields */
-
-	/* add flags field */
-	*p++ = flags;
-
-	if (peer_type_len)
-	{
-		memcpy(p,PEER_TYPE,peer_type_len);
-		p += peer_type_len;
-	}
-
-	msg_len = p - msg;
-
-	/* Octet 6 and 7 are the signal length, minus the length of the header */
-	write_uint16(msg_len - 8,msg + 6);
+	uint8_t msg[ENCODE_MAX_LEN];
+	uint16_t msg_len = encode_peer_discovery_signal(msg);
 
-	printf("Sending Peer Discovery signal to %s\n",formatAddress(address,str_address,sizeof(str_address)));
+	LOG_INFO(("Sending Peer Discovery signal to %s\n",formatAddress(address,str_address,sizeof(str_address))));
 
 	if (sendto(s,msg,msg_len,0,address,address_len) != msg_len)
 	{
-		printf("Failed to send Peer Discovery signal: %s\n",strerror(errno));
+		LOG_ERROR(("Failed to send Peer Discovery signal: %s\n",strerror(errno)));
 		return 0;
 	}
 
+	capture_packet(s_capture_if,NULL,CAPTURE_OUTBOUND,msg,msg_len);
+	STATS_INC(stats.discovery_attempts);
+
 	return 1;
 }
 
@@ -84,13 +58,13 @@ static ssize_t recv_peer_offer(int s, unsigned int secs, uint8_t msg[1500])
 	FD_ZERO(&readfds);
 	FD_SET(s,&readfds);
 
-	printf("Waiting for Peer Offer signal\n");
+	LOG_DEBUG(("Waiting for Peer Offer signal\n"));
 
 	/* Use select() to wait for secs seconds */
 	timeout.tv_sec = secs;
 	if (select(s+1,&readfds,NULL,NULL,&timeout) == -1)
 	{
-		printf("Failed to wait for peer discovery signal: %s\n",strerror(errno));
+		LOG_ERROR(("Failed to wait for peer discovery signal: %s\n",strerror(errno)));
 		return -1;
 	}
 	if (!FD_ISSET(s,&readfds))
@@ -100,16 +74,18 @@ static ssize_t recv_peer_offer(int s, unsigned int secs, uint8_t msg[1500])
 	received = recvfrom(s,msg,1500,0,(struct sockaddr*)&recv_address,&recv_address_len);
 	if (received == -1)
 	{
-		printf("Failed to receive from UDP socket: %s\n",strerror(errno));
+		LOG_ERROR(("Failed to receive from UDP socket: %s\n",strerror(errno)));
 		return -1;
 	}
 
-	printf("Received possible Peer Offer signal (%u bytes) from %s\n",(unsigned int)received,formatAddress((struct sockaddr*)&recv_address,str_address,sizeof(str_address)));
+	capture_packet(s_capture_if,NULL,CAPTURE_INBOUND,msg,received);
+
+	LOG_DEBUG(("Received possible Peer Offer signal (%u bytes) from %s\n",(unsigned int)received,formatAddress((struct sockaddr*)&recv_address,str_address,sizeof(str_address))));
 
 	return received;
 }
 
-static int get_peer_offer(int s, const struct sockaddr* dest_addr, socklen_t dest_addr_len, struct sockaddr_storage* modem_address, socklen_t* modem_address_length)
+static int get_peer_offer(int s, const struct sockaddr* dest_addr, socklen_t dest_addr_len, struct sockaddr_storage* modem_address, socklen_t* modem_address_length, void (*idle)(void*), void* param)
 {
 	uint8_t msg[1500];
 	ssize_t len = 0;
@@ -130,11 +106,21 @@ static int get_peer_offer(int s, const struct sockaddr* dest_addr, socklen_t des
 			return 0;
 
 		/* Validate the signal */
-		if (len && check_peer_offer_signal(msg,len))
-			len = 0;
+		if (len)
+		{
+			enum dlep_status_code sc = check_peer_offer_signal(msg,len);
+			DLEP_PROBE3(discovery__offer,msg,len,sc);
+			if (sc != DLEP_SC_SUCCESS)
+				len = 0;
+		}
+
+		/* Let the caller do what it must while we keep trying */
+		if (len == 0 && idle)
+			(*idle)(param);
 	}
 
-	printf("Valid Peer Offer signal from modem\n");
+	LOG_INFO(("Valid Peer Offer signal from modem\n"));
+	STATS_INC(stats.peer_offers);
 
 	/* The signal has been validated so just scan for the relevant data_items */
 	modem_address->ss_family = 0;
@@ -154,14 +140,14 @@ static int get_peer_offer(int s, const struct sockaddr* dest_addr, socklen_t des
 		switch (item_id)
 		{
 		case DLEP_PEER_TYPE_DATA_ITEM:
-			printf("  Peer Type: '%.*s'%s\n",(int)item_len-1,data_item + 1,data_item[0] ? " - Secured Medium" : "");
+			LOG_TRACE(("  Peer Type: '%.*s'%s\n",(int)item_len-1,data_item + 1,data_item[0] ? " - Secured Medium" : ""));
 			break;
 
 		case DLEP_IPV4_CONN_POINT_DATA_ITEM:
 			modem_address->ss_family = AF_INET;
 			memcpy(&((struct sockaddr_in*)modem_address)->sin_addr,data_item + 1,4);
 			*modem_address_length = sizeof(struct sockaddr_in);
-			printf("  IPv4 address: (TLS %s) %s\n",(data_item[0] ? "Required" : "optional"),inet_ntop(AF_INET,data_item + 1,peer_address,sizeof(peer_address)));
+			LOG_TRACE(("  IPv4 address: (TLS %s) %s\n",(data_item[0] ? "Required" : "optional"),inet_ntop(AF_INET,data_item + 1,peer_address,sizeof(peer_address))));
 			if (item_len == 7)
 				port = read_uint16(data_item + 5);
 			else
@@ -173,7 +159,7 @@ static int get_peer_offer(int s, const struct sockaddr* dest_addr, socklen_t des
 			modem_address->ss_family = AF_INET6;
 			memcpy(&((struct sockaddr_in6*)modem_address)->sin6_addr,data_item + 1,16);
 			*modem_address_length = sizeof(struct sockaddr_in6);
-			printf("  IPv6 address: (TLS %s) %s\n",(data_item[0] ? "Required" : "optional"),inet_ntop(AF_INET6,data_item + 1,peer_address,sizeof(peer_address)));
+			LOG_TRACE(("  IPv6 address: (TLS %s) %s\n",(data_item[0] ? "Required" : "optional"),inet_ntop(AF_INET6,data_item + 1,peer_address,sizeof(peer_address))));
 			if (item_len == 19)
 				port = read_uint16(data_item + 17);
 			else
@@ -193,14 +179,14 @@ static int get_peer_offer(int s, const struct sockaddr* dest_addr, socklen_t des
 	if (!modem_address->ss_family)
 	{
 		/* If we did not find an address with a compatible family, report */
-		printf("Failed to find an IP address in Peer Offer signal\n");
+		LOG_ERROR(("Failed to find an IP address in Peer Offer signal\n"));
 		return 0;
 	}
 
 	if (!port)
 	{
 		/* If we did not find a port, report */
-		printf("Failed to find an port in Peer Offer signal\n");
+		LOG_ERROR(("Failed to find an port in Peer Offer signal\n"));
 		return 0;
 	}
 
@@ -213,7 +199,7 @@ static int get_peer_offer(int s, const struct sockaddr* dest_addr, socklen_t des
 	return 1;
 }
 
-static int discover_ipv4(int s, struct sockaddr_storage* modem_address, socklen_t* modem_address_length)
+static int discover_ipv4(int s, struct sockaddr_storage* modem_address, socklen_t* modem_address_length, void (*idle)(void*), void* param)
 {
 	int ret = 0;
 
@@ -225,7 +211,7 @@ static int discover_ipv4(int s, struct sockaddr_storage* modem_address, socklen_
 
 	if (bind(s,(struct sockaddr*)&local_address,sizeof(local_address)) != 0)
 	{
-		printf("Failed to bind socket: %s\n",strerror(errno));
+		LOG_ERROR(("Failed to bind socket: %s\n",strerror(errno)));
 	}
 	else
 	{
@@ -234,7 +220,7 @@ static int discover_ipv4(int s, struct sockaddr_storage* modem_address, socklen_
 		int on = 1;
 		if (setsockopt(s,IPPROTO_IP,IP_MULTICAST_LOOP,&on,sizeof(on)) != 0)
 		{
-			printf("Failed to set multicast loopback option: %s\n",strerror(errno));
+			LOG_ERROR(("Failed to set multicast loopback option: %s\n",strerror(errno)));
 		}
 		else
 		{
@@ -244,7 +230,7 @@ static int discover_ipv4(int s, struct sockaddr_storage* modem_address, socklen_
 			inet_pton(AF_INET,DLEP_WELL_KNOWN_MULTICAST_ADDRESS,&discovery_address.sin_addr);
 
 			/* Do the discovery */
-			if (get_peer_offer(s,(struct sockaddr*)&discovery_address,sizeof(discovery_address),modem_address,modem_address_length))
+			if (get_peer_offer(s,(struct sockaddr*)&discovery_address,sizeof(discovery_address),modem_address,modem_address_length,idle,param))
 				ret = 1;
 		}
 	}
@@ -252,7 +238,7 @@ static int discover_ipv4(int s, struct sockaddr_storage* modem_address, socklen_
 	return ret;
 }
 
-static int discover_ipv6(int s, const char* iface, struct sockaddr_storage* modem_address, socklen_t* modem_address_length)
+static int discover_ipv6(int s, const char* iface, struct sockaddr_storage* modem_address, socklen_t* modem_address_length, void (*idle)(void*), void* param)
 {
 	int ret = 0;
 
@@ -264,7 +250,7 @@ static int discover_ipv6(int s, const char* iface, struct sockaddr_storage* mode
 
 	if (bind(s,(struct sockaddr*)&local_address,sizeof(local_address)) != 0)
 	{
-		printf("Failed to bind socket: %s\n",strerror(errno));
+		LOG_ERROR(("Failed to bind socket: %s\n",strerror(errno)));
 	}
 	else
 	{
@@ -273,7 +259,7 @@ static int discover_ipv6(int s, const char* iface, struct sockaddr_storage* mode
 		int on = 1;
 		if (setsockopt(s,IPPROTO_IPV6,IPV6_MULTICAST_LOOP,&on,sizeof(on)) != 0)
 		{
-			printf("Failed to set multicast loopback option: %s\n",strerror(errno));
+			LOG_ERROR(("Failed to set multicast loopback option: %s\n",strerror(errno)));
 		}
 		else
 		{
@@ -285,7 +271,7 @@ static int discover_ipv6(int s, const char* iface, struct sockaddr_storage* mode
 				discovery_address.sin6_scope_id = if_nametoindex(iface);
 
 			/* Do the discovery */
-			if (get_peer_offer(s,(struct sockaddr*)&discovery_address,sizeof(discovery_address),modem_address,modem_address_length))
+			if (get_peer_offer(s,(struct sockaddr*)&discovery_address,sizeof(discovery_address),modem_address,modem_address_length,idle,param))
 			{
 				((struct sockaddr_in6*)modem_address)->sin6_scope_id = discovery_address.sin6_scope_id;
 				ret = 1;
@@ -296,7 +282,7 @@ static int discover_ipv6(int s, const char* iface, struct sockaddr_storage* mode
 	return ret;
 }
 
-int discover(int use_ipv6, const char* iface, struct sockaddr_storage* modem_address, socklen_t* modem_address_length)
+int discover(int use_ipv6, const char* iface, struct sockaddr_storage* modem_address, socklen_t* modem_address_length, void (*idle)(void*), void* param)
 {
 	int ret = 0;
 
@@ -304,7 +290,7 @@ int discover(int use_ipv6, const char* iface, struct sockaddr_storage* modem_add
 	int s = socket(use_ipv6 ? AF_INET6 : AF_INET,SOCK_DGRAM,0);
 	if (s == -1)
 	{
-		printf("Failed to create socket: %s\n",strerror(errno));
+		LOG_ERROR(("Failed to create socket: %s\n",strerror(errno)));
 	}
 	else
 	{
@@ -314,20 +300,22 @@ int discover(int use_ipv6, const char* iface, struct sockaddr_storage* modem_add
 		{
 			/* Bind the socket to the specified interface */
 			if (geteuid() != 0)
-				printf("Not binding multicast discovery socket to interface %s as not root\n",iface);
+				LOG_WARN(("Not binding multicast discovery socket to interface %s as not root\n",iface));
 			else if (setsockopt(s,SOL_SOCKET,SO_BINDTODEVICE, iface, strlen(iface)+1) != 0)
 			{
-				printf("Failed to bind socket to interface %s: %s\n",iface,strerror(errno));
+				LOG_ERROR(("Failed to bind socket to interface %s: %s\n",iface,strerror(errno)));
 				ret = 0;
 			}
 		}
 
 		if (ret)
 		{
+			s_capture_if = capture_interface("discovery","DLEP peer discovery");
+
 			if (use_ipv6)
-				ret = discover_ipv6(s,iface,modem_address,modem_address_length);
+				ret = discover_ipv6(s,iface,modem_address,modem_address_length,idle,param);
 			else
-				ret = discover_ipv4(s,modem_address,modem_address_length);
+				ret = discover_ipv4(s,modem_address,modem_address_length,idle,param);
 		}
 
 		close(s);
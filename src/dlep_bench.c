@@ -0,0 +1,808 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Microbenchmarks of the codec primitives, the message validators and the
+ * message encoders, run by 'make bench'
+ */
+
+#include "./util.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "./dlep_iana.h"
+#include "./check.h"
+#include "./encode.h"
+#include "./session.h"
+#include "./destination.h"
+#include "./log.h"
+
+/* The largest message: a 4 octet header and a 65535 octet body */
+#define MAX_MESSAGE_LEN (4 + 65535)
+
+/* The largest signal we receive, the size of the discovery receive buffer */
+#define MAX_SIGNAL_LEN 1500
+
+/* Fill a message up to this length with the repeatable address data items */
+#define FILL_MAX ((size_t)-1)
+
+static void help()
+{
+    printf(
+	"dlep_bench - Microbenchmarks of the dlep_router message code\n"
+        "  Version 0.1.2\n"
+        "  Copyright (c) 2017 Airbus DS Limited\n\n"
+
+        "Usage: dlep_bench [options]\n");
+
+    printf(
+        "Options:\n"
+        "  -o or --output <F>    Write the results to F as JSON\n"
+        "  -r or --runs <N>      Time each benchmark N times (default is 101)\n"
+        "  -w or --warmup <MS>   Run each benchmark for MS milliseconds before timing it (default is 20)\n"
+        "  -t or --sample <US>   Make each timed run at least US microseconds long (default is 200)\n"
+        "  -f or --filter <S>    Only run the benchmarks with S in their name\n"
+        "  -h or --help          Show this text\n");
+}
+
+/* A benchmarked operation, called in a loop, the result keeps it from being optimized away */
+typedef unsigned long (*bench_op)(const void* arg);
+
+struct bench_result
+{
+	char name[64];
+	size_t bytes;             /* Message length, 0 for the primitives */
+	unsigned long iterations; /* Operations per timed run */
+	double median_ns;
+	double p99_ns;
+	double min_ns;
+};
+
+struct bench_params
+{
+	unsigned long runs;
+	unsigned long warmup_ms;
+	unsigned long sample_us;
+	const char* filter;
+};
+
+static volatile unsigned long s_sink;
+
+static uint8_t s_scratch[MAX_MESSAGE_LEN];
+
+/* A synthetic message, built by build up to target octets */
+struct fixture
+{
+	const char* name;
+	size_t (*build)(uint8_t* msg, size_t target);
+	size_t target;
+	enum dlep_status_code (*check)(const uint8_t* msg, size_t len);
+
+	uint8_t* msg;
+	size_t len;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint8_t* write_uint64(uint64_t v, uint8_t* p)
+{
+	p = write_uint32(v >> 32,p);
+	return write_uint32(v & 0xFFFFFFFF,p);
+}
+
+static uint8_t* write_uint64_item(uint8_t* p, uint16_t type, uint64_t v)
+{
+	p = write_data_item(p,type,8);
+	return write_uint64(v,p);
+}
+
+static uint8_t* write_uint8_item(uint8_t* p, uint16_t type, uint8_t v)
+{
+	p = write_data_item(p,type,1);
+	*p++ = v;
+	return p;
+}
+
+static uint8_t* write_mac(uint8_t* p)
+{
+	static const uint8_t mac[6] = { 0x02, 0x00, 0x5E, 0x10, 0x20, 0x30 };
+
+	p = write_data_item(p,DLEP_MAC_ADDRESS_DATA_ITEM,6);
+	memcpy(p,mac,6);
+	return p + 6;
+}
+
+static uint8_t* write_metrics(uint8_t* p, int all)
+{
+	p = write_uint64_item(p,DLEP_MDRR_DATA_ITEM,100000000);
+	p = write_uint64_item(p,DLEP_MDRT_DATA_ITEM,100000000);
+	p = write_uint64_item(p,DLEP_CDRR_DATA_ITEM,54000000);
+	p = write_uint64_item(p,DLEP_CDRT_DATA_ITEM,48000000);
+	p = write_uint64_item(p,DLEP_LATENCY_DATA_ITEM,2500);
+
+	if (all)
+	{
+		p = write_uint8_item(p,DLEP_RESOURCES_DATA_ITEM,80);
+		p = write_uint8_item(p,DLEP_RLQR_DATA_ITEM,90);
+		p = write_uint8_item(p,DLEP_RLQT_DATA_ITEM,85);
+
+		p = write_data_item(p,DLEP_MTU_DATA_ITEM,2);
+		p = write_uint16(1500,p);
+	}
+	return p;
+}
+
+/* The data items of the extensions, valid in the messages that write them */
+static uint8_t* write_latency_range(uint8_t* p)
+{
+	p = write_data_item(p,DLEP_LATENCY_RANGE_DATA_ITEM,16);
+	p = write_uint64(5000,p);
+	return write_uint64(1000,p);
+}
+
+static uint8_t* write_link_id(uint8_t* p)
+{
+	p = write_data_item(p,DLEP_LINK_ID_DATA_ITEM,DLEP_DEFAULT_LINK_ID_LENGTH);
+	return write_uint32(0x00000101,p);
+}
+
+static uint8_t* write_credit_item(uint8_t* p, uint16_t type)
+{
+	p = write_data_item(p,type,9);
+	*p++ = 0;
+	return write_uint64(65536,p);
+}
+
+static uint8_t* write_queue_params(uint8_t* p)
+{
+	/* One queue holding one DSCP */
+	p = write_data_item(p,DLEP_QUEUE_PARAMS_DATA_ITEM,14);
+	p = write_uint32(0x01000000,p);
+	p = write_data_item(p,DLEP_QUEUE_PARAM_SUB_ITEM,6);
+	p = write_uint32(0x00001000,p);
+	*p++ = 1;
+	*p++ = 46 << 2;
+	return p;
+}
+
+static uint8_t* write_pause_restart(uint8_t* p)
+{
+	p = write_data_item(p,DLEP_PAUSE_DATA_ITEM,1);
+	*p++ = 0;
+	p = write_data_item(p,DLEP_RESTART_DATA_ITEM,1);
+	*p++ = 0;
+	return p;
+}
+
+/* Add IPv4 Address data items until the next would take the message past target */
+static uint8_t* write_addresses(uint8_t* msg, uint8_t* p, size_t target)
+{
+	size_t limit = (target < MAX_MESSAGE_LEN ? target : MAX_MESSAGE_LEN);
+	uint32_t address = 0x0A000001;
+
+	while ((size_t)(p - msg) + 9 <= limit)
+	{
+		p = write_data_item(p,DLEP_IPV4_ADDRESS_DATA_ITEM,5);
+		*p++ = 1;
+		p = write_uint32(address++,p);
+	}
+	return p;
+}
+
+static size_t end_message(uint8_t* msg, const uint8_t* p)
+{
+	size_t msg_len = p - msg;
+	write_uint16(msg_len - 4,msg + 2);
+	return msg_len;
+}
+
+static size_t build_peer_offer(uint8_t* msg, size_t target)
+{
+	uint8_t* p;
+	size_t limit = (target < MAX_SIGNAL_LEN ? target : MAX_SIGNAL_LEN);
+
+	memcpy(msg,"DLEP",4);
+	p = write_uint16(DLEP_PEER_OFFER,msg + 4);
+	p = write_uint16(0,p);
+
+	p = write_data_item(p,DLEP_PEER_TYPE_DATA_ITEM,6);
+	*p++ = 0;
+	memcpy(p,"modem",5);
+	p += 5;
+
+	/* Connection points are repeatable */
+	do
+	{
+		p = write_data_item(p,DLEP_IPV4_CONN_POINT_DATA_ITEM,7);
+		*p++ = 0;
+		p = write_uint32(0xC0A80001,p);
+		p = write_uint16(DLEP_WELL_KNOWN_PORT,p);
+	}
+	while ((size_t)(p - msg) + 11 <= limit);
+
+	write_uint16((p - msg) - 8,msg + 6);
+	return p - msg;
+}
+
+static size_t build_session_init_resp(uint8_t* msg, size_t target)
+{
+	uint8_t* p = write_message_header(msg,DLEP_SESSION_INIT_RESP);
+
+	p = write_status_code(p,DLEP_SC_SUCCESS);
+
+	p = write_data_item(p,DLEP_PEER_TYPE_DATA_ITEM,6);
+	*p++ = 0;
+	memcpy(p,"modem",5);
+	p += 5;
+
+	p = write_data_item(p,DLEP_HEARTBEAT_INTERVAL_DATA_ITEM,4);
+	p = write_uint32(1000,p);
+
+	p = write_metrics(p,target > 0);
+	if (target > 0)
+	{
+		p = write_data_item(p,DLEP_EXTS_SUPP_DATA_ITEM,8);
+		p = write_uint16(DLEP_EXT_PAUSE,p);
+		p = write_uint16(DLEP_EXT_LINK_ID,p);
+		p = write_uint16(DLEP_EXT_LATENCY_RANGE,p);
+		p = write_uint16(DLEP_EXT_CREDIT_WINDOW,p);
+
+		p = write_queue_params(p);
+
+		p = write_data_item(p,DLEP_LINK_ID_LENGTH_DATA_ITEM,2);
+		p = write_uint16(DLEP_DEFAULT_LINK_ID_LENGTH,p);
+
+		p = write_latency_range(p);
+		p = write_credit_item(p,DLEP_CREDIT_WINDOW_INIT_DATA_ITEM);
+	}
+
+	p = write_addresses(msg,p,target);
+	return end_message(msg,p);
+}
+
+static size_t build_heartbeat(uint8_t* msg, size_t target)
+{
+	uint8_t* p = write_message_header(msg,DLEP_PEER_HEARTBEAT);
+	return end_message(msg,p);
+}
+
+static size_t build_session_term(uint8_t* msg, size_t target)
+{
+	uint8_t* p = write_message_header(msg,DLEP_SESSION_TERM);
+	p = write_status_code(p,DLEP_SC_SHUTDOWN);
+	return end_message(msg,p);
+}
+
+static size_t build_session_update(uint8_t* msg, size_t target)
+{
+	uint8_t* p = write_message_header(msg,DLEP_SESSION_UPDATE);
+
+	if (target > 0)
+	{
+		p = write_metrics(p,1);
+		p = write_queue_params(p);
+		p = write_pause_restart(p);
+		p = write_latency_range(p);
+		p = write_credit_item(p,DLEP_CREDIT_WINDOW_INIT_DATA_ITEM);
+	}
+
+	p = write_addresses(msg,p,target);
+	return end_message(msg,p);
+}
+
+static size_t build_destination_up(uint8_t* msg, size_t target)
+{
+	uint8_t* p = write_message_header(msg,DLEP_DEST_UP);
+
+	p = write_mac(p);
+	if (target > 0)
+	{
+		p = write_link_id(p);
+		p = write_metrics(p,1);
+		p = write_latency_range(p);
+		p = write_credit_item(p,DLEP_CREDIT_GRANT_DATA_ITEM);
+	}
+
+	p = write_addresses(msg,p,target);
+	return end_message(msg,p);
+}
+
+static size_t build_destination_update(uint8_t* msg, size_t target)
+{
+	uint8_t* p = write_message_header(msg,DLEP_DEST_UPDATE);
+
+	p = write_mac(p);
+	if (target > 0)
+	{
+		p = write_link_id(p);
+		p = write_metrics(p,1);
+		p = write_latency_range(p);
+		p = write_credit_item(p,DLEP_CREDIT_GRANT_DATA_ITEM);
+		p = write_pause_restart(p);
+	}
+
+	p = write_addresses(msg,p,target);
+	return end_message(msg,p);
+}
+
+static size_t build_destination_down(uint8_t* msg, size_t target)
+{
+	uint8_t* p = write_message_header(msg,DLEP_DEST_DOWN);
+	p = write_mac(p);
+	return end_message(msg,p);
+}
+
+static size_t build_link_char_resp(uint8_t* msg, size_t target)
+{
+	uint8_t* p = write_message_header(msg,DLEP_LINK_CHAR_RESP);
+
+	p = write_mac(p);
+	if (target > 0)
+	{
+		p = write_link_id(p);
+		p = write_status_code(p,DLEP_SC_SUCCESS);
+		p = write_metrics(p,1);
+		p = write_latency_range(p);
+	}
+	return end_message(msg,p);
+}
+
+static size_t build_credit_control_resp(uint8_t* msg, size_t target)
+{
+	uint8_t* p = write_message_header(msg,DLEP_CREDIT_CONTROL_RESP);
+
+	p = write_mac(p);
+	if (target > 0)
+	{
+		p = write_link_id(p);
+		p = write_status_code(p,DLEP_SC_SUCCESS);
+		p = write_credit_item(p,DLEP_CREDIT_GRANT_DATA_ITEM);
+	}
+	return end_message(msg,p);
+}
+
+/* Target 0 is the minimal message, anything else adds every optional metric and extension data item too */
+static struct fixture s_fixtures[] =
+{
+	{ "peer_offer/min", &build_peer_offer, 0, &check_peer_offer_signal },
+	{ "peer_offer/max", &build_peer_offer, FILL_MAX, &check_peer_offer_signal },
+	{ "session_init_resp/min", &build_session_init_resp, 0, &check_session_init_resp_message },
+	{ "session_init_resp/all", &build_session_init_resp, 1, &check_session_init_resp_message },
+	{ "session_init_resp/64k", &build_session_init_resp, FILL_MAX, &check_session_init_resp_message },
+	{ "heartbeat/min", &build_heartbeat, 0, &check_heartbeat_message },
+	{ "session_term/min", &build_session_term, 0, &check_session_term_message },
+	{ "session_update/min", &build_session_update, 0, &check_session_update_message },
+	{ "session_update/all", &build_session_update, 1, &check_session_update_message },
+	{ "session_update/64k", &build_session_update, FILL_MAX, &check_session_update_message },
+	{ "destination_up/min", &build_destination_up, 0, &check_destination_up_message },
+	{ "destination_up/all", &build_destination_up, 1, &check_destination_up_message },
+	{ "destination_up/1k", &build_destination_up, 1024, &check_destination_up_message },
+	{ "destination_up/64k", &build_destination_up, FILL_MAX, &check_destination_up_message },
+	{ "destination_update/min", &build_destination_update, 0, &check_destination_update_message },
+	{ "destination_update/all", &build_destination_update, 1, &check_destination_update_message },
+	{ "destination_update/1k", &build_destination_update, 1024, &check_destination_update_message },
+	{ "destination_update/64k", &build_destination_update, FILL_MAX, &check_destination_update_message },
+	{ "destination_down/min", &build_destination_down, 0, &check_destination_down_message },
+	{ "link_char_resp/min", &build_link_char_resp, 0, &check_link_char_resp_message },
+	{ "link_char_resp/all", &build_link_char_resp, 1, &check_link_char_resp_message },
+	{ "credit_control_resp/min", &build_credit_control_resp, 0, &check_credit_control_resp_message },
+	{ "credit_control_resp/all", &build_credit_control_resp, 1, &check_credit_control_resp_message }
+};
+
+/* The inputs of the primitive benchmarks */
+static uint8_t s_octets[8] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF };
+static struct sockaddr_in s_address4;
+static struct sockaddr_in6 s_address6;
+static struct timespec s_start = { 1000, 250000000 };
+static struct timespec s_end = { 1030, 500000000 };
+static const uint8_t s_mac[6] = { 0x02, 0x00, 0x5E, 0x10, 0x20, 0x30 };
+static const struct link_id s_link = { DLEP_DEFAULT_LINK_ID_LENGTH, { 0x00, 0x00, 0x01, 0x01 } };
+static const struct destination_metrics s_wanted = { DEST_FIELD_CDRR | DEST_FIELD_CDRT | DEST_FIELD_LATENCY, 0, 0, 54000000, 48000000, 2500 };
+
+static unsigned long op_read_uint16(const void* arg)
+{
+	return read_uint16(s_octets);
+}
+
+static unsigned long op_read_uint32(const void* arg)
+{
+	return read_uint32(s_octets);
+}
+
+static unsigned long op_read_uint64(const void* arg)
+{
+	return (unsigned long)read_uint64(s_octets);
+}
+
+static unsigned long op_write_uint16(const void* arg)
+{
+	return (unsigned long)write_uint16(0x1234,s_scratch);
+}
+
+static unsigned long op_write_uint32(const void* arg)
+{
+	return (unsigned long)write_uint32(0x12345678,s_scratch);
+}
+
+static unsigned long op_format_address(const void* arg)
+{
+	char str[FORMATADDRESS_LEN];
+	return (unsigned long)formatAddress((const struct sockaddr*)arg,str,sizeof(str));
+}
+
+static unsigned long op_interval_compare(const void* arg)
+{
+	return interval_compare(&s_start,&s_end,30);
+}
+
+static unsigned long op_write_message_header(const void* arg)
+{
+	return (unsigned long)write_message_header(s_scratch,DLEP_DEST_UPDATE);
+}
+
+static unsigned long op_write_data_item(const void* arg)
+{
+	return (unsigned long)write_data_item(s_scratch,DLEP_MDRR_DATA_ITEM,8);
+}
+
+static unsigned long op_write_status_code(const void* arg)
+{
+	return (unsigned long)write_status_code(s_scratch,DLEP_SC_SUCCESS);
+}
+
+static unsigned long op_encode_peer_discovery(const void* arg)
+{
+	return encode_peer_discovery_signal(s_scratch);
+}
+
+static unsigned long op_encode_session_init(const void* arg)
+{
+	static const uint16_t extensions[] = { DLEP_EXT_PAUSE };
+	return encode_session_init_message(s_scratch,60000,extensions,sizeof(extensions) / sizeof(extensions[0]));
+}
+
+static unsigned long op_encode_heartbeat(const void* arg)
+{
+	return encode_heartbeat_message(s_scratch);
+}
+
+static unsigned long op_encode_session_term(const void* arg)
+{
+	return encode_session_term_message(s_scratch,DLEP_SC_SHUTDOWN);
+}
+
+static unsigned long op_encode_session_term_resp(const void* arg)
+{
+	return encode_session_term_resp_message(s_scratch);
+}
+
+static unsigned long op_encode_destination_up_resp(const void* arg)
+{
+	return encode_destination_up_resp_message(s_scratch,s_mac,NULL,DLEP_SC_SUCCESS);
+}
+
+static unsigned long op_encode_destination_down_resp(const void* arg)
+{
+	return encode_destination_down_resp_message(s_scratch,s_mac,NULL,DLEP_SC_SUCCESS);
+}
+
+static unsigned long op_encode_link_char_request(const void* arg)
+{
+	return encode_link_char_request_message(s_scratch,s_mac,&s_link,&s_wanted);
+}
+
+static unsigned long op_encode_credit_control(const void* arg)
+{
+	/* A Credit Request for each of four starved traffic classes */
+	return encode_credit_control_message(s_scratch,s_mac,&s_link,0x0F);
+}
+
+static unsigned long op_check(const void* arg)
+{
+	const struct fixture* f = arg;
+	return f->check(f->msg,f->len);
+}
+
+static unsigned long op_build(const void* arg)
+{
+	const struct fixture* f = arg;
+	return f->build(s_scratch,f->target);
+}
+
+/* Time iterations calls of op, in nanoseconds per call */
+static double sample(bench_op op, const void* arg, unsigned long iterations)
+{
+	unsigned long sink = 0;
+	unsigned long i;
+	uint64_t start = now_ns();
+
+	for (i = 0; i < iterations; ++i)
+		sink += op(arg);
+
+	s_sink += sink;
+	return (double)(now_ns() - start) / iterations;
+}
+
+static int compare_double(const void* a, const void* b)
+{
+	double da = *(const double*)a;
+	double db = *(const double*)b;
+	return (da > db) - (da < db);
+}
+
+static int run_bench(const char* name, size_t bytes, bench_op op, const void* arg, const struct bench_params* params, struct bench_result* result)
+{
+	double* samples;
+	unsigned long i;
+	uint64_t start;
+
+	/* Pick a count that makes each run long enough for the clock */
+	result->iterations = 1;
+	while (sample(op,arg,result->iterations) * result->iterations < params->sample_us * 1000.0 && result->iterations < (1UL << 30))
+		result->iterations *= 2;
+
+	/* Warm the caches and branch predictors, and let the clock frequency settle */
+	start = now_ns();
+	while (now_ns() - start < params->warmup_ms * 1000000)
+		sample(op,arg,result->iterations);
+
+	samples = malloc(params->runs * sizeof(double));
+	if (!samples)
+	{
+		printf("Failed to allocate samples: %s\n",strerror(errno));
+		return 0;
+	}
+
+	for (i = 0; i < params->runs; ++i)
+		samples[i] = sample(op,arg,result->iterations);
+
+	qsort(samples,params->runs,sizeof(double),&compare_double);
+
+	strncpy(result->name,name,sizeof(result->name) - 1);
+	result->name[sizeof(result->name) - 1] = '\0';
+	result->bytes = bytes;
+	result->min_ns = samples[0];
+	result->median_ns = samples[params->runs / 2];
+	result->p99_ns = samples[(params->runs * 99 + 99) / 100 - 1];
+
+	free(samples);
+
+	printf("%-40s %6lu %12.2f %12.2f %12.2f\n",result->name,(unsigned long)result->bytes,result->median_ns,result->p99_ns,result->min_ns);
+	return 1;
+}
+
+static int write_json(const char* path, const struct bench_params* params, const struct bench_result* results, size_t count)
+{
+	size_t i;
+	FILE* f = fopen(path,"w");
+	if (!f)
+	{
+		printf("Failed to open %s: %s\n",path,strerror(errno));
+		return 0;
+	}
+
+	fprintf(f,"{\n  \"version\": \"0.1.2\",\n  \"runs\": %lu,\n  \"warmup_ms\": %lu,\n  \"sample_us\": %lu,\n  \"benchmarks\": [\n",
+			params->runs,params->warmup_ms,params->sample_us);
+
+	for (i = 0; i < count; ++i)
+	{
+		fprintf(f,"    { \"name\": \"%s\", \"bytes\": %lu, \"iterations\": %lu, \"median_ns\": %.3f, \"p99_ns\": %.3f, \"min_ns\": %.3f }%s\n",
+				results[i].name,(unsigned long)results[i].bytes,results[i].iterations,
+				results[i].median_ns,results[i].p99_ns,results[i].min_ns,
+				i + 1 < count ? "," : "");
+	}
+
+	fprintf(f,"  ]\n}\n");
+
+	if (fclose(f) != 0)
+	{
+		printf("Failed to write %s: %s\n",path,strerror(errno));
+		return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	const struct option options[] =
+	{
+		{ "output",1,NULL,'o' },
+		{ "runs",1,NULL,'r' },
+		{ "warmup",1,NULL,'w' },
+		{ "sample",1,NULL,'t' },
+		{ "filter",1,NULL,'f' },
+		{ "help",0,NULL,'h' },
+		{ 0 }
+	};
+
+	const struct
+	{
+		const char* name;
+		bench_op op;
+		const void* arg;
+	} primitives[] =
+	{
+		{ "read_uint16", &op_read_uint16, NULL },
+		{ "read_uint32", &op_read_uint32, NULL },
+		{ "read_uint64", &op_read_uint64, NULL },
+		{ "write_uint16", &op_write_uint16, NULL },
+		{ "write_uint32", &op_write_uint32, NULL },
+		{ "formatAddress/ipv4", &op_format_address, &s_address4 },
+		{ "formatAddress/ipv6", &op_format_address, &s_address6 },
+		{ "interval_compare", &op_interval_compare, NULL },
+		{ "write_message_header", &op_write_message_header, NULL },
+		{ "write_data_item", &op_write_data_item, NULL },
+		{ "write_status_code", &op_write_status_code, NULL },
+		{ "encode_peer_discovery_signal", &op_encode_peer_discovery, NULL },
+		{ "encode_session_init_message", &op_encode_session_init, NULL },
+		{ "encode_heartbeat_message", &op_encode_heartbeat, NULL },
+		{ "encode_session_term_message", &op_encode_session_term, NULL },
+		{ "encode_session_term_resp_message", &op_encode_session_term_resp, NULL },
+		{ "encode_destination_up_resp_message", &op_encode_destination_up_resp, NULL },
+		{ "encode_destination_down_resp_message", &op_encode_destination_down_resp, NULL },
+		{ "encode_link_char_request_message", &op_encode_link_char_request, NULL },
+		{ "encode_credit_control_message", &op_encode_credit_control, NULL }
+	};
+
+	const size_t primitive_count = sizeof(primitives) / sizeof(primitives[0]);
+	const size_t fixture_count = sizeof(s_fixtures) / sizeof(s_fixtures[0]);
+
+	int c;
+	struct bench_params params = { 101, 20, 200, NULL };
+	const char* output = NULL;
+	struct bench_result* results;
+	size_t count = 0;
+	size_t i;
+	char name[64];
+	int ret = EXIT_SUCCESS;
+
+	/* Disable getopt's error messages */
+	opterr = 0;
+
+	while ((c = getopt_long(argc, argv, ":ho:r:w:t:f:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'o':
+			output = optarg;
+			break;
+
+		case 'r':
+			params.runs = strtoul(optarg,NULL,10);
+			if (!params.runs)
+			{
+				printf("At least one run is needed\n");
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'w':
+			params.warmup_ms = strtoul(optarg,NULL,10);
+			break;
+
+		case 't':
+			params.sample_us = strtoul(optarg,NULL,10);
+			break;
+
+		case 'f':
+			params.filter = optarg;
+			break;
+
+		case 'h':
+			help();
+			return EXIT_SUCCESS;
+
+		case ':':
+			printf("Missing argument to -%c\n", optopt);
+			help();
+			return EXIT_FAILURE;
+
+		case '?':
+		default:
+			printf("Unknown option '-%c'\n", optopt);
+			help();
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Only our own failures are interesting */
+	log_level = LOG_LEVEL_ERROR;
+
+	s_address4.sin_family = AF_INET;
+	s_address4.sin_port = htons(DLEP_WELL_KNOWN_PORT);
+	inet_pton(AF_INET,"192.168.100.254",&s_address4.sin_addr);
+
+	s_address6.sin6_family = AF_INET6;
+	s_address6.sin6_port = htons(DLEP_WELL_KNOWN_PORT);
+	inet_pton(AF_INET6,"fe80::200:5eff:fe10:2030",&s_address6.sin6_addr);
+
+	/* The message checks validate the data items of the extensions through the registry */
+	session_register_extensions();
+
+	/* Build every message up front, each must pass its check */
+	for (i = 0; i < fixture_count; ++i)
+	{
+		struct fixture* f = &s_fixtures[i];
+
+		f->msg = malloc(MAX_MESSAGE_LEN);
+		if (!f->msg)
+		{
+			printf("Failed to allocate message: %s\n",strerror(errno));
+			return EXIT_FAILURE;
+		}
+		f->len = f->build(f->msg,f->target);
+
+		if (f->check(f->msg,f->len) != DLEP_SC_SUCCESS)
+		{
+			printf("Synthetic %s message of %lu bytes fails its check\n",f->name,(unsigned long)f->len);
+			return EXIT_FAILURE;
+		}
+	}
+
+	results = malloc((primitive_count + 2 * fixture_count) * sizeof(struct bench_result));
+	if (!results)
+	{
+		printf("Failed to allocate results: %s\n",strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	printf("%-40s %6s %12s %12s %12s\n","Benchmark","Bytes","Median ns","P99 ns","Min ns");
+
+	for (i = 0; i < primitive_count && ret == EXIT_SUCCESS; ++i)
+	{
+		if (params.filter && !strstr(primitives[i].name,params.filter))
+			continue;
+
+		if (run_bench(primitives[i].name,0,primitives[i].op,primitives[i].arg,&params,&results[count]))
+			++count;
+		else
+			ret = EXIT_FAILURE;
+	}
+
+	/* Decode then encode each synthetic message */
+	for (i = 0; i < fixture_count && ret == EXIT_SUCCESS; ++i)
+	{
+		const struct fixture* f = &s_fixtures[i];
+
+		sprintf(name,"check/%s",f->name);
+		if (!params.filter || strstr(name,params.filter))
+		{
+			if (run_bench(name,f->len,&op_check,f,&params,&results[count]))
+				++count;
+			else
+				ret = EXIT_FAILURE;
+		}
+
+		sprintf(name,"build/%s",f->name);
+		if (ret == EXIT_SUCCESS && (!params.filter || strstr(name,params.filter)))
+		{
+			if (run_bench(name,f->len,&op_build,f,&params,&results[count]))
+				++count;
+			else
+				ret = EXIT_FAILURE;
+		}
+	}
+
+	if (ret == EXIT_SUCCESS && output && !write_json(output,&params,results,count))
+		ret = EXIT_FAILURE;
+
+	for (i = 0; i < fixture_count; ++i)
+		free(s_fixtures[i].msg);
+	free(results);
+
+	return ret;
+}
@@ -41,7 +41,11 @@ enum dlep_message {
   DLEP_DEST_UPDATE                  = 13,
   DLEP_LINK_CHAR_REQ                = 14,
   DLEP_LINK_CHAR_RESP               = 15,
-  DLEP_PEER_HEARTBEAT               = 16
+  DLEP_PEER_HEARTBEAT               = 16,
+
+  /* Credit Windowing, from the Private Use range */
+  DLEP_CREDIT_CONTROL               = 65520,
+  DLEP_CREDIT_CONTROL_RESP          = 65521
 };
 
 /* The Data item numbers */
@@ -65,7 +69,48 @@ enum dlep_data_item {
   DLEP_RESOURCES_DATA_ITEM           = 17,
   DLEP_RLQR_DATA_ITEM                = 18,
   DLEP_RLQT_DATA_ITEM                = 19,
-  DLEP_MTU_DATA_ITEM                 = 20
+  DLEP_MTU_DATA_ITEM                 = 20,
+
+  /* 21 and 22 are Multi-Hop Forwarding, RFC 8629, which we do not support */
+
+  /* Control-Plane-Based Pause, RFC 8651 */
+  DLEP_QUEUE_PARAMS_DATA_ITEM        = 23,
+  DLEP_PAUSE_DATA_ITEM               = 24,
+  DLEP_RESTART_DATA_ITEM             = 25,
+
+  /* Link Identifiers, RFC 8703 */
+  DLEP_LINK_ID_LENGTH_DATA_ITEM      = 26,
+  DLEP_LINK_ID_DATA_ITEM             = 27,
+
+  /* Latency Range, RFC 8757 */
+  DLEP_LATENCY_RANGE_DATA_ITEM       = 28,
+
+  /* Credit Windowing, from the Private Use range */
+  DLEP_CREDIT_WINDOW_INIT_DATA_ITEM  = 65408,
+  DLEP_CREDIT_GRANT_DATA_ITEM        = 65409,
+  DLEP_CREDIT_REQUEST_DATA_ITEM      = 65410
+};
+
+/* The Queue Parameters sub-data item numbers */
+enum dlep_queue_params_sub_item {
+  DLEP_QUEUE_PARAM_SUB_ITEM          =  1
+};
+
+/* A Pause or Restart of this queue index applies to every queue */
+#define DLEP_ALL_QUEUES 255
+
+/* The Link Identifier Length if the modem does not send one */
+#define DLEP_DEFAULT_LINK_ID_LENGTH 4
+
+/* The Extension Type numbers */
+enum dlep_extension {
+  DLEP_EXT_PAUSE                     =  2,
+  DLEP_EXT_LINK_ID                   =  3,
+  DLEP_EXT_LATENCY_RANGE             =  4,
+
+  /* Credit Windowing, after draft-ietf-manet-dlep-credit-flow-control,
+   * which was never assigned numbers, so from the Private Use range */
+  DLEP_EXT_CREDIT_WINDOW             = 65520
 };
 
 /* The DLEP Status Codes - The values are NOT final */
@@ -90,7 +135,13 @@ enum dlep_status_code {
 /* The delay between Peer Discovery messages */
 #define DEFAULT_DISCOVERY_RETRY    3
 
-/* The default Heartbeat Interval */
+/* How long to wait for credit before repeating a Credit Request, in milliseconds */
+#define CREDIT_REQUEST_TIMEOUT 1000
+
+/* The longest Link Identifier we support */
+#define MAX_LINK_ID_LENGTH 16
+
+/* The default Heartbeat Interval, in seconds */
 #define DEFAULT_HEARTBEAT_INTERVAL 30
 
 #endif /* DLEP_IANA_H_ */
@@ -0,0 +1,353 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Decode the binary log written by dlep_router --binlog
+ */
+
+#include "./util.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "./dlep_iana.h"
+#include "./destination.h"
+#include "./binlog.h"
+
+static void help()
+{
+    printf(
+	"dlep_logdump - Decode dlep_router binary logs\n"
+        "  Version 0.1.2\n"
+        "  Copyright (c) 2017 Airbus DS Limited\n\n"
+
+        "Usage: dlep_logdump [options] file...\n"
+        "Options:\n"
+        "  -c or --csv           Output comma separated values\n"
+        "  -h or --help          Show this text\n");
+}
+
+static const char* event_name(unsigned int event)
+{
+	switch (event)
+	{
+	case BINLOG_RX:
+		return "RX";
+	case BINLOG_TX:
+		return "TX";
+	case BINLOG_PUBLISH_UP:
+		return "Publish up";
+	case BINLOG_PUBLISH_DOWN:
+		return "Publish down";
+	case BINLOG_PUBLISH_FIELDS:
+		return "Publish fields";
+	case BINLOG_PUBLISH_COST:
+		return "Publish cost";
+	default:
+		return "Unknown";
+	}
+}
+
+static const char* message_name(unsigned int message)
+{
+	switch (message)
+	{
+	case 0:
+		return "";
+	case DLEP_SESSION_INIT:
+		return "Session Initialization";
+	case DLEP_SESSION_INIT_RESP:
+		return "Session Initialization Response";
+	case DLEP_SESSION_UPDATE:
+		return "Session Update";
+	case DLEP_SESSION_UPDATE_RESP:
+		return "Session Update Response";
+	case DLEP_SESSION_TERM:
+		return "Session Termination";
+	case DLEP_SESSION_TERM_RESP:
+		return "Session Termination Response";
+	case DLEP_DEST_UP:
+		return "Destination Up";
+	case DLEP_DEST_UP_RESP:
+		return "Destination Up Response";
+	case DLEP_DEST_ANNOUNCE:
+		return "Destination Announce";
+	case DLEP_DEST_ANNOUNCE_RESP:
+		return "Destination Announce Response";
+	case DLEP_DEST_DOWN:
+		return "Destination Down";
+	case DLEP_DEST_DOWN_RESP:
+		return "Destination Down Response";
+	case DLEP_DEST_UPDATE:
+		return "Destination Update";
+	case DLEP_LINK_CHAR_REQ:
+		return "Link Characteristics Request";
+	case DLEP_LINK_CHAR_RESP:
+		return "Link Characteristics Response";
+	case DLEP_PEER_HEARTBEAT:
+		return "Heartbeat";
+	case DLEP_CREDIT_CONTROL:
+		return "Credit Control";
+	case DLEP_CREDIT_CONTROL_RESP:
+		return "Credit Control Response";
+	default:
+		return "Unknown";
+	}
+}
+
+static int has_mac(const struct binlog_record* r)
+{
+	static const uint8_t zero[6] = {0};
+	return memcmp(r->mac,zero,sizeof(zero)) != 0;
+}
+
+static void print_link_id(const struct binlog_record* r)
+{
+	unsigned int i;
+	for (i = 0; i < r->link_id_len && i < sizeof(r->link_id); ++i)
+		printf("%02X",r->link_id[i]);
+}
+
+static void print_text(const struct binlog_record* r)
+{
+	time_t secs = r->timestamp / 1000000000;
+	char str_time[32] = {0};
+
+	strftime(str_time,sizeof(str_time),"%Y-%m-%d %H:%M:%S",localtime(&secs));
+	printf("%s.%06lu %s",str_time,(unsigned long)(r->timestamp % 1000000000) / 1000,event_name(r->event));
+
+	if (r->message)
+		printf(" %s",message_name(r->message));
+
+	if (has_mac(r))
+		printf(" %02X:%02X:%02X:%02X:%02X:%02X",r->mac[0],r->mac[1],r->mac[2],r->mac[3],r->mac[4],r->mac[5]);
+
+	if (r->link_id_len)
+	{
+		printf(" link ");
+		print_link_id(r);
+	}
+
+	if (r->present & DEST_FIELD_MDRR)
+		printf(" MDRR: %"PRIu64"bps",r->mdrr);
+	if (r->present & DEST_FIELD_MDRT)
+		printf(" MDRT: %"PRIu64"bps",r->mdrt);
+	if (r->present & DEST_FIELD_CDRR)
+		printf(" CDRR: %"PRIu64"bps",r->cdrr);
+	if (r->present & DEST_FIELD_CDRT)
+		printf(" CDRT: %"PRIu64"bps",r->cdrt);
+	if (r->present & DEST_FIELD_LATENCY)
+		printf(" Latency: %"PRIu64"\x03\xBCs",r->latency);
+	if (r->present & DEST_FIELD_RESOURCES)
+		printf(" Resources: %u%%",r->resources);
+	if (r->present & DEST_FIELD_RLQR)
+		printf(" RLQR: %u",r->rlqr);
+	if (r->present & DEST_FIELD_RLQT)
+		printf(" RLQT: %u",r->rlqt);
+	if (r->present & DEST_FIELD_MTU)
+		printf(" MTU: %u",r->mtu);
+	if (r->present & DEST_FIELD_LATENCY_RANGE)
+		printf(" Latency Range: %"PRIu64"-%"PRIu64"\x03\xBCs",r->latency_min,r->latency_max);
+
+	if (r->event == BINLOG_PUBLISH_COST)
+		printf(" Cost: %"PRIu32,r->cost);
+
+	printf("\n");
+}
+
+static void print_csv_header(void)
+{
+	printf("timestamp,event,message,mac,link,mdrr,mdrt,cdrr,cdrt,latency,resources,rlqr,rlqt,mtu,latency_min,latency_max,cost\n");
+}
+
+static void print_csv(const struct binlog_record* r)
+{
+	printf("%"PRIu64".%09"PRIu64",%s,%s,",r->timestamp / 1000000000,r->timestamp % 1000000000,event_name(r->event),message_name(r->message));
+
+	if (has_mac(r))
+		printf("%02X:%02X:%02X:%02X:%02X:%02X",r->mac[0],r->mac[1],r->mac[2],r->mac[3],r->mac[4],r->mac[5]);
+	printf(",");
+	print_link_id(r);
+	printf(",");
+
+	/* Leave fields that are not present empty */
+	if (r->present & DEST_FIELD_MDRR)
+		printf("%"PRIu64,r->mdrr);
+	printf(",");
+	if (r->present & DEST_FIELD_MDRT)
+		printf("%"PRIu64,r->mdrt);
+	printf(",");
+	if (r->present & DEST_FIELD_CDRR)
+		printf("%"PRIu64,r->cdrr);
+	printf(",");
+	if (r->present & DEST_FIELD_CDRT)
+		printf("%"PRIu64,r->cdrt);
+	printf(",");
+	if (r->present & DEST_FIELD_LATENCY)
+		printf("%"PRIu64,r->latency);
+	printf(",");
+	if (r->present & DEST_FIELD_RESOURCES)
+		printf("%u",r->resources);
+	printf(",");
+	if (r->present & DEST_FIELD_RLQR)
+		printf("%u",r->rlqr);
+	printf(",");
+	if (r->present & DEST_FIELD_RLQT)
+		printf("%u",r->rlqt);
+	printf(",");
+	if (r->present & DEST_FIELD_MTU)
+		printf("%u",r->mtu);
+	printf(",");
+	if (r->present & DEST_FIELD_LATENCY_RANGE)
+		printf("%"PRIu64",%"PRIu64,r->latency_min,r->latency_max);
+	else
+		printf(",");
+	printf(",");
+	if (r->event == BINLOG_PUBLISH_COST)
+		printf("%"PRIu32,r->cost);
+	printf("\n");
+}
+
+static int dump_file(const char* path, int csv)
+{
+	struct stat st;
+	const uint8_t* map;
+	const struct binlog_header* header;
+	const struct binlog_record* records;
+	uint64_t i;
+	int fd;
+
+	fd = open(path,O_RDONLY);
+	if (fd == -1)
+	{
+		printf("Failed to open %s: %s\n",path,strerror(errno));
+		return 0;
+	}
+
+	if (fstat(fd,&st) != 0)
+	{
+		printf("Failed to stat %s: %s\n",path,strerror(errno));
+		close(fd);
+		return 0;
+	}
+
+	if ((size_t)st.st_size < sizeof(struct binlog_header))
+	{
+		printf("%s is not a binary log\n",path);
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		printf("Failed to map %s: %s\n",path,strerror(errno));
+		return 0;
+	}
+
+	header = (const struct binlog_header*)map;
+	records = (const struct binlog_record*)(map + sizeof(struct binlog_header));
+
+	if (memcmp(header->magic,BINLOG_MAGIC,sizeof(header->magic)) != 0)
+	{
+		printf("%s is not a binary log\n",path);
+		munmap((void*)map,st.st_size);
+		return 0;
+	}
+
+	if (header->version != BINLOG_VERSION || header->record_size != sizeof(struct binlog_record))
+	{
+		printf("%s is binary log version %u with %u byte records, expected version %u with %u byte records\n",
+				path,header->version,header->record_size,BINLOG_VERSION,(unsigned int)sizeof(struct binlog_record));
+		munmap((void*)map,st.st_size);
+		return 0;
+	}
+
+	if (header->capacity > (st.st_size - sizeof(struct binlog_header)) / sizeof(struct binlog_record))
+	{
+		printf("%s is truncated\n",path);
+		munmap((void*)map,st.st_size);
+		return 0;
+	}
+
+	/* The count in the header may lag behind if the router died,
+	 * so scan until the first unused record */
+	for (i = 0; i < header->capacity && records[i].timestamp; ++i)
+	{
+		if (csv)
+			print_csv(&records[i]);
+		else
+			print_text(&records[i]);
+	}
+
+	munmap((void*)map,st.st_size);
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	const struct option options[] =
+	{
+		{ "csv",0,NULL,'c' },
+		{ "help",0,NULL,'h' },
+		{ 0 }
+	};
+
+	int c;
+	int csv = 0;
+	int ret = EXIT_SUCCESS;
+
+	/* Disable getopt's error messages */
+	opterr = 0;
+
+	while ((c = getopt_long(argc, argv, "ch", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'c':
+			csv = 1;
+			break;
+
+		case 'h':
+			help();
+			return EXIT_SUCCESS;
+
+		case '?':
+		default:
+			printf("Unknown option '-%c'\n", optopt);
+			help();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind == argc)
+	{
+		printf("No binary log files\n");
+		help();
+		return EXIT_FAILURE;
+	}
+
+	if (csv)
+		print_csv_header();
+
+	/* Files are dumped in the order given, so put any rotated file first */
+	for (; optind < argc; ++optind)
+	{
+		if (!dump_file(argv[optind],csv))
+			ret = EXIT_FAILURE;
+	}
+
+	return ret;
+}
@@ -0,0 +1,1318 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * A simulated DLEP modem, for load and scale testing dlep_router on one machine.
+ * It answers Peer Discovery, accepts the router's session and reports a set of
+ * destinations, either with generated Up/Update/Down churn or from a trace file,
+ * answering any Link Characteristics Requests with their current metrics. The
+ * generated metrics include a Latency Range if the router supports it
+ */
+
+#include "./util.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "./dlep_iana.h"
+#include "./destination.h"
+#include "./encode.h"
+
+/* Long options without a short equivalent */
+enum long_option {
+	OPT_UP_RATE = 256,
+	OPT_MAX_RATE,
+	OPT_SEED
+};
+
+#define SIM_PEER_TYPE "dlep_modem_sim"
+
+/* Stop generating messages while this much is waiting to be sent */
+#define TX_BUFFER_SIZE 65536
+#define TX_HIGH_WATER (TX_BUFFER_SIZE - 256)
+
+#define RX_BUFFER_SIZE (2 * 65540)
+
+/* The longest we wait for the router to answer a Session Termination */
+#define TERM_TIMEOUT 2000
+
+/* The default maximum data rate of every destination */
+#define DEFAULT_MAX_RATE 100000000
+
+enum trace_event_type {
+	TRACE_UP,
+	TRACE_UPDATE,
+	TRACE_DOWN
+};
+
+struct trace_event
+{
+	uint64_t time;            /* Milliseconds from the start of the session */
+	unsigned long destination;
+	enum trace_event_type type;
+	struct destination_metrics metrics;
+};
+
+struct trace
+{
+	struct trace_event* events;
+	size_t count;
+	unsigned long destinations;
+};
+
+struct sim_params
+{
+	const char* address;
+	uint16_t port;
+	int discovery;
+	unsigned long destinations;
+	double up_rate;           /* Initial Destination Ups per second, 0 is as fast as possible */
+	double update_rate;       /* Destination Updates per second */
+	double churn_rate;        /* Destination Down and Up pairs per second */
+	uint64_t max_rate;        /* Maximum data rate of every destination, bps */
+	uint32_t heartbeat;       /* milliseconds */
+	unsigned long duration;   /* seconds, 0 runs until interrupted */
+	const struct trace* trace;
+	int loop;
+};
+
+struct sim_destination
+{
+	uint8_t mac[6];
+	int up;
+	struct destination_metrics metrics;
+};
+
+struct sim_stats
+{
+	unsigned long ups;
+	unsigned long updates;
+	unsigned long downs;
+	unsigned long responses;
+	unsigned long link_chars; /* Link Characteristics Requests answered */
+	unsigned long received;
+	uint64_t tx_bytes;
+};
+
+struct sim_session
+{
+	int s;
+	const struct sim_params* params;
+	struct sim_destination* destinations;
+	unsigned long count;
+
+	uint8_t tx[TX_BUFFER_SIZE];
+	size_t tx_len;
+	uint8_t rx[RX_BUFFER_SIZE];
+	size_t rx_len;
+
+	uint64_t start;           /* When the session started, ns */
+	uint64_t churn_start;     /* When the initial burst completed, ns, 0 until then */
+	uint64_t last_heartbeat;
+	uint64_t last_report;
+
+	unsigned long next_up;    /* Next destination of the initial burst */
+	unsigned long next_update;
+	unsigned long updates_sent;
+	unsigned long churns_sent;
+	long churned;             /* The destination taken down by the last churn, -1 for none */
+	size_t next_event;
+	uint64_t trace_offset;    /* Added to the trace times when looping, ms */
+
+	int latency_range;        /* The router supports the Latency Range extension */
+
+	int terminating;
+	uint64_t term_sent;
+
+	struct sim_stats stats;
+	struct sim_stats reported;
+};
+
+static volatile sig_atomic_t s_interrupted = 0;
+
+static uint64_t s_random = 2463534242UL;
+
+static void help()
+{
+    printf(
+	"dlep_modem_sim - A simulated DLEP modem for testing dlep_router\n"
+        "  Version 0.1.2\n"
+        "  Copyright (c) 2017 Airbus DS Limited\n\n"
+
+        "Usage: dlep_modem_sim [options]\n");
+
+    printf(
+        "Options:\n"
+        "  -a or --address <A>   Accept the router's session on IPv4 address A (default is 127.0.0.1)\n"
+        "  -p or --port <N>      Accept the router's session on TCP port N (default is %u)\n"
+        "  -D or --discovery     Answer Peer Discovery signals, requires root\n"
+        "  -H or --heartbeat <N> Use Heartbeat Interval N seconds (default is 1)\n"
+        "  -d or --duration <N>  End each session after N seconds, 0 runs until interrupted (default is 0)\n"
+        "  -h or --help          Show this text\n",
+        DLEP_WELL_KNOWN_PORT);
+
+    printf(
+	"Destination options:\n"
+        "  -n or --destinations <N> Report N destinations (default is 100)\n"
+        "  --up-rate <N>         Send the initial Destination Ups at N a second, 0 is unlimited (default is 0)\n"
+        "  -u or --update-rate <N> Then send N Destination Updates a second (default is 1000)\n"
+        "  -c or --churn-rate <N> And take down and restore N destinations a second (default is 0)\n");
+
+    printf(
+        "  --max-rate <N>        Maximum data rate of every destination in bps (default is %u)\n"
+        "  --seed <N>            Seed the generated metrics with N\n",
+        DEFAULT_MAX_RATE);
+
+    printf(
+	"Trace options:\n"
+        "  -t or --trace <F>     Replay the destination events in trace file F instead\n"
+        "  -l or --loop          Repeat the trace until interrupted\n\n"
+
+        "Each line of a trace file is '<ms> <destination> up|update|down [<metric>=<value>...]',\n"
+        "where <ms> is the time from the start of the session, <destination> is a number from 0,\n"
+        "and <metric> is one of mdrr, mdrt, cdrr, cdrt, latency, resources, rlqr, rlqt or mtu.\n");
+}
+
+static void interrupted(int sig)
+{
+	s_interrupted = 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* xorshift64, good enough for metrics */
+static uint32_t random_next(void)
+{
+	s_random ^= s_random << 13;
+	s_random ^= s_random >> 7;
+	s_random ^= s_random << 17;
+	return (uint32_t)(s_random >> 32);
+}
+
+static uint8_t* write_uint64(uint64_t v, uint8_t* p)
+{
+	p = write_uint32(v >> 32,p);
+	return write_uint32(v & 0xFFFFFFFF,p);
+}
+
+static int parse_metric(const char* str, struct destination_metrics* metrics)
+{
+	static const struct
+	{
+		const char* name;
+		unsigned int field;
+	} metric_names[] =
+	{
+		{ "mdrr", DEST_FIELD_MDRR },
+		{ "mdrt", DEST_FIELD_MDRT },
+		{ "cdrr", DEST_FIELD_CDRR },
+		{ "cdrt", DEST_FIELD_CDRT },
+		{ "latency", DEST_FIELD_LATENCY },
+		{ "resources", DEST_FIELD_RESOURCES },
+		{ "rlqr", DEST_FIELD_RLQR },
+		{ "rlqt", DEST_FIELD_RLQT },
+		{ "mtu", DEST_FIELD_MTU }
+	};
+
+	const char* value = strchr(str,'=');
+	uint64_t v;
+	size_t i;
+
+	if (!value)
+		return 0;
+
+	v = strtoul(value + 1,NULL,10);
+
+	for (i = 0; i < sizeof(metric_names) / sizeof(metric_names[0]); ++i)
+	{
+		if (strlen(metric_names[i].name) != (size_t)(value - str) || strncmp(str,metric_names[i].name,value - str) != 0)
+			continue;
+
+		switch (metric_names[i].field)
+		{
+		case DEST_FIELD_MDRR:
+			metrics->mdrr = v;
+			break;
+		case DEST_FIELD_MDRT:
+			metrics->mdrt = v;
+			break;
+		case DEST_FIELD_CDRR:
+			metrics->cdrr = v;
+			break;
+		case DEST_FIELD_CDRT:
+			metrics->cdrt = v;
+			break;
+		case DEST_FIELD_LATENCY:
+			metrics->latency = v;
+			break;
+		case DEST_FIELD_RESOURCES:
+			if (v > 100)
+				return 0;
+			metrics->resources = v;
+			break;
+		case DEST_FIELD_RLQR:
+			if (v > 100)
+				return 0;
+			metrics->rlqr = v;
+			break;
+		case DEST_FIELD_RLQT:
+			if (v > 100)
+				return 0;
+			metrics->rlqt = v;
+			break;
+		case DEST_FIELD_MTU:
+			metrics->mtu = v;
+			break;
+		}
+
+		metrics->present |= metric_names[i].field;
+		return 1;
+	}
+	return 0;
+}
+
+static int load_trace(const char* path, struct trace* trace)
+{
+	char line[512];
+	unsigned long line_no = 0;
+	size_t alloc = 0;
+	FILE* f = fopen(path,"r");
+	if (!f)
+	{
+		printf("Failed to open %s: %s\n",path,strerror(errno));
+		return 0;
+	}
+
+	while (fgets(line,sizeof(line),f))
+	{
+		struct trace_event* e;
+		char* token;
+		char* end;
+
+		++line_no;
+
+		token = strtok(line," \t\r\n");
+		if (!token || token[0] == '#')
+			continue;
+
+		if (trace->count == alloc)
+		{
+			struct trace_event* events;
+
+			alloc = (alloc ? alloc * 2 : 1024);
+			events = realloc(trace->events,alloc * sizeof(struct trace_event));
+			if (!events)
+			{
+				printf("Failed to allocate trace events\n");
+				fclose(f);
+				return 0;
+			}
+			trace->events = events;
+		}
+
+		e = &trace->events[trace->count];
+		memset(e,0,sizeof(struct trace_event));
+
+		e->time = strtoul(token,&end,10);
+		if (*end || (trace->count && e->time < trace->events[trace->count - 1].time))
+		{
+			printf("%s:%lu: Bad time '%s', times must be increasing milliseconds\n",path,line_no,token);
+			fclose(f);
+			return 0;
+		}
+
+		token = strtok(NULL," \t\r\n");
+		if (token)
+			e->destination = strtoul(token,&end,10);
+		if (!token || *end)
+		{
+			printf("%s:%lu: Missing destination number\n",path,line_no);
+			fclose(f);
+			return 0;
+		}
+
+		token = strtok(NULL," \t\r\n");
+		if (token && strcmp(token,"up") == 0)
+			e->type = TRACE_UP;
+		else if (token && strcmp(token,"update") == 0)
+			e->type = TRACE_UPDATE;
+		else if (token && strcmp(token,"down") == 0)
+			e->type = TRACE_DOWN;
+		else
+		{
+			printf("%s:%lu: Expected up, update or down\n",path,line_no);
+			fclose(f);
+			return 0;
+		}
+
+		while ((token = strtok(NULL," \t\r\n")) != NULL)
+		{
+			if (!parse_metric(token,&e->metrics))
+			{
+				printf("%s:%lu: Bad metric '%s'\n",path,line_no,token);
+				fclose(f);
+				return 0;
+			}
+		}
+
+		if (e->destination >= trace->destinations)
+			trace->destinations = e->destination + 1;
+
+		++trace->count;
+	}
+
+	fclose(f);
+
+	if (!trace->count)
+	{
+		printf("No events in trace %s\n",path);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int flush_tx(struct sim_session* sess)
+{
+	ssize_t sent;
+
+	if (!sess->tx_len)
+		return 1;
+
+	sent = send(sess->s,sess->tx,sess->tx_len,MSG_NOSIGNAL);
+	if (sent == -1)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return 1;
+
+		printf("Failed to send to router: %s\n",strerror(errno));
+		return 0;
+	}
+
+	sess->stats.tx_bytes += sent;
+	sess->tx_len -= sent;
+	memmove(sess->tx,sess->tx + sent,sess->tx_len);
+	return 1;
+}
+
+/* The messages are queued in the transmit buffer, and sent as the socket allows */
+static uint8_t* begin_message(struct sim_session* sess, uint16_t msg_type)
+{
+	return write_message_header(sess->tx + sess->tx_len,msg_type);
+}
+
+static void end_message(struct sim_session* sess, const uint8_t* p)
+{
+	uint8_t* msg = sess->tx + sess->tx_len;
+	size_t msg_len = p - msg;
+
+	/* Octet 2 and 3 are the message length, minus the length of the header */
+	write_uint16(msg_len - 4,msg + 2);
+
+	sess->tx_len += msg_len;
+}
+
+static uint8_t* write_metrics(uint8_t* p, const struct destination_metrics* metrics)
+{
+	if (metrics->present & DEST_FIELD_MDRR)
+	{
+		p = write_data_item(p,DLEP_MDRR_DATA_ITEM,8);
+		p = write_uint64(metrics->mdrr,p);
+	}
+	if (metrics->present & DEST_FIELD_MDRT)
+	{
+		p = write_data_item(p,DLEP_MDRT_DATA_ITEM,8);
+		p = write_uint64(metrics->mdrt,p);
+	}
+	if (metrics->present & DEST_FIELD_CDRR)
+	{
+		p = write_data_item(p,DLEP_CDRR_DATA_ITEM,8);
+		p = write_uint64(metrics->cdrr,p);
+	}
+	if (metrics->present & DEST_FIELD_CDRT)
+	{
+		p = write_data_item(p,DLEP_CDRT_DATA_ITEM,8);
+		p = write_uint64(metrics->cdrt,p);
+	}
+	if (metrics->present & DEST_FIELD_LATENCY)
+	{
+		p = write_data_item(p,DLEP_LATENCY_DATA_ITEM,8);
+		p = write_uint64(metrics->latency,p);
+	}
+	if (metrics->present & DEST_FIELD_RESOURCES)
+	{
+		p = write_data_item(p,DLEP_RESOURCES_DATA_ITEM,1);
+		*p++ = metrics->resources;
+	}
+	if (metrics->present & DEST_FIELD_RLQR)
+	{
+		p = write_data_item(p,DLEP_RLQR_DATA_ITEM,1);
+		*p++ = metrics->rlqr;
+	}
+	if (metrics->present & DEST_FIELD_RLQT)
+	{
+		p = write_data_item(p,DLEP_RLQT_DATA_ITEM,1);
+		*p++ = metrics->rlqt;
+	}
+	if (metrics->present & DEST_FIELD_MTU)
+	{
+		p = write_data_item(p,DLEP_MTU_DATA_ITEM,2);
+		p = write_uint16(metrics->mtu,p);
+	}
+	if (metrics->present & DEST_FIELD_LATENCY_RANGE)
+	{
+		p = write_data_item(p,DLEP_LATENCY_RANGE_DATA_ITEM,16);
+		p = write_uint64(metrics->latency_max,p);
+		p = write_uint64(metrics->latency_min,p);
+	}
+	return p;
+}
+
+static uint8_t* write_mac(uint8_t* p, const uint8_t* mac)
+{
+	p = write_data_item(p,DLEP_MAC_ADDRESS_DATA_ITEM,6);
+	memcpy(p,mac,6);
+	return p + 6;
+}
+
+static void send_destination_up(struct sim_session* sess, unsigned long i)
+{
+	struct sim_destination* d = &sess->destinations[i];
+	uint8_t* p = begin_message(sess,DLEP_DEST_UP);
+
+	p = write_mac(p,d->mac);
+
+	/* Each destination has an address in 10.0.0.0/8 */
+	p = write_data_item(p,DLEP_IPV4_ADDRESS_DATA_ITEM,5);
+	*p++ = 1;
+	p = write_uint32(0x0A000000 | ((i + 1) & 0xFFFFFF),p);
+
+	p = write_metrics(p,&d->metrics);
+	end_message(sess,p);
+
+	d->up = 1;
+	++sess->stats.ups;
+}
+
+static void send_destination_update(struct sim_session* sess, unsigned long i, const struct destination_metrics* metrics)
+{
+	uint8_t* p = begin_message(sess,DLEP_DEST_UPDATE);
+
+	p = write_mac(p,sess->destinations[i].mac);
+	p = write_metrics(p,metrics);
+	end_message(sess,p);
+
+	++sess->stats.updates;
+}
+
+static void send_destination_down(struct sim_session* sess, unsigned long i)
+{
+	uint8_t* p = begin_message(sess,DLEP_DEST_DOWN);
+
+	p = write_mac(p,sess->destinations[i].mac);
+	end_message(sess,p);
+
+	sess->destinations[i].up = 0;
+	++sess->stats.downs;
+}
+
+static void send_heartbeat(struct sim_session* sess)
+{
+	end_message(sess,begin_message(sess,DLEP_PEER_HEARTBEAT));
+}
+
+static void send_session_term(struct sim_session* sess, enum dlep_status_code sc)
+{
+	end_message(sess,write_status_code(begin_message(sess,DLEP_SESSION_TERM),sc));
+}
+
+static void send_link_char_resp(struct sim_session* sess, const uint8_t* msg, uint16_t msg_len)
+{
+	const uint8_t* data_item = msg + 4;
+	const uint8_t* mac = NULL;
+	struct sim_destination* d = NULL;
+	uint8_t* p;
+
+	while (data_item + 4 <= msg + msg_len)
+	{
+		if (read_uint16(data_item) == DLEP_MAC_ADDRESS_DATA_ITEM && read_uint16(data_item + 2) == 6)
+			mac = data_item + 4;
+		data_item += 4 + read_uint16(data_item + 2);
+	}
+
+	/* A busy modem does not answer, and the router times the request out */
+	if (!mac || sess->tx_len >= TX_HIGH_WATER)
+		return;
+
+	/* The MAC Address is the destination number, see init_destinations() */
+	if (mac[0] == 0x02 && mac[1] == 0x00)
+	{
+		unsigned long i = ((unsigned long)mac[2] << 24) | ((unsigned long)mac[3] << 16) | ((unsigned long)mac[4] << 8) | mac[5];
+		if (i < sess->count && sess->destinations[i].up)
+			d = &sess->destinations[i];
+	}
+
+	/* Answer with the current metrics of the destination, RFC 8175 section 12.20 */
+	p = begin_message(sess,DLEP_LINK_CHAR_RESP);
+	p = write_mac(p,mac);
+	if (d)
+		p = write_metrics(p,&d->metrics);
+	else
+		p = write_status_code(p,DLEP_SC_REQUEST_DENIED);
+	end_message(sess,p);
+
+	++sess->stats.link_chars;
+}
+
+static void send_session_init_resp(struct sim_session* sess)
+{
+	struct destination_metrics defaults = {0};
+	uint8_t* p = begin_message(sess,DLEP_SESSION_INIT_RESP);
+
+	p = write_status_code(p,DLEP_SC_SUCCESS);
+
+	p = write_data_item(p,DLEP_PEER_TYPE_DATA_ITEM,1 + strlen(SIM_PEER_TYPE));
+	*p++ = 0;
+	memcpy(p,SIM_PEER_TYPE,strlen(SIM_PEER_TYPE));
+	p += strlen(SIM_PEER_TYPE);
+
+	p = write_data_item(p,DLEP_HEARTBEAT_INTERVAL_DATA_ITEM,4);
+	p = write_uint32(sess->params->heartbeat,p);
+
+	if (sess->latency_range)
+	{
+		p = write_data_item(p,DLEP_EXTS_SUPP_DATA_ITEM,2);
+		p = write_uint16(DLEP_EXT_LATENCY_RANGE,p);
+	}
+
+	/* The mandatory session defaults */
+	defaults.present = DEST_FIELD_MDRR | DEST_FIELD_MDRT | DEST_FIELD_CDRR | DEST_FIELD_CDRT | DEST_FIELD_LATENCY;
+	defaults.mdrr = sess->params->max_rate;
+	defaults.mdrt = sess->params->max_rate;
+	defaults.cdrr = sess->params->max_rate;
+	defaults.cdrt = sess->params->max_rate;
+	defaults.latency = 1000;
+
+	p = write_metrics(p,&defaults);
+	end_message(sess,p);
+}
+
+/* Move a destination's link a random step, and report the fields that changed */
+static void random_walk(const struct sim_params* params, int latency_range, struct sim_destination* d, struct destination_metrics* changed)
+{
+	int step = (int)(random_next() % 11) - 5;
+	int rlq = d->metrics.rlqr + step;
+	uint64_t jitter;
+
+	if (rlq < 1)
+		rlq = 1;
+	else if (rlq > 100)
+		rlq = 100;
+
+	d->metrics.rlqr = rlq;
+	d->metrics.rlqt = rlq;
+	d->metrics.cdrr = params->max_rate / 100 * rlq;
+	d->metrics.cdrt = params->max_rate / 100 * rlq;
+	d->metrics.latency = 500 + (100 - rlq) * 100 + random_next() % 200;
+
+	*changed = d->metrics;
+	changed->present = DEST_FIELD_CDRR | DEST_FIELD_CDRT | DEST_FIELD_LATENCY | DEST_FIELD_RLQR | DEST_FIELD_RLQT;
+
+	/* Poorer links are more variable */
+	if (latency_range)
+	{
+		jitter = (100 - rlq) * 10 + random_next() % 50;
+		d->metrics.latency_min = (d->metrics.latency > jitter ? d->metrics.latency - jitter : 0);
+		d->metrics.latency_max = d->metrics.latency + jitter;
+
+		changed->latency_min = d->metrics.latency_min;
+		changed->latency_max = d->metrics.latency_max;
+		changed->present |= DEST_FIELD_LATENCY_RANGE;
+	}
+}
+
+static void init_destinations(struct sim_session* sess)
+{
+	unsigned long i;
+
+	for (i = 0; i < sess->count; ++i)
+	{
+		struct sim_destination* d = &sess->destinations[i];
+
+		/* Locally administered MAC addresses */
+		d->mac[0] = 0x02;
+		d->mac[1] = 0x00;
+		d->mac[2] = (i >> 24) & 0xFF;
+		d->mac[3] = (i >> 16) & 0xFF;
+		d->mac[4] = (i >> 8) & 0xFF;
+		d->mac[5] = i & 0xFF;
+		d->up = 0;
+
+		memset(&d->metrics,0,sizeof(d->metrics));
+		if (!sess->params->trace)
+		{
+			d->metrics.present = DEST_FIELD_MDRR | DEST_FIELD_MDRT | DEST_FIELD_RESOURCES | DEST_FIELD_MTU;
+			d->metrics.mdrr = sess->params->max_rate;
+			d->metrics.mdrt = sess->params->max_rate;
+			d->metrics.resources = 100;
+			d->metrics.mtu = 1500;
+			d->metrics.rlqr = 50 + random_next() % 51;
+
+			random_walk(sess->params,sess->latency_range,d,&d->metrics);
+			d->metrics.present |= DEST_FIELD_MDRR | DEST_FIELD_MDRT | DEST_FIELD_RESOURCES | DEST_FIELD_MTU;
+		}
+	}
+}
+
+/* How many events at rate per second are due since start */
+static unsigned long due(double rate, uint64_t start, uint64_t now)
+{
+	return (unsigned long)(rate * (now - start) / 1e9);
+}
+
+static void generate(struct sim_session* sess, uint64_t now)
+{
+	const struct sim_params* params = sess->params;
+	unsigned long target;
+
+	/* The initial burst of Destination Ups */
+	if (!sess->churn_start)
+	{
+		target = (params->up_rate > 0 ? due(params->up_rate,sess->start,now) : sess->count);
+
+		while (sess->next_up < sess->count && sess->next_up < target && sess->tx_len < TX_HIGH_WATER)
+			send_destination_up(sess,sess->next_up++);
+
+		if (sess->next_up < sess->count)
+			return;
+
+		printf("Sent Destination Up for all %lu destinations in %.3f s\n",sess->count,(now - sess->start) / 1e9);
+		sess->churn_start = now;
+	}
+
+	if (params->update_rate > 0)
+	{
+		target = due(params->update_rate,sess->churn_start,now);
+
+		while (sess->updates_sent < target && sess->tx_len < TX_HIGH_WATER)
+		{
+			struct sim_destination* d = &sess->destinations[sess->next_update];
+			if (d->up)
+			{
+				struct destination_metrics changed;
+				random_walk(params,sess->latency_range,d,&changed);
+				send_destination_update(sess,sess->next_update,&changed);
+			}
+
+			++sess->updates_sent;
+			if (++sess->next_update == sess->count)
+				sess->next_update = 0;
+		}
+	}
+
+	if (params->churn_rate > 0)
+	{
+		target = due(params->churn_rate,sess->churn_start,now);
+
+		while (sess->churns_sent < target && sess->tx_len < TX_HIGH_WATER)
+		{
+			/* Restore the last destination taken down, and take down another */
+			if (sess->churned != -1)
+				send_destination_up(sess,sess->churned);
+
+			sess->churned = random_next() % sess->count;
+			send_destination_down(sess,sess->churned);
+			++sess->churns_sent;
+		}
+	}
+}
+
+static void replay_trace(struct sim_session* sess, uint64_t now)
+{
+	const struct trace* trace = sess->params->trace;
+	uint64_t elapsed = (now - sess->start) / 1000000;
+
+	while (sess->tx_len < TX_HIGH_WATER)
+	{
+		const struct trace_event* e;
+		struct sim_destination* d;
+
+		if (sess->next_event == trace->count)
+		{
+			if (!sess->params->loop)
+				return;
+
+			/* Start again one millisecond after the last event */
+			sess->trace_offset += trace->events[trace->count - 1].time + 1;
+			sess->next_event = 0;
+		}
+
+		e = &trace->events[sess->next_event];
+		if (e->time + sess->trace_offset > elapsed)
+			return;
+
+		d = &sess->destinations[e->destination];
+		switch (e->type)
+		{
+		case TRACE_UP:
+			if (!d->up)
+			{
+				d->metrics = e->metrics;
+				send_destination_up(sess,e->destination);
+			}
+			break;
+
+		case TRACE_UPDATE:
+			if (d->up)
+				send_destination_update(sess,e->destination,&e->metrics);
+			break;
+
+		case TRACE_DOWN:
+			if (d->up)
+				send_destination_down(sess,e->destination);
+			break;
+		}
+
+		++sess->next_event;
+	}
+}
+
+/* Handle the complete messages from the router, returns 0 when the session has ended */
+static int handle_rx(struct sim_session* sess)
+{
+	size_t offset = 0;
+	int ret = 1;
+
+	while (ret && sess->rx_len - offset >= 4)
+	{
+		const uint8_t* msg = sess->rx + offset;
+		uint16_t msg_len = read_uint16(msg + 2) + 4;
+
+		if (sess->rx_len - offset < msg_len)
+			break;
+
+		++sess->stats.received;
+
+		switch (read_uint16(msg))
+		{
+		case DLEP_SESSION_TERM:
+			printf("Router terminated the session\n");
+			end_message(sess,begin_message(sess,DLEP_SESSION_TERM_RESP));
+			flush_tx(sess);
+			ret = 0;
+			break;
+
+		case DLEP_SESSION_TERM_RESP:
+			ret = 0;
+			break;
+
+		case DLEP_DEST_UP_RESP:
+		case DLEP_DEST_DOWN_RESP:
+			++sess->stats.responses;
+			break;
+
+		case DLEP_LINK_CHAR_REQ:
+			send_link_char_resp(sess,msg,msg_len);
+			break;
+
+		default:
+			break;
+		}
+
+		offset += msg_len;
+	}
+
+	sess->rx_len -= offset;
+	memmove(sess->rx,sess->rx + offset,sess->rx_len);
+	return ret;
+}
+
+static void report(struct sim_session* sess, uint64_t now)
+{
+	double secs = (now - sess->last_report) / 1e9;
+	struct sim_stats* s = &sess->stats;
+	struct sim_stats* r = &sess->reported;
+
+	printf("%8.1f s: %7.0f up/s %9.0f update/s %7.0f down/s %9.0f response/s %8.1f KiB/s\n",
+			(now - sess->start) / 1e9,
+			(s->ups - r->ups) / secs,
+			(s->updates - r->updates) / secs,
+			(s->downs - r->downs) / secs,
+			(s->responses - r->responses) / secs,
+			(s->tx_bytes - r->tx_bytes) / secs / 1024);
+
+	*r = *s;
+	sess->last_report = now;
+}
+
+static int recv_session_init(struct sim_session* sess)
+{
+	ssize_t received;
+	const uint8_t* p;
+	uint16_t i;
+
+	/* The router speaks first, the socket is still blocking */
+	while (sess->rx_len < 4 || sess->rx_len < (size_t)read_uint16(sess->rx + 2) + 4)
+	{
+		received = recv(sess->s,sess->rx + sess->rx_len,sizeof(sess->rx) - sess->rx_len,0);
+		if (received <= 0)
+		{
+			printf("Router closed the session before Session Initialization\n");
+			return 0;
+		}
+		sess->rx_len += received;
+	}
+
+	if (read_uint16(sess->rx) != DLEP_SESSION_INIT)
+	{
+		printf("Session Initialization message expected, but message %u received\n",read_uint16(sess->rx));
+		return 0;
+	}
+
+	/* Use the extensions the router supports too */
+	sess->latency_range = 0;
+	p = sess->rx + 4;
+	while (p + 4 <= sess->rx + read_uint16(sess->rx + 2) + 4)
+	{
+		uint16_t item_len = read_uint16(p + 2);
+		if (read_uint16(p) == DLEP_EXTS_SUPP_DATA_ITEM)
+		{
+			for (i = 0; i + 1 < item_len; i += 2)
+			{
+				if (read_uint16(p + 4 + i) == DLEP_EXT_LATENCY_RANGE)
+					sess->latency_range = 1;
+			}
+		}
+		p += 4 + item_len;
+	}
+
+	sess->rx_len -= read_uint16(sess->rx + 2) + 4;
+	memmove(sess->rx,sess->rx + read_uint16(sess->rx + 2) + 4,sess->rx_len);
+	return 1;
+}
+
+static void run_session(struct sim_session* sess)
+{
+	const struct sim_params* params = sess->params;
+	struct pollfd pfd;
+	uint64_t now;
+
+	if (!recv_session_init(sess))
+		return;
+
+	send_session_init_resp(sess);
+	init_destinations(sess);
+
+	fcntl(sess->s,F_SETFL,fcntl(sess->s,F_GETFL) | O_NONBLOCK);
+
+	sess->start = sess->last_heartbeat = sess->last_report = now_ns();
+
+	for (;;)
+	{
+		ssize_t received;
+
+		now = now_ns();
+
+		if (!sess->terminating)
+		{
+			if (s_interrupted || (params->duration && now - sess->start >= (uint64_t)params->duration * 1000000000))
+			{
+				send_session_term(sess,DLEP_SC_SUCCESS);
+				sess->terminating = 1;
+				sess->term_sent = now;
+			}
+			else if (params->trace)
+				replay_trace(sess,now);
+			else
+				generate(sess,now);
+		}
+		else if (now - sess->term_sent > (uint64_t)TERM_TIMEOUT * 1000000)
+		{
+			printf("No Session Termination Response from router\n");
+			break;
+		}
+
+		if (now - sess->last_heartbeat >= (uint64_t)params->heartbeat * 1000000)
+		{
+			send_heartbeat(sess);
+			sess->last_heartbeat = now;
+		}
+
+		if (now - sess->last_report >= 1000000000)
+			report(sess,now);
+
+		if (!flush_tx(sess))
+			break;
+
+		/* Wake at least every millisecond to keep to the rates */
+		pfd.fd = sess->s;
+		pfd.events = POLLIN | (sess->tx_len ? POLLOUT : 0);
+		if (poll(&pfd,1,1) == -1 && errno != EINTR)
+		{
+			printf("Failed to wait for router: %s\n",strerror(errno));
+			break;
+		}
+
+		if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+
+		received = recv(sess->s,sess->rx + sess->rx_len,sizeof(sess->rx) - sess->rx_len,0);
+		if (received == 0)
+		{
+			printf("Router closed the session\n");
+			break;
+		}
+		if (received == -1)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				continue;
+
+			printf("Failed to receive from router: %s\n",strerror(errno));
+			break;
+		}
+
+		sess->rx_len += received;
+		if (!handle_rx(sess))
+			break;
+	}
+
+	now = now_ns();
+	printf("Session lasted %.3f s: sent %lu Destination Up, %lu Update, %lu Down, %.1f MiB, received %lu messages\n",
+			(now - sess->start) / 1e9,sess->stats.ups,sess->stats.updates,sess->stats.downs,
+			sess->stats.tx_bytes / 1048576.0,sess->stats.received);
+	if (sess->stats.link_chars)
+		printf("Answered %lu Link Characteristics Requests\n",sess->stats.link_chars);
+}
+
+static int open_listener(const struct sim_params* params)
+{
+	struct sockaddr_in address = {0};
+	int on = 1;
+	int s = socket(AF_INET,SOCK_STREAM,0);
+	if (s == -1)
+	{
+		printf("Failed to create socket: %s\n",strerror(errno));
+		return -1;
+	}
+
+	address.sin_family = AF_INET;
+	address.sin_port = htons(params->port);
+	if (inet_pton(AF_INET,params->address,&address.sin_addr) != 1)
+	{
+		printf("Bad address '%s'\n",params->address);
+		close(s);
+		return -1;
+	}
+
+	setsockopt(s,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+
+	if (bind(s,(struct sockaddr*)&address,sizeof(address)) != 0 || listen(s,1) != 0)
+	{
+		printf("Failed to listen on %s:%u: %s\n",params->address,params->port,strerror(errno));
+		close(s);
+		return -1;
+	}
+
+	return s;
+}
+
+static int open_discovery(void)
+{
+	struct sockaddr_in address = {0};
+	struct ip_mreq mreq;
+	int on = 1;
+	int s = socket(AF_INET,SOCK_DGRAM,0);
+	if (s == -1)
+	{
+		printf("Failed to create socket: %s\n",strerror(errno));
+		return -1;
+	}
+
+	setsockopt(s,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+
+	address.sin_family = AF_INET;
+	address.sin_port = htons(DLEP_WELL_KNOWN_PORT);
+	address.sin_addr.s_addr = INADDR_ANY;
+	if (bind(s,(struct sockaddr*)&address,sizeof(address)) != 0)
+	{
+		printf("Failed to bind discovery socket: %s\n",strerror(errno));
+		close(s);
+		return -1;
+	}
+
+	inet_pton(AF_INET,DLEP_WELL_KNOWN_MULTICAST_ADDRESS,&mreq.imr_multiaddr);
+	mreq.imr_interface.s_addr = INADDR_ANY;
+	if (setsockopt(s,IPPROTO_IP,IP_ADD_MEMBERSHIP,&mreq,sizeof(mreq)) != 0)
+	{
+		printf("Failed to join discovery multicast group: %s\n",strerror(errno));
+		close(s);
+		return -1;
+	}
+
+	return s;
+}
+
+static void answer_discovery(int s, const struct sim_params* params)
+{
+	uint8_t msg[1500];
+	uint8_t* p;
+	struct sockaddr_in from;
+	socklen_t from_len = sizeof(from);
+	char str_address[FORMATADDRESS_LEN] = {0};
+	ssize_t received = recvfrom(s,msg,sizeof(msg),0,(struct sockaddr*)&from,&from_len);
+
+	if (received < 8 || memcmp(msg,"DLEP",4) != 0 || read_uint16(msg + 4) != DLEP_PEER_DISCOVERY)
+		return;
+
+	printf("Peer Discovery from %s\n",formatAddress((struct sockaddr*)&from,str_address,sizeof(str_address)));
+
+	p = write_uint16(DLEP_PEER_OFFER,msg + 4);
+	p = write_uint16(0,p);
+
+	p = write_data_item(p,DLEP_PEER_TYPE_DATA_ITEM,1 + strlen(SIM_PEER_TYPE));
+	*p++ = 0;
+	memcpy(p,SIM_PEER_TYPE,strlen(SIM_PEER_TYPE));
+	p += strlen(SIM_PEER_TYPE);
+
+	/* Offer the address we accept the session on */
+	p = write_data_item(p,DLEP_IPV4_CONN_POINT_DATA_ITEM,7);
+	*p++ = 0;
+	inet_pton(AF_INET,params->address,p);
+	p += 4;
+	p = write_uint16(params->port,p);
+
+	write_uint16((p - msg) - 8,msg + 6);
+
+	if (sendto(s,msg,p - msg,0,(struct sockaddr*)&from,from_len) == -1)
+		printf("Failed to send Peer Offer: %s\n",strerror(errno));
+}
+
+int main(int argc, char* argv[])
+{
+	const struct option options[] =
+	{
+		{ "address",1,NULL,'a' },
+		{ "port",1,NULL,'p' },
+		{ "discovery",0,NULL,'D' },
+		{ "heartbeat",1,NULL,'H' },
+		{ "duration",1,NULL,'d' },
+		{ "destinations",1,NULL,'n' },
+		{ "up-rate",1,NULL,OPT_UP_RATE },
+		{ "update-rate",1,NULL,'u' },
+		{ "churn-rate",1,NULL,'c' },
+		{ "max-rate",1,NULL,OPT_MAX_RATE },
+		{ "seed",1,NULL,OPT_SEED },
+		{ "trace",1,NULL,'t' },
+		{ "loop",0,NULL,'l' },
+		{ "help",0,NULL,'h' },
+		{ 0 }
+	};
+
+	int c;
+	struct sim_params params = { "127.0.0.1", DLEP_WELL_KNOWN_PORT, 0, 100, 0.0, 1000.0, 0.0, DEFAULT_MAX_RATE, 1000, 0, NULL, 0 };
+	struct trace trace = {0};
+	struct sim_session* sess;
+	int listener;
+	int discovery = -1;
+
+	/* Disable getopt's error messages */
+	opterr = 0;
+
+	while ((c = getopt_long(argc, argv, ":ha:p:DH:d:n:u:c:t:l", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'a':
+			params.address = optarg;
+			break;
+
+		case 'p':
+			params.port = strtoul(optarg,NULL,10);
+			break;
+
+		case 'D':
+			params.discovery = 1;
+			break;
+
+		case 'H':
+			params.heartbeat = strtoul(optarg,NULL,10) * 1000;
+			if (!params.heartbeat)
+			{
+				printf("Heartbeat Interval must be at least 1 second\n");
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'd':
+			params.duration = strtoul(optarg,NULL,10);
+			break;
+
+		case 'n':
+			params.destinations = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_UP_RATE:
+			params.up_rate = strtod(optarg,NULL);
+			break;
+
+		case 'u':
+			params.update_rate = strtod(optarg,NULL);
+			break;
+
+		case 'c':
+			params.churn_rate = strtod(optarg,NULL);
+			break;
+
+		case OPT_MAX_RATE:
+			params.max_rate = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_SEED:
+			s_random = strtoul(optarg,NULL,10);
+			if (!s_random)
+				s_random = 1;
+			break;
+
+		case 't':
+			if (!load_trace(optarg,&trace))
+				return EXIT_FAILURE;
+			params.trace = &trace;
+			break;
+
+		case 'l':
+			params.loop = 1;
+			break;
+
+		case 'h':
+			help();
+			return EXIT_SUCCESS;
+
+		case ':':
+			printf("Missing argument to -%c\n", optopt);
+			help();
+			return EXIT_FAILURE;
+
+		case '?':
+		default:
+			printf("Unknown option '-%c'\n", optopt);
+			help();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc)
+	{
+		help();
+		return EXIT_FAILURE;
+	}
+
+	if (params.trace)
+		params.destinations = trace.destinations;
+
+	if (!params.destinations)
+	{
+		printf("At least one destination is needed\n");
+		return EXIT_FAILURE;
+	}
+
+	sess = malloc(sizeof(struct sim_session));
+	if (sess)
+		sess->destinations = malloc(params.destinations * sizeof(struct sim_destination));
+	if (!sess || !sess->destinations)
+	{
+		printf("Failed to allocate %lu destinations\n",params.destinations);
+		return EXIT_FAILURE;
+	}
+
+	listener = open_listener(&params);
+	if (listener == -1)
+		return EXIT_FAILURE;
+
+	if (params.discovery)
+	{
+		discovery = open_discovery();
+		if (discovery == -1)
+			return EXIT_FAILURE;
+	}
+
+	signal(SIGINT,&interrupted);
+	signal(SIGTERM,&interrupted);
+
+	printf("Waiting for the router on %s:%u\n",params.address,params.port);
+
+	while (!s_interrupted)
+	{
+		struct pollfd pfds[2];
+		nfds_t nfds = 1;
+
+		pfds[0].fd = listener;
+		pfds[0].events = POLLIN;
+		if (discovery != -1)
+		{
+			pfds[1].fd = discovery;
+			pfds[1].events = POLLIN;
+			nfds = 2;
+		}
+
+		if (poll(pfds,nfds,-1) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			printf("Failed to wait for router: %s\n",strerror(errno));
+			break;
+		}
+
+		if (nfds == 2 && (pfds[1].revents & POLLIN))
+			answer_discovery(discovery,&params);
+
+		if (pfds[0].revents & POLLIN)
+		{
+			struct sim_destination* destinations = sess->destinations;
+
+			memset(sess,0,sizeof(struct sim_session));
+			sess->destinations = destinations;
+			sess->count = params.destinations;
+			sess->params = &params;
+			sess->churned = -1;
+
+			sess->s = accept(listener,NULL,NULL);
+			if (sess->s == -1)
+			{
+				printf("Failed to accept session: %s\n",strerror(errno));
+				continue;
+			}
+
+			printf("Router connected\n");
+			run_session(sess);
+			close(sess->s);
+		}
+	}
+
+	if (discovery != -1)
+		close(discovery);
+	close(listener);
+
+	free(sess->destinations);
+	free(sess);
+	free(trace.events);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,525 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Replay the messages received in a capture written by dlep_router --capture
+ * through the session receive, validate, decode and destination table code,
+ * and report how fast it went
+ */
+
+#include "./util.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "./capture.h"
+#include "./destination.h"
+#include "./session.h"
+#include "./log.h"
+
+/* pcapng block types */
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+#define PCAPNG_OPT_COMMENT   1
+#define PCAPNG_OPT_IF_NAME   2
+#define PCAPNG_OPT_EPB_FLAGS 2
+
+/* A session interface that has not captured a session yet */
+#define SESSION_PENDING ((unsigned int)-1)
+
+/* What is known of the session captured on an interface */
+struct capture_session
+{
+	unsigned int session;     /* Replayed session number, 0 if not a session interface */
+	unsigned long id;         /* Number the router gave the session, 0 if not commented */
+};
+
+/* Every allocation made by the router code is counted, it is linked with
+ * -Wl,--wrap=malloc and friends */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static unsigned long s_allocations = 0;
+
+void* __wrap_malloc(size_t size)
+{
+	++s_allocations;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+	++s_allocations;
+	return __real_calloc(nmemb,size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	++s_allocations;
+	return __real_realloc(ptr,size);
+}
+
+/* A message received from the modem */
+struct replay_message
+{
+	const uint8_t* data;
+	uint32_t len;
+	uint64_t timestamp;       /* Nanoseconds */
+	unsigned int session;
+};
+
+struct replay
+{
+	struct replay_message* messages;
+	size_t count;
+	size_t alloc;
+	unsigned int sessions;
+};
+
+static void help()
+{
+    printf(
+	"dlep_replay - Replay a dlep_router capture through the router\n"
+        "  Version 0.1.2\n"
+        "  Copyright (c) 2017 Airbus DS Limited\n\n"
+
+        "Usage: dlep_replay [options] capture.pcapng\n"
+        "Options:\n"
+        "  -s or --speed <F>     Replay at F times the captured rate, 0 is as fast as possible (default is 0)\n"
+        "  -n or --iterations <N> Replay the capture N times (default is 1)\n"
+        "  -L or --log-level <L> Log router messages up to level L (default is error)\n"
+        "  -h or --help          Show this text\n");
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int add_message(struct replay* replay, const uint8_t* data, uint32_t len, uint64_t timestamp, unsigned int session)
+{
+	struct replay_message* m;
+
+	if (replay->count == replay->alloc)
+	{
+		size_t alloc = replay->alloc ? replay->alloc * 2 : 1024;
+		m = realloc(replay->messages,alloc * sizeof(struct replay_message));
+		if (!m)
+		{
+			printf("Failed to allocate replay messages\n");
+			return 0;
+		}
+		replay->messages = m;
+		replay->alloc = alloc;
+	}
+
+	m = &replay->messages[replay->count++];
+	m->data = data;
+	m->len = len;
+	m->timestamp = timestamp;
+	m->session = session;
+	return 1;
+}
+
+/* Find the messages received in each captured session */
+static int load_capture(const uint8_t* p, size_t len, struct replay* replay)
+{
+	const uint8_t* end = p + len;
+
+	/* The session on each interface in the current section. The router
+	 * captures every session on the same interface, commenting each packet
+	 * with the session it belongs to. Older captures carry no comments, so
+	 * there a new session starts with each Session Initialization Response */
+	struct capture_session* sessions = NULL;
+	uint32_t interfaces = 0;
+
+	while (p + 12 <= end)
+	{
+		uint32_t type, block_len;
+
+		memcpy(&type,p,4);
+		memcpy(&block_len,p + 4,4);
+
+		/* A capture cut short by a crash ends in zeros */
+		if (block_len < 12 || block_len % 4 || p + block_len > end)
+			break;
+
+		if (type == PCAPNG_SHB)
+		{
+			uint32_t magic;
+			memcpy(&magic,p + 8,4);
+			if (magic != PCAPNG_BYTE_ORDER_MAGIC)
+			{
+				printf("Capture was written with a different byte order\n");
+				free(sessions);
+				return 0;
+			}
+			interfaces = 0;
+		}
+		else if (type == PCAPNG_IDB && block_len >= 20)
+		{
+			const uint8_t* opt = p + 16;
+			unsigned int session = 0;
+			struct capture_session* new_sessions;
+
+			/* Look for the if_name option */
+			while (opt + 4 <= p + block_len - 4)
+			{
+				uint16_t code, opt_len;
+				memcpy(&code,opt,2);
+				memcpy(&opt_len,opt + 2,2);
+				if (code == 0)
+					break;
+
+				if (code == PCAPNG_OPT_IF_NAME && opt_len >= 7 && !memcmp(opt + 4,"session",7))
+					session = SESSION_PENDING;
+
+				opt += 4 + ((opt_len + 3) & ~3);
+			}
+
+			new_sessions = realloc(sessions,(interfaces + 1) * sizeof(struct capture_session));
+			if (!new_sessions)
+			{
+				printf("Failed to allocate replay interfaces\n");
+				free(sessions);
+				return 0;
+			}
+			sessions = new_sessions;
+			sessions[interfaces].session = session;
+			sessions[interfaces++].id = 0;
+		}
+		else if (type == PCAPNG_EPB && block_len >= 32)
+		{
+			uint32_t interface, ts_high, ts_low, captured;
+			const uint8_t* opt;
+			uint32_t flags = 0;
+			unsigned long id = 0;
+
+			memcpy(&interface,p + 8,4);
+			memcpy(&ts_high,p + 12,4);
+			memcpy(&ts_low,p + 16,4);
+			memcpy(&captured,p + 20,4);
+
+			if (28 + captured + 4 > block_len)
+				break;
+
+			/* Look for the direction and the session */
+			for (opt = p + 28 + ((captured + 3) & ~3); opt + 4 <= p + block_len - 4; )
+			{
+				uint16_t code, opt_len;
+				memcpy(&code,opt,2);
+				memcpy(&opt_len,opt + 2,2);
+				if (code == 0)
+					break;
+
+				if (code == PCAPNG_OPT_EPB_FLAGS && opt_len == 4)
+					memcpy(&flags,opt + 4,4);
+				else if (code == PCAPNG_OPT_COMMENT && opt_len > 8 && !memcmp(opt + 4,"session ",8))
+				{
+					char number[16] = {0};
+					memcpy(number,opt + 12,opt_len - 8 < sizeof(number) - 1 ? opt_len - 8 : sizeof(number) - 1);
+					id = strtoul(number,NULL,10);
+				}
+
+				opt += 4 + ((opt_len + 3) & ~3);
+			}
+
+			if (interface < interfaces && sessions[interface].session && (flags & 3) == CAPTURE_INBOUND)
+			{
+				struct capture_session* s = &sessions[interface];
+				if (id ? id != s->id : (s->session == SESSION_PENDING || (captured >= 4 && read_uint16(p + 28) == DLEP_SESSION_INIT_RESP)))
+				{
+					s->session = ++replay->sessions;
+					s->id = id;
+				}
+
+				if (!add_message(replay,p + 28,captured,((uint64_t)ts_high << 32) | ts_low,s->session))
+				{
+					free(sessions);
+					return 0;
+				}
+			}
+		}
+
+		p += block_len;
+	}
+
+	free(sessions);
+	return 1;
+}
+
+/* Throw away everything the router has sent */
+static size_t drain(int s)
+{
+	static uint8_t buffer[65536];
+	size_t total = 0;
+	ssize_t r;
+
+	while ((r = recv(s,buffer,sizeof(buffer),0)) > 0)
+		total += r;
+
+	return total;
+}
+
+/* Replay one session, returns the number of messages handled */
+static size_t replay_session(const struct replay* replay, unsigned int session, double speed, uint64_t* elapsed, size_t* sent)
+{
+	struct destination_table destinations;
+	struct session_params params;
+	struct dlep_session* sess;
+	int sv[2];
+	size_t i;
+	size_t handled = 0;
+	uint64_t first_ts = 0;
+	uint64_t start;
+	int up = 1;
+
+	if (socketpair(AF_UNIX,SOCK_STREAM,0,sv) != 0)
+	{
+		printf("Failed to create socket pair: %s\n",strerror(errno));
+		return 0;
+	}
+	fcntl(sv[0],F_SETFL,O_NONBLOCK);
+	fcntl(sv[1],F_SETFL,O_NONBLOCK);
+
+	/* Publish every change straight away, so the result does not depend on timing */
+	destination_table_init(&destinations);
+	destinations.publish_rate = 0;
+	destinations.cost_params.hold_down = 0;
+	session_params_init(&params);
+	params.sync_settle = 0;
+
+	sess = session_attach(sv[0],&params,&destinations);
+	if (!sess)
+	{
+		close(sv[0]);
+		close(sv[1]);
+		return 0;
+	}
+
+	start = now_ns();
+
+	for (i = 0; i < replay->count && up; ++i)
+	{
+		const struct replay_message* m = &replay->messages[i];
+		size_t off = 0;
+
+		if (m->session != session)
+			continue;
+
+		if (speed > 0.0)
+		{
+			/* Keep to the captured timing */
+			uint64_t due;
+			if (!handled && !first_ts)
+				first_ts = m->timestamp;
+
+			due = start + (uint64_t)((m->timestamp - first_ts) / speed);
+			while (now_ns() < due)
+			{
+				uint64_t wait = due - now_ns();
+				struct timespec ts;
+				ts.tv_sec = wait / 1000000000;
+				ts.tv_nsec = wait % 1000000000;
+				nanosleep(&ts,NULL);
+			}
+		}
+
+		while (off < m->len && up)
+		{
+			ssize_t w = send(sv[1],m->data + off,m->len - off,MSG_NOSIGNAL);
+			if (w > 0)
+				off += w;
+			else if (w == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				/* The socket is full, let the router catch up */
+				up = (session_receive(sess) == 1);
+				*sent += drain(sv[1]);
+			}
+			else
+			{
+				printf("Failed to send to socket pair: %s\n",strerror(errno));
+				up = 0;
+			}
+		}
+		++handled;
+
+		/* When keeping to time, handle each message as it arrives */
+		if (speed > 0.0 && up)
+		{
+			up = (session_receive(sess) == 1);
+			*sent += drain(sv[1]);
+		}
+	}
+
+	if (up)
+		up = (session_receive(sess) == 1);
+	*sent += drain(sv[1]);
+
+	/* A capture normally ends with the Session Termination */
+	for (; !up && i < replay->count; ++i)
+	{
+		if (replay->messages[i].session == session)
+		{
+			printf("Session %u ended early, after %lu messages\n",session,(unsigned long)handled);
+			break;
+		}
+	}
+
+	*elapsed += now_ns() - start;
+
+	session_detach(sess);
+	close(sv[0]);
+	close(sv[1]);
+
+	destination_clear(&destinations);
+	destination_table_free(&destinations);
+
+	return handled;
+}
+
+int main(int argc, char* argv[])
+{
+	const struct option options[] =
+	{
+		{ "speed",1,NULL,'s' },
+		{ "iterations",1,NULL,'n' },
+		{ "log-level",1,NULL,'L' },
+		{ "help",0,NULL,'h' },
+		{ 0 }
+	};
+
+	int c;
+	double speed = 0.0;
+	unsigned long iterations = 1;
+	unsigned long n;
+	struct replay replay = {0};
+	struct stat st;
+	const uint8_t* map;
+	int fd;
+	size_t messages = 0;
+	size_t sent = 0;
+	uint64_t elapsed = 0;
+	unsigned long allocations;
+	unsigned int session;
+
+	/* The router's own output would swamp the measurement */
+	log_level = LOG_LEVEL_ERROR;
+
+	/* Disable getopt's error messages */
+	opterr = 0;
+
+	while ((c = getopt_long(argc, argv, ":hs:n:L:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 's':
+			speed = strtod(optarg,NULL);
+			break;
+
+		case 'n':
+			iterations = strtoul(optarg,NULL,10);
+			break;
+
+		case 'L':
+			log_level = log_level_parse(optarg);
+			if (log_level < 0)
+			{
+				printf("Unknown log level '%s'\n",optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'h':
+			help();
+			return EXIT_SUCCESS;
+
+		case ':':
+			printf("Missing argument to -%c\n", optopt);
+			help();
+			return EXIT_FAILURE;
+
+		case '?':
+		default:
+			printf("Unknown option '-%c'\n", optopt);
+			help();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind + 1 != argc)
+	{
+		help();
+		return EXIT_FAILURE;
+	}
+
+	fd = open(argv[optind],O_RDONLY);
+	if (fd == -1 || fstat(fd,&st) != 0)
+	{
+		printf("Failed to open %s: %s\n",argv[optind],strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	map = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		printf("Failed to map %s: %s\n",argv[optind],strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (!load_capture(map,st.st_size,&replay))
+		return EXIT_FAILURE;
+
+	if (!replay.count)
+	{
+		printf("No received session messages in %s\n",argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	printf("Replaying %lu messages from %u sessions, %lu times\n",(unsigned long)replay.count,replay.sessions,iterations);
+
+	/* Only count what the router allocates */
+	allocations = s_allocations;
+
+	for (n = 0; n < iterations; ++n)
+	{
+		for (session = 1; session <= replay.sessions; ++session)
+			messages += replay_session(&replay,session,speed,&elapsed,&sent);
+	}
+
+	allocations = s_allocations - allocations;
+
+	printf("Messages:     %lu\n",(unsigned long)messages);
+	printf("Elapsed:      %.3f ms\n",elapsed / 1e6);
+	if (messages && elapsed)
+	{
+		printf("Throughput:   %.0f messages/s\n",messages * 1e9 / elapsed);
+		printf("Latency:      %.0f ns/message\n",(double)elapsed / messages);
+	}
+	printf("Allocations:  %lu (%.2f per message)\n",allocations,messages ? (double)allocations / messages : 0.0);
+	printf("Response:     %lu bytes\n",(unsigned long)sent);
+
+	free(replay.messages);
+	munmap((void*)map,st.st_size);
+
+	return EXIT_SUCCESS;
+}
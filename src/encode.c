@@ -0,0 +1,268 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./encode.h"
+
+#include <string.h>
+
+#include "./destination.h"
+
+uint8_t* write_message_header(uint8_t* msg, uint16_t msg_type)
+{
+	/* Octet 0 and 1 are the message type */
+	uint8_t* p = write_uint16(msg_type,msg);
+
+	/* Octet 2 and 3 are the message length, set to 0 initially */
+	return write_uint16(0,p);
+}
+
+uint8_t* write_data_item(uint8_t* msg, uint16_t type, uint16_t length)
+{
+	/* Octet 0 and 1 are the type code */
+	uint8_t* p = write_uint16(type,msg);
+
+	/* Octet 2 and 3 are the length, this excludes the header length (4) */
+	return write_uint16(length,p);
+}
+
+uint8_t* write_status_code(uint8_t* msg, enum dlep_status_code sc)
+{
+	/* Write out Status Code header */
+	msg = write_data_item(msg,DLEP_STATUS_DATA_ITEM,1);
+
+	/* And the code */
+	*msg++ = sc;
+
+	return msg;
+}
+
+static uint8_t* write_uint64(uint64_t v, uint8_t* p)
+{
+	p = write_uint32((uint32_t)(v >> 32),p);
+	return write_uint32((uint32_t)v,p);
+}
+
+static uint16_t end_message(uint8_t* msg, const uint8_t* p)
+{
+	uint16_t msg_len = p - msg;
+
+	/* Octet 2 and 3 are the message length, minus the length of the header */
+	write_uint16(msg_len - 4,msg + 2);
+
+	return msg_len;
+}
+
+uint16_t encode_peer_discovery_signal(uint8_t* msg)
+{
+	uint8_t* p;
+	uint16_t msg_len = 0;
+	size_t peer_type_len = 0;
+	uint8_t flags = 0x00;
+
+	/* All DLEP signals start with the 4 characters 'DLEP' */
+	msg[0] = 'D';
+	msg[1] = 'L';
+	msg[2] = 'E';
+	msg[3] = 'P';
+
+	/* Octets 4 and 5 are the signal number */
+	p = write_uint16(DLEP_PEER_DISCOVERY,msg+4);
+
+	/* Octets 6 and 7 are the signal length, initialize to 0 */
+	p = write_uint16(0,p);
+
+	/* Write out Peer Type, with safety check! */
+	peer_type_len = strlen(PEER_TYPE);
+	if (peer_type_len > ENCODE_MAX_LEN - 13)
+		peer_type_len = ENCODE_MAX_LEN - 13;
+
+	p = write_uint16(DLEP_PEER_TYPE_DATA_ITEM,p);
+	p = write_uint16(1 + peer_type_len,p); /* includes length of the flag + description fields */
+
+	/* add flags field */
+	*p++ = flags;
+
+	if (peer_type_len)
+	{
+		memcpy(p,PEER_TYPE,peer_type_len);
+		p += peer_type_len;
+	}
+
+	msg_len = p - msg;
+
+	/* Octet 6 and 7 are the signal length, minus the length of the header */
+	write_uint16(msg_len - 8,msg + 6);
+
+	return msg_len;
+}
+
+uint16_t encode_session_init_message(uint8_t* msg, uint32_t heartbeat_interval, const uint16_t* extensions, size_t extension_count)
+{
+	size_t peer_type_len = 0;
+	uint8_t flags = 0x00;
+	size_t i;
+
+	/* Write the message header */
+	uint8_t* p = write_message_header(msg,DLEP_SESSION_INIT);
+
+	/* Write out our Heartbeat Interval */
+	p = write_data_item(p,DLEP_HEARTBEAT_INTERVAL_DATA_ITEM,4);
+	p = write_uint32(heartbeat_interval,p);
+
+	/* Write out Peer Type */
+	peer_type_len = strlen(PEER_TYPE);
+	if (peer_type_len > ENCODE_MAX_LEN - 17)
+		peer_type_len = ENCODE_MAX_LEN - 17;
+
+	p = write_data_item(p,DLEP_PEER_TYPE_DATA_ITEM, 1 + peer_type_len);  /* includes length of the flag + description fields */
+	*p++ = flags;
+
+	if (peer_type_len)
+	{
+		memcpy(p, PEER_TYPE, peer_type_len);
+		p += peer_type_len;
+	}
+
+	/* Write out the extensions we support */
+	if (extension_count)
+	{
+		p = write_data_item(p,DLEP_EXTS_SUPP_DATA_ITEM,extension_count * 2);
+		for (i = 0; i < extension_count; ++i)
+			p = write_uint16(extensions[i],p);
+	}
+
+	return end_message(msg,p);
+}
+
+uint16_t encode_heartbeat_message(uint8_t* msg)
+{
+	/* Write the message header */
+	uint8_t* p = write_message_header(msg,DLEP_PEER_HEARTBEAT);
+
+	return end_message(msg,p);
+}
+
+uint16_t encode_session_term_message(uint8_t* msg, enum dlep_status_code sc)
+{
+	/* Write the message header */
+	uint8_t* p = write_message_header(msg,DLEP_SESSION_TERM);
+
+	/* Write out our Status Code */
+	p = write_status_code(p,sc);
+
+	return end_message(msg,p);
+}
+
+uint16_t encode_session_term_resp_message(uint8_t* msg)
+{
+	/* Write the message header */
+	uint8_t* p = write_message_header(msg,DLEP_SESSION_TERM_RESP);
+
+	return end_message(msg,p);
+}
+
+static uint16_t encode_destination_resp(uint8_t* msg, uint16_t msg_type, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc)
+{
+	/* Write the message header */
+	uint8_t* p = write_message_header(msg,msg_type);
+
+	/* Write out our MAC Address */
+	p = write_data_item(p,DLEP_MAC_ADDRESS_DATA_ITEM,6);
+	memcpy(p,mac,6);
+	p += 6;
+
+	/* Echo the Link Identifier, RFC 8703 section 2.2 */
+	if (link && link->len)
+	{
+		p = write_data_item(p,DLEP_LINK_ID_DATA_ITEM,link->len);
+		memcpy(p,link->id,link->len);
+		p += link->len;
+	}
+
+	/* Write out our Status code */
+	p = write_status_code(p,sc);
+
+	return end_message(msg,p);
+}
+
+uint16_t encode_destination_up_resp_message(uint8_t* msg, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc)
+{
+	return encode_destination_resp(msg,DLEP_DEST_UP_RESP,mac,link,sc);
+}
+
+uint16_t encode_destination_down_resp_message(uint8_t* msg, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc)
+{
+	return encode_destination_resp(msg,DLEP_DEST_DOWN_RESP,mac,link,sc);
+}
+
+uint16_t encode_link_char_request_message(uint8_t* msg, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* wanted)
+{
+	/* Write the message header */
+	uint8_t* p = write_message_header(msg,DLEP_LINK_CHAR_REQ);
+
+	/* Write out the MAC Address and Link Identifier of the destination */
+	p = write_data_item(p,DLEP_MAC_ADDRESS_DATA_ITEM,6);
+	memcpy(p,mac,6);
+	p += 6;
+
+	if (link && link->len)
+	{
+		p = write_data_item(p,DLEP_LINK_ID_DATA_ITEM,link->len);
+		memcpy(p,link->id,link->len);
+		p += link->len;
+	}
+
+	/* And what we would like from it, RFC 8175 section 12.19 */
+	if (wanted->present & DEST_FIELD_CDRR)
+	{
+		p = write_data_item(p,DLEP_CDRR_DATA_ITEM,8);
+		p = write_uint64(wanted->cdrr,p);
+	}
+	if (wanted->present & DEST_FIELD_CDRT)
+	{
+		p = write_data_item(p,DLEP_CDRT_DATA_ITEM,8);
+		p = write_uint64(wanted->cdrt,p);
+	}
+	if (wanted->present & DEST_FIELD_LATENCY)
+	{
+		p = write_data_item(p,DLEP_LATENCY_DATA_ITEM,8);
+		p = write_uint64(wanted->latency,p);
+	}
+
+	return end_message(msg,p);
+}
+
+uint16_t encode_credit_control_message(uint8_t* msg, const uint8_t* mac, const struct link_id* link, uint32_t classes)
+{
+	unsigned int i;
+
+	/* Write the message header */
+	uint8_t* p = write_message_header(msg,DLEP_CREDIT_CONTROL);
+
+	/* Write out the MAC Address and Link Identifier of the destination */
+	p = write_data_item(p,DLEP_MAC_ADDRESS_DATA_ITEM,6);
+	memcpy(p,mac,6);
+	p += 6;
+
+	if (link && link->len)
+	{
+		p = write_data_item(p,DLEP_LINK_ID_DATA_ITEM,link->len);
+		memcpy(p,link->id,link->len);
+		p += link->len;
+	}
+
+	/* A Credit Request for each starved traffic class */
+	for (i = 0; i < CREDIT_CLASSES; ++i)
+	{
+		if (classes & ((uint32_t)1 << i))
+		{
+			p = write_data_item(p,DLEP_CREDIT_REQUEST_DATA_ITEM,1);
+			*p++ = (uint8_t)i;
+		}
+	}
+
+	return end_message(msg,p);
+}
@@ -0,0 +1,43 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Encoders for the messages and signals the router sends
+ */
+
+#ifndef DLEP_ENCODE_H_
+#define DLEP_ENCODE_H_
+
+#include "./util.h"
+#include "./dlep_iana.h"
+
+/* A buffer of this size is large enough for any of the encoders below */
+#define ENCODE_MAX_LEN 300
+
+uint8_t* write_message_header(uint8_t* msg, uint16_t msg_type);
+uint8_t* write_data_item(uint8_t* msg, uint16_t type, uint16_t length);
+uint8_t* write_status_code(uint8_t* msg, enum dlep_status_code sc);
+
+/* Each encoder writes a complete message or signal to msg and returns its length */
+uint16_t encode_peer_discovery_signal(uint8_t* msg);
+uint16_t encode_session_init_message(uint8_t* msg, uint32_t heartbeat_interval, const uint16_t* extensions, size_t extension_count);
+uint16_t encode_heartbeat_message(uint8_t* msg);
+uint16_t encode_session_term_message(uint8_t* msg, enum dlep_status_code sc);
+uint16_t encode_session_term_resp_message(uint8_t* msg);
+
+/* link is the Link Identifier to echo, NULL if there is none */
+struct link_id;
+uint16_t encode_destination_up_resp_message(uint8_t* msg, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc);
+uint16_t encode_destination_down_resp_message(uint8_t* msg, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc);
+
+/* wanted may carry the CDRR, CDRT and Latency to ask for */
+struct destination_metrics;
+uint16_t encode_link_char_request_message(uint8_t* msg, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* wanted);
+
+/* A Credit Request for each traffic class set in classes, a bitmap */
+uint16_t encode_credit_control_message(uint8_t* msg, const uint8_t* mac, const struct link_id* link, uint32_t classes);
+
+#endif /* DLEP_ENCODE_H_ */
@@ -0,0 +1,220 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./extension.h"
+
+#include "./log.h"
+
+/* Assigned numbers below these, then the Private Use ranges */
+#define MESSAGE_ASSIGNED 32
+#define ITEM_ASSIGNED    64
+
+#define MESSAGE_PRIVATE  65520
+#define ITEM_PRIVATE     65408
+#define PRIVATE_END      65535
+
+#define MESSAGE_SLOTS    (MESSAGE_ASSIGNED + PRIVATE_END - MESSAGE_PRIVATE)
+#define ITEM_SLOTS       (ITEM_ASSIGNED + PRIVATE_END - ITEM_PRIVATE)
+
+static struct
+{
+	const struct extension_def* extensions[EXTENSION_MAX];
+	size_t count;
+
+	/* Indexed by message_slot() and item_slot() */
+	const struct extension_message* messages[MESSAGE_SLOTS];
+	unsigned int message_bits[MESSAGE_SLOTS];
+	const struct extension_item* items[ITEM_SLOTS];
+	unsigned int item_bits[ITEM_SLOTS];
+	unsigned long item_seen[ITEM_SLOTS]; /* The bit of each item in a seen mask */
+	size_t item_count;
+} s_registry;
+
+/* Returns -1 for the numbers we cannot hold */
+static int message_slot(uint16_t id)
+{
+	if (id < MESSAGE_ASSIGNED)
+		return id;
+	if (id >= MESSAGE_PRIVATE && id < PRIVATE_END)
+		return MESSAGE_ASSIGNED + (id - MESSAGE_PRIVATE);
+	return -1;
+}
+
+static int item_slot(uint16_t id)
+{
+	if (id < ITEM_ASSIGNED)
+		return id;
+	if (id >= ITEM_PRIVATE && id < PRIVATE_END)
+		return ITEM_ASSIGNED + (id - ITEM_PRIVATE);
+	return -1;
+}
+
+unsigned int extension_register(const struct extension_def* ext)
+{
+	unsigned int bit;
+	size_t i;
+
+	/* The core protocol has to have EXTENSION_CORE */
+	if (!s_registry.count != !ext->id)
+	{
+		LOG_ERROR(("The core DLEP protocol must be registered first, not registering %s\n",ext->name));
+		return 0;
+	}
+
+	if (s_registry.count == EXTENSION_MAX)
+	{
+		LOG_ERROR(("Too many DLEP extensions registered, not registering %s\n",ext->name));
+		return 0;
+	}
+
+	/* Check everything before touching the tables */
+	for (i = 0; i < ext->message_count; ++i)
+	{
+		int slot = message_slot(ext->messages[i].id);
+		if (slot < 0 || s_registry.messages[slot])
+		{
+			LOG_ERROR(("Message %u of DLEP extension %s cannot be registered\n",ext->messages[i].id,ext->name));
+			return 0;
+		}
+	}
+	for (i = 0; i < ext->item_count; ++i)
+	{
+		int slot = item_slot(ext->items[i].id);
+		if (slot < 0 || s_registry.item_bits[slot] || s_registry.item_count + i >= EXTENSION_ITEMS_MAX)
+		{
+			LOG_ERROR(("Data item %u of DLEP extension %s cannot be registered\n",ext->items[i].id,ext->name));
+			return 0;
+		}
+	}
+
+	bit = 1U << s_registry.count;
+	s_registry.extensions[s_registry.count++] = ext;
+
+	for (i = 0; i < ext->message_count; ++i)
+	{
+		int slot = message_slot(ext->messages[i].id);
+		s_registry.messages[slot] = &ext->messages[i];
+		s_registry.message_bits[slot] = bit;
+	}
+	for (i = 0; i < ext->item_count; ++i)
+	{
+		int slot = item_slot(ext->items[i].id);
+		s_registry.items[slot] = &ext->items[i];
+		s_registry.item_bits[slot] = bit;
+		s_registry.item_seen[slot] = 1UL << s_registry.item_count++;
+	}
+
+	return bit;
+}
+
+unsigned int extension_bit(uint16_t id)
+{
+	size_t i;
+	for (i = 1; i < s_registry.count; ++i)
+	{
+		if (s_registry.extensions[i]->id == id)
+			return 1U << i;
+	}
+	return 0;
+}
+
+size_t extension_offer(uint16_t* ids)
+{
+	size_t i;
+	size_t count = 0;
+
+	/* Everything but the core protocol */
+	for (i = 0; i < s_registry.count; ++i)
+	{
+		if (s_registry.extensions[i]->id)
+			ids[count++] = s_registry.extensions[i]->id;
+	}
+	return count;
+}
+
+unsigned int extension_negotiate(const uint8_t* data_item, uint16_t item_len)
+{
+	unsigned int negotiated = EXTENSION_CORE;
+	uint16_t i;
+
+	LOG_TRACE(("  Extensions advertised by peer:\n"));
+	for (i = 0; i + 1 < item_len; i += 2)
+	{
+		uint16_t ext_id = read_uint16(data_item + i);
+		size_t j;
+
+		/* Only the extensions we both support are used */
+		for (j = 1; j < s_registry.count && s_registry.extensions[j]->id != ext_id; ++j)
+			;
+
+		if (j >= s_registry.count)
+			LOG_TRACE(("    Unknown DLEP extension %u (which we don't support)\n",ext_id));
+		else
+		{
+			LOG_TRACE(("    %s\n",s_registry.extensions[j]->name));
+			negotiated |= 1U << j;
+		}
+	}
+	return negotiated;
+}
+
+int extension_item_allowed(unsigned int negotiated, uint16_t item_id)
+{
+	int slot = item_slot(item_id);
+	if (slot < 0 || !s_registry.item_bits[slot])
+		return 1;
+
+	return (s_registry.item_bits[slot] & negotiated) != 0;
+}
+
+const char* extension_item_name(uint16_t item_id)
+{
+	int slot = item_slot(item_id);
+	if (slot < 0 || !s_registry.items[slot])
+		return NULL;
+
+	return s_registry.items[slot]->name;
+}
+
+int extension_check_item(uint16_t msg_id, uint16_t item_id, const uint8_t* data_item, uint16_t item_len, unsigned long* seen, enum dlep_status_code* sc)
+{
+	const struct extension_item* item;
+	int slot = item_slot(item_id);
+	size_t i;
+
+	if (slot < 0 || !s_registry.items[slot])
+		return 0;
+
+	item = s_registry.items[slot];
+	for (i = 0; i < item->use_count && item->uses[i].message != msg_id; ++i)
+		;
+	if (i == item->use_count)
+		return 0;
+
+	if (item->uses[i].once && (*seen & s_registry.item_seen[slot]))
+	{
+		int msg_slot = message_slot(msg_id);
+		if (msg_slot >= 0 && s_registry.messages[msg_slot])
+			LOG_WARN(("Multiple %s data items in %s message\n",item->name,s_registry.messages[msg_slot]->name));
+		else
+			LOG_WARN(("Multiple %s data items in message %u\n",item->name,msg_id));
+		*sc = DLEP_SC_INVALID_DATA;
+		return 1;
+	}
+	*seen |= s_registry.item_seen[slot];
+
+	*sc = (item->check ? (*item->check)(data_item,item_len) : DLEP_SC_SUCCESS);
+	return 1;
+}
+
+const struct extension_message* extension_message(unsigned int negotiated, uint16_t msg_id)
+{
+	int slot = message_slot(msg_id);
+	if (slot < 0 || !(s_registry.message_bits[slot] & negotiated))
+		return NULL;
+
+	return s_registry.messages[slot];
+}
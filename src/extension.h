@@ -0,0 +1,113 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * The registry of the DLEP extensions we support. Each extension registers
+ * the data items it adds, with their validators and the messages they may
+ * appear in, and the messages it adds, with the validator and handler of
+ * each message. The core protocol of RFC 8175 is registered the same way
+ * as an extension that is always in use. Messages and data items are found
+ * through dense tables indexed by their numbers, with the Private Use ranges
+ * folded in after the assigned ones.
+ *
+ * The negotiated extensions of a session are a bitmask, each registered
+ * extension gets the next bit, and the core protocol has EXTENSION_CORE.
+ */
+
+#ifndef DLEP_EXTENSION_H_
+#define DLEP_EXTENSION_H_
+
+#include "./util.h"
+#include "./dlep_iana.h"
+
+/* The most extensions that can be registered, including the core protocol */
+#define EXTENSION_MAX 16
+
+/* The bit of the core protocol, always set in a negotiated mask */
+#define EXTENSION_CORE 1U
+
+/* The most data items that can be registered by all the extensions */
+#define EXTENSION_ITEMS_MAX 32
+
+struct dlep_session;
+
+/* Checks a complete message, returns DLEP_SC_SUCCESS if it is valid */
+typedef enum dlep_status_code (*extension_check)(const uint8_t* msg, size_t len);
+
+/* Handles a message that has been validated, data_items follows the message
+ * header. Returns DLEP_SC_SUCCESS, or a Status that may end the session */
+typedef enum dlep_status_code (*extension_handler)(struct dlep_session* sess, const uint8_t* data_items, uint16_t len);
+
+/* Checks the value of a data item, returns DLEP_SC_SUCCESS if it is valid */
+typedef enum dlep_status_code (*extension_item_check)(const uint8_t* data_item, uint16_t item_len);
+
+/* A message a data item may appear in */
+struct extension_item_use
+{
+	uint16_t message;         /* enum dlep_message */
+	int once;                 /* Non-zero if it may appear at most once */
+};
+
+struct extension_item
+{
+	uint16_t id;              /* enum dlep_data_item */
+	const char* name;
+	extension_item_check check;
+	const struct extension_item_use* uses; /* The messages from the modem it may appear in */
+	size_t use_count;
+};
+
+struct extension_message
+{
+	uint16_t id;              /* enum dlep_message */
+	const char* name;
+	extension_check check;    /* NULL if the modem should never send it */
+	extension_handler handler;
+};
+
+struct extension_def
+{
+	uint16_t id;              /* enum dlep_extension, 0 for the core protocol */
+	const char* name;
+	const struct extension_item* items; /* The data items it adds */
+	size_t item_count;
+	const struct extension_message* messages;
+	size_t message_count;
+};
+
+/* Register ext, which must outlive the registry, the core protocol first.
+ * Returns its bit, or 0 if the registry is full or a message or data item is
+ * already registered */
+unsigned int extension_register(const struct extension_def* ext);
+
+/* Returns the bit of extension id, or 0 if it is not registered */
+unsigned int extension_bit(uint16_t id);
+
+/* Write the ids of the registered extensions to ids, which has room for
+ * EXTENSION_MAX, returns how many there are */
+size_t extension_offer(uint16_t* ids);
+
+/* Returns the extensions in an Extensions Supported data item that we also
+ * support, as a negotiated mask including EXTENSION_CORE */
+unsigned int extension_negotiate(const uint8_t* data_item, uint16_t item_len);
+
+/* Returns 0 if item_id belongs to an extension that is not in negotiated,
+ * data items nobody registered are left to the validators */
+int extension_item_allowed(unsigned int negotiated, uint16_t item_id);
+
+/* Returns the name of data item item_id, or NULL if no extension registered it */
+const char* extension_item_name(uint16_t item_id);
+
+/* Checks data item item_id in message msg_id with the validator of the
+ * extension that registered it. seen records the extension data items already
+ * in the message, and starts at 0. Returns 0 if no extension lets item_id
+ * appear in msg_id, otherwise sets sc to the result */
+int extension_check_item(uint16_t msg_id, uint16_t item_id, const uint8_t* data_item, uint16_t item_len, unsigned long* seen, enum dlep_status_code* sc);
+
+/* Returns the message msg_id, or NULL if no extension in negotiated has it */
+const struct extension_message* extension_message(unsigned int negotiated, uint16_t msg_id);
+
+#endif /* DLEP_EXTENSION_H_ */
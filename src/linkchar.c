@@ -0,0 +1,534 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./linkchar.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "./encode.h"
+#include "./log.h"
+
+/* The timer wheel turns every WHEEL_TICK milliseconds, a timeout longer than
+ * WHEEL_SLOTS ticks just stays in its slot for more than one turn */
+#define WHEEL_TICK  10
+#define WHEEL_SLOTS 256
+
+/* The initial number of requests, must be a power of 2 */
+#define LINKCHAR_TABLE_MIN 64
+
+/* The end of a list of entries */
+#define NONE ((size_t)-1)
+
+enum entry_state
+{
+	ENTRY_FREE,
+	ENTRY_QUEUED,             /* Waiting for the session to send it */
+	ENTRY_SENT                /* Waiting for the response */
+};
+
+struct linkchar_entry
+{
+	uint8_t mac[6];
+	struct link_id link;      /* len is 0 if the request has none */
+	enum entry_state state;
+	struct destination_metrics wanted;
+	linkchar_callback callback;
+	void* context;
+
+	unsigned long expires;    /* The wheel tick it times out on */
+	size_t hash_next;         /* Next in the hash chain, or in the free list */
+	size_t timer_next;        /* Neighbours in the wheel slot */
+	size_t timer_prev;
+	size_t queue_next;        /* Next waiting to be sent */
+};
+
+struct linkchar_table
+{
+	pthread_mutex_t lock;
+	int wake_fd;
+	int active;               /* A session is accepting requests */
+	uint8_t link_id_len;      /* Negotiated by the session, 0 if Link Identifiers are not in use */
+
+	struct linkchar_entry* entries;
+	size_t* chains;           /* Hash chains, as many as entries */
+	size_t capacity;          /* Always a power of 2 */
+	size_t free_list;
+	size_t outstanding;       /* Also read without the lock, like queued */
+
+	size_t queue_head;
+	size_t queue_tail;
+	size_t queued;            /* Also read without the lock, to keep linkchar_next() cheap */
+
+	size_t wheel[WHEEL_SLOTS];
+	unsigned long wheel_tick; /* The next tick to be expired */
+};
+
+static size_t hash_destination(const uint8_t* mac, const struct link_id* link)
+{
+	/* FNV-1a, over the MAC address and then the Link Identifier */
+	uint32_t h = 2166136261UL;
+	unsigned int i;
+	for (i = 0; i < 6; ++i)
+	{
+		h ^= mac[i];
+		h *= 16777619UL;
+	}
+	for (i = 0; i < link->len; ++i)
+	{
+		h ^= link->id[i];
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+static unsigned long to_tick(const struct timespec* t)
+{
+	return (unsigned long)t->tv_sec * (1000 / WHEEL_TICK) + t->tv_nsec / (WHEEL_TICK * 1000000L);
+}
+
+static size_t* chain_of(struct linkchar_table* table, const uint8_t* mac, const struct link_id* link)
+{
+	return &table->chains[hash_destination(mac,link) & (table->capacity - 1)];
+}
+
+static int same_destination(const struct linkchar_entry* e, const uint8_t* mac, const struct link_id* link)
+{
+	return (memcmp(e->mac,mac,6) == 0 && e->link.len == link->len && memcmp(e->link.id,link->id,link->len) == 0);
+}
+
+static size_t find(struct linkchar_table* table, const uint8_t* mac, const struct link_id* link)
+{
+	size_t i = *chain_of(table,mac,link);
+	while (i != NONE && !same_destination(&table->entries[i],mac,link))
+		i = table->entries[i].hash_next;
+	return i;
+}
+
+/* A NULL link is the same as an empty one */
+static const struct link_id* key_link(const struct link_id* link)
+{
+	static const struct link_id no_link = { 0 };
+	return (link ? link : &no_link);
+}
+
+/* The link of an entry to pass on, NULL if it has none */
+static const struct link_id* optional_link(const struct link_id* link)
+{
+	return (link->len ? link : NULL);
+}
+
+static int grow(struct linkchar_table* table)
+{
+	size_t i;
+	size_t old_capacity = table->capacity;
+	size_t new_capacity = (old_capacity ? old_capacity * 2 : LINKCHAR_TABLE_MIN);
+	struct linkchar_entry* new_entries;
+	size_t* new_chains;
+
+	/* Entries are referred to by index, so they can just be reallocated */
+	new_entries = realloc(table->entries,new_capacity * sizeof(struct linkchar_entry));
+	if (!new_entries)
+		return 0;
+	table->entries = new_entries;
+
+	new_chains = malloc(new_capacity * sizeof(size_t));
+	if (!new_chains)
+		return 0;
+	free(table->chains);
+	table->chains = new_chains;
+	table->capacity = new_capacity;
+
+	/* The new entries are free */
+	for (i = new_capacity; i-- > old_capacity;)
+	{
+		table->entries[i].state = ENTRY_FREE;
+		table->entries[i].hash_next = table->free_list;
+		table->free_list = i;
+	}
+
+	/* Rehash the requests in use */
+	for (i = 0; i < new_capacity; ++i)
+		table->chains[i] = NONE;
+
+	for (i = 0; i < old_capacity; ++i)
+	{
+		if (table->entries[i].state != ENTRY_FREE)
+		{
+			size_t* chain = chain_of(table,table->entries[i].mac,&table->entries[i].link);
+			table->entries[i].hash_next = *chain;
+			*chain = i;
+		}
+	}
+	return 1;
+}
+
+static void set_queued(struct linkchar_table* table, size_t queued)
+{
+	__atomic_store_n(&table->queued,queued,__ATOMIC_RELAXED);
+}
+
+static void set_outstanding(struct linkchar_table* table, size_t outstanding)
+{
+	__atomic_store_n(&table->outstanding,outstanding,__ATOMIC_RELAXED);
+}
+
+static void timer_insert(struct linkchar_table* table, size_t i)
+{
+	struct linkchar_entry* e = &table->entries[i];
+	size_t* slot = &table->wheel[e->expires & (WHEEL_SLOTS - 1)];
+
+	e->timer_prev = NONE;
+	e->timer_next = *slot;
+	if (*slot != NONE)
+		table->entries[*slot].timer_prev = i;
+	*slot = i;
+}
+
+static void timer_remove(struct linkchar_table* table, size_t i)
+{
+	struct linkchar_entry* e = &table->entries[i];
+
+	if (e->timer_prev != NONE)
+		table->entries[e->timer_prev].timer_next = e->timer_next;
+	else
+		table->wheel[e->expires & (WHEEL_SLOTS - 1)] = e->timer_next;
+
+	if (e->timer_next != NONE)
+		table->entries[e->timer_next].timer_prev = e->timer_prev;
+}
+
+static void queue_remove(struct linkchar_table* table, size_t i)
+{
+	/* Only needed when a request ends before it is sent, so rare enough to walk */
+	size_t* p = &table->queue_head;
+	size_t prev = NONE;
+
+	while (*p != i)
+	{
+		prev = *p;
+		p = &table->entries[*p].queue_next;
+	}
+
+	*p = table->entries[i].queue_next;
+	if (table->queue_tail == i)
+		table->queue_tail = prev;
+
+	set_queued(table,table->queued - 1);
+}
+
+static void release(struct linkchar_table* table, size_t i)
+{
+	struct linkchar_entry* e = &table->entries[i];
+	size_t* p = chain_of(table,e->mac,&e->link);
+
+	while (*p != i)
+		p = &table->entries[*p].hash_next;
+	*p = e->hash_next;
+
+	timer_remove(table,i);
+	if (e->state == ENTRY_QUEUED)
+		queue_remove(table,i);
+
+	e->state = ENTRY_FREE;
+	e->hash_next = table->free_list;
+	table->free_list = i;
+	set_outstanding(table,table->outstanding - 1);
+}
+
+struct linkchar_table* linkchar_table_create(void)
+{
+	size_t i;
+	struct linkchar_table* table = calloc(1,sizeof(struct linkchar_table));
+	if (!table)
+	{
+		LOG_ERROR(("Failed to allocate Link Characteristics table\n"));
+		return NULL;
+	}
+
+	pthread_mutex_init(&table->lock,NULL);
+	table->free_list = NONE;
+	table->queue_head = NONE;
+	table->queue_tail = NONE;
+	for (i = 0; i < WHEEL_SLOTS; ++i)
+		table->wheel[i] = NONE;
+
+	table->wake_fd = eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+	if (table->wake_fd == -1)
+	{
+		LOG_ERROR(("Failed to create Link Characteristics event: %s\n",strerror(errno)));
+		pthread_mutex_destroy(&table->lock);
+		free(table);
+		return NULL;
+	}
+
+	if (!grow(table))
+	{
+		LOG_ERROR(("Failed to allocate Link Characteristics table\n"));
+		linkchar_table_destroy(table);
+		return NULL;
+	}
+
+	return table;
+}
+
+void linkchar_table_destroy(struct linkchar_table* table)
+{
+	if (table)
+	{
+		pthread_mutex_destroy(&table->lock);
+		close(table->wake_fd);
+		free(table->entries);
+		free(table->chains);
+		free(table);
+	}
+}
+
+int linkchar_request(struct linkchar_table* table, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* wanted, unsigned int timeout, linkchar_callback callback, void* context)
+{
+	struct timespec now;
+	int ret = 0;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+
+	link = key_link(link);
+
+	pthread_mutex_lock(&table->lock);
+
+	/* The modem only knows links of the negotiated length */
+	if (table->active && (!link->len || link->len == table->link_id_len) &&
+			find(table,mac,link) == NONE && (table->free_list != NONE || grow(table)))
+	{
+		size_t i = table->free_list;
+		struct linkchar_entry* e = &table->entries[i];
+		size_t* chain;
+
+		table->free_list = e->hash_next;
+
+		memcpy(e->mac,mac,6);
+		e->link = *link;
+		e->state = ENTRY_QUEUED;
+		if (wanted)
+			e->wanted = *wanted;
+		else
+			memset(&e->wanted,0,sizeof(e->wanted));
+		e->callback = callback;
+		e->context = context;
+
+		/* Round up, and never into a tick that has already been expired */
+		e->expires = to_tick(&now) + (timeout + WHEEL_TICK - 1) / WHEEL_TICK;
+		if (e->expires < table->wheel_tick)
+			e->expires = table->wheel_tick;
+
+		chain = chain_of(table,mac,link);
+		e->hash_next = *chain;
+		*chain = i;
+		timer_insert(table,i);
+
+		e->queue_next = NONE;
+		if (table->queue_tail != NONE)
+			table->entries[table->queue_tail].queue_next = i;
+		else
+			table->queue_head = i;
+		table->queue_tail = i;
+		set_queued(table,table->queued + 1);
+
+		set_outstanding(table,table->outstanding + 1);
+		ret = 1;
+	}
+
+	pthread_mutex_unlock(&table->lock);
+
+	if (ret)
+	{
+		/* Wake the session to send it */
+		uint64_t one = 1;
+		if (write(table->wake_fd,&one,sizeof(one)) == -1 && errno != EAGAIN)
+			LOG_ERROR(("Failed to signal Link Characteristics event: %s\n",strerror(errno)));
+	}
+
+	return ret;
+}
+
+void linkchar_begin(struct linkchar_table* table, uint8_t link_id_len)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+
+	pthread_mutex_lock(&table->lock);
+	table->active = 1;
+	table->link_id_len = link_id_len;
+	table->wheel_tick = to_tick(&now);
+	pthread_mutex_unlock(&table->lock);
+}
+
+void linkchar_end(struct linkchar_table* table)
+{
+	pthread_mutex_lock(&table->lock);
+	table->active = 0;
+
+	/* Callbacks are made without the lock, so they can make new requests */
+	while (table->outstanding)
+	{
+		size_t i;
+		uint8_t mac[6];
+		struct link_id link;
+		linkchar_callback callback;
+		void* context;
+
+		for (i = 0; table->entries[i].state == ENTRY_FREE; ++i)
+			;
+
+		memcpy(mac,table->entries[i].mac,6);
+		link = table->entries[i].link;
+		callback = table->entries[i].callback;
+		context = table->entries[i].context;
+		release(table,i);
+
+		pthread_mutex_unlock(&table->lock);
+		(*callback)(context,mac,optional_link(&link),DLEP_SC_SHUTDOWN,NULL);
+		pthread_mutex_lock(&table->lock);
+	}
+
+	pthread_mutex_unlock(&table->lock);
+}
+
+int linkchar_wake_fd(const struct linkchar_table* table)
+{
+	return table->wake_fd;
+}
+
+void linkchar_clear_wake(struct linkchar_table* table)
+{
+	uint64_t count;
+	if (read(table->wake_fd,&count,sizeof(count)) == -1 && errno != EAGAIN)
+		LOG_ERROR(("Failed to read Link Characteristics event: %s\n",strerror(errno)));
+}
+
+uint16_t linkchar_next(struct linkchar_table* table, uint8_t* msg)
+{
+	uint16_t msg_len = 0;
+
+	/* This is called for every message handled, so don't take the lock for nothing */
+	if (!__atomic_load_n(&table->queued,__ATOMIC_RELAXED))
+		return 0;
+
+	pthread_mutex_lock(&table->lock);
+
+	if (table->queue_head != NONE)
+	{
+		struct linkchar_entry* e = &table->entries[table->queue_head];
+
+		table->queue_head = e->queue_next;
+		if (table->queue_head == NONE)
+			table->queue_tail = NONE;
+		set_queued(table,table->queued - 1);
+
+		e->state = ENTRY_SENT;
+		msg_len = encode_link_char_request_message(msg,e->mac,optional_link(&e->link),&e->wanted);
+	}
+
+	pthread_mutex_unlock(&table->lock);
+
+	return msg_len;
+}
+
+int linkchar_response(struct linkchar_table* table, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc, const struct destination_metrics* metrics)
+{
+	size_t i;
+	linkchar_callback callback = NULL;
+	void* context = NULL;
+
+	pthread_mutex_lock(&table->lock);
+
+	i = find(table,mac,key_link(link));
+	if (i != NONE && table->entries[i].state == ENTRY_SENT)
+	{
+		callback = table->entries[i].callback;
+		context = table->entries[i].context;
+		release(table,i);
+	}
+
+	pthread_mutex_unlock(&table->lock);
+
+	if (!callback)
+		return 0;
+
+	(*callback)(context,mac,link,sc,metrics);
+	return 1;
+}
+
+static size_t next_expired(struct linkchar_table* table, unsigned long now_tick)
+{
+	/* One turn of the wheel visits every slot */
+	if (now_tick >= table->wheel_tick + WHEEL_SLOTS)
+		table->wheel_tick = now_tick - WHEEL_SLOTS + 1;
+
+	while (table->wheel_tick <= now_tick)
+	{
+		size_t i;
+		for (i = table->wheel[table->wheel_tick & (WHEEL_SLOTS - 1)]; i != NONE; i = table->entries[i].timer_next)
+		{
+			if (table->entries[i].expires <= now_tick)
+				return i;
+		}
+
+		++table->wheel_tick;
+	}
+	return NONE;
+}
+
+unsigned long linkchar_expire(struct linkchar_table* table, const struct timespec* now)
+{
+	unsigned long now_tick = to_tick(now);
+	unsigned long wait = 0;
+	unsigned long t;
+
+	/* Also called for every message handled */
+	if (!__atomic_load_n(&table->outstanding,__ATOMIC_RELAXED))
+		return 0;
+
+	pthread_mutex_lock(&table->lock);
+
+	for (;;)
+	{
+		uint8_t mac[6];
+		struct link_id link;
+		linkchar_callback callback;
+		void* context;
+
+		size_t i = next_expired(table,now_tick);
+		if (i == NONE)
+			break;
+
+		memcpy(mac,table->entries[i].mac,6);
+		link = table->entries[i].link;
+		callback = table->entries[i].callback;
+		context = table->entries[i].context;
+		release(table,i);
+
+		pthread_mutex_unlock(&table->lock);
+		LOG_WARN(("No Link Characteristics Response for destination %02X:%02X:%02X:%02X:%02X:%02X\n",mac[0],mac[1],mac[2],mac[3],mac[4],mac[5]));
+		(*callback)(context,mac,optional_link(&link),DLEP_SC_TIMEDOUT,NULL);
+		pthread_mutex_lock(&table->lock);
+	}
+
+	/* Wake up for the next occupied slot, it may be for a later turn but that's harmless */
+	if (table->outstanding)
+	{
+		for (t = table->wheel_tick; table->wheel[t & (WHEEL_SLOTS - 1)] == NONE; ++t)
+			;
+		wait = (t - now_tick) * WHEEL_TICK;
+	}
+
+	pthread_mutex_unlock(&table->lock);
+
+	return wait;
+}
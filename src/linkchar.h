@@ -0,0 +1,70 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Link Characteristics Requests, RFC 8175 section 12.19, sent without waiting
+ * for the round trip: any number of destinations can have a request
+ * outstanding, each is completed through its callback by the modem's
+ * response, a timeout or the end of the session. A destination is a MAC
+ * address and, if the Link Identifier extension is in use, a link, RFC 8703
+ */
+
+#ifndef DLEP_LINKCHAR_H_
+#define DLEP_LINKCHAR_H_
+
+#include "./util.h"
+#include "./dlep_iana.h"
+#include "./destination.h"
+
+struct linkchar_table;
+
+/* Called on the session thread when a request completes. link is NULL if the
+ * request had no Link Identifier. sc is the Status of the response
+ * (DLEP_SC_SUCCESS if it had none), DLEP_SC_TIMEDOUT if the modem did not
+ * respond in time or DLEP_SC_SHUTDOWN if the session ended first, metrics is
+ * only set when a response was received */
+typedef void (*linkchar_callback)(void* context, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc, const struct destination_metrics* metrics);
+
+/* Create an empty table, returns NULL on failure */
+struct linkchar_table* linkchar_table_create(void);
+
+/* Free the table, there must be no session using it */
+void linkchar_table_destroy(struct linkchar_table* table);
+
+/* Ask the modem for the link characteristics of the destination mac and link,
+ * from any thread. link may be NULL, wanted may carry the CDRR, CDRT and Latency
+ * a flow needs, or be NULL, and timeout is in milliseconds. Returns 1 if the
+ * request has been queued, or 0 if there is no session, link does not have the
+ * negotiated length, a request for the destination is already outstanding, or
+ * on allocation failure */
+int linkchar_request(struct linkchar_table* table, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* wanted, unsigned int timeout, linkchar_callback callback, void* context);
+
+/* The rest is for the session */
+
+/* Accept requests for a new session, link_id_len is the negotiated length of
+ * a Link Identifier, or 0 if the extension is not in use */
+void linkchar_begin(struct linkchar_table* table, uint8_t link_id_len);
+
+/* Stop accepting requests, and complete every outstanding one with DLEP_SC_SHUTDOWN */
+void linkchar_end(struct linkchar_table* table);
+
+/* A descriptor that becomes readable when a request is queued, clear it with linkchar_clear_wake() */
+int linkchar_wake_fd(const struct linkchar_table* table);
+void linkchar_clear_wake(struct linkchar_table* table);
+
+/* Encode the next queued request into msg, which must be ENCODE_MAX_LEN octets,
+ * returns its length or 0 if there is nothing to send */
+uint16_t linkchar_next(struct linkchar_table* table, uint8_t* msg);
+
+/* Complete the outstanding request for mac and link with the response from
+ * the modem, returns 0 if there was none */
+int linkchar_response(struct linkchar_table* table, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc, const struct destination_metrics* metrics);
+
+/* Time out the requests that are due, returns the number of milliseconds until
+ * the next may be due, or 0 if nothing is outstanding */
+unsigned long linkchar_expire(struct linkchar_table* table, const struct timespec* now);
+
+#endif /* DLEP_LINKCHAR_H_ */
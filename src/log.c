@@ -0,0 +1,661 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./log.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#define LOG_MAX_ARGS  16
+#define LOG_TEXT_SIZE 320   /* Space for copies of %s arguments */
+#define LOG_LINE_SIZE 2048  /* Longest formatted message */
+#define LOG_SPEC_SIZE 32    /* Longest single conversion specification */
+
+/* Everything needed to format a message later. The argument types are
+ * not stored, they are recovered by parsing the format string again */
+union log_arg
+{
+	int64_t i;
+	uint64_t u;
+	double d;
+	const void* p;
+	size_t offset;            /* Of a copied string in the text */
+};
+
+struct log_record
+{
+	size_t sequence;          /* Ring cell sequence number */
+	const char* format;
+	unsigned int nargs;
+	size_t text_len;
+	union log_arg args[LOG_MAX_ARGS];
+	char text[LOG_TEXT_SIZE + 1];
+};
+
+int log_level = LOG_LEVEL_TRACE;
+
+/* A bounded multiple producer, single consumer ring after Dmitry Vyukov's queue */
+static struct
+{
+	struct log_record* records;
+	size_t mask;
+	enum log_policy policy;
+	pthread_t thread;
+	sem_t wakeup;
+
+	int running;
+	int producers;            /* In log_printf(), and possibly using the ring */
+	int stopping;
+	int sleeping;             /* The consumer is waiting on wakeup */
+	unsigned long dropped;
+
+	/* Keep the producer and consumer positions on separate cache lines */
+	char pad1[64];
+	size_t enqueue_pos;
+	char pad2[64];
+	size_t dequeue_pos;
+} s_log;
+
+/* A parsed conversion specification */
+struct log_spec
+{
+	const char* start;        /* The '%' */
+	size_t prefix_len;        /* '%', flags, width and precision */
+	int star_width;
+	int star_precision;
+	int precision;            /* -1 if not given */
+	char length;              /* 0, 'h', 'l', 'L' (long long), 'z' or 'D' (long double) */
+	char conversion;
+};
+
+static const char* parse_spec(const char* p, struct log_spec* spec)
+{
+	spec->start = p++;
+	spec->star_width = 0;
+	spec->star_precision = 0;
+	spec->precision = -1;
+	spec->length = 0;
+
+	while (*p && strchr("-+ #0'",*p))
+		++p;
+
+	if (*p == '*')
+	{
+		spec->star_width = 1;
+		++p;
+	}
+	else
+	{
+		while (isdigit((unsigned char)*p))
+			++p;
+	}
+
+	if (*p == '.')
+	{
+		++p;
+		if (*p == '*')
+		{
+			spec->star_precision = 1;
+			++p;
+		}
+		else
+		{
+			spec->precision = 0;
+			while (isdigit((unsigned char)*p))
+				spec->precision = spec->precision * 10 + (*p++ - '0');
+		}
+	}
+
+	spec->prefix_len = p - spec->start;
+
+	switch (*p)
+	{
+	case 'h':
+		spec->length = 'h';
+		if (*++p == 'h')
+			++p;
+		break;
+
+	case 'l':
+		spec->length = 'l';
+		if (*++p == 'l')
+		{
+			spec->length = 'L';
+			++p;
+		}
+		break;
+
+	case 'j':
+	case 'q':
+		spec->length = 'L';
+		++p;
+		break;
+
+	case 'z':
+	case 't':
+		spec->length = 'z';
+		++p;
+		break;
+
+	case 'L':
+		spec->length = 'D';
+		++p;
+		break;
+	}
+
+	spec->conversion = *p;
+	if (*p)
+		++p;
+
+	return p;
+}
+
+/* Copy at most max characters of str into the record text */
+static size_t copy_string(struct log_record* rec, const char* str, int max)
+{
+	size_t offset = rec->text_len < LOG_TEXT_SIZE ? rec->text_len : LOG_TEXT_SIZE;
+	size_t room = LOG_TEXT_SIZE - offset;
+	size_t len = 0;
+
+	if (!str)
+		str = "(null)";
+
+	if (max >= 0 && (size_t)max < room)
+		room = max;
+
+	while (len < room && str[len])
+	{
+		rec->text[offset + len] = str[len];
+		++len;
+	}
+	rec->text[offset + len] = '\0';
+
+	rec->text_len = offset + len + 1;
+	return offset;
+}
+
+/* Record the arguments, stopping if there are too many */
+static void capture(struct log_record* rec, const char* format, va_list ap)
+{
+	const char* p = format;
+	struct log_spec spec;
+
+	rec->format = format;
+	rec->nargs = 0;
+	rec->text_len = 0;
+
+	while (*p)
+	{
+		if (*p != '%')
+		{
+			++p;
+			continue;
+		}
+
+		p = parse_spec(p,&spec);
+		if (rec->nargs + spec.star_width + spec.star_precision + 1 > LOG_MAX_ARGS)
+			break;
+
+		if (spec.star_width)
+			rec->args[rec->nargs++].i = va_arg(ap,int);
+
+		if (spec.star_precision)
+		{
+			spec.precision = va_arg(ap,int);
+			rec->args[rec->nargs++].i = spec.precision;
+		}
+
+		switch (spec.conversion)
+		{
+		case 'd':
+		case 'i':
+			if (spec.length == 'l')
+				rec->args[rec->nargs++].i = va_arg(ap,long);
+			else if (spec.length == 'L')
+				rec->args[rec->nargs++].i = va_arg(ap,int64_t);
+			else if (spec.length == 'z')
+				rec->args[rec->nargs++].i = va_arg(ap,ssize_t);
+			else
+				rec->args[rec->nargs++].i = va_arg(ap,int);
+			break;
+
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			if (spec.length == 'l')
+				rec->args[rec->nargs++].u = va_arg(ap,unsigned long);
+			else if (spec.length == 'L')
+				rec->args[rec->nargs++].u = va_arg(ap,uint64_t);
+			else if (spec.length == 'z')
+				rec->args[rec->nargs++].u = va_arg(ap,size_t);
+			else
+				rec->args[rec->nargs++].u = va_arg(ap,unsigned int);
+
+			/* Apply the truncation the caller asked for */
+			if (spec.length == 'h')
+				rec->args[rec->nargs-1].u &= (spec.start[spec.prefix_len+1] == 'h' ? 0xFF : 0xFFFF);
+			break;
+
+		case 'c':
+			rec->args[rec->nargs++].i = va_arg(ap,int);
+			break;
+
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (spec.length == 'D')
+				rec->args[rec->nargs++].d = va_arg(ap,long double);
+			else
+				rec->args[rec->nargs++].d = va_arg(ap,double);
+			break;
+
+		case 'p':
+			rec->args[rec->nargs++].p = va_arg(ap,void*);
+			break;
+
+		case 's':
+			rec->args[rec->nargs++].offset = copy_string(rec,va_arg(ap,const char*),spec.precision);
+			break;
+
+		default:
+			/* '%' or something unsupported */
+			break;
+		}
+	}
+}
+
+#define LOG_SNPRINTF(value) \
+	(spec.star_width ? \
+		(spec.star_precision ? snprintf(out,room,fmt,width,precision,value) : snprintf(out,room,fmt,width,value)) : \
+		(spec.star_precision ? snprintf(out,room,fmt,precision,value) : snprintf(out,room,fmt,value)))
+
+/* Format a record into line, returns the length */
+static size_t format_record(const struct log_record* rec, char* line, size_t line_len)
+{
+	const char* p = rec->format;
+	size_t pos = 0;
+	unsigned int n = 0;
+
+	while (*p && pos < line_len - 1)
+	{
+		struct log_spec spec;
+		char fmt[LOG_SPEC_SIZE];
+		const char* conv = NULL;
+		char* out = line + pos;
+		size_t room = line_len - pos;
+		int width = 0;
+		int precision = 0;
+		int r = 0;
+
+		if (*p != '%')
+		{
+			line[pos++] = *p++;
+			continue;
+		}
+
+		p = parse_spec(p,&spec);
+		if (spec.conversion == '%')
+		{
+			line[pos++] = '%';
+			continue;
+		}
+
+		if (spec.prefix_len > LOG_SPEC_SIZE - 8 || n + spec.star_width + spec.star_precision + 1 > rec->nargs)
+			break;
+
+		if (spec.star_width)
+			width = (int)rec->args[n++].i;
+		if (spec.star_precision)
+			precision = (int)rec->args[n++].i;
+
+		switch (spec.conversion)
+		{
+		case 'd':
+		case 'i':
+			conv = PRId64;
+			break;
+		case 'u':
+			conv = PRIu64;
+			break;
+		case 'o':
+			conv = PRIo64;
+			break;
+		case 'x':
+			conv = PRIx64;
+			break;
+		case 'X':
+			conv = PRIX64;
+			break;
+		case 'c':
+			conv = "c";
+			break;
+		case 's':
+			conv = "s";
+			break;
+		case 'p':
+			conv = "p";
+			break;
+		case 'f':
+			conv = "f";
+			break;
+		case 'F':
+			conv = "F";
+			break;
+		case 'e':
+			conv = "e";
+			break;
+		case 'E':
+			conv = "E";
+			break;
+		case 'g':
+			conv = "g";
+			break;
+		case 'G':
+			conv = "G";
+			break;
+		case 'a':
+			conv = "a";
+			break;
+		case 'A':
+			conv = "A";
+			break;
+		}
+
+		if (!conv)
+			break;
+
+		memcpy(fmt,spec.start,spec.prefix_len);
+		strcpy(fmt + spec.prefix_len,conv);
+
+		switch (spec.conversion)
+		{
+		case 'd':
+		case 'i':
+			r = LOG_SNPRINTF(rec->args[n].i);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			r = LOG_SNPRINTF(rec->args[n].u);
+			break;
+		case 'c':
+			r = LOG_SNPRINTF((int)rec->args[n].i);
+			break;
+		case 's':
+			r = LOG_SNPRINTF(rec->text + rec->args[n].offset);
+			break;
+		case 'p':
+			r = LOG_SNPRINTF(rec->args[n].p);
+			break;
+		default:
+			r = LOG_SNPRINTF(rec->args[n].d);
+			break;
+		}
+		++n;
+
+		if (r < 0)
+			break;
+		pos += ((size_t)r < room ? (size_t)r : room - 1);
+	}
+
+	return pos;
+}
+
+int log_level_parse(const char* name)
+{
+	static const char* const names[] = { "error", "warn", "info", "debug", "trace" };
+	int i;
+
+	for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); ++i)
+	{
+		if (!strcmp(name,names[i]))
+			return i;
+	}
+	return -1;
+}
+
+int log_policy_parse(const char* name)
+{
+	if (!strcmp(name,"drop"))
+		return LOG_POLICY_DROP;
+	if (!strcmp(name,"block"))
+		return LOG_POLICY_BLOCK;
+	if (!strcmp(name,"sync"))
+		return LOG_POLICY_SYNC;
+	return -1;
+}
+
+static void wake_consumer(void)
+{
+	/* Pairs with the fence in the consumer: either it sees the new record
+	 * or we see that it is about to sleep */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&s_log.sleeping,__ATOMIC_RELAXED) && __atomic_exchange_n(&s_log.sleeping,0,__ATOMIC_ACQ_REL))
+		sem_post(&s_log.wakeup);
+}
+
+static struct log_record* ring_acquire(size_t* ppos)
+{
+	size_t pos = __atomic_load_n(&s_log.enqueue_pos,__ATOMIC_RELAXED);
+	for (;;)
+	{
+		struct log_record* rec = &s_log.records[pos & s_log.mask];
+		size_t seq = __atomic_load_n(&rec->sequence,__ATOMIC_ACQUIRE);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&s_log.enqueue_pos,&pos,pos + 1,1,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+			{
+				*ppos = pos;
+				return rec;
+			}
+		}
+		else if (diff < 0)
+		{
+			/* Full */
+			if (s_log.policy != LOG_POLICY_BLOCK)
+				return NULL;
+
+			wake_consumer();
+			sched_yield();
+			pos = __atomic_load_n(&s_log.enqueue_pos,__ATOMIC_RELAXED);
+		}
+		else
+			pos = __atomic_load_n(&s_log.enqueue_pos,__ATOMIC_RELAXED);
+	}
+}
+
+static struct log_record* ring_peek(void)
+{
+	struct log_record* rec = &s_log.records[s_log.dequeue_pos & s_log.mask];
+	if (__atomic_load_n(&rec->sequence,__ATOMIC_ACQUIRE) != s_log.dequeue_pos + 1)
+		return NULL;
+	return rec;
+}
+
+static void ring_release(struct log_record* rec)
+{
+	__atomic_store_n(&rec->sequence,s_log.dequeue_pos + s_log.mask + 1,__ATOMIC_RELEASE);
+	++s_log.dequeue_pos;
+}
+
+static void* log_thread(void* arg)
+{
+	static char line[LOG_LINE_SIZE];
+	unsigned long reported = 0;
+
+	(void)arg;
+
+	for (;;)
+	{
+		struct log_record* rec;
+		unsigned long dropped;
+		int stopping = __atomic_load_n(&s_log.stopping,__ATOMIC_ACQUIRE);
+
+		while ((rec = ring_peek()) != NULL)
+		{
+			size_t len = format_record(rec,line,sizeof(line));
+			ring_release(rec);
+			fwrite(line,1,len,stdout);
+		}
+
+		dropped = __atomic_load_n(&s_log.dropped,__ATOMIC_RELAXED);
+		if (dropped != reported)
+		{
+			printf("Log ring full, %lu messages dropped\n",dropped - reported);
+			reported = dropped;
+		}
+
+		fflush(stdout);
+
+		if (stopping)
+			break;
+
+		__atomic_store_n(&s_log.sleeping,1,__ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		if (!ring_peek() && !__atomic_load_n(&s_log.stopping,__ATOMIC_ACQUIRE))
+			sem_wait(&s_log.wakeup);
+
+		__atomic_store_n(&s_log.sleeping,0,__ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+int log_start(size_t ring_size, enum log_policy policy)
+{
+	static int registered = 0;
+	size_t i;
+	int err;
+
+	if (policy == LOG_POLICY_SYNC || s_log.running)
+		return 0;
+
+	if (!ring_size || (ring_size & (ring_size - 1)))
+	{
+		printf("Log ring size must be a power of 2\n");
+		return -1;
+	}
+
+	s_log.records = malloc(ring_size * sizeof(struct log_record));
+	if (!s_log.records)
+	{
+		printf("Failed to allocate log ring: %s\n",strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < ring_size; ++i)
+		s_log.records[i].sequence = i;
+
+	s_log.mask = ring_size - 1;
+	s_log.policy = policy;
+	s_log.enqueue_pos = 0;
+	s_log.dequeue_pos = 0;
+	s_log.stopping = 0;
+	s_log.sleeping = 0;
+	s_log.dropped = 0;
+
+	if (sem_init(&s_log.wakeup,0,0) != 0)
+	{
+		printf("Failed to create log semaphore: %s\n",strerror(errno));
+		free(s_log.records);
+		s_log.records = NULL;
+		return -1;
+	}
+
+	err = pthread_create(&s_log.thread,NULL,&log_thread,NULL);
+	if (err)
+	{
+		printf("Failed to start logging thread: %s\n",strerror(err));
+		sem_destroy(&s_log.wakeup);
+		free(s_log.records);
+		s_log.records = NULL;
+		return -1;
+	}
+
+	__atomic_store_n(&s_log.running,1,__ATOMIC_RELEASE);
+
+	if (!registered)
+	{
+		atexit(&log_stop);
+		registered = 1;
+	}
+
+	return 0;
+}
+
+void log_stop(void)
+{
+	if (!__atomic_load_n(&s_log.running,__ATOMIC_ACQUIRE))
+		return;
+
+	/* Anything logged from here on goes straight to stdout */
+	__atomic_store_n(&s_log.running,0,__ATOMIC_SEQ_CST);
+
+	/* Other threads may still be running at exit, let any that saw the ring
+	 * running finish with it before it goes */
+	while (__atomic_load_n(&s_log.producers,__ATOMIC_SEQ_CST))
+		sched_yield();
+
+	__atomic_store_n(&s_log.stopping,1,__ATOMIC_RELEASE);
+	sem_post(&s_log.wakeup);
+	pthread_join(s_log.thread,NULL);
+
+	sem_destroy(&s_log.wakeup);
+	free(s_log.records);
+	s_log.records = NULL;
+}
+
+void log_printf(const char* format, ...)
+{
+	va_list ap;
+	va_start(ap,format);
+
+	/* Pairs with log_stop(): either it sees us here, or we see it has stopped */
+	__atomic_add_fetch(&s_log.producers,1,__ATOMIC_SEQ_CST);
+
+	if (!__atomic_load_n(&s_log.running,__ATOMIC_SEQ_CST))
+		vprintf(format,ap);
+	else
+	{
+		size_t pos;
+		struct log_record* rec = ring_acquire(&pos);
+		if (rec)
+		{
+			capture(rec,format,ap);
+			__atomic_store_n(&rec->sequence,pos + 1,__ATOMIC_RELEASE);
+			wake_consumer();
+		}
+		else
+			__atomic_add_fetch(&s_log.dropped,1,__ATOMIC_RELAXED);
+	}
+
+	__atomic_sub_fetch(&s_log.producers,1,__ATOMIC_RELEASE);
+	va_end(ap);
+}
+
+unsigned long log_dropped(void)
+{
+	return __atomic_load_n(&s_log.dropped,__ATOMIC_RELAXED);
+}
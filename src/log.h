@@ -0,0 +1,79 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Asynchronous logging: the caller only records the format string and the raw
+ * arguments in a lock-free ring, and a background thread does the formatting
+ * and the (possibly slow) writing to stdout
+ */
+
+#ifndef DLEP_LOG_H_
+#define DLEP_LOG_H_
+
+#include "./util.h"
+
+/* Log levels, in increasing verbosity */
+enum log_level {
+	LOG_LEVEL_ERROR = 0,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG,
+	LOG_LEVEL_TRACE
+};
+
+/* The most verbose level compiled in, set with configure --with-log-floor */
+#ifndef DLEP_LOG_FLOOR
+#define DLEP_LOG_FLOOR LOG_LEVEL_TRACE
+#endif
+
+/* The most verbose level logged at runtime */
+extern int log_level;
+
+#define LOG_ENABLED(level) ((level) <= DLEP_LOG_FLOOR && (level) <= log_level)
+
+/* Each takes a parenthesised printf() argument list, e.g. LOG_INFO(("%u\n",n)).
+ * The arguments are not evaluated if the level is disabled, and levels above
+ * the floor compile to nothing */
+#define LOG_AT(level,args) do { if (LOG_ENABLED(level)) log_printf args; } while (0)
+
+#define LOG_ERROR(args) LOG_AT(LOG_LEVEL_ERROR,args)
+#define LOG_WARN(args)  LOG_AT(LOG_LEVEL_WARN,args)
+#define LOG_INFO(args)  LOG_AT(LOG_LEVEL_INFO,args)
+#define LOG_DEBUG(args) LOG_AT(LOG_LEVEL_DEBUG,args)
+#define LOG_TRACE(args) LOG_AT(LOG_LEVEL_TRACE,args)
+
+/* Parse a level name, returns -1 if the name is not recognised */
+int log_level_parse(const char* name);
+
+/* What to do when the ring is full */
+enum log_policy {
+	LOG_POLICY_DROP = 0,      /* Drop the message and count it, never block */
+	LOG_POLICY_BLOCK,         /* Wait for the background thread to make room */
+	LOG_POLICY_SYNC           /* No background thread, write directly to stdout */
+};
+
+/* Parse a policy name, returns -1 if the name is not recognised */
+int log_policy_parse(const char* name);
+
+/* Start the background thread, ring_size is the number of records and must be a power of 2.
+ * Until this is called, or if it fails, messages are written directly to stdout */
+int log_start(size_t ring_size, enum log_policy policy);
+
+/* Flush the ring and stop the background thread, registered with atexit() */
+void log_stop(void);
+
+/* Log a printf() style message. Only the conversions d, i, u, o, x, X, c, s, p, f, e, g
+ * and % are supported, with any flags, width, precision and length modifiers */
+void log_printf(const char* format, ...)
+#ifdef __GNUC__
+	__attribute__((format(printf,1,2)))
+#endif
+;
+
+/* The number of messages dropped because the ring was full */
+unsigned long log_dropped(void);
+
+#endif /* DLEP_LOG_H_ */
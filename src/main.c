@@ -12,17 +12,107 @@ Copyright (c) 2017 Airbus DS Limited
 #include <unistd.h>
 #include <getopt.h>
 #include <errno.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <net/if.h>
+#include <sys/prctl.h>
 
 #include "./dlep_iana.h"
+#include "./destination.h"
+#include "./session.h"
+#include "./log.h"
+#include "./binlog.h"
+#include "./capture.h"
+#include "./pause.h"
+#include "./credit.h"
+#include "./stats.h"
+#include "./linkchar.h"
+#include "./control.h"
+#include "./rt.h"
+
+/* Every allocation made by the router code is counted for the real-time
+ * self-check, it is linked with -Wl,--wrap=malloc and friends */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+	rt_allocated();
+	return __real_malloc(size);
+}
 
-/* Defined in discovery.c */
-int discover(int use_ipv6, const char* iface, struct sockaddr_storage* modem_address, socklen_t* modem_address_length);
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+	rt_allocated();
+	return __real_calloc(nmemb,size);
+}
 
-/* Defined in session.c */
-int session(const struct sockaddr* modem_address, socklen_t modem_address_length, uint32_t router_heartbeat_interval);
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	rt_allocated();
+	return __real_realloc(ptr,size);
+}
+
+/* Defined in discovery.c, idle is called with param each time no Peer Offer arrives */
+int discover(int use_ipv6, const char* iface, struct sockaddr_storage* modem_address, socklen_t* modem_address_length, void (*idle)(void*), void* param);
+
+/* While discovery waits for the modem, the retained destinations still expire */
+static void discovery_idle(void* param)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	destination_table_expire(param,&now);
+}
+
+/* Set by SIGINT or SIGTERM, the router terminates the session and exits */
+static volatile sig_atomic_t s_stop = 0;
+
+static void stop_handler(int sig)
+{
+	s_stop = 1;
+}
+
+/* Long options without a short equivalent */
+enum long_option {
+	OPT_COST_ALPHA = 256,
+	OPT_COST_HYSTERESIS,
+	OPT_COST_HOLD_DOWN,
+	OPT_DAMP_PENALTY,
+	OPT_DAMP_SUPPRESS,
+	OPT_DAMP_REUSE,
+	OPT_DAMP_HALF_LIFE,
+	OPT_DAMP_MAX_SUPPRESS,
+	OPT_PUBLISH_RATE,
+	OPT_SYNC_SETTLE,
+	OPT_GRACE_PERIOD,
+	OPT_LOG_LEVEL,
+	OPT_LOG_RING,
+	OPT_LOG_POLICY,
+	OPT_BINLOG,
+	OPT_BINLOG_SIZE,
+	OPT_CAPTURE,
+	OPT_CAPTURE_SIZE,
+	OPT_STATS,
+	OPT_PAUSE_SHM,
+	OPT_CREDIT_SHM,
+	OPT_CONTROL,
+	OPT_LOW_POWER,
+	OPT_RT_PRIORITY,
+	OPT_RT_POLICY,
+	OPT_CPU
+};
+
+/* Default number of records in the log ring */
+#define DEFAULT_LOG_RING 4096
+
+/* Default size of the binary log file in megabytes */
+#define DEFAULT_BINLOG_SIZE 64
+
+/* Default size of the capture file in megabytes */
+#define DEFAULT_CAPTURE_SIZE 64
 
 static void help()
 {
@@ -35,8 +125,63 @@ static void help()
         "Options:\n"
         "  -6 or --ipv6          Use IPv6 (default is IPv4)\n"
         "  -I or --interface <I> Bind the discovery to interface I, requires root\n"
-        "  -H or --heartbeat <N> Use Heartbeat Interval N (default is 0)\n"
+        "  -H or --heartbeat <N> Use Heartbeat Interval N seconds (default is 30)\n"
         "  -h or --help          Show this text\n");
+
+    printf(
+	"Session options:\n"
+        "  --sync-settle <N>     Publish the initial Destination Up burst once quiet for N ms, 0 disables (default is 50)\n"
+        "  --grace-period <N>    Retain destinations for N seconds after a session fails and\n"
+        "                        keep reconnecting, 0 disables (default is 0)\n"
+        "  --pause-shm <N>       Publish the queues the modem pauses in shared memory object N\n"
+        "  --credit-shm <N>      Publish the credit the modem grants in shared memory object N\n");
+
+    printf(
+        "  --control <S>         Accept Link Characteristics Requests, for QoS admission control,\n"
+        "                        on Unix socket S\n"
+        "  --low-power <N>       Coalesce timers onto N ms boundaries and let the kernel defer\n"
+        "                        them by up to N ms, keep N well below the heartbeat intervals,\n"
+        "                        0 disables (default is 0)\n");
+
+    printf(
+	"Link-cost options:\n"
+        "  -C or --cost <F>      Use link-cost function F, one of %s (default is ett)\n"
+        "  --cost-alpha <A>      EWMA weight A of each new cost sample (default is 0.25)\n"
+        "  --cost-hysteresis <P> Only publish cost changes of at least P percent (default is 10)\n"
+        "  --cost-hold-down <N>  Publish cost changes at most once every N ms (default is 1000)\n"
+        "  --publish-rate <N>    Publish destination changes at most N times a second, 0 is unlimited (default is 10)\n",
+        cost_function_names());
+
+    printf(
+	"Flap damping options:\n"
+        "  --damp-penalty <N>      Add penalty N for every Destination Down (default is 1000)\n"
+        "  --damp-suppress <N>     Suppress destinations with a penalty above N (default is 2000)\n"
+        "  --damp-reuse <N>        Reuse destinations once the penalty drops below N (default is 750)\n"
+        "  --damp-half-life <N>    Halve the penalty every N seconds, 0 disables (default is 15)\n"
+        "  --damp-max-suppress <N> Suppress destinations for at most N seconds (default is 60)\n");
+
+    printf(
+	"Logging options:\n"
+        "  --log-level <L>       Log messages up to level L, one of error|warn|info|debug|trace (default is trace)\n"
+        "  --log-ring <N>        Buffer up to N log messages, a power of 2 (default is %u)\n"
+        "  --log-policy <P>      When the buffer is full, drop messages or block,\n"
+        "                        or sync to write directly to stdout (default is drop)\n",
+        DEFAULT_LOG_RING);
+
+    printf(
+        "  --binlog <F>          Also record events in binary log file F, read it with dlep_logdump\n"
+        "  --binlog-size <N>     Rotate the binary log file every N megabytes (default is %u)\n"
+        "  --capture <F>         Capture every DLEP message and signal to pcapng file F\n"
+        "  --capture-size <N>    Rotate the capture file every N megabytes (default is %u)\n"
+        "  --stats <S>           Serve protocol counters as OpenMetrics text on Unix socket S\n",
+        DEFAULT_BINLOG_SIZE,DEFAULT_CAPTURE_SIZE);
+
+    printf(
+	"Real-time options:\n"
+        "  --rt-priority <N>     Run the protocol thread at real-time priority N with memory\n"
+        "                        locked, and check for page faults and allocations, 0 disables (default is 0)\n"
+        "  --rt-policy <P>       Use scheduling policy P, one of fifo|rr (default is fifo)\n"
+        "  --cpu <N>             Pin the protocol threads to CPU N\n");
 }
 
 int main(int argc, char* argv[])
@@ -47,6 +192,33 @@ int main(int argc, char* argv[])
 		{ "interface",1,NULL,'I' },
 		{ "help",0,NULL,'h' },
 		{ "ipv6",0,NULL,'6' },
+		{ "sync-settle",1,NULL,OPT_SYNC_SETTLE },
+		{ "grace-period",1,NULL,OPT_GRACE_PERIOD },
+		{ "cost",1,NULL,'C' },
+		{ "cost-alpha",1,NULL,OPT_COST_ALPHA },
+		{ "cost-hysteresis",1,NULL,OPT_COST_HYSTERESIS },
+		{ "cost-hold-down",1,NULL,OPT_COST_HOLD_DOWN },
+		{ "publish-rate",1,NULL,OPT_PUBLISH_RATE },
+		{ "damp-penalty",1,NULL,OPT_DAMP_PENALTY },
+		{ "damp-suppress",1,NULL,OPT_DAMP_SUPPRESS },
+		{ "damp-reuse",1,NULL,OPT_DAMP_REUSE },
+		{ "damp-half-life",1,NULL,OPT_DAMP_HALF_LIFE },
+		{ "damp-max-suppress",1,NULL,OPT_DAMP_MAX_SUPPRESS },
+		{ "log-level",1,NULL,OPT_LOG_LEVEL },
+		{ "log-ring",1,NULL,OPT_LOG_RING },
+		{ "log-policy",1,NULL,OPT_LOG_POLICY },
+		{ "binlog",1,NULL,OPT_BINLOG },
+		{ "binlog-size",1,NULL,OPT_BINLOG_SIZE },
+		{ "capture",1,NULL,OPT_CAPTURE },
+		{ "capture-size",1,NULL,OPT_CAPTURE_SIZE },
+		{ "stats",1,NULL,OPT_STATS },
+		{ "pause-shm",1,NULL,OPT_PAUSE_SHM },
+		{ "credit-shm",1,NULL,OPT_CREDIT_SHM },
+		{ "control",1,NULL,OPT_CONTROL },
+		{ "low-power",1,NULL,OPT_LOW_POWER },
+		{ "rt-priority",1,NULL,OPT_RT_PRIORITY },
+		{ "rt-policy",1,NULL,OPT_RT_POLICY },
+		{ "cpu",1,NULL,OPT_CPU },
 		{ 0 }
 	};
 
@@ -55,14 +227,33 @@ int main(int argc, char* argv[])
 	int use_ipv6 = 0;
 	struct sockaddr_storage address = {0};
 	socklen_t address_length = 0;
-	uint32_t router_heartbeat_interval = DEFAULT_HEARTBEAT_INTERVAL;
+	struct session_params params;
 	const char* iface = NULL;
+	struct destination_table destinations;
+	size_t log_ring = DEFAULT_LOG_RING;
+	int log_policy = LOG_POLICY_DROP;
+	const char* binlog_path = NULL;
+	size_t binlog_size = DEFAULT_BINLOG_SIZE;
+	const char* capture_path = NULL;
+	size_t capture_size = DEFAULT_CAPTURE_SIZE;
+	const char* stats_path = NULL;
+	const char* pause_name = NULL;
+	const char* credit_name = NULL;
+	const char* control_path = NULL;
+	struct rt_params rt;
+	int reconnect = 0;
+	sigset_t stop_signals;
+	struct sigaction stop_action;
+
+	destination_table_init(&destinations);
+	session_params_init(&params);
+	rt_params_init(&rt);
 
 	/* Disable getopt's error messages */
 	opterr = 0;
 
 	/* Parse command line arguments */
-	while ((c = getopt_long(argc, argv, ":h6H:I:", options, &longindex)) != -1)
+	while ((c = getopt_long(argc, argv, ":h6H:I:C:", options, &longindex)) != -1)
 	{
 		switch (c)
 		{
@@ -75,8 +266,146 @@ int main(int argc, char* argv[])
 			break;
 
 		case 'H':
-			router_heartbeat_interval = strtoul(optarg,NULL,10);
-			router_heartbeat_interval *= 1000;
+			params.router_heartbeat_interval = strtoul(optarg,NULL,10);
+			params.router_heartbeat_interval *= 1000;
+			break;
+
+		case OPT_SYNC_SETTLE:
+			params.sync_settle = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_GRACE_PERIOD:
+			destinations.grace_period = strtoul(optarg,NULL,10);
+			break;
+
+		case 'C':
+			if (!cost_params_select(&destinations.cost_params,optarg))
+			{
+				printf("Unknown cost function '%s'\n",optarg);
+				help();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case OPT_COST_ALPHA:
+			destinations.cost_params.alpha = strtod(optarg,NULL);
+			if (destinations.cost_params.alpha <= 0.0 || destinations.cost_params.alpha > 1.0)
+			{
+				printf("Cost EWMA weight must be greater than 0 and at most 1\n");
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case OPT_COST_HYSTERESIS:
+			destinations.cost_params.hysteresis = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_COST_HOLD_DOWN:
+			destinations.cost_params.hold_down = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_PUBLISH_RATE:
+			destinations.publish_rate = strtoul(optarg,NULL,10);
+			if (destinations.publish_rate > 1000)
+				destinations.publish_rate = 1000;
+			break;
+
+		case OPT_DAMP_PENALTY:
+			destinations.damping_params.penalty = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_DAMP_SUPPRESS:
+			destinations.damping_params.suppress = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_DAMP_REUSE:
+			destinations.damping_params.reuse = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_DAMP_HALF_LIFE:
+			destinations.damping_params.half_life = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_DAMP_MAX_SUPPRESS:
+			destinations.damping_params.max_suppress = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_LOG_LEVEL:
+			log_level = log_level_parse(optarg);
+			if (log_level < 0)
+			{
+				printf("Unknown log level '%s'\n",optarg);
+				help();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case OPT_LOG_RING:
+			log_ring = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_LOG_POLICY:
+			log_policy = log_policy_parse(optarg);
+			if (log_policy < 0)
+			{
+				printf("Unknown log policy '%s'\n",optarg);
+				help();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case OPT_BINLOG:
+			binlog_path = optarg;
+			break;
+
+		case OPT_BINLOG_SIZE:
+			binlog_size = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_CAPTURE:
+			capture_path = optarg;
+			break;
+
+		case OPT_CAPTURE_SIZE:
+			capture_size = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_STATS:
+			stats_path = optarg;
+			break;
+
+		case OPT_PAUSE_SHM:
+			pause_name = optarg;
+			break;
+
+		case OPT_CONTROL:
+			control_path = optarg;
+			break;
+
+		case OPT_CREDIT_SHM:
+			credit_name = optarg;
+			break;
+
+		case OPT_LOW_POWER:
+			params.coalesce = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_RT_PRIORITY:
+			rt.priority = strtoul(optarg,NULL,10);
+			break;
+
+		case OPT_RT_POLICY:
+			rt.policy = rt_policy_parse(optarg);
+			if (rt.policy < 0)
+			{
+				printf("Unknown scheduling policy '%s'\n",optarg);
+				help();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case OPT_CPU:
+			rt.cpu = strtoul(optarg,NULL,10);
 			break;
 
 		case 'h':
@@ -99,6 +428,12 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	if (destinations.damping_params.reuse >= destinations.damping_params.suppress)
+	{
+		printf("Flap damping reuse threshold must be below the suppress threshold\n");
+		return EXIT_FAILURE;
+	}
+
 	if (argc > optind + 2)
 	{
 		printf("Too many arguments\n");
@@ -167,25 +502,95 @@ int main(int argc, char* argv[])
 	/* Seed the prng */
 	srand(time(NULL) ^ getpid());
 
-	printf(	"dlep_router - A logging DLEP router\n"
+	/* Let the kernel batch our wakeups with everyone else's, every thread inherits it */
+	if (params.coalesce && prctl(PR_SET_TIMERSLACK,(unsigned long)params.coalesce * 1000000,0,0,0) != 0)
+	{
+		printf("Failed to set timer slack: %s\n",strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	/* Only this thread takes SIGINT and SIGTERM, so they interrupt whatever it
+	 * is waiting for, and the threads started from here on never see them */
+	sigemptyset(&stop_signals);
+	sigaddset(&stop_signals,SIGINT);
+	sigaddset(&stop_signals,SIGTERM);
+	pthread_sigmask(SIG_BLOCK,&stop_signals,NULL);
+
+	/* From here on, logging is done by a background thread */
+	if (log_start(log_ring,log_policy) != 0)
+		return EXIT_FAILURE;
+
+	if (binlog_path && binlog_open(binlog_path,binlog_size * 1024 * 1024) != 0)
+		return EXIT_FAILURE;
+
+	if (capture_path && capture_open(capture_path,capture_size * 1024 * 1024) != 0)
+		return EXIT_FAILURE;
+
+	if (stats_path && stats_start(stats_path) != 0)
+		return EXIT_FAILURE;
+
+	if (pause_name && pause_open(pause_name) != 0)
+		return EXIT_FAILURE;
+
+	if (credit_name && credit_open(credit_name) != 0)
+		return EXIT_FAILURE;
+
+	/* Requests from the control socket are sent by whichever session is up */
+	if (control_path)
+	{
+		params.link_chars = linkchar_table_create();
+		if (!params.link_chars || control_start(control_path,params.link_chars) != 0)
+			return EXIT_FAILURE;
+	}
+
+	/* Last, so only this thread and the ones it starts are real-time */
+	if (rt_start(&rt) != 0)
+		return EXIT_FAILURE;
+
+	LOG_INFO(("dlep_router - A logging DLEP router\n"
 	        "  Version 0.1.2\n"
-	        "  Copyright (c) 2017 Airbus DS Limited\n\n");
+	        "  Copyright (c) 2017 Airbus DS Limited\n\n"));
+
+	/* Stop by returning from main, so everything registered with atexit() is
+	 * tidied up, truncating the capture and binary log files */
+	memset(&stop_action,0,sizeof(stop_action));
+	stop_action.sa_handler = &stop_handler;
+	sigemptyset(&stop_action.sa_mask);
+	params.stop = &s_stop;
+	if (sigaction(SIGINT,&stop_action,NULL) != 0 || sigaction(SIGTERM,&stop_action,NULL) != 0)
+	{
+		LOG_ERROR(("Failed to install signal handlers: %s\n",strerror(errno)));
+		return EXIT_FAILURE;
+	}
+	pthread_sigmask(SIG_UNBLOCK,&stop_signals,NULL);
 
-	/* Loop forever */
-	for (;;)
+	/* Loop until stopped */
+	while (!s_stop)
 	{
+		if (reconnect++)
+			STATS_INC(stats.reconnects);
+
 		if (optind == argc)
 		{
 			/* If no address was supplied on the command line, perform discovery
 			 * This is section 7.1 in RFC 8175 */
 
-			if (!discover(use_ipv6,iface,&address,&address_length))
-				return EXIT_FAILURE;
+			if (!discover(use_ipv6,iface,&address,&address_length,&discovery_idle,&destinations))
+				return (s_stop ? EXIT_SUCCESS : EXIT_FAILURE);
 		}
 
-		if (session((const struct sockaddr*)&address,address_length,router_heartbeat_interval) != 0)
-			return EXIT_FAILURE;
+		if (session((const struct sockaddr*)&address,address_length,&params,&destinations) != 0 && !s_stop)
+		{
+			/* With graceful restart, keep trying to get back to the modem */
+			if (!destinations.grace_period)
+				return EXIT_FAILURE;
+
+			LOG_WARN(("Session failed, reconnecting in %u seconds\n",DEFAULT_DISCOVERY_RETRY));
+			sleep(DEFAULT_DISCOVERY_RETRY);
+		}
 	}
 
+	destination_table_free(&destinations);
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,202 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./pause.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "./log.h"
+
+static struct
+{
+	char* name;
+	struct pause_shm* map;
+	size_t count;             /* Entries in use, one slot is always left empty */
+} s_pause = { NULL, NULL, 0 };
+
+static uint32_t hash_octets(uint32_t h, const uint8_t* p, size_t len)
+{
+	/* FNV-1a */
+	size_t i;
+	for (i = 0; i < len; ++i)
+	{
+		h ^= p[i];
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+static size_t hash_key(const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len)
+{
+	return hash_octets(hash_octets(2166136261UL,mac,6),link_id,link_id_len);
+}
+
+static void changed(void)
+{
+	__atomic_fetch_add(&s_pause.map->generation,1,__ATOMIC_RELEASE);
+}
+
+int pause_open(const char* name)
+{
+	static int registered = 0;
+	int fd;
+
+	pause_close();
+
+	s_pause.name = malloc(strlen(name) + 1);
+	if (!s_pause.name)
+	{
+		LOG_ERROR(("Failed to allocate pause shared memory name\n"));
+		return -1;
+	}
+	strcpy(s_pause.name,name);
+
+	fd = shm_open(name,O_RDWR | O_CREAT | O_TRUNC,0644);
+	if (fd == -1)
+	{
+		LOG_ERROR(("Failed to create pause shared memory %s: %s\n",name,strerror(errno)));
+		pause_close();
+		return -1;
+	}
+
+	if (ftruncate(fd,sizeof(struct pause_shm)) != 0)
+	{
+		LOG_ERROR(("Failed to size pause shared memory %s: %s\n",name,strerror(errno)));
+		close(fd);
+		pause_close();
+		return -1;
+	}
+
+	s_pause.map = mmap(NULL,sizeof(struct pause_shm),PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if (s_pause.map == MAP_FAILED)
+	{
+		LOG_ERROR(("Failed to map pause shared memory %s: %s\n",name,strerror(errno)));
+		s_pause.map = NULL;
+		pause_close();
+		return -1;
+	}
+
+	/* Freshly truncated, so already zero */
+	s_pause.map->version = PAUSE_SHM_VERSION;
+	s_pause.map->slots = PAUSE_SHM_SLOTS;
+	__atomic_store_n(&s_pause.map->magic,PAUSE_SHM_MAGIC,__ATOMIC_RELEASE);
+	s_pause.count = 0;
+
+	if (!registered)
+	{
+		atexit(&pause_close);
+		registered = 1;
+	}
+
+	return 0;
+}
+
+void pause_close(void)
+{
+	if (s_pause.map)
+	{
+		munmap(s_pause.map,sizeof(struct pause_shm));
+		s_pause.map = NULL;
+	}
+
+	if (s_pause.name)
+	{
+		shm_unlink(s_pause.name);
+		free(s_pause.name);
+		s_pause.name = NULL;
+	}
+}
+
+void pause_reset(void)
+{
+	size_t i;
+
+	if (!s_pause.map || (!s_pause.count && !s_pause.map->num_queues))
+		return;
+
+	/* Cut every probe sequence before wiping the entries */
+	for (i = 0; i < PAUSE_SHM_SLOTS; ++i)
+		__atomic_store_n(&s_pause.map->entries[i].in_use,0,__ATOMIC_RELEASE);
+
+	memset(s_pause.map->entries,0,sizeof(s_pause.map->entries));
+	s_pause.count = 0;
+
+	__atomic_store_n(&s_pause.map->num_queues,0,__ATOMIC_RELEASE);
+	changed();
+}
+
+void pause_queues(unsigned int num_queues, const uint8_t* dscp_queue)
+{
+	if (!s_pause.map)
+		return;
+
+	/* The map first, readers only trust it once num_queues is set */
+	__atomic_store_n(&s_pause.map->num_queues,0,__ATOMIC_RELEASE);
+	memcpy(s_pause.map->dscp_queue,dscp_queue,sizeof(s_pause.map->dscp_queue));
+	__atomic_store_n(&s_pause.map->num_queues,num_queues,__ATOMIC_RELEASE);
+	changed();
+}
+
+void pause_publish(const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len, const uint32_t* paused)
+{
+	size_t mask = PAUSE_SHM_SLOTS - 1;
+	size_t i;
+	unsigned int w;
+	struct pause_shm_entry* e;
+
+	if (!s_pause.map)
+		return;
+
+	if (link_id_len > MAX_LINK_ID_LENGTH)
+		link_id_len = MAX_LINK_ID_LENGTH;
+
+	/* Linear probing, the table is never full */
+	for (i = hash_key(mac,link_id,link_id_len) & mask; s_pause.map->entries[i].in_use; i = (i + 1) & mask)
+	{
+		e = &s_pause.map->entries[i];
+		if (memcmp(e->mac,mac,6) == 0 && e->link_id_len == link_id_len && memcmp(e->link_id,link_id,link_id_len) == 0)
+			break;
+	}
+	e = &s_pause.map->entries[i];
+
+	if (!e->in_use)
+	{
+		/* Nothing paused is the same as not being there at all */
+		for (w = 0; w < PAUSE_QUEUE_WORDS && !paused[w]; ++w)
+			;
+		if (w == PAUSE_QUEUE_WORDS)
+			return;
+
+		if (s_pause.count == PAUSE_SHM_SLOTS - 1)
+		{
+			LOG_WARN(("Pause shared memory is full, not publishing paused queues of %02X:%02X:%02X:%02X:%02X:%02X\n",mac[0],mac[1],mac[2],mac[3],mac[4],mac[5]));
+			return;
+		}
+
+		memcpy(e->mac,mac,6);
+		e->link_id_len = link_id_len;
+		memcpy(e->link_id,link_id,link_id_len);
+		for (w = 0; w < PAUSE_QUEUE_WORDS; ++w)
+			__atomic_store_n(&e->paused[w],paused[w],__ATOMIC_RELAXED);
+
+		__atomic_store_n(&e->in_use,1,__ATOMIC_RELEASE);
+		++s_pause.count;
+	}
+	else
+	{
+		for (w = 0; w < PAUSE_QUEUE_WORDS; ++w)
+			__atomic_store_n(&e->paused[w],paused[w],__ATOMIC_RELEASE);
+	}
+
+	changed();
+}
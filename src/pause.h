@@ -0,0 +1,75 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * The queues the modem has paused, RFC 8651, published in a POSIX shared
+ * memory region for the forwarding plane to poll. The router writes the
+ * region as each Pause or Restart is parsed, so a reader sees it within
+ * microseconds of receipt.
+ *
+ * A reader maps the region read-only, checks magic and version, then finds
+ * a destination by linear probing from the FNV-1a hash of its MAC address
+ * followed by the link_id_len octets of its Link Identifier (RFC 8703, none
+ * if the extension was not negotiated), stopping at the first entry that is
+ * not in_use. Entries are only added
+ * while a session is up, in_use is stored with release semantics after the
+ * key, and each word of paused[] is stored atomically, so no locking is
+ * needed. generation is incremented after every change.
+ */
+
+#ifndef DLEP_PAUSE_H_
+#define DLEP_PAUSE_H_
+
+#include "./util.h"
+#include "./dlep_iana.h"
+
+#define PAUSE_SHM_MAGIC   0x444C5051  /* "DLPQ" */
+#define PAUSE_SHM_VERSION 2
+#define PAUSE_SHM_SLOTS   4096        /* A power of 2 */
+
+/* A bitmap of queue indexes, bit n % 32 of word n / 32 is queue n */
+#define PAUSE_QUEUE_WORDS 8
+
+struct pause_shm_entry
+{
+	uint8_t mac[6];
+	uint8_t in_use;
+	uint8_t link_id_len;
+	uint32_t paused[PAUSE_QUEUE_WORDS];
+	uint8_t link_id[MAX_LINK_ID_LENGTH];
+};
+
+struct pause_shm
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t generation;
+
+	/* From the modem's Queue Parameters, num_queues is 0 if it sent none */
+	uint32_t num_queues;
+	uint8_t dscp_queue[64];   /* The queue index of each DSCP */
+
+	struct pause_shm_entry entries[PAUSE_SHM_SLOTS];
+};
+
+/* Publish to the shared memory object name, e.g. "/dlep_pause" */
+int pause_open(const char* name);
+
+/* Stop publishing and unlink the object, registered with atexit() */
+void pause_close(void);
+
+/* Forget every destination and the queue parameters, at the end of a session */
+void pause_reset(void);
+
+/* Publish the queue parameters, dscp_queue has 64 entries */
+void pause_queues(unsigned int num_queues, const uint8_t* dscp_queue);
+
+/* Publish the paused queues of destination mac on link link_id, a
+ * PAUSE_QUEUE_WORDS bitmap. link_id_len is 0 if there is no Link Identifier */
+void pause_publish(const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len, const uint32_t* paused);
+
+#endif /* DLEP_PAUSE_H_ */
@@ -0,0 +1,57 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * USDT probes at the protocol hot spots, under the provider 'dlep', e.g.
+ *
+ *   bpftrace -e 'usdt:./dlep_router:dlep:message__validate /arg2/ { @[arg0,arg2] = count(); }'
+ *
+ * With <sys/sdt.h> a probe that is not being traced is a single NOP, without
+ * it the probes compile to nothing. Arguments are kept to values already to
+ * hand, as they are evaluated even when the probe is not traced.
+ *
+ * message__receive(type, length, msg)        A message has been read from the modem
+ * message__validate(type, length, status)    A message has been checked, status is 0 if valid
+ * message__decode(type, length, mac, status) A message has been applied to the destination
+ *                                            table, mac is NULL if it has none, status is
+ *                                            DLEP_SC_INVALID_DEST if the destination is unknown
+ * message__send(type, length, mac, status)   A message is being sent or queued, mac is NULL
+ *                                            if it has none, status is -1 if it has no Status
+ * heartbeat__receive(interval, since)        A Heartbeat from the modem, its interval (ms) and
+ *                                            the time since the last one (ns, 0 for the first)
+ * heartbeat__send(interval, late)            Our Heartbeat, its interval (ms) and how long
+ *                                            after it was due it went (ns)
+ * session__state(state, status)              The session changed state, one of the strings
+ *                                            "connecting", "initializing", "in_session",
+ *                                            "terminating" or "closed", status is the reason
+ *                                            for terminating
+ * destination__pause(mac, queues, count, pause) The modem paused (pause is 1) or restarted
+ *                                            count queue indexes of destination mac, or of
+ *                                            every destination if mac is NULL
+ * discovery__offer(signal, length, status)   A Peer Offer signal, status is 0 if valid
+ */
+
+#ifndef DLEP_PROBES_H_
+#define DLEP_PROBES_H_
+
+#if defined(HAVE_SYS_SDT_H)
+
+#include <sys/sdt.h>
+
+#define DLEP_PROBE2(name,a1,a2)          DTRACE_PROBE2(dlep,name,a1,a2)
+#define DLEP_PROBE3(name,a1,a2,a3)       DTRACE_PROBE3(dlep,name,a1,a2,a3)
+#define DLEP_PROBE4(name,a1,a2,a3,a4)    DTRACE_PROBE4(dlep,name,a1,a2,a3,a4)
+
+#else
+
+/* The arguments are still type checked, but never evaluated */
+#define DLEP_PROBE2(name,a1,a2)          ((void)sizeof(a1),(void)sizeof(a2))
+#define DLEP_PROBE3(name,a1,a2,a3)       ((void)sizeof(a1),(void)sizeof(a2),(void)sizeof(a3))
+#define DLEP_PROBE4(name,a1,a2,a3,a4)    ((void)sizeof(a1),(void)sizeof(a2),(void)sizeof(a3),(void)sizeof(a4))
+
+#endif
+
+#endif /* DLEP_PROBES_H_ */
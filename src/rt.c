@@ -0,0 +1,239 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./rt.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "./log.h"
+#include "./stats.h"
+
+/* How much of the stack and heap to fault in up front */
+#define RT_STACK_PREFAULT (512 * 1024)
+#define RT_HEAP_PREFAULT  (8 * 1024 * 1024)
+
+/* How often the self-check looks, in milliseconds */
+#define RT_CHECK_INTERVAL 10000
+
+static struct
+{
+	struct rt_params params;
+
+	/* The self-check of the protocol thread */
+	int steady;
+	struct timespec check_time;
+	unsigned long faults;     /* At the last check */
+	uint64_t allocated;
+	unsigned long total_faults;
+	uint64_t total_allocated;
+} s_rt = { { 0, SCHED_FIFO, -1 } };
+
+/* Allocations made by the router code on each thread, so the self-check only
+ * counts the protocol thread's, as it only counts its page faults */
+static __thread uint64_t t_allocations;
+
+void rt_params_init(struct rt_params* params)
+{
+	params->priority = 0;
+	params->policy = SCHED_FIFO;
+	params->cpu = -1;
+}
+
+int rt_policy_parse(const char* name)
+{
+	if (!strcmp(name,"fifo"))
+		return SCHED_FIFO;
+	if (!strcmp(name,"rr"))
+		return SCHED_RR;
+	return -1;
+}
+
+static void prefault_stack(void)
+{
+	/* Touch every page, so growing into them later does not fault */
+	volatile uint8_t stack[RT_STACK_PREFAULT];
+	size_t i;
+	for (i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+static int prefault_heap(void)
+{
+	uint8_t* p;
+
+	/* Never give freed memory back, or it would fault again when reused */
+	if (!mallopt(M_TRIM_THRESHOLD,-1) || !mallopt(M_MMAP_MAX,0))
+	{
+		LOG_ERROR(("Failed to stop the heap shrinking\n"));
+		return -1;
+	}
+
+	/* With MCL_FUTURE this is faulted in as it is allocated, and stays in the heap once freed */
+	p = malloc(RT_HEAP_PREFAULT);
+	if (!p)
+	{
+		LOG_ERROR(("Failed to prefault the heap\n"));
+		return -1;
+	}
+	memset(p,0,RT_HEAP_PREFAULT);
+	free(p);
+	return 0;
+}
+
+static int pin(pthread_t thread, int cpu)
+{
+	cpu_set_t cpus;
+	int err;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu,&cpus);
+	err = pthread_setaffinity_np(thread,sizeof(cpus),&cpus);
+	if (err)
+	{
+		LOG_ERROR(("Failed to pin thread to CPU %d: %s\n",cpu,strerror(err)));
+		return -1;
+	}
+	return 0;
+}
+
+int rt_start(const struct rt_params* params)
+{
+	struct sched_param sp = {0};
+	int err;
+
+	s_rt.params = *params;
+
+	if (params->cpu >= 0 && pin(pthread_self(),params->cpu) != 0)
+		return -1;
+
+	if (!params->priority)
+		return 0;
+
+	if (params->priority < sched_get_priority_min(params->policy) || params->priority >= sched_get_priority_max(params->policy))
+	{
+		LOG_ERROR(("Real-time priority must be from %d to %d\n",sched_get_priority_min(params->policy),sched_get_priority_max(params->policy) - 1));
+		return -1;
+	}
+
+	/* Lock everything we have and will have */
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+	{
+		LOG_ERROR(("Failed to lock memory: %s\n",strerror(errno)));
+		return -1;
+	}
+
+	if (prefault_heap() != 0)
+		return -1;
+	prefault_stack();
+
+	sp.sched_priority = params->priority;
+	err = pthread_setschedparam(pthread_self(),params->policy,&sp);
+	if (err)
+	{
+		LOG_ERROR(("Failed to set real-time priority %d: %s\n",params->priority,strerror(err)));
+		return -1;
+	}
+
+	LOG_INFO(("Running at %s priority %d with memory locked\n",params->policy == SCHED_RR ? "SCHED_RR" : "SCHED_FIFO",params->priority));
+	return 0;
+}
+
+int rt_thread(pthread_t thread, int boost)
+{
+	struct sched_param sp = {0};
+	int err;
+
+	if (s_rt.params.cpu >= 0)
+		pin(thread,s_rt.params.cpu);
+
+	if (!s_rt.params.priority)
+		return -1;
+
+	sp.sched_priority = s_rt.params.priority + boost;
+	if (sp.sched_priority > sched_get_priority_max(s_rt.params.policy))
+		sp.sched_priority = sched_get_priority_max(s_rt.params.policy);
+
+	err = pthread_setschedparam(thread,s_rt.params.policy,&sp);
+	if (err)
+	{
+		LOG_ERROR(("Failed to set real-time priority %d: %s\n",sp.sched_priority,strerror(err)));
+		return -1;
+	}
+	return 0;
+}
+
+void rt_allocated(void)
+{
+	++t_allocations;
+}
+
+static unsigned long thread_faults(void)
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_THREAD,&usage) != 0)
+		return 0;
+	return usage.ru_minflt + usage.ru_majflt;
+}
+
+void rt_session_steady(const struct timespec* now)
+{
+	if (!s_rt.params.priority)
+		return;
+
+	s_rt.steady = 1;
+	s_rt.check_time = *now;
+	s_rt.faults = thread_faults();
+	s_rt.allocated = t_allocations;
+	s_rt.total_faults = 0;
+	s_rt.total_allocated = 0;
+}
+
+static void check(void)
+{
+	unsigned long faults = thread_faults();
+	uint64_t allocated = t_allocations;
+
+	if (faults != s_rt.faults || allocated != s_rt.allocated)
+	{
+		LOG_WARN(("Real-time self-check: %lu page faults and %lu allocations since the last check\n",faults - s_rt.faults,(unsigned long)(allocated - s_rt.allocated)));
+
+		STATS_ADD(stats.rt_page_faults,faults - s_rt.faults);
+		STATS_ADD(stats.rt_allocations,allocated - s_rt.allocated);
+		s_rt.total_faults += faults - s_rt.faults;
+		s_rt.total_allocated += allocated - s_rt.allocated;
+		s_rt.faults = faults;
+		s_rt.allocated = allocated;
+	}
+}
+
+void rt_session_check(const struct timespec* now)
+{
+	if (!s_rt.steady || interval_ms(&s_rt.check_time,now) < RT_CHECK_INTERVAL)
+		return;
+
+	s_rt.check_time = *now;
+	check();
+}
+
+void rt_session_end(void)
+{
+	if (!s_rt.steady)
+		return;
+
+	check();
+	s_rt.steady = 0;
+
+	if (s_rt.total_faults || s_rt.total_allocated)
+		LOG_WARN(("Real-time self-check failed: %lu page faults and %lu allocations once the session settled\n",s_rt.total_faults,(unsigned long)s_rt.total_allocated));
+	else
+		LOG_INFO(("Real-time self-check passed: no page faults or allocations once the session settled\n"));
+}
@@ -0,0 +1,61 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Real-time mode, for gateways loaded enough to deschedule the router past
+ * its heartbeat deadlines. The protocol thread runs at a SCHED_FIFO or
+ * SCHED_RR priority, with the watchdog just above it, all memory is locked
+ * and the stack and heap are faulted in up front, and the protocol threads
+ * may be pinned to a CPU.
+ *
+ * Once a session has settled, a self-check counts the page faults taken by
+ * the protocol thread and the allocations the router code makes on it,
+ * neither of which should happen in a steady state.
+ */
+
+#ifndef DLEP_RT_H_
+#define DLEP_RT_H_
+
+#include "./util.h"
+
+#include <pthread.h>
+
+struct rt_params
+{
+	int priority;             /* Of the protocol thread, 0 leaves real-time mode off */
+	int policy;               /* SCHED_FIFO or SCHED_RR */
+	int cpu;                  /* Pin the protocol threads to this CPU, -1 for any */
+};
+
+/* Fill in the default parameters, real-time mode off */
+void rt_params_init(struct rt_params* params);
+
+/* Parse a policy name, fifo or rr, returns -1 if the name is not recognised */
+int rt_policy_parse(const char* name);
+
+/* Apply params to the calling thread, which becomes the protocol thread.
+ * Threads started beforehand are left as they are */
+int rt_start(const struct rt_params* params);
+
+/* Run thread boost priorities above the protocol thread, on the same CPU.
+ * Returns -1 if real-time mode is off or it failed */
+int rt_thread(pthread_t thread, int boost);
+
+/* Count an allocation on the calling thread, from the malloc() wrappers of dlep_router */
+void rt_allocated(void);
+
+/* The session has settled, start the self-check, on the protocol thread like
+ * the two below */
+void rt_session_steady(const struct timespec* now);
+
+/* Report any page faults or allocations since the last check, at most
+ * every RT_CHECK_INTERVAL */
+void rt_session_check(const struct timespec* now);
+
+/* Report the self-check of the session that has ended */
+void rt_session_end(void);
+
+#endif /* DLEP_RT_H_ */
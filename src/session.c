@@ -14,145 +14,266 @@ Copyright (c) 2017 Airbus DS Limited
 #include <inttypes.h>
 #include <unistd.h>
 
+#include "./session.h"
 #include "./dlep_iana.h"
 #include "./check.h"
+#include "./encode.h"
+#include "./destination.h"
+#include "./linkchar.h"
+#include "./watchdog.h"
+#include "./rt.h"
+#include "./extension.h"
+#include "./log.h"
+#include "./binlog.h"
+#include "./capture.h"
+#include "./pause.h"
+#include "./credit.h"
+#include "./stats.h"
+#include "./probes.h"
+
+/* The longest message, including its header */
+#define MSG_BUFFER_SIZE 65540
+
+/* The size of the receive buffer, enough for several maximum length messages */
+#define RX_BUFFER_SIZE (4 * MSG_BUFFER_SIZE)
+
+/* The size of the buffer for batched responses */
+#define TX_BATCH_SIZE 65536
+
+/* The most responses in a batch, each remembers when it was queued */
+#define TX_BATCH_MESSAGES 4096
+
+/* The longest we will wait for the initial burst of Destination Up messages to settle */
+#define SYNC_MAX_TIME 5000
+
+/* How often to look for starved credit windows, in milliseconds */
+#define CREDIT_POLL_INTERVAL 10
+
+/* The bits of the extensions we support, once registered by session_register_extensions() */
+static struct
+{
+	int registered;
+	unsigned int pause;
+	unsigned int link_id;
+	unsigned int latency_range;
+	unsigned int credit_window;
+} s_ext;
+
+/* Sessions connected so far, numbering them in the capture */
+static unsigned int s_session_count;
 
-static ssize_t recv_message(int s, uint8_t** msg)
+struct dlep_session
 {
-	ssize_t received = -1;
+	int s;
+	int capture_if;           /* pcapng capture interface, -1 if not capturing */
+	char capture_comment[FORMATADDRESS_LEN + 32]; /* Names the session in the capture */
+	const struct session_params* params;
+	struct destination_table* destinations;
+	uint32_t modem_heartbeat_interval;
+	unsigned int extensions;  /* Negotiated with the modem, a mask of the bits in s_ext */
+	uint8_t link_id_len;      /* Of every Link Identifier, if DLEP_EXT_LINK_ID was negotiated */
+
+	/* Received data not yet handled */
+	uint8_t* rx_buffer;
+	size_t rx_start;
+	size_t rx_end;
+	struct timespec rx_time;  /* When the message being handled was received */
+
+	/* Responses waiting to be sent in a single batch */
+	uint8_t* tx_batch;
+	size_t tx_len;
+	struct timespec* tx_queued;
+	size_t tx_count;
+
+	/* Sends our Heartbeats and times out the modem while in session, otherwise NULL */
+	struct watchdog* watchdog;
+
+	/* When the last Heartbeat was received from the modem, 0 if none yet */
+	struct timespec modem_heartbeat_time;
+
+	/* Fed from a socket by dlep_replay rather than connected to a modem */
+	int offline;
+	int established;
+
+	/* For the wakeups per minute, both threads' wakeups at wakeup_time */
+	struct timespec wakeup_time;
+	uint64_t wakeups;
+
+	/* Bulk initial synchronisation, right after session initialization */
+	int syncing;
+	struct timespec sync_start;
+	unsigned long sync_count;
+};
+
+static int rx_pending(const struct dlep_session* sess)
+{
+	/* Is there a complete message in the receive buffer? */
+	size_t avail = sess->rx_end - sess->rx_start;
+	return (avail >= 4 && avail >= (size_t)read_uint16(sess->rx_buffer + sess->rx_start + 2) + 4);
+}
 
-	/* Make sure we have room for the header */
-	uint8_t* new_msg = realloc(*msg,4);
-	if (!new_msg)
+static int msg_buffer(uint8_t** msg)
+{
+	/* Room for the longest message, allocated once so the steady state never allocates */
+	if (!*msg)
 	{
-		printf("Failed to allocate message buffer");
-		return -1;
+		*msg = malloc(MSG_BUFFER_SIZE);
+		if (!*msg)
+		{
+			LOG_ERROR(("Failed to allocate message buffer\n"));
+			return 0;
+		}
 	}
-	*msg = new_msg;
+	return 1;
+}
 
-	/* Receive the header */
-	received = recv(s,*msg,4,0);
-	if (received == 4)
+static ssize_t recv_message(struct dlep_session* sess, uint8_t** msg)
+{
+	/* Read as much as the socket has to offer, and hand out one message at a time */
+	while (!rx_pending(sess))
 	{
-		/* Read the message length */
-		uint16_t reported_len = read_uint16((*msg)+2);
-		if (reported_len)
+		ssize_t received;
+
+		/* Move any partial message to the start of the buffer */
+		if (sess->rx_start)
 		{
-			/* Make more room in the message buffer */
-			new_msg = realloc(*msg,reported_len+4);
-			if (!new_msg)
-			{
-				printf("Failed to allocate message buffer");
-				return -1;
-			}
-			*msg = new_msg;
+			memmove(sess->rx_buffer,sess->rx_buffer + sess->rx_start,sess->rx_end - sess->rx_start);
+			sess->rx_end -= sess->rx_start;
+			sess->rx_start = 0;
+		}
 
-			/* Receive the rest of the message */
-			received = recv(s,(*msg)+4,reported_len,0);
-			if (received == -1)
-				return -1;
+		received = recv(sess->s,sess->rx_buffer + sess->rx_end,RX_BUFFER_SIZE - sess->rx_end,0);
+		if (received <= 0)
+			return received;
 
-			/* Include the header length in the return value */
-			received += 4;
-		}
+		sess->rx_end += received;
+		clock_gettime(CLOCK_MONOTONIC,&sess->rx_time);
+		if (sess->watchdog)
+			watchdog_received(sess->watchdog,&sess->rx_time);
 	}
 
-	return received;
-}
+	{
+		/* Read the message length, and include the header length */
+		size_t msg_len = read_uint16(sess->rx_buffer + sess->rx_start + 2) + 4;
 
-static uint8_t* write_message_header(uint8_t* msg, uint16_t msg_type)
-{
-	/* Octet 0 and 1 are the message type */
-	uint8_t* p = write_uint16(msg_type,msg);
+		if (!msg_buffer(msg))
+			return -1;
 
-	/* Octet 2 and 3 are the message length, set to 0 initially */
-	return write_uint16(0,p);
-}
+		memcpy(*msg,sess->rx_buffer + sess->rx_start,msg_len);
+		sess->rx_start += msg_len;
 
-static uint8_t* write_data_item(uint8_t* msg, uint16_t type, uint16_t length)
-{
-	/* Octet 0 and 1 are the type code */
-	uint8_t* p = write_uint16(type,msg);
+		capture_packet(sess->capture_if,sess->capture_comment,CAPTURE_INBOUND,*msg,msg_len);
+		DLEP_PROBE3(message__receive,read_uint16(*msg),msg_len,*msg);
+		STATS_INC(stats.rx_messages[STATS_MESSAGE_INDEX(read_uint16(*msg))]);
+		STATS_ADD(stats.rx_bytes,msg_len);
 
-	/* Octet 2 and 3 are the length, this excludes the header length (4) */
-	return write_uint16(length,p);
+		return msg_len;
+	}
 }
 
-static uint8_t* write_status_code(uint8_t* msg, enum dlep_status_code sc)
+static ssize_t transmit(struct dlep_session* sess, const uint8_t* data, size_t len)
 {
-	/* Write out Status Code header */
-	msg = write_data_item(msg,DLEP_STATUS_DATA_ITEM,1);
-
-	/* And the code */
-	*msg++ = sc;
-
-	return msg;
+	/* The watchdog sends Heartbeats on the same socket */
+	ssize_t sent;
+	if (!sess->watchdog)
+		return send(sess->s,data,len,0);
+
+	watchdog_tx_begin(sess->watchdog);
+	sent = send(sess->s,data,len,0);
+	watchdog_tx_end(sess->watchdog,sent == (ssize_t)len);
+	return sent;
 }
 
-static int send_session_init_message(int s, uint32_t router_heartbeat_interval)
+static int flush_batch(struct dlep_session* sess)
 {
-	uint8_t msg[300];
-	uint16_t msg_len = 0;
-	size_t peer_type_len = 0;
-	uint8_t flags = 0x00;
+	if (sess->tx_len)
+	{
+		struct timespec now_time;
+		size_t i;
 
-	/* Write the message header */
-	uint8_t* p = write_message_header(msg,DLEP_SESSION_INIT);
+		if (transmit(sess,sess->tx_batch,sess->tx_len) != (ssize_t)sess->tx_len)
+		{
+			LOG_ERROR(("Failed to send batched messages: %s\n",strerror(errno)));
+			sess->tx_len = 0;
+			sess->tx_count = 0;
+			return 0;
+		}
 
-	/* Write out our Heartbeat Interval */
-	p = write_data_item(p,DLEP_HEARTBEAT_INTERVAL_DATA_ITEM,4);
-	p = write_uint32(router_heartbeat_interval,p);
+		clock_gettime(CLOCK_MONOTONIC,&now_time);
+		for (i = 0; i < sess->tx_count; ++i)
+			stats_record(&stats.handled_to_sent,interval_ns(&sess->tx_queued[i],&now_time));
 
-	/* Write out Peer Type */
-	peer_type_len = strlen(PEER_TYPE);
-	if (peer_type_len > sizeof(msg) - 17)
-		peer_type_len = sizeof(msg) - 17;
+		sess->tx_len = 0;
+		sess->tx_count = 0;
+	}
+	return 1;
+}
 
-	p = write_data_item(p,DLEP_PEER_TYPE_DATA_ITEM, 1 + peer_type_len);  /* includes length of the flag + description fields */
-	*p++ = flags;
+static int send_message(struct dlep_session* sess, const uint8_t* msg, uint16_t msg_len, const char* name)
+{
+	/* Anything batched must go first */
+	if (!flush_batch(sess))
+		return 0;
 
-	if (peer_type_len)
+	if (transmit(sess,msg,msg_len) != msg_len)
 	{
-		memcpy(p, PEER_TYPE, peer_type_len);
-		p += peer_type_len;
+		LOG_ERROR(("Failed to send %s message: %s\n",name,strerror(errno)));
+		return 0;
 	}
 
-	msg_len = p - msg;
-
-	/* Octet 2 and 3 are the message length, minus the length of the header */
-	write_uint16(msg_len - 4,msg + 2);
-
-	printf("Sending Session Initialization message\n");
+	capture_packet(sess->capture_if,sess->capture_comment,CAPTURE_OUTBOUND,msg,msg_len);
+	binlog_event(BINLOG_TX,read_uint16(msg),NULL,NULL,NULL,0,0);
+	STATS_INC(stats.tx_messages[STATS_MESSAGE_INDEX(read_uint16(msg))]);
+	STATS_ADD(stats.tx_bytes,msg_len);
+	return 1;
+}
 
-	if (send(s,msg,msg_len,0) != msg_len)
-	{
-		printf("Failed to send Session Initialization message: %s\n",strerror(errno));
+static int queue_message(struct dlep_session* sess, const uint8_t* msg, uint16_t msg_len)
+{
+	/* Add the message to the batch, sent once everything received has been handled */
+	if ((sess->tx_len + msg_len > TX_BATCH_SIZE || sess->tx_count == TX_BATCH_MESSAGES) && !flush_batch(sess))
 		return 0;
-	}
 
+	memcpy(sess->tx_batch + sess->tx_len,msg,msg_len);
+	sess->tx_len += msg_len;
+	clock_gettime(CLOCK_MONOTONIC,&sess->tx_queued[sess->tx_count++]);
+
+	capture_packet(sess->capture_if,sess->capture_comment,CAPTURE_OUTBOUND,msg,msg_len);
+	binlog_event(BINLOG_TX,read_uint16(msg),NULL,NULL,NULL,0,0);
+	STATS_INC(stats.tx_messages[STATS_MESSAGE_INDEX(read_uint16(msg))]);
+	STATS_ADD(stats.tx_bytes,msg_len);
 	return 1;
 }
 
-static void send_heartbeat(int s, uint16_t router_heartbeat_interval)
+static int send_session_init_message(struct dlep_session* sess)
 {
-	uint8_t msg[30];
-	uint16_t msg_len = 0;
+	uint8_t msg[ENCODE_MAX_LEN];
+	uint16_t extensions[EXTENSION_MAX];
+	uint16_t msg_len = encode_session_init_message(msg,sess->params->router_heartbeat_interval,extensions,extension_offer(extensions));
 
-	/* Write the message header */
-	uint8_t* p = write_message_header(msg,DLEP_PEER_HEARTBEAT);
+	LOG_DEBUG(("Sending Session Initialization message\n"));
+	DLEP_PROBE4(message__send,DLEP_SESSION_INIT,msg_len,NULL,-1);
 
-	msg_len = p - msg;
+	return send_message(sess,msg,msg_len,"Session Initialization");
+}
 
-	/* Octet 2 and 3 are the message length, minus the length of the header */
-	write_uint16(msg_len - 4,msg + 2);
+static void record_heartbeats(struct dlep_session* sess, unsigned int count)
+{
+	/* The watchdog has sent them, so all that is left is to record them */
+	uint8_t msg[ENCODE_MAX_LEN];
+	uint16_t msg_len = encode_heartbeat_message(msg);
 
-	printf("Sending Heartbeat message\n");
+	for (; count; --count)
+	{
+		LOG_DEBUG(("Sent Heartbeat message\n"));
+		DLEP_PROBE4(message__send,DLEP_PEER_HEARTBEAT,msg_len,NULL,-1);
 
-	if (send(s,msg,msg_len,0) != msg_len)
-		printf("Failed to send Heartbeat message: %s\n",strerror(errno));
+		capture_packet(sess->capture_if,sess->capture_comment,CAPTURE_OUTBOUND,msg,msg_len);
+		binlog_event(BINLOG_TX,DLEP_PEER_HEARTBEAT,NULL,NULL,NULL,0,0);
+	}
 }
 
-static int term_session(int s, uint8_t** msg, uint32_t modem_heartbeat_interval)
+static int term_session(struct dlep_session* sess, uint8_t** msg)
 {
 	struct timespec last_recv_time = {0};
 	struct timespec now_time = {0};
@@ -166,31 +287,31 @@ static int term_session(int s, uint8_t** msg, uint32_t modem_heartbeat_interval)
 	last_recv_time = now_time;
 
 	/* Make sure we check heartbeats promptly - this is a bit hackish */
-	timeout.tv_sec = modem_heartbeat_interval / 1000;
-	timeout.tv_usec = (modem_heartbeat_interval % 1000) * 1000;
+	timeout.tv_sec = sess->modem_heartbeat_interval / 1000;
+	timeout.tv_usec = (sess->modem_heartbeat_interval % 1000) * 1000;
 
 	/* Loop forever handling messages */
 	for (;;)
 	{
 		/* Wait for a message */
 		FD_ZERO(&readfds);
-		FD_SET(s,&readfds);
-		if (select(s+1,&readfds,NULL,NULL,&timeout) == -1)
+		FD_SET(sess->s,&readfds);
+		if (select(sess->s+1,&readfds,NULL,NULL,&timeout) == -1)
 		{
-			printf("Failed to wait for message: %s\n",strerror(errno));
+			LOG_ERROR(("Failed to wait for message: %s\n",strerror(errno)));
 			return -1;
 		}
 
 		clock_gettime(CLOCK_MONOTONIC,&now_time);
 
-		if (!FD_ISSET(s,&readfds))
+		if (!FD_ISSET(sess->s,&readfds))
 		{
 			/* Timeout */
 
 			/* Check Modem heartbeat interval, check for 2 missed intervals */
-			if (interval_compare(&last_recv_time,&now_time,modem_heartbeat_interval * 4) > 0)
+			if (interval_compare(&last_recv_time,&now_time,sess->modem_heartbeat_interval * 4) > 0)
 			{
-				printf("No messages from modem within %u seconds, resetting session\n",modem_heartbeat_interval * 4);
+				LOG_WARN(("No messages from modem within %ums, resetting session\n",sess->modem_heartbeat_interval * 4));
 				return -1;
 			}
 
@@ -199,15 +320,15 @@ static int term_session(int s, uint8_t** msg, uint32_t modem_heartbeat_interval)
 		}
 
 		/* Receive a message */
-		received = recv_message(s,msg);
+		received = recv_message(sess,msg);
 		if (received == -1)
 		{
-			printf("Failed to receive from TCP socket: %s\n",strerror(errno));
+			LOG_ERROR(("Failed to receive from TCP socket: %s\n",strerror(errno)));
 			return -1;
 		}
 		else if (received == 0)
 		{
-			printf("Modem closed TCP session\n");
+			LOG_INFO(("Modem closed TCP session\n"));
 			return -1;
 		}
 		else
@@ -223,119 +344,90 @@ static int term_session(int s, uint8_t** msg, uint32_t modem_heartbeat_interval)
 	}
 }
 
-static int send_session_term(int s, enum dlep_status_code sc, uint8_t** msg, uint32_t modem_heartbeat_interval)
+static int send_session_term(struct dlep_session* sess, enum dlep_status_code sc, uint8_t** msg)
 {
 	uint16_t msg_len = 0;
-	uint8_t* p;
-
-	/* Make sure we have room for the header */
-	uint8_t* new_msg = realloc(*msg,9);
-	if (!new_msg)
-	{
-		printf("Failed to allocate message buffer");
-		return -1;
-	}
-	*msg = new_msg;
 
-	/* Write the message header */
-	p = write_message_header(*msg,DLEP_SESSION_TERM);
+	/* No more Heartbeats once we are terminating */
+	watchdog_stop(sess->watchdog);
+	sess->watchdog = NULL;
 
-	/* Write out our Status Code */
-	p = write_status_code(p,sc);
-
-	msg_len = p - *msg;
+	/* Make sure we have room for the message */
+	if (!msg_buffer(msg))
+		return -1;
 
-	/* Octet 2 and 3 are the message length, minus the length of the header */
-	write_uint16(msg_len - 4,*msg + 2);
+	msg_len = encode_session_term_message(*msg,sc);
+	STATS_INC(stats.tx_status[sc]);
 
-	printf("Sending Session Termination message\n");
+	LOG_DEBUG(("Sending Session Termination message\n"));
+	DLEP_PROBE4(message__send,DLEP_SESSION_TERM,msg_len,NULL,sc);
+	DLEP_PROBE2(session__state,"terminating",sc);
 
-	if (send(s,*msg,msg_len,0) != msg_len)
-	{
-		printf("Failed to send Session Termination message: %s\n",strerror(errno));
+	if (!send_message(sess,*msg,msg_len,"Session Termination"))
 		return -1;
-	}
+
+	/* There is no modem to wait for */
+	if (sess->offline)
+		return 0;
 
 	/* Now enter the Session termination state */
-	return term_session(s,msg,modem_heartbeat_interval);
+	return term_session(sess,msg);
 }
 
-static int send_session_term_resp(int s)
+static int send_session_term_resp(struct dlep_session* sess)
 {
-	uint8_t msg[30];
-	uint16_t msg_len = 0;
-
-	/* Write the message header */
-	uint8_t* p = write_message_header(msg,DLEP_SESSION_TERM_RESP);
+	uint8_t msg[ENCODE_MAX_LEN];
+	uint16_t msg_len = encode_session_term_resp_message(msg);
 
-	msg_len = p - msg;
+	LOG_DEBUG(("Sending Session Termination Response message\n"));
+	DLEP_PROBE4(message__send,DLEP_SESSION_TERM_RESP,msg_len,NULL,-1);
 
-	/* Octet 2 and 3 are the message length, minus the length of the header */
-	write_uint16(msg_len - 4,msg + 2);
-
-	printf("Sending Session Termination Response message\n");
-
-	if (send(s,msg,msg_len,0) != msg_len)
-	{
-		printf("Failed to send Session Termination Response message: %s\n",strerror(errno));
+	if (!send_message(sess,msg,msg_len,"Session Termination Response"))
 		return -1;
-	}
 
 	return 0;
 }
 
-static void send_destination_up_resp(int s, const uint8_t* mac, enum dlep_status_code sc)
+static int send_destination_up_resp(struct dlep_session* sess, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc)
 {
-	uint8_t msg[30];
-	uint16_t msg_len = 0;
-
-	/* Write the message header */
-	uint8_t* p = write_message_header(msg,DLEP_DEST_UP_RESP);
-
-	/* Write out our MAC Address */
-	p = write_data_item(p,DLEP_MAC_ADDRESS_DATA_ITEM,6);
-	memcpy(p,mac,6);
-	p += 6;
-
-	/* Write out our Status code */
-	p = write_status_code(p,sc);
+	uint8_t msg[ENCODE_MAX_LEN];
+	uint16_t msg_len = encode_destination_up_resp_message(msg,mac,link,sc);
 
-	msg_len = p - msg;
+	STATS_INC(stats.tx_status[sc]);
 
-	/* Octet 2 and 3 are the message length, minus the length of the header */
-	write_uint16(msg_len - 4,msg + 2);
+	/* Don't log every response to the initial burst */
+	if (!sess->syncing)
+		LOG_DEBUG(("Sending Destination Up Response message\n"));
 
-	printf("Sending Destination Up Response message\n");
-
-	if (send(s,msg,msg_len,0) != msg_len)
-		printf("Failed to send Destination Up Response message: %s\n",strerror(errno));
+	DLEP_PROBE4(message__send,DLEP_DEST_UP_RESP,msg_len,mac,sc);
+	return queue_message(sess,msg,msg_len);
 }
 
-static void send_destination_down_resp(int s, const uint8_t* mac, enum dlep_status_code sc)
+static int send_destination_down_resp(struct dlep_session* sess, const uint8_t* mac, const struct link_id* link, enum dlep_status_code sc)
 {
-	uint8_t msg[30];
-	uint16_t msg_len = 0;
-
-	/* Write the message header */
-	uint8_t* p = write_message_header(msg,DLEP_DEST_DOWN_RESP);
-
-	/* Write out our MAC Address */
-	p = write_data_item(p,DLEP_MAC_ADDRESS_DATA_ITEM,6);
-	memcpy(p,mac,6);
-	p += 6;
+	uint8_t msg[ENCODE_MAX_LEN];
+	uint16_t msg_len = encode_destination_down_resp_message(msg,mac,link,sc);
 
-	/* Write out our Status code */
-	p = write_status_code(p,sc);
+	STATS_INC(stats.tx_status[sc]);
 
-	msg_len = p - msg;
+	LOG_DEBUG(("Sending Destination Down Response message\n"));
 
-	/* Octet 2 and 3 are the message length, minus the length of the header */
-	write_uint16(msg_len - 4,msg + 2);
+	DLEP_PROBE4(message__send,DLEP_DEST_DOWN_RESP,msg_len,mac,sc);
+	return queue_message(sess,msg,msg_len);
+}
 
-	printf("Sending Destination Down Response message\n");
+static void send_link_char_requests(struct dlep_session* sess)
+{
+	uint8_t msg[ENCODE_MAX_LEN];
+	uint16_t msg_len;
 
-	if (send(s,msg,msg_len,0) != msg_len)
-		printf("Failed to send Destination Down Response message: %s\n",strerror(errno));
+	/* Requests go out in the batch, without waiting for each response */
+	while ((msg_len = linkchar_next(sess->params->link_chars,msg)) != 0)
+	{
+		LOG_DEBUG(("Sending Link Characteristics Request message\n"));
+		DLEP_PROBE4(message__send,DLEP_LINK_CHAR_REQ,msg_len,msg + 8,-1);
+		queue_message(sess,msg,msg_len);
+	}
 }
 
 static void printf_status(enum dlep_status_code sc)
@@ -343,50 +435,50 @@ static void printf_status(enum dlep_status_code sc)
 	switch (sc)
 	{
 	case DLEP_SC_SUCCESS:
-		printf("  Status: %u - Success\n",sc);
+		LOG_TRACE(("  Status: %u - Success\n",sc));
 		break;
 
 	case DLEP_SC_UNKNOWN_MESSAGE:
-		printf("  Status: %u - Unknown Signal\n",sc);
+		LOG_TRACE(("  Status: %u - Unknown Signal\n",sc));
 		break;
 
 	case DLEP_SC_INVALID_DATA:
-		printf("  Status: %u - Invalid Data\n",sc);
+		LOG_TRACE(("  Status: %u - Invalid Data\n",sc));
 		break;
 
 	case DLEP_SC_UNEXPECTED_MESSAGE:
-		printf("  Status: %u - Unexpected Signal\n",sc);
+		LOG_TRACE(("  Status: %u - Unexpected Signal\n",sc));
 		break;
 
 	case DLEP_SC_INVALID_DEST:
-		printf("  Status: %u - Invalid Destination\n",sc);
+		LOG_TRACE(("  Status: %u - Invalid Destination\n",sc));
 		break;
 
 	case DLEP_SC_NOT_INTERESTED:
-		printf("  Status: %u - Not Interested\n",sc);
+		LOG_TRACE(("  Status: %u - Not Interested\n",sc));
 		break;
 
 	case DLEP_SC_REQUEST_DENIED:
-		printf("  Status: %u - Request Denied\n",sc);
+		LOG_TRACE(("  Status: %u - Request Denied\n",sc));
 		break;
 
 	case DLEP_SC_TIMEDOUT:
-		printf("  Status: %u - Timed Out\n",sc);
+		LOG_TRACE(("  Status: %u - Timed Out\n",sc));
 		break;
 
 	case DLEP_SC_SHUTDOWN:
-		printf("  Status: %u - Shutting Down\n",sc);
+		LOG_TRACE(("  Status: %u - Shutting Down\n",sc));
 		break;
 
 	default:
 		if (sc <= 111)
-			printf("  Status: %u - Unassigned / Specification Required\n",sc);
+			LOG_TRACE(("  Status: %u - Unassigned / Specification Required\n",sc));
 		else if (sc <= 127)
-			printf("  Status: %u - Private Use\n",sc);
+			LOG_TRACE(("  Status: %u - Private Use\n",sc));
 		else if (sc <= 239)
-			printf("  Status: %u - Unassigned / Specification Required\n",sc);
+			LOG_TRACE(("  Status: %u - Unassigned / Specification Required\n",sc));
 		else if (sc <= 254)
-			printf("  Status: %u - Private Use\n",sc);
+			LOG_TRACE(("  Status: %u - Private Use\n",sc));
 		break;
 	}
 }
@@ -398,15 +490,15 @@ static void parse_address(const uint8_t* data_item, uint16_t item_len, int chang
 	if (changeable)
 	{
 		if (data_item[0] == 1)
-			printf("Add ");
+			LOG_TRACE(("Add "));
 		else
-			printf("Drop ");
+			LOG_TRACE(("Drop "));
 	}
 
 	if (item_len == 5)
-		printf("IPv4 address: %s\n",inet_ntop(AF_INET,data_item+1,address,sizeof(address)));
+		LOG_TRACE(("IPv4 address: %s\n",inet_ntop(AF_INET,data_item+1,address,sizeof(address))));
 	else
-		printf("IPv6 address: %s\n",inet_ntop(AF_INET6,data_item+1,address,sizeof(address)));
+		LOG_TRACE(("IPv6 address: %s\n",inet_ntop(AF_INET6,data_item+1,address,sizeof(address))));
 }
 
 static void parse_attached_subnet(const uint8_t* data_item, uint16_t item_len, int changeable)
@@ -416,22 +508,218 @@ static void parse_attached_subnet(const uint8_t* data_item, uint16_t item_len, i
 	if (changeable)
 	{
 		if (data_item[0] == 1)
-			printf("Add ");
+			LOG_TRACE(("Add "));
 		else
-			printf("Drop ");
+			LOG_TRACE(("Drop "));
 	}
 
 	if (item_len == 6)
-		printf("IPv4 attached subnet: %s/%u\n",inet_ntop(AF_INET,data_item+1,address,sizeof(address)),(unsigned int)data_item[5]);
+		LOG_TRACE(("IPv4 attached subnet: %s/%u\n",inet_ntop(AF_INET,data_item+1,address,sizeof(address)),(unsigned int)data_item[5]));
 	else
-		printf("IPv6 attached subnet: %s/%u\n",inet_ntop(AF_INET6,data_item+1,address,sizeof(address)),(unsigned int)data_item[17]);
+		LOG_TRACE(("IPv6 attached subnet: %s/%u\n",inet_ntop(AF_INET6,data_item+1,address,sizeof(address)),(unsigned int)data_item[17]));
+}
+
+static void parse_latency_range(const struct dlep_session* sess, const uint8_t* data_item)
+{
+	/* Maximum Latency, then Minimum Latency */
+	LOG_TRACE(("  Latency Range: %"PRIu64"-%"PRIu64"\x03\xBCs\n",read_uint64(data_item + 8),read_uint64(data_item)));
+
+	if (!extension_item_allowed(sess->extensions,DLEP_LATENCY_RANGE_DATA_ITEM))
+		LOG_WARN(("  Latency Range data item without the Latency Range extension, ignoring\n"));
+}
+
+/* Returns link filled in from the Link Identifier data item, or NULL if it is to be ignored */
+static const struct link_id* parse_link_id(const struct dlep_session* sess, const uint8_t* data_item, uint16_t item_len, struct link_id* link)
+{
+	uint16_t i;
+
+	LOG_TRACE(("  Link Identifier: "));
+	for (i = 0; i < item_len; ++i)
+		LOG_TRACE(("%02X",data_item[i]));
+	LOG_TRACE(("\n"));
+
+	if (!extension_item_allowed(sess->extensions,DLEP_LINK_ID_DATA_ITEM))
+	{
+		LOG_WARN(("  Link Identifier data item without the Link Identifier extension, ignoring\n"));
+		return NULL;
+	}
+
+	/* Still a distinct link, so keep it rather than merge it into another */
+	if (item_len != sess->link_id_len)
+		LOG_WARN(("  Link Identifier is %u octets, not the negotiated %u\n",item_len,sess->link_id_len));
+
+	/* Validated by check_link_id() */
+	link->len = (uint8_t)item_len;
+	memcpy(link->id,data_item,item_len);
+	return link;
+}
+
+static void parse_queue_parameters(const uint8_t* data_item, uint16_t item_len)
+{
+	static const char* const scales[] = { "B", "KB", "MB", "GB" };
+	const uint8_t* p = data_item + 4;
+	uint8_t dscp_queue[64] = {0};
+	unsigned int scale = data_item[1] >> 4;
+
+	LOG_TRACE(("  Queue Parameters: %u queues\n",data_item[0]));
+
+	/* Validated by check_queue_parameters() */
+	while (p < data_item + item_len)
+	{
+		uint16_t sub_len = read_uint16(p + 2);
+		unsigned int i;
+
+		LOG_TRACE(("    Queue %u: %lu%s, DSCPs",p[4],((unsigned long)p[5] << 16) | ((unsigned long)p[6] << 8) | p[7],scale < 4 ? scales[scale] : " (unknown scale)"));
+		for (i = 0; i < p[8]; ++i)
+		{
+			/* The DSCP is the top 6 bits of the DS Field */
+			dscp_queue[p[9 + i] >> 2] = p[4];
+			LOG_TRACE((" %u",p[9 + i] >> 2));
+		}
+		LOG_TRACE(("\n"));
+
+		p += 4 + sub_len;
+	}
+
+	pause_queues(data_item[0],dscp_queue);
+}
+
+static void parse_pause(struct dlep_session* sess, const uint8_t* mac, const struct link_id* link, enum dlep_data_item item_id, const uint8_t* data_item, uint16_t item_len)
+{
+	int pause = (item_id == DLEP_PAUSE_DATA_ITEM);
+	uint16_t i;
+
+	LOG_TRACE(("  %s queues:",pause ? "Pause" : "Restart"));
+	for (i = 0; i < item_len; ++i)
+	{
+		if (data_item[i] == DLEP_ALL_QUEUES)
+			LOG_TRACE((" all"));
+		else
+			LOG_TRACE((" %u",data_item[i]));
+	}
+	LOG_TRACE(("\n"));
+
+	if (!(sess->extensions & s_ext.pause))
+	{
+		LOG_WARN(("  %s data item without the Pause extension, ignoring\n",pause ? "Pause" : "Restart"));
+		return;
+	}
+
+	if (destination_pause(sess->destinations,mac,link,data_item,item_len,pause))
+		DLEP_PROBE4(destination__pause,mac,data_item,item_len,pause);
+}
+
+static void parse_pause_items(struct dlep_session* sess, const uint8_t* mac, const struct link_id* link, const uint8_t* data_items, uint16_t len)
+{
+	const uint8_t* data_item = data_items;
+
+	/* Pauses go straight to the forwarding plane, ahead of the rest of the message */
+	while (data_item < data_items + len)
+	{
+		enum dlep_data_item item_id = read_uint16(data_item);
+		uint16_t item_len = read_uint16(data_item + 2);
+
+		if (item_id == DLEP_PAUSE_DATA_ITEM || item_id == DLEP_RESTART_DATA_ITEM)
+			parse_pause(sess,mac,link,item_id,data_item + 4,item_len);
+
+		data_item += 4 + item_len;
+	}
 }
 
-static enum dlep_status_code parse_session_init_resp_message(const uint8_t* data_items, uint16_t len, uint32_t* heartbeat_interval, enum dlep_status_code* sc)
+static void parse_credit_windows(struct dlep_session* sess, const uint8_t* data_items, uint16_t len)
 {
 	const uint8_t* data_item = data_items;
 
-	printf("Valid Session Initialization Response message from modem:\n");
+	while (data_item < data_items + len)
+	{
+		enum dlep_data_item item_id = read_uint16(data_item);
+		uint16_t item_len = read_uint16(data_item + 2);
+
+		if (item_id == DLEP_CREDIT_WINDOW_INIT_DATA_ITEM)
+		{
+			/* Validated by check_credit_window_init() */
+			LOG_TRACE(("  Credit Window of traffic class %u: %"PRIu64" octets\n",data_item[4],read_uint64(data_item + 5)));
+
+			if (!extension_item_allowed(sess->extensions,item_id))
+				LOG_WARN(("  Credit Window Initialization data item without the Credit Windowing extension, ignoring\n"));
+			else
+				destination_credit_window(sess->destinations,data_item[4],read_uint64(data_item + 5));
+		}
+
+		data_item += 4 + item_len;
+	}
+}
+
+static void parse_credit_grants(struct dlep_session* sess, const uint8_t* mac, const struct link_id* link, const uint8_t* data_items, uint16_t len)
+{
+	const uint8_t* data_item = data_items;
+
+	/* Grants go straight to the forwarding plane, like pauses */
+	while (data_item < data_items + len)
+	{
+		enum dlep_data_item item_id = read_uint16(data_item);
+		uint16_t item_len = read_uint16(data_item + 2);
+
+		if (item_id == DLEP_CREDIT_GRANT_DATA_ITEM)
+		{
+			/* Validated by check_credit_grant() */
+			uint64_t credits = read_uint64(data_item + 5);
+
+			if (!sess->syncing)
+				LOG_TRACE(("  Credit Grant of traffic class %u: %"PRIu64" octets\n",data_item[4],credits));
+
+			if (!extension_item_allowed(sess->extensions,item_id))
+				LOG_WARN(("  Credit Grant data item without the Credit Windowing extension, ignoring\n"));
+			else if (destination_credit_grant(sess->destinations,mac,link,data_item[4],credits))
+				STATS_ADD(stats.credit_granted,credits);
+		}
+
+		data_item += 4 + item_len;
+	}
+}
+
+static void send_credit_request(void* context, const uint8_t* mac, const uint8_t* link_id, uint8_t link_id_len, uint32_t classes)
+{
+	struct dlep_session* sess = context;
+	struct link_id link = {0};
+	uint8_t msg[ENCODE_MAX_LEN];
+	uint16_t msg_len;
+
+	link.len = link_id_len;
+	memcpy(link.id,link_id,link_id_len);
+
+	classes = destination_credit_request(sess->destinations,mac,&link,classes);
+	if (!classes)
+		return;
+
+	msg_len = encode_credit_control_message(msg,mac,&link,classes);
+
+	STATS_INC(stats.credit_requests);
+
+	LOG_DEBUG(("Sending Credit Control message\n"));
+
+	DLEP_PROBE4(message__send,DLEP_CREDIT_CONTROL,msg_len,mac,-1);
+	queue_message(sess,msg,msg_len);
+}
+
+static void send_credit_requests(struct dlep_session* sess)
+{
+	if (sess->extensions & s_ext.credit_window)
+		credit_poll(&send_credit_request,sess);
+}
+
+static enum dlep_status_code parse_session_init_resp_message(struct dlep_session* sess, const uint8_t* data_items, uint16_t len, enum dlep_status_code* sc)
+{
+	struct destination_metrics* defaults = &sess->destinations->defaults;
+	const uint8_t* data_item = data_items;
+	const uint8_t* queue_params = NULL;
+	uint16_t queue_params_len = 0;
+	uint16_t link_id_length = DLEP_DEFAULT_LINK_ID_LENGTH;
+
+	sess->extensions = EXTENSION_CORE;
+	sess->link_id_len = 0;
+
+	LOG_DEBUG(("Valid Session Initialization Response message from modem:\n"));
 
 	/* The message has been validated so just scan for the relevant data_items */
 	while (data_item < data_items + len)
@@ -445,15 +733,18 @@ static enum dlep_status_code parse_session_init_resp_message(const uint8_t* data
 		/* Increment data_item to point to the data */
 		data_item += 4;
 
+		/* Remember the session default metrics */
+		destination_decode_metric(defaults,item_id,data_item);
+
 		switch (item_id)
 		{
 		case DLEP_HEARTBEAT_INTERVAL_DATA_ITEM:
-			*heartbeat_interval = read_uint32(data_item);
-			printf("  Heartbeat Interval: %ums\n",*heartbeat_interval);
+			sess->modem_heartbeat_interval = read_uint32(data_item);
+			LOG_TRACE(("  Heartbeat Interval: %ums\n",sess->modem_heartbeat_interval));
 			break;
 
 		case DLEP_PEER_TYPE_DATA_ITEM:
-			printf("  Peer Type: '%.*s'%s\n",(int)item_len-1,data_item + 1,data_item[0] ? " - Secured Medium" : "");
+			LOG_TRACE(("  Peer Type: '%.*s'%s\n",(int)item_len-1,data_item + 1,data_item[0] ? " - Secured Medium" : ""));
 			break;
 
 		case DLEP_STATUS_DATA_ITEM:
@@ -462,62 +753,70 @@ static enum dlep_status_code parse_session_init_resp_message(const uint8_t* data
 			break;
 
 		case DLEP_MDRR_DATA_ITEM:
-			printf("  Default MDDR: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  Default MDDR: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_MDRT_DATA_ITEM:
-			printf("  Default MDDT: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  Default MDDT: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_CDRR_DATA_ITEM:
-			printf("  Default CDDR: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  Default CDDR: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_CDRT_DATA_ITEM:
-			printf("  Default CDDT: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  Default CDDT: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_LATENCY_DATA_ITEM:
-			printf("  Default Latency: %"PRIu64"\x03\xBCs\n",read_uint64(data_item));
+			LOG_TRACE(("  Default Latency: %"PRIu64"\x03\xBCs\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_RESOURCES_DATA_ITEM:
-			printf("  Default Resources: %u%%\n",data_item[0]);
+			LOG_TRACE(("  Default Resources: %u%%\n",data_item[0]));
 			break;
 
 		case DLEP_RLQR_DATA_ITEM:
-			printf("  Default RLQR: %u\n",data_item[0]);
+			LOG_TRACE(("  Default RLQR: %u\n",data_item[0]));
 			break;
 
 		case DLEP_RLQT_DATA_ITEM:
-			printf("  Default RLQT: %u\n",data_item[0]);
+			LOG_TRACE(("  Default RLQT: %u\n",data_item[0]));
 			break;
 
 		case DLEP_MTU_DATA_ITEM:
-			printf("  Default MTU: %"PRIu32"\n",read_uint32(data_item));
+			LOG_TRACE(("  Default MTU: %"PRIu32"\n",read_uint32(data_item)));
+			break;
+
+		case DLEP_LATENCY_RANGE_DATA_ITEM:
+			LOG_TRACE(("  Default Latency Range: %"PRIu64"-%"PRIu64"\x03\xBCs\n",read_uint64(data_item + 8),read_uint64(data_item)));
 			break;
 
 		case DLEP_EXTS_SUPP_DATA_ITEM:
 			if (item_len > 0)
-			{
-				size_t i = 0;
-				printf("  Extensions advertised by peer:\n");
-				for (; i < item_len; i += 2)
-				{
-					printf("    Unknown DLEP extension %u (which we don't support)\n",read_uint16(data_item + i));
-				}
-			}
+				sess->extensions = extension_negotiate(data_item,item_len);
+			break;
+
+		case DLEP_LINK_ID_LENGTH_DATA_ITEM:
+			link_id_length = read_uint16(data_item);
+			LOG_TRACE(("  Link Identifier Length: %u\n",link_id_length));
+			break;
+
+		case DLEP_QUEUE_PARAMS_DATA_ITEM:
+			/* The Extensions Supported data item may come later */
+			queue_params = data_item;
+			queue_params_len = item_len;
 			break;
 
 		case DLEP_IPV4_ADDRESS_DATA_ITEM:
 		case DLEP_IPV6_ADDRESS_DATA_ITEM:
-			printf("  Modem ");
+			LOG_TRACE(("  Modem "));
 			parse_address(data_item,item_len,0);
 			break;
 
 		case DLEP_IPV4_ATT_SUBNET_DATA_ITEM:
 		case DLEP_IPV6_ATT_SUBNET_DATA_ITEM:
-			printf("  Modem ");
+			LOG_TRACE(("  Modem "));
 			parse_attached_subnet(data_item,item_len,0);
 			break;
 
@@ -529,14 +828,46 @@ static enum dlep_status_code parse_session_init_resp_message(const uint8_t* data
 		/* Increment data_item to point to the next data item */
 		data_item += item_len;
 	}
+
+	/* Extensions Supported may follow the data items it covers */
+	if ((defaults->present & DEST_FIELD_LATENCY_RANGE) && !extension_item_allowed(sess->extensions,DLEP_LATENCY_RANGE_DATA_ITEM))
+	{
+		LOG_WARN(("  Latency Range data item without the Latency Range extension, ignoring\n"));
+		defaults->present &= ~DEST_FIELD_LATENCY_RANGE;
+	}
+
+	if (sess->extensions & s_ext.link_id)
+	{
+		if (link_id_length > MAX_LINK_ID_LENGTH)
+		{
+			LOG_ERROR(("Link Identifier Length %u is longer than we support (%u)\n",link_id_length,MAX_LINK_ID_LENGTH));
+			return DLEP_SC_INVALID_DATA;
+		}
+		sess->link_id_len = (uint8_t)link_id_length;
+	}
+
+	parse_credit_windows(sess,data_items,len);
+
+	if (queue_params)
+	{
+		if (sess->extensions & s_ext.pause)
+			parse_queue_parameters(queue_params,queue_params_len);
+		else
+			LOG_WARN(("  Queue Parameters data item without the Pause extension, ignoring\n"));
+	}
+
+	binlog_event(BINLOG_RX,DLEP_SESSION_INIT_RESP,NULL,NULL,defaults,defaults->present,0);
 	return DLEP_SC_SUCCESS;
 }
 
-static void parse_session_update_message(const uint8_t* data_items, uint16_t len)
+static enum dlep_status_code parse_session_update_message(struct dlep_session* sess, const uint8_t* data_items, uint16_t len)
 {
+	struct destination_table* destinations = sess->destinations;
 	const uint8_t* data_item = data_items;
 
-	printf("Received Session Update message from modem:\n");
+	LOG_DEBUG(("Received Session Update message from modem:\n"));
+
+	parse_pause_items(sess,NULL,NULL,data_items,len);
 
 	/* The message has been validated so just scan for the relevant data_items */
 	while (data_item < data_items + len)
@@ -550,54 +881,69 @@ static void parse_session_update_message(const uint8_t* data_items, uint16_t len
 		/* Increment data_item to point to the data */
 		data_item += 4;
 
+		/* Update the session default metrics */
+		if (extension_item_allowed(sess->extensions,item_id))
+			destination_decode_metric(&destinations->defaults,item_id,data_item);
+
 		switch (item_id)
 		{
 		case DLEP_IPV4_ADDRESS_DATA_ITEM:
 		case DLEP_IPV6_ADDRESS_DATA_ITEM:
-			printf("  Modem ");
+			LOG_TRACE(("  Modem "));
 			parse_address(data_item,item_len,1);
 			break;
 
 		case DLEP_IPV4_ATT_SUBNET_DATA_ITEM:
 		case DLEP_IPV6_ATT_SUBNET_DATA_ITEM:
-			printf("  Modem ");
+			LOG_TRACE(("  Modem "));
 			parse_attached_subnet(data_item,item_len,1);
 			break;
 
 		case DLEP_MDRR_DATA_ITEM:
-			printf("  Session MDDR: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  Session MDDR: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_MDRT_DATA_ITEM:
-			printf("  Session MDDT: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  Session MDDT: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_CDRR_DATA_ITEM:
-			printf("  Session CDDR: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  Session CDDR: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_CDRT_DATA_ITEM:
-			printf("  Session CDDT: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  Session CDDT: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_LATENCY_DATA_ITEM:
-			printf("  Session Latency: %"PRIu64"\x03\xBCs\n",read_uint64(data_item));
+			LOG_TRACE(("  Session Latency: %"PRIu64"\x03\xBCs\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_RESOURCES_DATA_ITEM:
-			printf("  Session Resources: %u%%\n",data_item[0]);
+			LOG_TRACE(("  Session Resources: %u%%\n",data_item[0]));
 			break;
 
 		case DLEP_RLQR_DATA_ITEM:
-			printf("  Session RLQR: %u\n",data_item[0]);
+			LOG_TRACE(("  Session RLQR: %u\n",data_item[0]));
 			break;
 
 		case DLEP_RLQT_DATA_ITEM:
-			printf("  Session RLQT: %u\n",data_item[0]);
+			LOG_TRACE(("  Session RLQT: %u\n",data_item[0]));
 			break;
 
 		case DLEP_MTU_DATA_ITEM:
-			printf("  MTU: %"PRIu32"\n",read_uint32(data_item));
+			LOG_TRACE(("  MTU: %"PRIu32"\n",read_uint32(data_item)));
+			break;
+
+		case DLEP_LATENCY_RANGE_DATA_ITEM:
+			parse_latency_range(sess,data_item);
+			break;
+
+		case DLEP_QUEUE_PARAMS_DATA_ITEM:
+			if (sess->extensions & s_ext.pause)
+				parse_queue_parameters(data_item,item_len);
+			else
+				LOG_WARN(("  Queue Parameters data item without the Pause extension, ignoring\n"));
 			break;
 
 		default:
@@ -608,13 +954,88 @@ static void parse_session_update_message(const uint8_t* data_items, uint16_t len
 		/* Increment data_item to point to the next data item */
 		data_item += item_len;
 	}
+
+	parse_credit_windows(sess,data_items,len);
+
+	binlog_event(BINLOG_RX,DLEP_SESSION_UPDATE,NULL,NULL,&destinations->defaults,destinations->defaults.present,0);
+	DLEP_PROBE4(message__decode,DLEP_SESSION_UPDATE,len + 4,NULL,DLEP_SC_SUCCESS);
+
+	return DLEP_SC_SUCCESS;
+}
+
+/* Add the destination of a Destination Up message to the table, then respond */
+static enum dlep_status_code destination_up_message(struct dlep_session* sess, const uint8_t* mac, const struct link_id* link, const struct destination_metrics* metrics, const uint8_t* data_items, uint16_t len)
+{
+	enum dlep_status_code sc = DLEP_SC_SUCCESS;
+
+	binlog_event(BINLOG_RX,DLEP_DEST_UP,mac,link,metrics,metrics->present,0);
+
+	/* Only tell the modem we have the destination once we really do */
+	if (!destination_up(sess->destinations,mac,link,metrics))
+	{
+		LOG_ERROR(("Failed to add destination to the destination table\n"));
+		sc = DLEP_SC_REQUEST_DENIED;
+	}
+	else
+	{
+		if (sess->syncing)
+			++sess->sync_count;
+		parse_credit_grants(sess,mac,link,data_items,len);
+	}
+	DLEP_PROBE4(message__decode,DLEP_DEST_UP,len + 4,mac,sc);
+
+	/* Responses are only lost if the socket has failed, which ends the session */
+	if (!send_destination_up_resp(sess,mac,link,sc))
+		return DLEP_SC_SHUTDOWN;
+
+	return DLEP_SC_SUCCESS;
+}
+
+static enum dlep_status_code sync_destination_up_message(struct dlep_session* sess, const uint8_t* data_items, uint16_t len)
+{
+	const uint8_t* data_item = data_items;
+	const uint8_t* mac = NULL;
+	struct link_id link_id;
+	const struct link_id* link = NULL;
+	struct destination_metrics metrics = {0};
+
+	/* During the initial burst, just decode what the destination table needs */
+	while (data_item < data_items + len)
+	{
+		enum dlep_data_item item_id = read_uint16(data_item);
+		uint16_t item_len = read_uint16(data_item + 2);
+
+		data_item += 4;
+
+		if (item_id == DLEP_MAC_ADDRESS_DATA_ITEM)
+			mac = data_item;
+		else if (item_id == DLEP_LINK_ID_DATA_ITEM)
+			link = parse_link_id(sess,data_item,item_len,&link_id);
+		else if (extension_item_allowed(sess->extensions,item_id))
+			destination_decode_metric(&metrics,item_id,data_item);
+
+		data_item += item_len;
+	}
+
+	/* The message has been validated, so there is always a MAC Address */
+	if (!mac)
+		return DLEP_SC_SUCCESS;
+
+	return destination_up_message(sess,mac,link,&metrics,data_items,len);
 }
 
-static void parse_destination_up_message(int s, const uint8_t* data_items, uint16_t len)
+static enum dlep_status_code parse_destination_up_message(struct dlep_session* sess, const uint8_t* data_items, uint16_t len)
 {
 	const uint8_t* data_item = data_items;
+	const uint8_t* mac = NULL;
+	struct link_id link_id;
+	const struct link_id* link = NULL;
+	struct destination_metrics metrics = {0};
 
-	printf("Received Destination Up message from modem:\n");
+	if (sess->syncing)
+		return sync_destination_up_message(sess,data_items,len);
+
+	LOG_DEBUG(("Received Destination Up message from modem:\n"));
 
 	/* The message has been validated so just scan for the relevant data_items */
 	while (data_item < data_items + len)
@@ -628,59 +1049,71 @@ static void parse_destination_up_message(int s, const uint8_t* data_items, uint1
 		/* Increment data_item to point to the data */
 		data_item += 4;
 
+		/* Decode the metrics into the destination table form */
+		if (extension_item_allowed(sess->extensions,item_id))
+			destination_decode_metric(&metrics,item_id,data_item);
+
 		switch (item_id)
 		{
 		case DLEP_MAC_ADDRESS_DATA_ITEM:
-			printf("  MAC Address: %02X:%02X:%02X:%02X:%02X:%02X\n",data_item[0],data_item[1],data_item[2],data_item[3],data_item[4],data_item[5]);
-			send_destination_up_resp(s,data_item,DLEP_SC_SUCCESS);
+			LOG_TRACE(("  MAC Address: %02X:%02X:%02X:%02X:%02X:%02X\n",data_item[0],data_item[1],data_item[2],data_item[3],data_item[4],data_item[5]));
+			mac = data_item;
+			break;
+
+		case DLEP_LINK_ID_DATA_ITEM:
+			link = parse_link_id(sess,data_item,item_len,&link_id);
 			break;
 
 		case DLEP_IPV4_ADDRESS_DATA_ITEM:
 		case DLEP_IPV6_ADDRESS_DATA_ITEM:
-			printf("  ");
+			LOG_TRACE(("  "));
 			parse_address(data_item,item_len,0);
 			break;
 
 		case DLEP_IPV4_ATT_SUBNET_DATA_ITEM:
 		case DLEP_IPV6_ATT_SUBNET_DATA_ITEM:
-			printf("  ");
+			LOG_TRACE(("  "));
 			parse_attached_subnet(data_item,item_len,0);
 			break;
 
 		case DLEP_MDRR_DATA_ITEM:
-			printf("  MDDR: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  MDDR: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_MDRT_DATA_ITEM:
-			printf("  MDDT: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  MDDT: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_CDRR_DATA_ITEM:
-			printf("  CDDR: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  CDDR: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_CDRT_DATA_ITEM:
-			printf("  CDDT: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  CDDT: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_LATENCY_DATA_ITEM:
-			printf("  Latency: %"PRIu64"\x03\xBCs\n",read_uint64(data_item));
+			LOG_TRACE(("  Latency: %"PRIu64"\x03\xBCs\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_RESOURCES_DATA_ITEM:
-			printf("  Resources (Receive): %u%%\n",data_item[0]);
+			LOG_TRACE(("  Resources (Receive): %u%%\n",data_item[0]));
 			break;
 
 		case DLEP_RLQR_DATA_ITEM:
-			printf("  RLQR: %u\n",data_item[0]);
+			LOG_TRACE(("  RLQR: %u\n",data_item[0]));
 			break;
 
 		case DLEP_RLQT_DATA_ITEM:
-			printf("  RLQT: %u\n",data_item[0]);
+			LOG_TRACE(("  RLQT: %u\n",data_item[0]));
 			break;
 
 		case DLEP_MTU_DATA_ITEM:
-			printf("  MTU: %"PRIu32"\n",read_uint32(data_item));
+			LOG_TRACE(("  MTU: %"PRIu32"\n",read_uint32(data_item)));
+			break;
+
+		case DLEP_LATENCY_RANGE_DATA_ITEM:
+			parse_latency_range(sess,data_item);
 			break;
 
 		default:
@@ -691,13 +1124,24 @@ static void parse_destination_up_message(int s, const uint8_t* data_items, uint1
 		/* Increment data_item to point to the next data item */
 		data_item += item_len;
 	}
+
+	/* The message has been validated, so there is always a MAC Address */
+	if (!mac)
+		return DLEP_SC_SUCCESS;
+
+	return destination_up_message(sess,mac,link,&metrics,data_items,len);
 }
 
-static void parse_destination_update_message(const uint8_t* data_items, uint16_t len)
+static enum dlep_status_code parse_destination_update_message(struct dlep_session* sess, const uint8_t* data_items, uint16_t len)
 {
+	struct destination_table* destinations = sess->destinations;
 	const uint8_t* data_item = data_items;
+	const uint8_t* mac = NULL;
+	struct link_id link_id;
+	const struct link_id* link = NULL;
+	struct destination_metrics metrics = {0};
 
-	printf("Received Destination Update message from modem:\n");
+	LOG_DEBUG(("Received Destination Update message from modem:\n"));
 
 	/* The message has been validated so just scan for the relevant data_items */
 	while (data_item < data_items + len)
@@ -711,58 +1155,71 @@ static void parse_destination_update_message(const uint8_t* data_items, uint16_t
 		/* Increment data_item to point to the data */
 		data_item += 4;
 
+		/* Decode the metrics into the destination table form */
+		if (extension_item_allowed(sess->extensions,item_id))
+			destination_decode_metric(&metrics,item_id,data_item);
+
 		switch (item_id)
 		{
 		case DLEP_MAC_ADDRESS_DATA_ITEM:
-			printf("  MAC Address: %02X:%02X:%02X:%02X:%02X:%02X\n",data_item[0],data_item[1],data_item[2],data_item[3],data_item[4],data_item[5]);
+			LOG_TRACE(("  MAC Address: %02X:%02X:%02X:%02X:%02X:%02X\n",data_item[0],data_item[1],data_item[2],data_item[3],data_item[4],data_item[5]));
+			mac = data_item;
+			break;
+
+		case DLEP_LINK_ID_DATA_ITEM:
+			link = parse_link_id(sess,data_item,item_len,&link_id);
 			break;
 
 		case DLEP_IPV4_ADDRESS_DATA_ITEM:
 		case DLEP_IPV6_ADDRESS_DATA_ITEM:
-			printf("  ");
+			LOG_TRACE(("  "));
 			parse_address(data_item,item_len,1);
 			break;
 
 		case DLEP_IPV4_ATT_SUBNET_DATA_ITEM:
 		case DLEP_IPV6_ATT_SUBNET_DATA_ITEM:
-			printf("  ");
+			LOG_TRACE(("  "));
 			parse_attached_subnet(data_item,item_len,1);
 			break;
 
 		case DLEP_MDRR_DATA_ITEM:
-			printf("  MDDR: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  MDDR: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_MDRT_DATA_ITEM:
-			printf("  MDDT: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  MDDT: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_CDRR_DATA_ITEM:
-			printf("  CDDR: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  CDDR: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_CDRT_DATA_ITEM:
-			printf("  CDDT: %"PRIu64"bps\n",read_uint64(data_item));
+			LOG_TRACE(("  CDDT: %"PRIu64"bps\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_LATENCY_DATA_ITEM:
-			printf("  Latency: %"PRIu64"\x03\xBCs\n",read_uint64(data_item));
+			LOG_TRACE(("  Latency: %"PRIu64"\x03\xBCs\n",read_uint64(data_item)));
 			break;
 
 		case DLEP_RESOURCES_DATA_ITEM:
-			printf("  Resources (Receive): %u%%\n",data_item[0]);
+			LOG_TRACE(("  Resources (Receive): %u%%\n",data_item[0]));
 			break;
 
 		case DLEP_RLQR_DATA_ITEM:
-			printf("  RLQR: %u\n",data_item[0]);
+			LOG_TRACE(("  RLQR: %u\n",data_item[0]));
 			break;
 
 		case DLEP_RLQT_DATA_ITEM:
-			printf("  RLQT: %u\n",data_item[0]);
+			LOG_TRACE(("  RLQT: %u\n",data_item[0]));
 			break;
 
 		case DLEP_MTU_DATA_ITEM:
-			printf("  MTU: %"PRIu32"\n",read_uint32(data_item));
+			LOG_TRACE(("  MTU: %"PRIu32"\n",read_uint32(data_item)));
+			break;
+
+		case DLEP_LATENCY_RANGE_DATA_ITEM:
+			parse_latency_range(sess,data_item);
 			break;
 
 		default:
@@ -773,13 +1230,36 @@ static void parse_destination_update_message(const uint8_t* data_items, uint16_t
 		/* Increment data_item to point to the next data item */
 		data_item += item_len;
 	}
+
+	if (mac)
+	{
+		binlog_event(BINLOG_RX,DLEP_DEST_UPDATE,mac,link,&metrics,metrics.present,0);
+
+		parse_pause_items(sess,mac,link,data_items,len);
+
+		if (!destination_update(destinations,mac,link,&metrics))
+		{
+			LOG_WARN(("  Destination Update for unknown destination, ignoring\n"));
+			DLEP_PROBE4(message__decode,DLEP_DEST_UPDATE,len + 4,mac,DLEP_SC_INVALID_DEST);
+		}
+		else
+		{
+			parse_credit_grants(sess,mac,link,data_items,len);
+			DLEP_PROBE4(message__decode,DLEP_DEST_UPDATE,len + 4,mac,DLEP_SC_SUCCESS);
+		}
+	}
+
+	return DLEP_SC_SUCCESS;
 }
 
-static void parse_destination_down_message(int s, const uint8_t* data_items, uint16_t len)
+static enum dlep_status_code parse_destination_down_message(struct dlep_session* sess, const uint8_t* data_items, uint16_t len)
 {
 	const uint8_t* data_item = data_items;
+	const uint8_t* mac = NULL;
+	struct link_id link_id;
+	const struct link_id* link = NULL;
 
-	printf("Received Destination Down message from modem:\n");
+	LOG_DEBUG(("Received Destination Down message from modem:\n"));
 
 	/* The message has been validated so just scan for the relevant data_items */
 	while (data_item < data_items + len)
@@ -796,8 +1276,12 @@ static void parse_destination_down_message(int s, const uint8_t* data_items, uin
 		switch (item_id)
 		{
 		case DLEP_MAC_ADDRESS_DATA_ITEM:
-			printf("  MAC Address: %02X:%02X:%02X:%02X:%02X:%02X\n",data_item[0],data_item[1],data_item[2],data_item[3],data_item[4],data_item[5]);
-			send_destination_down_resp(s,data_item,DLEP_SC_SUCCESS);
+			LOG_TRACE(("  MAC Address: %02X:%02X:%02X:%02X:%02X:%02X\n",data_item[0],data_item[1],data_item[2],data_item[3],data_item[4],data_item[5]));
+			mac = data_item;
+			break;
+
+		case DLEP_LINK_ID_DATA_ITEM:
+			link = parse_link_id(sess,data_item,item_len,&link_id);
 			break;
 
 		default:
@@ -808,195 +1292,492 @@ static void parse_destination_down_message(int s, const uint8_t* data_items, uin
 		/* Increment data_item to point to the next data item */
 		data_item += item_len;
 	}
+
+	/* The message has been validated, so there is always a MAC Address */
+	if (mac)
+	{
+		binlog_event(BINLOG_RX,DLEP_DEST_DOWN,mac,link,NULL,0,0);
+
+		if (!destination_down(sess->destinations,mac,link))
+		{
+			LOG_WARN(("  Destination Down for unknown destination\n"));
+			DLEP_PROBE4(message__decode,DLEP_DEST_DOWN,len + 4,mac,DLEP_SC_INVALID_DEST);
+		}
+		else
+			DLEP_PROBE4(message__decode,DLEP_DEST_DOWN,len + 4,mac,DLEP_SC_SUCCESS);
+
+		/* Responses are only lost if the socket has failed, which ends the session */
+		if (!send_destination_down_resp(sess,mac,link,DLEP_SC_SUCCESS))
+			return DLEP_SC_SHUTDOWN;
+	}
+
+	return DLEP_SC_SUCCESS;
 }
 
-static int handle_message(int s, uint8_t** msg, size_t len, uint32_t modem_heartbeat_interval)
+static enum dlep_status_code parse_link_char_resp_message(struct dlep_session* sess, const uint8_t* data_items, uint16_t len)
 {
+	const uint8_t* data_item = data_items;
+	const uint8_t* mac = NULL;
+	struct link_id link_id;
+	const struct link_id* link = NULL;
 	enum dlep_status_code sc = DLEP_SC_SUCCESS;
+	struct destination_metrics metrics = {0};
 
-	/* Octets 0 and 1 are the message type */
-	enum dlep_message msg_id = read_uint16(*msg);
+	if (!sess->params->link_chars)
+	{
+		binlog_event(BINLOG_RX,DLEP_LINK_CHAR_RESP,NULL,NULL,NULL,0,0);
+		LOG_WARN(("Unexpected Link Characteristics Response message received. We don't send requests!\n"));
+		return DLEP_SC_UNEXPECTED_MESSAGE;
+	}
 
-	/* Octets 2 and 3 are the message length */
-	uint16_t msg_len = read_uint16(*msg + 2);
+	LOG_DEBUG(("Received Link Characteristics Response message from modem\n"));
 
-	/* Check the message type */
-	switch (msg_id)
+	/* The message has been validated so just scan for the relevant data_items */
+	while (data_item < data_items + len)
 	{
-	case DLEP_SESSION_INIT:
-		printf("Unexpected Session Initialization message received during 'in session' state\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+		enum dlep_data_item item_id = read_uint16(data_item);
+		uint16_t item_len = read_uint16(data_item + 2);
 
-	case DLEP_SESSION_INIT_RESP:
-		printf("Unexpected Session Initialization Response message received during 'in session' state\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+		data_item += 4;
 
-	case DLEP_SESSION_TERM:
-		sc = check_session_term_message(*msg,len);
-		if (sc == DLEP_SC_SUCCESS)
-			printf("Received Session Termination message from modem\n");
+		if (item_id == DLEP_MAC_ADDRESS_DATA_ITEM)
+			mac = data_item;
+		else if (item_id == DLEP_LINK_ID_DATA_ITEM)
+			link = parse_link_id(sess,data_item,item_len,&link_id);
+		else if (item_id == DLEP_STATUS_DATA_ITEM)
+			sc = data_item[0];
+		else if (extension_item_allowed(sess->extensions,item_id))
+			destination_decode_metric(&metrics,item_id,data_item);
 
-		/* Always send a response, otherwise it's tough to quit! */
-		return send_session_term_resp(s);
+		data_item += item_len;
+	}
 
-	case DLEP_SESSION_TERM_RESP:
-		printf("Unexpected Session Termination Response message received during 'in session' state\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+	/* The message has been validated, so there is always a MAC Address */
+	if (mac)
+	{
+		binlog_event(BINLOG_RX,DLEP_LINK_CHAR_RESP,mac,link,&metrics,metrics.present,0);
 
-	case DLEP_SESSION_UPDATE:
-		sc = check_session_update_message(*msg,len);
-		if (sc == DLEP_SC_SUCCESS)
-			parse_session_update_message(*msg+4,msg_len);
-		break;
+		/* The response carries the current metrics of the destination */
+		if (metrics.present && !destination_update(sess->destinations,mac,link,&metrics))
+			LOG_WARN(("  Link Characteristics Response for unknown destination\n"));
 
-	case DLEP_SESSION_UPDATE_RESP:
-		printf("Unexpected Session Update Response message received\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+		if (!linkchar_response(sess->params->link_chars,mac,link,sc,&metrics))
+		{
+			LOG_WARN(("  Link Characteristics Response with no request outstanding, ignoring\n"));
+			DLEP_PROBE4(message__decode,DLEP_LINK_CHAR_RESP,len + 4,mac,DLEP_SC_INVALID_DEST);
+		}
+		else
+			DLEP_PROBE4(message__decode,DLEP_LINK_CHAR_RESP,len + 4,mac,sc);
+	}
 
-	case DLEP_DEST_UP:
-		sc = check_destination_up_message(*msg,len);
-		if (sc == DLEP_SC_SUCCESS)
-			parse_destination_up_message(s,*msg+4,msg_len);
-		break;
+	return DLEP_SC_SUCCESS;
+}
 
-	case DLEP_DEST_UP_RESP:
-		printf("Unexpected Destination Up Response message received\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+static enum dlep_status_code parse_credit_control_resp_message(struct dlep_session* sess, const uint8_t* data_items, uint16_t len)
+{
+	const uint8_t* data_item = data_items;
+	const uint8_t* mac = NULL;
+	struct link_id link_id;
+	const struct link_id* link = NULL;
+	enum dlep_status_code sc = DLEP_SC_SUCCESS;
 
-	case DLEP_DEST_DOWN:
-		sc = check_destination_down_message(*msg,len);
-		if (sc == DLEP_SC_SUCCESS)
-			parse_destination_down_message(s,*msg+4,msg_len);
-		break;
+	LOG_DEBUG(("Received Credit Control Response message from modem\n"));
 
-	case DLEP_DEST_DOWN_RESP:
-		printf("Unexpected Destination Up Response message received\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+	/* The message has been validated so just scan for the relevant data_items */
+	while (data_item < data_items + len)
+	{
+		enum dlep_data_item item_id = read_uint16(data_item);
+		uint16_t item_len = read_uint16(data_item + 2);
 
-	case DLEP_DEST_UPDATE:
-		sc = check_destination_update_message(*msg,len);
-		if (sc == DLEP_SC_SUCCESS)
-			parse_destination_update_message(*msg+4,msg_len);
-		break;
+		data_item += 4;
 
-	case DLEP_LINK_CHAR_REQ:
-		printf("Unexpected Link Characteristics Request message received.\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+		if (item_id == DLEP_MAC_ADDRESS_DATA_ITEM)
+			mac = data_item;
+		else if (item_id == DLEP_LINK_ID_DATA_ITEM)
+			link = parse_link_id(sess,data_item,item_len,&link_id);
+		else if (item_id == DLEP_STATUS_DATA_ITEM)
+		{
+			sc = data_item[0];
+			printf_status(sc);
+		}
 
-	case DLEP_LINK_CHAR_RESP:
-		printf("Unexpected Link Characteristics Response message received. We don't send requests!\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+		data_item += item_len;
+	}
 
-	case DLEP_PEER_HEARTBEAT:
-		sc = check_heartbeat_message(*msg,len);
-		if (sc == DLEP_SC_SUCCESS)
-			printf("Received Heartbeat message from modem\n");
-		break;
+	/* The message has been validated, so there is always a MAC Address */
+	if (mac)
+	{
+		if (!destination_find(sess->destinations,mac,link))
+		{
+			LOG_WARN(("  Credit Control Response for unknown destination, ignoring\n"));
+			DLEP_PROBE4(message__decode,DLEP_CREDIT_CONTROL_RESP,len + 4,mac,DLEP_SC_INVALID_DEST);
+			return DLEP_SC_SUCCESS;
+		}
 
-	case DLEP_DEST_ANNOUNCE:
-		printf("Unexpected Destination Announce message received.\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+		/* Requests left without a grant are repeated after CREDIT_REQUEST_TIMEOUT */
+		parse_credit_grants(sess,mac,link,data_items,len);
+		DLEP_PROBE4(message__decode,DLEP_CREDIT_CONTROL_RESP,len + 4,mac,sc);
+	}
 
-	case DLEP_DEST_ANNOUNCE_RESP:
-		printf("Unexpected Destination Announce Response message received. We don't send announces!\n");
-		sc = DLEP_SC_UNEXPECTED_MESSAGE;
-		break;
+	return DLEP_SC_SUCCESS;
+}
 
-	default:
-		printf("Unrecognized message %u received\n",msg_id);
+static enum dlep_status_code parse_heartbeat_message(struct dlep_session* sess, const uint8_t* data_items, uint16_t len)
+{
+	uint64_t since = 0;
+
+	LOG_DEBUG(("Received Heartbeat message from modem\n"));
+
+	if (sess->modem_heartbeat_time.tv_sec || sess->modem_heartbeat_time.tv_nsec)
+	{
+		since = interval_ns(&sess->modem_heartbeat_time,&sess->rx_time);
+		stats_record(&stats.modem_heartbeat_interval,since);
+	}
+	sess->modem_heartbeat_time = sess->rx_time;
+
+	DLEP_PROBE2(heartbeat__receive,sess->modem_heartbeat_interval,since);
+	return DLEP_SC_SUCCESS;
+}
+
+/* The messages of RFC 8175, those without a validator are never sent by a modem
+ * once the session is up. The Session Termination is answered by handle_message() */
+static const struct extension_message s_core_messages[] =
+{
+	{ DLEP_SESSION_INIT, "Session Initialization", NULL, NULL },
+	{ DLEP_SESSION_INIT_RESP, "Session Initialization Response", NULL, NULL },
+	{ DLEP_SESSION_UPDATE, "Session Update", &check_session_update_message, &parse_session_update_message },
+	{ DLEP_SESSION_UPDATE_RESP, "Session Update Response", NULL, NULL },
+	{ DLEP_SESSION_TERM, "Session Termination", &check_session_term_message, NULL },
+	{ DLEP_SESSION_TERM_RESP, "Session Termination Response", NULL, NULL },
+	{ DLEP_DEST_UP, "Destination Up", &check_destination_up_message, &parse_destination_up_message },
+	{ DLEP_DEST_UP_RESP, "Destination Up Response", NULL, NULL },
+	{ DLEP_DEST_ANNOUNCE, "Destination Announce", NULL, NULL },
+	{ DLEP_DEST_ANNOUNCE_RESP, "Destination Announce Response", NULL, NULL },
+	{ DLEP_DEST_DOWN, "Destination Down", &check_destination_down_message, &parse_destination_down_message },
+	{ DLEP_DEST_DOWN_RESP, "Destination Down Response", NULL, NULL },
+	{ DLEP_DEST_UPDATE, "Destination Update", &check_destination_update_message, &parse_destination_update_message },
+	{ DLEP_LINK_CHAR_REQ, "Link Characteristics Request", NULL, NULL },
+	{ DLEP_LINK_CHAR_RESP, "Link Characteristics Response", &check_link_char_resp_message, &parse_link_char_resp_message },
+	{ DLEP_PEER_HEARTBEAT, "Heartbeat", &check_heartbeat_message, &parse_heartbeat_message }
+};
+
+#define COUNT_OF(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Where the data items of the extensions may appear in the messages from the modem */
+static const struct extension_item_use s_queue_params_uses[] = { { DLEP_SESSION_INIT_RESP, 1 }, { DLEP_SESSION_UPDATE, 1 } };
+static const struct extension_item_use s_pause_uses[] = { { DLEP_SESSION_UPDATE, 0 }, { DLEP_DEST_UPDATE, 0 } };
+static const struct extension_item_use s_link_id_length_uses[] = { { DLEP_SESSION_INIT_RESP, 1 } };
+static const struct extension_item_use s_link_id_uses[] = { { DLEP_DEST_UP, 1 }, { DLEP_DEST_UPDATE, 1 }, { DLEP_DEST_DOWN, 1 }, { DLEP_LINK_CHAR_RESP, 1 }, { DLEP_CREDIT_CONTROL_RESP, 1 } };
+static const struct extension_item_use s_latency_range_uses[] = { { DLEP_SESSION_INIT_RESP, 1 }, { DLEP_SESSION_UPDATE, 1 }, { DLEP_DEST_UP, 1 }, { DLEP_DEST_UPDATE, 1 }, { DLEP_LINK_CHAR_RESP, 1 } };
+static const struct extension_item_use s_credit_window_init_uses[] = { { DLEP_SESSION_INIT_RESP, 0 }, { DLEP_SESSION_UPDATE, 0 } };
+static const struct extension_item_use s_credit_grant_uses[] = { { DLEP_DEST_UP, 0 }, { DLEP_DEST_UPDATE, 0 }, { DLEP_CREDIT_CONTROL_RESP, 0 } };
+
+static const struct extension_item s_pause_items[] =
+{
+	{ DLEP_QUEUE_PARAMS_DATA_ITEM, "Queue Parameters", &check_queue_parameters, s_queue_params_uses, COUNT_OF(s_queue_params_uses) },
+	{ DLEP_PAUSE_DATA_ITEM, "Pause", &check_pause, s_pause_uses, COUNT_OF(s_pause_uses) },
+	{ DLEP_RESTART_DATA_ITEM, "Restart", &check_restart, s_pause_uses, COUNT_OF(s_pause_uses) }
+};
+
+static const struct extension_item s_link_id_items[] =
+{
+	{ DLEP_LINK_ID_LENGTH_DATA_ITEM, "Link Identifier Length", &check_link_id_length, s_link_id_length_uses, COUNT_OF(s_link_id_length_uses) },
+	{ DLEP_LINK_ID_DATA_ITEM, "Link Identifier", &check_link_id, s_link_id_uses, COUNT_OF(s_link_id_uses) }
+};
+
+static const struct extension_item s_latency_range_items[] =
+{
+	{ DLEP_LATENCY_RANGE_DATA_ITEM, "Latency Range", &check_latency_range, s_latency_range_uses, COUNT_OF(s_latency_range_uses) }
+};
+
+/* Only the router sends Credit Requests */
+static const struct extension_item s_credit_window_items[] =
+{
+	{ DLEP_CREDIT_WINDOW_INIT_DATA_ITEM, "Credit Window Initialization", &check_credit_window_init, s_credit_window_init_uses, COUNT_OF(s_credit_window_init_uses) },
+	{ DLEP_CREDIT_GRANT_DATA_ITEM, "Credit Grant", &check_credit_grant, s_credit_grant_uses, COUNT_OF(s_credit_grant_uses) },
+	{ DLEP_CREDIT_REQUEST_DATA_ITEM, "Credit Request", NULL, NULL, 0 }
+};
+
+static const struct extension_message s_credit_window_messages[] =
+{
+	{ DLEP_CREDIT_CONTROL, "Credit Control", NULL, NULL },
+	{ DLEP_CREDIT_CONTROL_RESP, "Credit Control Response", &check_credit_control_resp_message, &parse_credit_control_resp_message }
+};
+
+static const struct extension_def s_core = { 0, "DLEP", NULL, 0, s_core_messages, COUNT_OF(s_core_messages) };
+static const struct extension_def s_pause = { DLEP_EXT_PAUSE, "Control-Plane-Based Pause", s_pause_items, COUNT_OF(s_pause_items), NULL, 0 };
+static const struct extension_def s_link_id = { DLEP_EXT_LINK_ID, "Link Identifier", s_link_id_items, COUNT_OF(s_link_id_items), NULL, 0 };
+static const struct extension_def s_latency_range = { DLEP_EXT_LATENCY_RANGE, "Latency Range", s_latency_range_items, COUNT_OF(s_latency_range_items), NULL, 0 };
+static const struct extension_def s_credit_window = { DLEP_EXT_CREDIT_WINDOW, "Credit Windowing", s_credit_window_items, COUNT_OF(s_credit_window_items), s_credit_window_messages, COUNT_OF(s_credit_window_messages) };
+
+void session_register_extensions(void)
+{
+	if (s_ext.registered)
+		return;
+
+	/* Offered to the modem in this order */
+	extension_register(&s_core);
+	s_ext.pause = extension_register(&s_pause);
+	s_ext.link_id = extension_register(&s_link_id);
+	s_ext.latency_range = extension_register(&s_latency_range);
+	s_ext.credit_window = extension_register(&s_credit_window);
+	s_ext.registered = 1;
+}
+
+static int handle_message(struct dlep_session* sess, uint8_t** msg, size_t len)
+{
+	enum dlep_status_code sc = DLEP_SC_SUCCESS;
+	const struct extension_message* m;
+
+	/* Octets 0 and 1 are the message type */
+	enum dlep_message msg_id = read_uint16(*msg);
+
+	/* Octets 2 and 3 are the message length */
+	uint16_t msg_len = read_uint16(*msg + 2);
+
+	/* Messages carrying destination metrics are recorded once they have been parsed */
+	if (msg_id != DLEP_DEST_UP && msg_id != DLEP_DEST_UPDATE && msg_id != DLEP_DEST_DOWN && msg_id != DLEP_SESSION_UPDATE && msg_id != DLEP_LINK_CHAR_RESP)
+		binlog_event(BINLOG_RX,msg_id,NULL,NULL,NULL,0,0);
+
+	/* Only the messages of the negotiated extensions are known */
+	m = extension_message(sess->extensions,msg_id);
+	if (!m)
+	{
+		LOG_WARN(("Unrecognized message %u received\n",msg_id));
 		sc = DLEP_SC_UNKNOWN_MESSAGE;
-		break;
+		DLEP_PROBE3(message__validate,msg_id,msg_len,sc);
+	}
+	else if (!m->check)
+	{
+		LOG_WARN(("Unexpected %s message received during 'in session' state\n",m->name));
+		sc = DLEP_SC_UNEXPECTED_MESSAGE;
+	}
+	else
+	{
+		sc = (*m->check)(*msg,len);
+		DLEP_PROBE3(message__validate,msg_id,msg_len,sc);
+
+		if (msg_id == DLEP_SESSION_TERM)
+		{
+			if (sc == DLEP_SC_SUCCESS)
+				LOG_INFO(("Received Session Termination message from modem\n"));
+			else
+				STATS_INC(stats.rejected_messages[DLEP_SESSION_TERM]);
+
+			/* Always send a response, otherwise it's tough to quit! */
+			return send_session_term_resp(sess);
+		}
+
+		if (sc == DLEP_SC_SUCCESS)
+			sc = (*m->handler)(sess,*msg+4,msg_len);
 	}
 
+	if (sc != DLEP_SC_SUCCESS)
+		STATS_INC(stats.rejected_messages[STATS_MESSAGE_INDEX(msg_id)]);
+
 	if (sc && sc >= DLEP_SC_UNKNOWN_MESSAGE)
-		return send_session_term(s,sc,msg,modem_heartbeat_interval);
+		return send_session_term(sess,sc,msg);
 
 	return 1;
 }
 
-static int in_session(int s, uint8_t** msg, uint32_t modem_heartbeat_interval, uint32_t router_heartbeat_interval)
+static void end_sync(struct dlep_session* sess, const struct timespec* now)
+{
+	LOG_INFO(("Initial burst of %lu Destination Up messages handled in %lums\n",sess->sync_count,interval_ms(&sess->sync_start,now)));
+
+	sess->syncing = 0;
+	destination_table_sync_end(sess->destinations,now);
+
+	/* Nothing should fault or allocate from here on */
+	rt_session_steady(now);
+}
+
+static void report_wakeups(struct dlep_session* sess, const struct timespec* now)
+{
+	/* Once a minute, so the idle residency can be checked */
+	unsigned long elapsed = interval_ms(&sess->wakeup_time,now);
+	if (elapsed >= 60000)
+	{
+		uint64_t wakeups = __atomic_load_n(&stats.session_wakeups,__ATOMIC_RELAXED) + __atomic_load_n(&stats.watchdog_wakeups,__ATOMIC_RELAXED);
+		unsigned long per_minute = (unsigned long)((wakeups - sess->wakeups) * 60000 / elapsed);
+
+		LOG_DEBUG(("%lu wakeups per minute\n",per_minute));
+		STATS_SET(stats.wakeups_per_minute,per_minute);
+
+		sess->wakeup_time = *now;
+		sess->wakeups = wakeups;
+	}
+}
+
+/* The sooner of two waits in milliseconds, where 0 is no wait at all */
+static unsigned long sooner(unsigned long a, unsigned long b)
+{
+	return (!a || (b && b < a) ? b : a);
+}
+
+static void record_handled(const struct dlep_session* sess)
+{
+	struct timespec now_time;
+	clock_gettime(CLOCK_MONOTONIC,&now_time);
+	stats_record(&stats.receive_to_handled,interval_ns(&sess->rx_time,&now_time));
+}
+
+static int in_session(struct dlep_session* sess, uint8_t** msg)
 {
 	struct timespec last_recv_time = {0};
-	struct timespec last_sent_time = {0};
 	struct timespec now_time = {0};
 
 	ssize_t received;
 	struct timeval timeout = {0};
 	fd_set readfds;
+	unsigned long tick_wait;
+	unsigned long link_char_wait = 0;
+	int expired = 0;
+	int nfds;
 
 	/* Remember when we started */
 	clock_gettime(CLOCK_MONOTONIC,&now_time);
-	last_sent_time = last_recv_time = now_time;
+	last_recv_time = now_time;
 
-	/* Make sure we send and check heartbeats promptly - this is a bit hackish */
-	timeout.tv_sec = (modem_heartbeat_interval < router_heartbeat_interval ? modem_heartbeat_interval : router_heartbeat_interval);
-	timeout.tv_usec = (timeout.tv_sec % 1000) * 1000;
-	timeout.tv_sec /= 1000;
+	/* The modem is about to replay a Destination Up for every known destination,
+	 * so build the destination table in bulk and publish it when the burst settles */
+	if (sess->params->sync_settle)
+	{
+		sess->syncing = 1;
+		sess->sync_start = now_time;
+		sess->sync_count = 0;
+		destination_table_sync_begin(sess->destinations);
+	}
+	else
+		rt_session_steady(&now_time);
+
+	/* The watchdog looks after the heartbeats, so only wake up for the destination
+	 * table's maintenance while it has some to do */
+	tick_wait = destination_table_tick(sess->destinations,&now_time);
+
+	sess->wakeup_time = now_time;
+	sess->wakeups = __atomic_load_n(&stats.session_wakeups,__ATOMIC_RELAXED) + __atomic_load_n(&stats.watchdog_wakeups,__ATOMIC_RELAXED);
+
+	/* Wake up for the watchdog, and Link Characteristics Requests from other threads */
+	nfds = sess->s + 1;
+	if (watchdog_wake_fd(sess->watchdog) >= nfds)
+		nfds = watchdog_wake_fd(sess->watchdog) + 1;
+	if (sess->params->link_chars && linkchar_wake_fd(sess->params->link_chars) >= nfds)
+		nfds = linkchar_wake_fd(sess->params->link_chars) + 1;
 
 	/* Loop forever handling messages */
 	for (;;)
 	{
-		/* Wait for a message */
-		FD_ZERO(&readfds);
-		FD_SET(s,&readfds);
-		if (select(s+1,&readfds,NULL,NULL,&timeout) == -1)
+		/* Only wait if everything received so far has been handled */
+		int readable = rx_pending(sess);
+		if (!readable)
 		{
-			printf("Failed to wait for message: %s\n",strerror(errno));
-			return -1;
+			/* Flush any destination changes that are due, and make sure we wake
+			 * up in time for the next ones */
+			unsigned long wait = destination_table_flush(sess->destinations,&now_time);
+			wait = sooner(wait,tick_wait);
+			if (sess->syncing)
+				wait = sooner(wait,sess->params->sync_settle);
+			wait = sooner(wait,link_char_wait);
+			if ((sess->extensions & s_ext.credit_window) && credit_enabled())
+				wait = sooner(wait,CREDIT_POLL_INTERVAL);
+
+			/* Share the wakeup with the watchdog's, and any others on the same boundary */
+			if (wait && sess->params->coalesce)
+				wait = interval_align(&now_time,wait,sess->params->coalesce);
+
+			/* Send the batched responses before we wait */
+			if (!flush_batch(sess))
+				return -1;
+
+			/* select() may modify the timeout, so set it every time */
+			timeout.tv_sec = wait / 1000;
+			timeout.tv_usec = (wait % 1000) * 1000;
+
+			/* Wait for a message */
+			FD_ZERO(&readfds);
+			FD_SET(sess->s,&readfds);
+			FD_SET(watchdog_wake_fd(sess->watchdog),&readfds);
+			if (sess->params->link_chars)
+				FD_SET(linkchar_wake_fd(sess->params->link_chars),&readfds);
+			/* With nothing due, wait for as long as it takes */
+			if (select(nfds,&readfds,NULL,NULL,wait ? &timeout : NULL) == -1)
+			{
+				/* Interrupted by a signal, which may be asking us to stop */
+				if (errno != EINTR)
+				{
+					LOG_ERROR(("Failed to wait for message: %s\n",strerror(errno)));
+					return -1;
+				}
+				FD_ZERO(&readfds);
+			}
+			STATS_INC(stats.session_wakeups);
+
+			readable = FD_ISSET(sess->s,&readfds);
+			if (sess->params->link_chars && FD_ISSET(linkchar_wake_fd(sess->params->link_chars),&readfds))
+				linkchar_clear_wake(sess->params->link_chars);
 		}
 
 		clock_gettime(CLOCK_MONOTONIC,&now_time);
 
-		/* Check for our heartbeat interval */
-		if (interval_compare(&last_sent_time,&now_time,router_heartbeat_interval) > 0)
+		/* Say goodbye to the modem if we are being stopped */
+		if (sess->params->stop && *sess->params->stop)
 		{
-			/* Send out a heartbeat if the 'timer' has expired */
-			send_heartbeat(s,router_heartbeat_interval);
-
-			/* Update the last sent time */
-			last_sent_time = now_time;
+			LOG_INFO(("Router stopping, terminating session\n"));
+			return send_session_term(sess,DLEP_SC_SUCCESS,msg);
 		}
 
-		if (!FD_ISSET(s,&readfds))
+		/* Send any new Link Characteristics Requests, and time out the old ones */
+		if (sess->params->link_chars)
 		{
-			/* Timeout */
+			send_link_char_requests(sess);
+			link_char_wait = linkchar_expire(sess->params->link_chars,&now_time);
+		}
 
-			/* Check Modem heartbeat interval, check for 2 missed intervals */
-			if (interval_compare(&last_recv_time,&now_time,modem_heartbeat_interval * 2) > 0)
-			{
-				printf("No heartbeat from modem within %u seconds, terminating session\n",modem_heartbeat_interval * 2);
-				return send_session_term(s,DLEP_SC_TIMEDOUT,msg,modem_heartbeat_interval);
-			}
+		/* Ask for credit for the windows the forwarding plane has drained */
+		send_credit_requests(sess);
+
+		/* Publish the destination table once the initial burst has settled */
+		if (sess->syncing && ((!readable && interval_ms(&last_recv_time,&now_time) >= sess->params->sync_settle) || interval_ms(&sess->sync_start,&now_time) >= SYNC_MAX_TIME))
+			end_sync(sess,&now_time);
+
+		/* Reuse destinations that have stopped flapping */
+		tick_wait = destination_table_tick(sess->destinations,&now_time);
 
+		rt_session_check(&now_time);
+		report_wakeups(sess,&now_time);
+
+		/* Record what the watchdog has done, and end the session if the modem has gone quiet */
+		record_heartbeats(sess,watchdog_poll(sess->watchdog,&expired));
+		if (expired)
+		{
+			LOG_WARN(("No heartbeat from modem within %ums, terminating session\n",sess->modem_heartbeat_interval * 2));
+			return send_session_term(sess,DLEP_SC_TIMEDOUT,msg);
+		}
+
+		if (!readable)
+		{
 			/* Wait again */
 			continue;
 		}
 
 		/* Receive a message */
-		received = recv_message(s,msg);
+		received = recv_message(sess,msg);
 		if (received == -1)
 		{
-			printf("Failed to receive from TCP socket: %s\n",strerror(errno));
+			LOG_ERROR(("Failed to receive from TCP socket: %s\n",strerror(errno)));
 			return -1;
 		}
 		else if (received == 0)
 		{
-			printf("Modem closed TCP session\n");
+			LOG_INFO(("Modem closed TCP session\n"));
 			return -1;
 		}
 		else
 		{
 			/* Handle the message */
-			int r = handle_message(s,msg,received,modem_heartbeat_interval);
+			int r = handle_message(sess,msg,received);
+			record_handled(sess);
 			if (r != 1)
 				return r;
 		}
@@ -1006,65 +1787,127 @@ static int in_session(int s, uint8_t** msg, uint32_t modem_heartbeat_interval, u
 	}
 }
 
-int session(const struct sockaddr* modem_address, socklen_t modem_address_length, uint32_t router_heartbeat_interval)
+void session_params_init(struct session_params* params)
+{
+	params->router_heartbeat_interval = DEFAULT_HEARTBEAT_INTERVAL * 1000;
+	params->sync_settle = 50;
+	params->coalesce = 0;
+	params->link_chars = NULL;
+	params->stop = NULL;
+}
+
+int session(const struct sockaddr* modem_address, socklen_t modem_address_length, const struct session_params* params, struct destination_table* destinations)
 {
 	int ret = -1;
 	char str_address[FORMATADDRESS_LEN] = {0};
+	struct dlep_session sess = {0};
+	struct timespec now_time;
+
+	session_register_extensions();
+
+	sess.params = params;
+	sess.destinations = destinations;
+	sess.modem_heartbeat_interval = 60000;
+	sess.extensions = EXTENSION_CORE;
+
+	/* Allocate the receive and batch buffers */
+	sess.rx_buffer = malloc(RX_BUFFER_SIZE);
+	sess.tx_batch = malloc(TX_BATCH_SIZE);
+	sess.tx_queued = malloc(TX_BATCH_MESSAGES * sizeof(struct timespec));
+	if (!sess.rx_buffer || !sess.tx_batch || !sess.tx_queued)
+	{
+		LOG_ERROR(("Failed to allocate session buffers\n"));
+		free(sess.rx_buffer);
+		free(sess.tx_batch);
+		free(sess.tx_queued);
+		return -1;
+	}
 
 	/* First we must initialise, RFC 8175 section 7.2 */
-	int s = socket(modem_address->sa_family,SOCK_STREAM,0);
-	if (s == -1)
+	sess.s = socket(modem_address->sa_family,SOCK_STREAM,0);
+	if (sess.s == -1)
 	{
-		printf("Failed to create socket: %s\n",strerror(errno));
+		LOG_ERROR(("Failed to create socket: %s\n",strerror(errno)));
+		free(sess.rx_buffer);
+		free(sess.tx_batch);
+		free(sess.tx_queued);
 		return -1;
 	}
 
-	printf("Connecting to modem at %s\n",formatAddress(modem_address,str_address,sizeof(str_address)));
+	formatAddress(modem_address,str_address,sizeof(str_address));
+	LOG_INFO(("Connecting to modem at %s\n",str_address));
+	STATS_INC(stats.sessions);
+
+	/* Every session is captured on the same interface, however often we
+	 * reconnect, with each packet commented with the session it belongs to */
+	sess.capture_if = capture_interface("session","DLEP sessions with the modem");
+	sprintf(sess.capture_comment,"session %u modem %s",++s_session_count,str_address);
 
 	/* Connect to the modem */
-	if (connect(s,modem_address,modem_address_length) == -1)
+	DLEP_PROBE2(session__state,"connecting",DLEP_SC_SUCCESS);
+	if (connect(sess.s,modem_address,modem_address_length) == -1)
 	{
-		printf("Failed to connect socket: %s\n",strerror(errno));
+		LOG_ERROR(("Failed to connect socket: %s\n",strerror(errno)));
 	}
-	else if (send_session_init_message(s,router_heartbeat_interval))
+	else if (send_session_init_message(&sess))
 	{
 		uint8_t* msg = NULL;
 		ssize_t received;
 
-		printf("Waiting for Session Initialization Response message\n");
+		LOG_DEBUG(("Waiting for Session Initialization Response message\n"));
+		DLEP_PROBE2(session__state,"initializing",DLEP_SC_SUCCESS);
 
 		/* Receive a Session Initialization Response message */
-		received = recv_message(s,&msg);
+		received = recv_message(&sess,&msg);
 		if (received == -1)
-			printf("Failed to receive from TCP socket: %s\n",strerror(errno));
+			LOG_ERROR(("Failed to receive from TCP socket: %s\n",strerror(errno)));
 		else if (received == 0)
-			printf("Modem disconnected TCP session\n");
+			LOG_INFO(("Modem disconnected TCP session\n"));
 		else
 		{
-			printf("Received possible Session Initialization Response message (%u bytes)\n",(unsigned int)received);
+			LOG_DEBUG(("Received possible Session Initialization Response message (%u bytes)\n",(unsigned int)received));
 
 			/* Check it's a valid Session Initialization Response message */
-			if (check_session_init_resp_message(msg,received) == DLEP_SC_SUCCESS)
+			if (check_session_init_resp_message(msg,received) != DLEP_SC_SUCCESS)
+			{
+				STATS_INC(stats.rejected_messages[DLEP_SESSION_INIT_RESP]);
+			}
+			else
 			{
-				uint32_t modem_heartbeat_interval = 60000;
 				enum dlep_status_code init_sc = DLEP_SC_SUCCESS;
 
-				enum dlep_status_code sc = parse_session_init_resp_message(msg+4,received-4,&modem_heartbeat_interval,&init_sc);
+				enum dlep_status_code sc = parse_session_init_resp_message(&sess,msg+4,received-4,&init_sc);
 				if (sc != DLEP_SC_SUCCESS)
 				{
-					send_session_term(s,sc,&msg,modem_heartbeat_interval);
+					send_session_term(&sess,sc,&msg);
 				}
 				else if (init_sc != DLEP_SC_SUCCESS)
 				{
-					printf("Non-zero Status data item in Session Initialization Response message: %u, Terminating\n",init_sc);
+					LOG_ERROR(("Non-zero Status data item in Session Initialization Response message: %u, Terminating\n",init_sc));
 
-					ret = send_session_term(s,DLEP_SC_SHUTDOWN,&msg,modem_heartbeat_interval);
+					ret = send_session_term(&sess,DLEP_SC_SHUTDOWN,&msg);
 				}
 				else
 				{
-					printf("Moving to 'in-session' state\n");
+					LOG_INFO(("Moving to 'in-session' state\n"));
+
+					STATS_SET(stats.session_up,1);
+					DLEP_PROBE2(session__state,"in_session",DLEP_SC_SUCCESS);
+					if (params->link_chars)
+						linkchar_begin(params->link_chars,sess.link_id_len);
+
+					sess.watchdog = watchdog_start(sess.s,params->router_heartbeat_interval,sess.modem_heartbeat_interval,params->coalesce);
+					if (sess.watchdog)
+						ret = in_session(&sess,&msg);
+
+					watchdog_stop(sess.watchdog);
+					sess.watchdog = NULL;
+					rt_session_end();
 
-					ret = in_session(s,&msg,modem_heartbeat_interval,router_heartbeat_interval);
+					if (params->link_chars)
+						linkchar_end(params->link_chars);
+
+					STATS_SET(stats.session_up,0);
 				}
 			}
 		}
@@ -1072,7 +1915,123 @@ int session(const struct sockaddr* modem_address, socklen_t modem_address_length
 		free(msg);
 	}
 
-	close(s);
+	close(sess.s);
+	DLEP_PROBE2(session__state,"closed",DLEP_SC_SUCCESS);
+
+	free(sess.rx_buffer);
+	free(sess.tx_batch);
+	free(sess.tx_queued);
+
+	/* Keep the destinations for a grace period in case the modem comes back,
+	 * otherwise all knowledge of destinations is lost with the session */
+	clock_gettime(CLOCK_MONOTONIC,&now_time);
+	if (!destination_table_retain(destinations,&now_time))
+		destination_clear(destinations);
+
+	pause_reset();
+	credit_reset();
+
+	return ret;
+}
+
+struct dlep_session* session_attach(int s, const struct session_params* params, struct destination_table* destinations)
+{
+	struct dlep_session* sess = calloc(1,sizeof(struct dlep_session));
+	if (!sess)
+	{
+		LOG_ERROR(("Failed to allocate session\n"));
+		return NULL;
+	}
+
+	sess->s = s;
+	sess->capture_if = -1;
+	sess->params = params;
+	sess->destinations = destinations;
+	sess->modem_heartbeat_interval = 60000;
+	sess->extensions = EXTENSION_CORE;
+	sess->offline = 1;
+
+	session_register_extensions();
+
+	sess->rx_buffer = malloc(RX_BUFFER_SIZE);
+	sess->tx_batch = malloc(TX_BATCH_SIZE);
+	sess->tx_queued = malloc(TX_BATCH_MESSAGES * sizeof(struct timespec));
+	if (!sess->rx_buffer || !sess->tx_batch || !sess->tx_queued)
+	{
+		LOG_ERROR(("Failed to allocate session buffers\n"));
+		session_detach(sess);
+		return NULL;
+	}
+
+	return sess;
+}
+
+int session_receive(struct dlep_session* sess)
+{
+	struct timespec now_time;
+	uint8_t* msg = NULL;
+	int ret = 1;
+
+	while (ret == 1)
+	{
+		ssize_t received = recv_message(sess,&msg);
+		if (received == -1)
+		{
+			/* Everything available has been handled */
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				LOG_ERROR(("Failed to receive from socket: %s\n",strerror(errno)));
+				ret = -1;
+			}
+			break;
+		}
+		else if (received == 0)
+		{
+			ret = 0;
+		}
+		else if (!sess->established)
+		{
+			/* The first message must be the Session Initialization Response */
+			enum dlep_status_code init_sc = DLEP_SC_SUCCESS;
+
+			if (check_session_init_resp_message(msg,received) != DLEP_SC_SUCCESS ||
+					parse_session_init_resp_message(sess,msg+4,received-4,&init_sc) != DLEP_SC_SUCCESS ||
+					init_sc != DLEP_SC_SUCCESS)
+			{
+				ret = 0;
+			}
+			else
+			{
+				sess->established = 1;
+			}
+		}
+		else
+		{
+			ret = handle_message(sess,&msg,received);
+			record_handled(sess);
+		}
+	}
+
+	free(msg);
+
+	/* Publish changes as in_session() would */
+	clock_gettime(CLOCK_MONOTONIC,&now_time);
+	destination_table_flush(sess->destinations,&now_time);
+	destination_table_tick(sess->destinations,&now_time);
+
+	if (!flush_batch(sess))
+		ret = -1;
 
 	return ret;
 }
+
+void session_detach(struct dlep_session* sess)
+{
+	if (sess)
+	{
+		free(sess->rx_buffer);
+		free(sess->tx_batch);
+		free(sess->tx_queued);
+		free(sess);
+	}
+}
@@ -0,0 +1,49 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#ifndef DLEP_SESSION_H_
+#define DLEP_SESSION_H_
+
+#include "./util.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+
+struct destination_table;
+struct linkchar_table;
+struct dlep_session;
+
+struct session_params
+{
+	uint32_t router_heartbeat_interval; /* milliseconds */
+	unsigned int sync_settle;           /* Quiet time in milliseconds that ends the initial burst, 0 disables bulk sync */
+	unsigned int coalesce;              /* Round timers up to a multiple of this many milliseconds, 0 disables */
+	struct linkchar_table* link_chars;  /* Link Characteristics Requests to send, NULL if none are made */
+	const volatile sig_atomic_t* stop;  /* Set when the session must be terminated, NULL if it never is */
+};
+
+/* Fill in the default parameters */
+void session_params_init(struct session_params* params);
+
+/* Register the core protocol and the extensions we support, which the message
+ * validators rely on. Done by session() and session_attach() */
+void session_register_extensions(void);
+
+/* Run a single session with the modem, RFC 8175 section 7.2 onwards */
+int session(const struct sockaddr* modem_address, socklen_t modem_address_length, const struct session_params* params, struct destination_table* destinations);
+
+/* Attach an offline session to the non-blocking socket s, which delivers the messages
+ * of a session captured after the Session Initialization message, for dlep_replay */
+struct dlep_session* session_attach(int s, const struct session_params* params, struct destination_table* destinations);
+
+/* Handle every message readable from an offline session without blocking, returns
+ * 1 if the session is still up, 0 if it has ended and -1 on error */
+int session_receive(struct dlep_session* sess);
+
+/* Free an offline session, the socket is left open */
+void session_detach(struct dlep_session* sess);
+
+#endif /* DLEP_SESSION_H_ */
@@ -0,0 +1,445 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./stats.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "./dlep_iana.h"
+#include "./log.h"
+
+/* How long a client has to send an HTTP request before it gets plain text */
+#define REQUEST_TIMEOUT 100
+
+/* How long a client has to read the response */
+#define SEND_TIMEOUT 1
+
+/* Histograms are reported with a bucket just below every power of 2
+ * nanoseconds from 2^10 (~1us) to 2^36 (~69s), these are all boundaries of
+ * the recorded buckets */
+#define HISTOGRAM_LE_FIRST 10
+#define HISTOGRAM_LE_LAST  36
+
+struct stats_counters stats;
+
+static struct
+{
+	char* path;
+	int s;
+	pthread_t thread;
+} s_stats = { NULL, -1 };
+
+/* Label values, indexed by the IANA numbers */
+static const char* const s_message_names[STATS_MESSAGE_TYPES] =
+{
+	"other",
+	"session_init",
+	"session_init_resp",
+	"session_update",
+	"session_update_resp",
+	"session_term",
+	"session_term_resp",
+	"destination_up",
+	"destination_up_resp",
+	"destination_announce",
+	"destination_announce_resp",
+	"destination_down",
+	"destination_down_resp",
+	"destination_update",
+	"link_char_req",
+	"link_char_resp",
+	"heartbeat"
+};
+
+static const char* const s_item_names[STATS_DATA_ITEMS] =
+{
+	"other",
+	"status",
+	"ipv4_connection_point",
+	"ipv6_connection_point",
+	"peer_type",
+	"heartbeat_interval",
+	"extensions_supported",
+	"mac_address",
+	"ipv4_address",
+	"ipv6_address",
+	"ipv4_attached_subnet",
+	"ipv6_attached_subnet",
+	"mdrr",
+	"mdrt",
+	"cdrr",
+	"cdrt",
+	"latency",
+	"resources",
+	"rlqr",
+	"rlqt",
+	"mtu",
+	"hop_count",
+	"hop_control",
+	"queue_parameters",
+	"pause",
+	"restart",
+	"link_identifier_length",
+	"link_identifier",
+	"latency_range"
+};
+
+static const char* status_name(unsigned int sc)
+{
+	switch (sc)
+	{
+	case DLEP_SC_SUCCESS:
+		return "success";
+	case DLEP_SC_NOT_INTERESTED:
+		return "not_interested";
+	case DLEP_SC_REQUEST_DENIED:
+		return "request_denied";
+	case DLEP_SC_INCONSISTENT:
+		return "inconsistent";
+	case DLEP_SC_UNKNOWN_MESSAGE:
+		return "unknown_message";
+	case DLEP_SC_UNEXPECTED_MESSAGE:
+		return "unexpected_message";
+	case DLEP_SC_INVALID_DATA:
+		return "invalid_data";
+	case DLEP_SC_INVALID_DEST:
+		return "invalid_destination";
+	case DLEP_SC_TIMEDOUT:
+		return "timed_out";
+	case DLEP_SC_SHUTDOWN:
+		return "shutdown";
+	default:
+		return NULL;
+	}
+}
+
+static uint64_t load(const uint64_t* counter)
+{
+	return __atomic_load_n(counter,__ATOMIC_RELAXED);
+}
+
+static unsigned int bucket_index(uint64_t ns)
+{
+	unsigned int msb;
+
+	if (ns < STATS_HISTOGRAM_SUB_BUCKETS)
+		return (unsigned int)ns;
+
+	/* The most significant bit picks the power of 2, the bits after it the linear sub-bucket */
+	msb = 63 - __builtin_clzll(ns);
+	return (msb - STATS_HISTOGRAM_SUB_BITS + 1) * STATS_HISTOGRAM_SUB_BUCKETS + (unsigned int)(ns >> (msb - STATS_HISTOGRAM_SUB_BITS)) - STATS_HISTOGRAM_SUB_BUCKETS;
+}
+
+static uint64_t bucket_highest(unsigned int i)
+{
+	/* The highest value recorded in bucket i */
+	unsigned int shift;
+
+	if (i < STATS_HISTOGRAM_SUB_BUCKETS)
+		return i;
+	if (i == STATS_HISTOGRAM_BUCKETS - 1)
+		return (uint64_t)-1;
+
+	shift = i / STATS_HISTOGRAM_SUB_BUCKETS - 1;
+	return (((uint64_t)(i % STATS_HISTOGRAM_SUB_BUCKETS) + STATS_HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void stats_record(struct stats_histogram* h, uint64_t ns)
+{
+	STATS_INC(h->buckets[bucket_index(ns)]);
+	STATS_ADD(h->sum,ns);
+}
+
+static void write_family(FILE* f, const char* name, const char* type, const char* help)
+{
+	fprintf(f,"# TYPE %s %s\n# HELP %s %s\n",name,type,name,help);
+}
+
+static void write_counter(FILE* f, const char* name, const char* help, const uint64_t* counter)
+{
+	write_family(f,name,"counter",help);
+	fprintf(f,"%s_total %lu\n",name,(unsigned long)load(counter));
+}
+
+static void write_labelled(FILE* f, const char* name, const char* help, const char* label, const char* const* values, const uint64_t* counters, size_t count)
+{
+	size_t i;
+
+	write_family(f,name,"counter",help);
+
+	/* Every known value is always present, so rates work from the first scrape */
+	for (i = 1; i < count; ++i)
+		fprintf(f,"%s_total{%s=\"%s\"} %lu\n",name,label,values[i],(unsigned long)load(&counters[i]));
+	fprintf(f,"%s_total{%s=\"%s\"} %lu\n",name,label,values[0],(unsigned long)load(&counters[0]));
+}
+
+static void write_status_codes(FILE* f)
+{
+	unsigned int sc;
+
+	write_family(f,"dlep_status_codes_sent","counter","Status codes sent to the modem.");
+
+	for (sc = 0; sc < STATS_STATUS_CODES; ++sc)
+	{
+		uint64_t v = load(&stats.tx_status[sc]);
+		const char* name = status_name(sc);
+
+		/* Codes outside the registry only appear once they have been sent */
+		if (name)
+			fprintf(f,"dlep_status_codes_sent_total{code=\"%s\"} %lu\n",name,(unsigned long)v);
+		else if (v)
+			fprintf(f,"dlep_status_codes_sent_total{code=\"%u\"} %lu\n",sc,(unsigned long)v);
+	}
+}
+
+static void write_quantile(FILE* f, const char* name, const uint64_t* counts, uint64_t total, unsigned int per_mille)
+{
+	uint64_t rank = (total * per_mille + 999) / 1000;
+	uint64_t cumulative = 0;
+	unsigned int i;
+
+	if (!total)
+	{
+		fprintf(f,"%s_quantile_seconds{quantile=\"%g\"} NaN\n",name,per_mille / 1000.0);
+		return;
+	}
+
+	for (i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; ++i)
+	{
+		cumulative += counts[i];
+		if (cumulative >= rank)
+			break;
+	}
+
+	fprintf(f,"%s_quantile_seconds{quantile=\"%g\"} %.9f\n",name,per_mille / 1000.0,bucket_highest(i) / 1e9);
+}
+
+static void write_histogram(FILE* f, const char* name, const char* help, const struct stats_histogram* h)
+{
+	char family[128];
+	uint64_t counts[STATS_HISTOGRAM_BUCKETS];
+	uint64_t total = 0;
+	uint64_t cumulative = 0;
+	unsigned int i;
+	unsigned int le;
+
+	/* Work from one copy so the buckets, count and quantiles agree */
+	for (i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i)
+	{
+		counts[i] = load(&h->buckets[i]);
+		total += counts[i];
+	}
+
+	sprintf(family,"%s_seconds",name);
+	write_family(f,family,"histogram",help);
+
+	/* le is inclusive, but a value of exactly 2^le is recorded in the bucket
+	 * above it, so each bound is the highest value of the bucket below */
+	i = 0;
+	for (le = HISTOGRAM_LE_FIRST; le <= HISTOGRAM_LE_LAST; ++le)
+	{
+		unsigned int end = bucket_index((uint64_t)1 << le);
+		for (; i < end; ++i)
+			cumulative += counts[i];
+
+		fprintf(f,"%s_bucket{le=\"%.12g\"} %lu\n",family,bucket_highest(end - 1) / 1e9,(unsigned long)cumulative);
+	}
+	fprintf(f,"%s_bucket{le=\"+Inf\"} %lu\n",family,(unsigned long)total);
+	fprintf(f,"%s_count %lu\n",family,(unsigned long)total);
+	fprintf(f,"%s_sum %.9f\n",family,load(&h->sum) / 1e9);
+
+	/* The common quantiles, to within the 1/16 precision of the buckets */
+	sprintf(family,"%s_quantile_seconds",name);
+	write_family(f,family,"gauge","Quantiles of the histogram above, as the highest value of the bucket they fall in.");
+	write_quantile(f,name,counts,total,500);
+	write_quantile(f,name,counts,total,990);
+	write_quantile(f,name,counts,total,999);
+}
+
+static void write_metrics(FILE* f)
+{
+	write_labelled(f,"dlep_messages_received","Messages received from the modem, by type.","type",s_message_names,stats.rx_messages,STATS_MESSAGE_TYPES);
+	write_labelled(f,"dlep_messages_sent","Messages sent to the modem, by type.","type",s_message_names,stats.tx_messages,STATS_MESSAGE_TYPES);
+	write_labelled(f,"dlep_messages_rejected","Messages received that were invalid or unexpected, by type.","type",s_message_names,stats.rejected_messages,STATS_MESSAGE_TYPES);
+	write_labelled(f,"dlep_invalid_data_items","Data items that failed validation, by item.","item",s_item_names,stats.invalid_items,STATS_DATA_ITEMS);
+	write_status_codes(f);
+
+	write_counter(f,"dlep_received_bytes","Message bytes received from the modem.",&stats.rx_bytes);
+	write_counter(f,"dlep_sent_bytes","Message bytes sent to the modem.",&stats.tx_bytes);
+	write_counter(f,"dlep_sessions","Sessions started with the modem.",&stats.sessions);
+	write_counter(f,"dlep_reconnects","Sessions restarted after a session ended.",&stats.reconnects);
+	write_counter(f,"dlep_discovery_attempts","Peer Discovery signals sent.",&stats.discovery_attempts);
+	write_counter(f,"dlep_peer_offers","Peer Offer signals received.",&stats.peer_offers);
+	write_counter(f,"dlep_heartbeat_misses","Modem heartbeat intervals that passed without a message.",&stats.heartbeat_misses);
+	write_counter(f,"dlep_heartbeats_suppressed","Heartbeats not sent as other messages kept the session alive.",&stats.heartbeats_suppressed);
+
+	write_counter(f,"dlep_credit_granted_bytes","Octets of credit granted by the modem.",&stats.credit_granted);
+	write_counter(f,"dlep_credit_requests","Credit Control messages sent for starved credit windows.",&stats.credit_requests);
+	write_counter(f,"dlep_rt_page_faults","Page faults taken by the protocol thread once a session settled, in real-time mode.",&stats.rt_page_faults);
+	write_counter(f,"dlep_rt_allocations","Allocations made once a session settled, in real-time mode.",&stats.rt_allocations);
+	write_counter(f,"dlep_session_wakeups","Times the session thread woke from waiting.",&stats.session_wakeups);
+	write_counter(f,"dlep_watchdog_wakeups","Times the watchdog thread woke from waiting.",&stats.watchdog_wakeups);
+
+	write_family(f,"dlep_session_up","gauge","1 while in session with the modem.");
+	fprintf(f,"dlep_session_up %lu\n",(unsigned long)load(&stats.session_up));
+
+	write_family(f,"dlep_wakeups_per_minute","gauge","Wakeups of the session and watchdog threads over the last minute in session.");
+	fprintf(f,"dlep_wakeups_per_minute %lu\n",(unsigned long)load(&stats.wakeups_per_minute));
+
+	write_histogram(f,"dlep_receive_to_handled","Time from a message being received to it being handled.",&stats.receive_to_handled);
+	write_histogram(f,"dlep_handled_to_sent","Time from a response being queued to it being sent.",&stats.handled_to_sent);
+	write_histogram(f,"dlep_modem_heartbeat_interval","Time between Heartbeat messages received from the modem.",&stats.modem_heartbeat_interval);
+	write_histogram(f,"dlep_heartbeat_lateness","Time our Heartbeat messages are sent after the heartbeat interval is due.",&stats.heartbeat_lateness);
+
+	fprintf(f,"# EOF\n");
+}
+
+static void send_all(int s, const char* data, size_t len)
+{
+	while (len)
+	{
+		ssize_t sent = send(s,data,len,MSG_NOSIGNAL);
+		if (sent <= 0)
+		{
+			if (sent == -1 && errno == EINTR)
+				continue;
+			return;
+		}
+		data += sent;
+		len -= sent;
+	}
+}
+
+static void serve(int s)
+{
+	char request[512];
+	ssize_t received = 0;
+	struct pollfd pfd;
+	struct timeval timeout = {0};
+	char* text = NULL;
+	size_t text_len = 0;
+	FILE* f;
+
+	/* Answer 'curl --unix-socket' with HTTP, and anything that just connects
+	 * and reads (e.g. socat) with the bare text */
+	pfd.fd = s;
+	pfd.events = POLLIN;
+	if (poll(&pfd,1,REQUEST_TIMEOUT) == 1)
+		received = recv(s,request,sizeof(request),0);
+
+	timeout.tv_sec = SEND_TIMEOUT;
+	setsockopt(s,SOL_SOCKET,SO_SNDTIMEO,&timeout,sizeof(timeout));
+
+	f = open_memstream(&text,&text_len);
+	if (!f)
+	{
+		LOG_ERROR(("Failed to allocate statistics text: %s\n",strerror(errno)));
+		return;
+	}
+	write_metrics(f);
+	fclose(f);
+
+	if (received >= 4 && memcmp(request,"GET ",4) == 0)
+	{
+		char header[256];
+		int header_len = snprintf(header,sizeof(header),
+				"HTTP/1.0 200 OK\r\n"
+				"Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+				"Content-Length: %lu\r\n\r\n",(unsigned long)text_len);
+		send_all(s,header,header_len);
+	}
+
+	send_all(s,text,text_len);
+	free(text);
+}
+
+static void* stats_thread(void* arg)
+{
+	for (;;)
+	{
+		int s = accept(s_stats.s,NULL,NULL);
+		if (s == -1)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			LOG_ERROR(("Failed to accept statistics connection: %s\n",strerror(errno)));
+			return NULL;
+		}
+
+		serve(s);
+		close(s);
+	}
+}
+
+static void stats_stop(void)
+{
+	if (s_stats.path)
+	{
+		unlink(s_stats.path);
+		free(s_stats.path);
+		s_stats.path = NULL;
+	}
+}
+
+int stats_start(const char* path)
+{
+	struct sockaddr_un address = {0};
+	int err;
+
+	if (strlen(path) >= sizeof(address.sun_path))
+	{
+		LOG_ERROR(("Statistics socket path %s is too long\n",path));
+		return -1;
+	}
+
+	s_stats.path = malloc(strlen(path) + 1);
+	if (!s_stats.path)
+	{
+		LOG_ERROR(("Failed to allocate statistics socket path\n"));
+		return -1;
+	}
+	strcpy(s_stats.path,path);
+
+	s_stats.s = socket(AF_UNIX,SOCK_STREAM,0);
+	if (s_stats.s == -1)
+	{
+		LOG_ERROR(("Failed to create statistics socket: %s\n",strerror(errno)));
+		return -1;
+	}
+
+	/* Replace the socket of a previous run */
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path,path);
+	unlink(path);
+
+	if (bind(s_stats.s,(struct sockaddr*)&address,sizeof(address)) != 0 || listen(s_stats.s,8) != 0)
+	{
+		LOG_ERROR(("Failed to listen on statistics socket %s: %s\n",path,strerror(errno)));
+		close(s_stats.s);
+		return -1;
+	}
+
+	atexit(&stats_stop);
+
+	err = pthread_create(&s_stats.thread,NULL,&stats_thread,NULL);
+	if (err)
+	{
+		LOG_ERROR(("Failed to start statistics thread: %s\n",strerror(err)));
+		return -1;
+	}
+	pthread_detach(s_stats.thread);
+
+	return 0;
+}
@@ -0,0 +1,83 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * Counters and latency histograms of the router's protocol activity, updated
+ * with relaxed atomics so they cost next to nothing, and served as OpenMetrics
+ * text on a Unix socket by a background thread
+ */
+
+#ifndef DLEP_STATS_H_
+#define DLEP_STATS_H_
+
+#include "./util.h"
+
+/* Sizes of the counter arrays, index 0 counts the unrecognised values */
+#define STATS_MESSAGE_TYPES 17
+#define STATS_DATA_ITEMS    29
+#define STATS_STATUS_CODES  256
+
+#define STATS_MESSAGE_INDEX(t) ((unsigned int)(t) < STATS_MESSAGE_TYPES ? (unsigned int)(t) : 0)
+#define STATS_ITEM_INDEX(t)    ((unsigned int)(t) < STATS_DATA_ITEMS ? (unsigned int)(t) : 0)
+
+/* HDR-style histograms of nanoseconds: values below STATS_HISTOGRAM_SUB_BUCKETS
+ * have a bucket each, above that every power of 2 is split into
+ * STATS_HISTOGRAM_SUB_BUCKETS linear buckets, so any value is recorded to
+ * within 1/16 of itself over the whole range of uint64_t */
+#define STATS_HISTOGRAM_SUB_BITS    4
+#define STATS_HISTOGRAM_SUB_BUCKETS (1 << STATS_HISTOGRAM_SUB_BITS)
+#define STATS_HISTOGRAM_BUCKETS     ((64 - STATS_HISTOGRAM_SUB_BITS + 1) * STATS_HISTOGRAM_SUB_BUCKETS)
+
+struct stats_histogram
+{
+	uint64_t buckets[STATS_HISTOGRAM_BUCKETS];
+	uint64_t sum;                                    /* Of every value recorded, in ns */
+};
+
+struct stats_counters
+{
+	uint64_t rx_messages[STATS_MESSAGE_TYPES];
+	uint64_t tx_messages[STATS_MESSAGE_TYPES];
+	uint64_t rejected_messages[STATS_MESSAGE_TYPES]; /* Failed validation, or not expected */
+	uint64_t invalid_items[STATS_DATA_ITEMS];        /* The data item that failed validation */
+	uint64_t tx_status[STATS_STATUS_CODES];          /* Status codes sent */
+	uint64_t rx_bytes;
+	uint64_t tx_bytes;
+	uint64_t sessions;
+	uint64_t reconnects;
+	uint64_t discovery_attempts;
+	uint64_t peer_offers;
+	uint64_t heartbeat_misses;                       /* Modem heartbeat intervals with nothing received */
+	uint64_t heartbeats_suppressed;                  /* Heartbeats not sent as other messages were sent in time */
+	uint64_t session_up;                             /* A gauge, 1 while in session */
+	uint64_t credit_granted;                         /* Octets of credit granted by the modem */
+	uint64_t credit_requests;                        /* Credit Control messages sent for starved windows */
+	uint64_t rt_page_faults;                         /* Taken by the protocol thread once a session settled, in real-time mode */
+	uint64_t rt_allocations;                         /* Made once a session settled, in real-time mode */
+	uint64_t session_wakeups;                        /* Times the session thread woke from waiting */
+	uint64_t watchdog_wakeups;                       /* Times the watchdog thread woke from waiting */
+	uint64_t wakeups_per_minute;                     /* A gauge, of both threads over the last minute in session */
+
+	struct stats_histogram receive_to_handled;       /* From recv() returning a message to it being handled */
+	struct stats_histogram handled_to_sent;          /* From a response being queued to its batch being sent */
+	struct stats_histogram modem_heartbeat_interval; /* Between Heartbeats received from the modem */
+	struct stats_histogram heartbeat_lateness;       /* How long after router_heartbeat_interval our Heartbeats go */
+};
+
+extern struct stats_counters stats;
+
+/* The protocol loop only ever does relaxed atomic adds, readers take what they find */
+#define STATS_ADD(counter,n) __atomic_fetch_add(&(counter),(n),__ATOMIC_RELAXED)
+#define STATS_INC(counter)   STATS_ADD(counter,1)
+#define STATS_SET(gauge,v)   __atomic_store_n(&(gauge),(v),__ATOMIC_RELAXED)
+
+/* Add a value in nanoseconds to a histogram */
+void stats_record(struct stats_histogram* h, uint64_t ns);
+
+/* Serve the counters on Unix socket path, the path is removed at exit */
+int stats_start(const char* path);
+
+#endif /* DLEP_STATS_H_ */
@@ -104,10 +104,50 @@ int interval_compare(const struct timespec* start, const struct timespec* end, u
 		diff_time.tv_nsec += 1000000000;
 	}
 
-	if (diff_time.tv_sec < interval)
+	/* interval is in milliseconds */
+	if (diff_time.tv_sec < interval / 1000 || (diff_time.tv_sec == interval / 1000 && diff_time.tv_nsec < (long)(interval % 1000) * 1000000))
 		return -1;
-	if (diff_time.tv_sec > interval || diff_time.tv_nsec > 0)
+	if (diff_time.tv_sec > interval / 1000 || diff_time.tv_nsec > (long)(interval % 1000) * 1000000)
 		return 1;
 
 	return 0;
 }
+
+unsigned long interval_align(const struct timespec* now, unsigned long ms, unsigned int grid)
+{
+	uint64_t now_ms = (uint64_t)now->tv_sec * 1000 + now->tv_nsec / 1000000;
+	uint64_t end = (now_ms + ms + grid - 1) / grid * grid;
+	return (unsigned long)(end - now_ms);
+}
+
+unsigned long interval_ms(const struct timespec* start, const struct timespec* end)
+{
+	long secs = end->tv_sec - start->tv_sec;
+	long nsecs = end->tv_nsec - start->tv_nsec;
+	if (nsecs < 0)
+	{
+		--secs;
+		nsecs += 1000000000;
+	}
+
+	if (secs < 0)
+		return 0;
+
+	return (unsigned long)secs * 1000 + nsecs / 1000000;
+}
+
+uint64_t interval_ns(const struct timespec* start, const struct timespec* end)
+{
+	long secs = end->tv_sec - start->tv_sec;
+	long nsecs = end->tv_nsec - start->tv_nsec;
+	if (nsecs < 0)
+	{
+		--secs;
+		nsecs += 1000000000;
+	}
+
+	if (secs < 0)
+		return 0;
+
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
@@ -29,6 +29,18 @@ uint64_t read_uint64(const uint8_t* p);
 #define FORMATADDRESS_LEN INET6_ADDRSTRLEN+6
 const char* formatAddress(const struct sockaddr* addr, char* str, size_t str_len);
 
+/* Compares the time from start to end with interval milliseconds, returns
+ * -1, 0 or 1 as it is shorter, equal or longer */
 int interval_compare(const struct timespec* start, const struct timespec* end, unsigned int interval);
 
+/* Lengthen a wait of ms milliseconds from now so it ends on a multiple of
+ * grid milliseconds of the clock, so timers on the same grid fire together */
+unsigned long interval_align(const struct timespec* now, unsigned long ms, unsigned int grid);
+
+/* The number of milliseconds from start to end, 0 if end is before start */
+unsigned long interval_ms(const struct timespec* start, const struct timespec* end);
+
+/* The number of nanoseconds from start to end, 0 if end is before start */
+uint64_t interval_ns(const struct timespec* start, const struct timespec* end);
+
 #endif /* DLEP_UTIL_H_ */
@@ -0,0 +1,322 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+#include "./watchdog.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "./dlep_iana.h"
+#include "./encode.h"
+#include "./log.h"
+#include "./stats.h"
+#include "./probes.h"
+#include "./rt.h"
+
+/* How soon to try again when a Heartbeat could not be sent, in milliseconds */
+#define WATCHDOG_RETRY 1
+
+struct watchdog
+{
+	int s;
+	uint64_t heartbeat_interval;       /* Nanoseconds */
+	uint64_t modem_heartbeat_interval; /* Nanoseconds */
+	uint64_t coalesce;                 /* Nanoseconds, deadlines are rounded up to a multiple */
+
+	/* Held by whoever is sending on s */
+	pthread_mutex_t tx_lock;
+	uint8_t heartbeat[ENCODE_MAX_LEN];
+	uint16_t heartbeat_len;
+	uint16_t heartbeat_sent;           /* Octets of a Heartbeat partly sent, 0 if none */
+
+	/* CLOCK_MONOTONIC nanoseconds, updated from the session thread */
+	uint64_t tx_time;
+	uint64_t rx_time;
+
+	/* For the session thread, behind wake_fd */
+	uint32_t sent;
+	int expired;
+	int wake_fd;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stopping;
+	pthread_t thread;
+};
+
+static uint64_t to_ns(const struct timespec* t)
+{
+	return (uint64_t)t->tv_sec * 1000000000 + t->tv_nsec;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return to_ns(&now);
+}
+
+static void wake(struct watchdog* w)
+{
+	uint64_t one = 1;
+	if (write(w->wake_fd,&one,sizeof(one)) == -1 && errno != EAGAIN)
+		LOG_ERROR(("Failed to wake session thread: %s\n",strerror(errno)));
+}
+
+/* With tx_lock held, returns 1 once the whole Heartbeat has gone */
+static int send_heartbeat(struct watchdog* w, int flags)
+{
+	while (w->heartbeat_sent < w->heartbeat_len)
+	{
+		ssize_t sent = send(w->s,w->heartbeat + w->heartbeat_sent,w->heartbeat_len - w->heartbeat_sent,flags | MSG_NOSIGNAL);
+		if (sent <= 0)
+		{
+			if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+				LOG_ERROR(("Failed to send Heartbeat message: %s\n",strerror(errno)));
+			return 0;
+		}
+		w->heartbeat_sent += sent;
+	}
+
+	w->heartbeat_sent = 0;
+	__atomic_store_n(&w->tx_time,now_ns(),__ATOMIC_RELEASE);
+
+	STATS_INC(stats.tx_messages[STATS_MESSAGE_INDEX(DLEP_PEER_HEARTBEAT)]);
+	STATS_ADD(stats.tx_bytes,w->heartbeat_len);
+
+	/* Recorded by the session thread on its next wakeup, it is not woken for it */
+	__atomic_fetch_add(&w->sent,1,__ATOMIC_RELEASE);
+	return 1;
+}
+
+/* Returns 1 if the modem has sent something we have not read yet */
+static int rx_waiting(const struct watchdog* w)
+{
+	struct pollfd p;
+	p.fd = w->s;
+	p.events = POLLIN;
+	p.revents = 0;
+	return poll(&p,1,0) == 1 && (p.revents & POLLIN);
+}
+
+static void* watchdog_thread(void* param)
+{
+	struct watchdog* w = param;
+	uint64_t heartbeat_time = now_ns();
+	int watching = 1;
+
+	pthread_mutex_lock(&w->lock);
+	while (!w->stopping)
+	{
+		/* Read the clock last, so neither time is after now */
+		uint64_t tx_time = __atomic_load_n(&w->tx_time,__ATOMIC_ACQUIRE);
+		uint64_t rx_time = __atomic_load_n(&w->rx_time,__ATOMIC_ACQUIRE);
+		uint64_t now = now_ns();
+		uint64_t next;
+		struct timespec deadline;
+
+		/* Only send a Heartbeat once we have sent nothing else for a whole interval */
+		next = tx_time + w->heartbeat_interval;
+		if (now >= next)
+		{
+			/* Whoever holds the socket is sending something else */
+			int sent = 0;
+			if (pthread_mutex_trylock(&w->tx_lock) == 0)
+			{
+				sent = send_heartbeat(w,MSG_DONTWAIT);
+				pthread_mutex_unlock(&w->tx_lock);
+			}
+
+			if (sent)
+			{
+				stats_record(&stats.heartbeat_lateness,now - next);
+				DLEP_PROBE2(heartbeat__send,(uint32_t)(w->heartbeat_interval / 1000000),now - next);
+
+				heartbeat_time = now;
+				next = now + w->heartbeat_interval;
+			}
+			else
+				next = now + (uint64_t)WATCHDOG_RETRY * 1000000;
+		}
+		else if (now - heartbeat_time >= w->heartbeat_interval)
+		{
+			/* A fixed schedule would have sent these by now, but other messages made them redundant */
+			uint64_t missed = (now - heartbeat_time) / w->heartbeat_interval;
+			STATS_ADD(stats.heartbeats_suppressed,missed);
+			heartbeat_time += missed * w->heartbeat_interval;
+		}
+
+		/* Check the modem heartbeat interval, for 2 missed intervals. The
+		 * misses before that are counted as messages arrive */
+		if (watching)
+		{
+			uint64_t due = rx_time + 2 * w->modem_heartbeat_interval;
+			if (now >= due)
+			{
+				/* The session thread may just be busy */
+				if (rx_waiting(w))
+					due = now + w->modem_heartbeat_interval;
+				else
+				{
+					STATS_ADD(stats.heartbeat_misses,(now - rx_time) / w->modem_heartbeat_interval - 1);
+					__atomic_store_n(&w->expired,1,__ATOMIC_RELEASE);
+					wake(w);
+					watching = 0;
+				}
+			}
+
+			if (watching && due < next)
+				next = due;
+		}
+
+		/* Share the wakeup with any other timer on the same boundary */
+		if (w->coalesce)
+			next = (next + w->coalesce - 1) / w->coalesce * w->coalesce;
+
+		deadline.tv_sec = next / 1000000000;
+		deadline.tv_nsec = next % 1000000000;
+		pthread_cond_timedwait(&w->cond,&w->lock,&deadline);
+		STATS_INC(stats.watchdog_wakeups);
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+struct watchdog* watchdog_start(int s, uint32_t heartbeat_interval, uint32_t modem_heartbeat_interval, unsigned int coalesce)
+{
+	pthread_condattr_t attr;
+	struct sched_param sp = {0};
+	sigset_t signals;
+	sigset_t old_signals;
+	int err;
+
+	struct watchdog* w = calloc(1,sizeof(struct watchdog));
+	if (!w)
+	{
+		LOG_ERROR(("Failed to allocate watchdog\n"));
+		return NULL;
+	}
+
+	w->s = s;
+	w->heartbeat_interval = (uint64_t)heartbeat_interval * 1000000;
+	w->modem_heartbeat_interval = (uint64_t)modem_heartbeat_interval * 1000000;
+	w->coalesce = (uint64_t)coalesce * 1000000;
+	w->heartbeat_len = encode_heartbeat_message(w->heartbeat);
+	w->tx_time = w->rx_time = now_ns();
+
+	w->wake_fd = eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+	if (w->wake_fd == -1)
+	{
+		LOG_ERROR(("Failed to create watchdog event: %s\n",strerror(errno)));
+		free(w);
+		return NULL;
+	}
+
+	/* The deadlines are CLOCK_MONOTONIC */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr,CLOCK_MONOTONIC);
+	pthread_cond_init(&w->cond,&attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&w->lock,NULL);
+	pthread_mutex_init(&w->tx_lock,NULL);
+
+	/* The watchdog takes no signals, SIGINT and SIGTERM must interrupt the session thread */
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK,&signals,&old_signals);
+	err = pthread_create(&w->thread,NULL,&watchdog_thread,w);
+	pthread_sigmask(SIG_SETMASK,&old_signals,NULL);
+	if (err)
+	{
+		LOG_ERROR(("Failed to start watchdog thread: %s\n",strerror(err)));
+		pthread_mutex_destroy(&w->tx_lock);
+		pthread_mutex_destroy(&w->lock);
+		pthread_cond_destroy(&w->cond);
+		close(w->wake_fd);
+		free(w);
+		return NULL;
+	}
+
+	/* Run ahead of the session thread, if we are allowed to outside real-time mode */
+	if (rt_thread(w->thread,1) != 0)
+	{
+		sp.sched_priority = sched_get_priority_min(SCHED_FIFO);
+		err = pthread_setschedparam(w->thread,SCHED_FIFO,&sp);
+		if (err)
+			LOG_DEBUG(("Watchdog thread left at normal priority: %s\n",strerror(err)));
+	}
+
+	return w;
+}
+
+void watchdog_stop(struct watchdog* w)
+{
+	if (!w)
+		return;
+
+	pthread_mutex_lock(&w->lock);
+	w->stopping = 1;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread,NULL);
+
+	pthread_mutex_destroy(&w->tx_lock);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+	close(w->wake_fd);
+	free(w);
+}
+
+void watchdog_tx_begin(struct watchdog* w)
+{
+	pthread_mutex_lock(&w->tx_lock);
+
+	/* Never leave half a Heartbeat in front of a message */
+	if (w->heartbeat_sent)
+		send_heartbeat(w,0);
+}
+
+void watchdog_tx_end(struct watchdog* w, int sent)
+{
+	/* A failed send put nothing on the wire, so the Heartbeat is still due */
+	if (sent)
+		__atomic_store_n(&w->tx_time,now_ns(),__ATOMIC_RELEASE);
+	pthread_mutex_unlock(&w->tx_lock);
+}
+
+void watchdog_received(struct watchdog* w, const struct timespec* now)
+{
+	uint64_t rx_time = to_ns(now);
+	uint64_t last = __atomic_exchange_n(&w->rx_time,rx_time,__ATOMIC_ACQ_REL);
+
+	/* Count the modem heartbeat intervals that passed with nothing received,
+	 * after the one in which something was due */
+	if (rx_time > last && rx_time - last >= 2 * w->modem_heartbeat_interval)
+		STATS_ADD(stats.heartbeat_misses,(rx_time - last) / w->modem_heartbeat_interval - 1);
+}
+
+int watchdog_wake_fd(const struct watchdog* w)
+{
+	return w->wake_fd;
+}
+
+unsigned int watchdog_poll(struct watchdog* w, int* expired)
+{
+	uint64_t count;
+	if (read(w->wake_fd,&count,sizeof(count)) == -1 && errno != EAGAIN)
+		LOG_ERROR(("Failed to clear watchdog event: %s\n",strerror(errno)));
+
+	*expired = __atomic_load_n(&w->expired,__ATOMIC_ACQUIRE);
+	return __atomic_exchange_n(&w->sent,0,__ATOMIC_ACQ_REL);
+}
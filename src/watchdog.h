@@ -0,0 +1,53 @@
+/*
+
+Copyright (c) 2017 Airbus DS Limited
+
+*/
+
+/*
+ * The liveness of a session, RFC 8175 section 7.3, kept on its own thread so
+ * that neither a burst of messages to handle nor a stalled log holds up our
+ * Heartbeats or the modem timeout.
+ *
+ * The watchdog sends a pre-encoded Heartbeat without blocking once nothing
+ * has been sent for the Heartbeat Interval, and expires the session when
+ * nothing has been received from the modem for two of its intervals, unless
+ * the session thread simply has not read what the modem sent yet. Every other
+ * send on the socket must be made between watchdog_tx_begin() and
+ * watchdog_tx_end(), so a Heartbeat never lands in the middle of a message.
+ */
+
+#ifndef DLEP_WATCHDOG_H_
+#define DLEP_WATCHDOG_H_
+
+#include "./util.h"
+
+struct watchdog;
+
+/* Start watching the session on socket s, the intervals are in milliseconds.
+ * Deadlines are rounded up to a multiple of coalesce milliseconds, if it is
+ * not 0. Returns NULL on failure */
+struct watchdog* watchdog_start(int s, uint32_t heartbeat_interval, uint32_t modem_heartbeat_interval, unsigned int coalesce);
+
+/* Stop the thread and free the watchdog, no more Heartbeats are sent */
+void watchdog_stop(struct watchdog* w);
+
+/* Take the socket to send a message, finishing any Heartbeat partly sent */
+void watchdog_tx_begin(struct watchdog* w);
+
+/* Release the socket, a message sent in full counts as a Heartbeat */
+void watchdog_tx_end(struct watchdog* w, int sent);
+
+/* Something was received from the modem at now */
+void watchdog_received(struct watchdog* w, const struct timespec* now);
+
+/* A descriptor that becomes readable when the modem has timed out, cleared by
+ * watchdog_poll() */
+int watchdog_wake_fd(const struct watchdog* w);
+
+/* Returns the number of Heartbeats sent since the last call, and sets
+ * *expired if the modem has timed out. Heartbeats do not make the descriptor
+ * readable, they are picked up by the next call whatever woke the session */
+unsigned int watchdog_poll(struct watchdog* w, int* expired);
+
+#endif /* DLEP_WATCHDOG_H_ */